@@ -0,0 +1,158 @@
+#include "application.h"
+
+#include "linalg.h"
+#include "platform.h"
+#include "broadphase.cpp"
+
+// Windowless app comparing the broad-phase pair finders on moving boxes.
+// One object count and layout per app_update, prints milliseconds per frame, the axis the sweep
+// picked, and quits. The corridor layout spreads the same volume along z.
+
+#define BENCH_FRAMES     30
+#define BENCH_BRUTE_MAX  10000   // The O(n^2) reference gets too slow past this.
+#define BENCH_MAX_PAIRS  (1 << 20)
+
+
+struct bench_state
+{
+  clock            timer;
+  arena            scratch;
+  broadphase_pair *pairs;
+  u32              round;
+  bool             running;
+};
+
+global bench_state *bench;
+global const u32 bench_counts[] = { 1000, 10000, 100000 };
+
+
+// World extent per axis, relative to a cube holding the boxes at the same density.
+struct bench_layout
+{
+  const char *name;
+  f32 extent[3];
+};
+
+global const bench_layout bench_layouts[] = { { "cube", { 1.0f, 1.0f, 1.0f } }, { "corridor", { 0.25f, 0.25f, 16.0f } } };
+#define BENCH_LAYOUT_COUNT (sizeof(bench_layouts) / sizeof(bench_layouts[0]))
+#define BENCH_COUNT_COUNT  (sizeof(bench_counts) / sizeof(bench_counts[0]))
+
+
+internal f32 bench_random(u32 *seed)
+{
+  // xorshift32, in [0, 1)
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 17;
+  *seed ^= *seed << 5;
+  return (f32)(*seed >> 8) * (1.0f / 16777216.0f);
+}
+
+
+internal f64 bench_ms(i64 start)
+{
+  return (f64)(platform_clock_time() - start) * bench->timer.secs_per_count * 1000.0;
+}
+
+
+internal u32 bench_brute(broadphase *bp)
+{
+  u32 found = 0;
+  for (u32 a = 0; a < bp->count; ++a)
+  {
+    for (u32 b = a + 1; b < bp->count; ++b)
+    {
+      found += (bp->min_x[a] <= bp->max_x[b]) && (bp->max_x[a] >= bp->min_x[b]) &&
+               (bp->min_y[a] <= bp->max_y[b]) && (bp->max_y[a] >= bp->min_y[b]) &&
+               (bp->min_z[a] <= bp->max_z[b]) && (bp->max_z[a] >= bp->min_z[b]);
+    }
+  }
+  return found;
+}
+
+
+internal void bench_run(u32 count, const bench_layout *layout, arena *memory)
+{
+  arena_savepoint save = arena_save(memory);
+  // Unit boxes, about one overlap per box whatever the count.
+  f32 side = 2.0f * cbrtf((f32)count);
+  fvec3 world = fvec3_init(side * layout->extent[0], side * layout->extent[1], side * layout->extent[2]);
+  f32 half = 0.5f;
+  broadphase bp = broadphase_init(memory, count, 2.0f * half);
+  fvec3 *pos = arena_push_array(memory, count, fvec3);
+  fvec3 *vel = arena_push_array(memory, count, fvec3);
+  u32 seed = 0x9e3779b9u;
+  for (u32 i = 0; i < count; ++i)
+  {
+    pos[i] = fvec3_init(bench_random(&seed) * world.x, bench_random(&seed) * world.y, bench_random(&seed) * world.z);
+    vel[i] = fvec3_init(bench_random(&seed) - 0.5f, bench_random(&seed) - 0.5f, bench_random(&seed) - 0.5f);
+    vel[i] = fvec3_scale(vel[i], 0.1f);
+    broadphase_add(&bp, fvec3_sub(pos[i], fvec3_init(half, half, half)), fvec3_add(pos[i], fvec3_init(half, half, half)));
+  }
+  f64 sweep_ms = 0.0;
+  f64 hash_ms = 0.0;
+  u32 mismatches = 0;
+  u32 pair_count = 0;
+  for (u32 frame = 0; frame < BENCH_FRAMES; ++frame)
+  {
+    for (u32 i = 0; i < count; ++i)
+    {
+      pos[i] = fvec3_add(pos[i], vel[i]);
+      for (u32 k = 0; k < 3; ++k)
+      {
+        if (pos[i].array[k] < 0.0f || pos[i].array[k] > world.array[k]) vel[i].array[k] = -vel[i].array[k];
+      }
+      broadphase_update(&bp, i, fvec3_sub(pos[i], fvec3_init(half, half, half)), fvec3_add(pos[i], fvec3_init(half, half, half)));
+    }
+    i64 start = platform_clock_time();
+    u32 swept = broadphase_sweep(&bp, bench->pairs, BENCH_MAX_PAIRS);
+    // The first sweep sorts from scratch, only time the incremental frames.
+    if (frame > 0) sweep_ms += bench_ms(start);
+    start = platform_clock_time();
+    u32 hashed = broadphase_hash(&bp, bench->pairs, BENCH_MAX_PAIRS, &bench->scratch);
+    if (frame > 0) hash_ms += bench_ms(start);
+    mismatches += (swept != hashed);
+    pair_count = swept;
+  }
+  f64 brute_ms = 0.0;
+  if (count <= BENCH_BRUTE_MAX)
+  {
+    i64 start = platform_clock_time();
+    u32 brute = bench_brute(&bp);
+    brute_ms = bench_ms(start);
+    mismatches += (brute != pair_count);
+  }
+  f64 frames = (f64)(BENCH_FRAMES - 1);
+  printf("%-8s %7u objects  %7u pairs  sweep %8.3f ms (axis %c)  hash %8.3f ms  brute %9.3f ms  mismatches %u\n",
+         layout->name, count, pair_count, sweep_ms / frames, "xyz"[bp.axis], hash_ms / frames, brute_ms, mismatches);
+  arena_pop(save);
+}
+
+
+bool app_is_running()
+{
+  return bench->running;
+}
+
+
+arena app_init()
+{
+  size_t memory_size = (size_t) Gigabytes(1);
+  void *raw_memory = platform_memory_alloc(0, memory_size);
+  arena app_memory = arena_init(raw_memory, memory_size);
+  arena *memory = &app_memory;
+  bench = arena_push_struct(memory, bench_state);
+  platform_init(memory);
+  bench->timer = platform_clock_init(60.0f);
+  bench->scratch = subarena_init(memory, Megabytes(256));
+  bench->pairs = arena_push_array(memory, BENCH_MAX_PAIRS, broadphase_pair);
+  bench->running = true;
+  return app_memory;
+}
+
+
+void app_update(arena *a)
+{
+  bench_run(bench_counts[bench->round % BENCH_COUNT_COUNT], &bench_layouts[bench->round / BENCH_COUNT_COUNT], a);
+  bench->round++;
+  bench->running = bench->round < BENCH_COUNT_COUNT * BENCH_LAYOUT_COUNT;
+}
@@ -0,0 +1,239 @@
+#include "application.h"
+
+#include "linalg.h"
+#include "platform.h"
+
+// Windowless app timing the linalg 4-wide ops against plain scalar loops and glm.
+// Every op runs over the same inputs, prints nanoseconds per op and the largest difference
+// from the scalar result, then quits.
+
+#define BENCH_COUNT   4096  // Matrices and vectors per pass, small enough to stay in cache.
+#define BENCH_PASSES  200
+
+
+struct bench_state
+{
+  clock      timer;
+  fmat4     *a;
+  fmat4     *b;
+  fmat4     *out;
+  fmat4     *reference;
+  fvec4     *vecs;
+  fvec4     *vec_out;
+  fvec4     *vec_reference;
+  glm::mat4 *glm_a;
+  glm::mat4 *glm_b;
+  glm::mat4 *glm_out;
+  glm::vec4 *glm_vecs;
+  glm::vec4 *glm_vec_out;
+  bool       running;
+};
+
+global bench_state *bench;
+
+
+internal f32 bench_random(u32 *seed)
+{
+  // xorshift32, in [-1, 1)
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 17;
+  *seed ^= *seed << 5;
+  return (f32)(*seed >> 8) * (2.0f / 16777216.0f) - 1.0f;
+}
+
+
+internal f64 bench_ns_per_op(i64 start)
+{
+  f64 secs = (f64)(platform_clock_time() - start) * bench->timer.secs_per_count;
+  return secs * 1e9 / (f64)(BENCH_COUNT * BENCH_PASSES);
+}
+
+
+internal f32 bench_max_diff(f32 *a, f32 *b, u32 count)
+{
+  f32 diff = 0.0f;
+  for (u32 i = 0; i < count; ++i)
+  {
+    f32 d = fabsf(a[i] - b[i]);
+    diff = (d > diff) ? d : diff;
+  }
+  return diff;
+}
+
+
+// The scalar versions the SIMD paths replace.
+internal void bench_scalar_mul(fmat4 out, fmat4 a, fmat4 b)
+{
+  memset(out, 0, sizeof(fmat4));
+  for (u8 col = 0; col < 4; ++col)
+  {
+    for (u8 row = 0; row < 4; ++row)
+    {
+      for (u8 index = 0; index < 4; ++index)
+      {
+        out[col][row] += a[index][row] * b[col][index];
+      }
+    }
+  }
+}
+
+
+internal fvec4 bench_scalar_transform(fmat4 m, fvec4 v)
+{
+  fvec4 out = {};
+  for (u8 row = 0; row < 4; ++row)
+  {
+    for (u8 index = 0; index < 4; ++index)
+    {
+      out.array[row] += m[index][row] * v.array[index];
+    }
+  }
+  return out;
+}
+
+
+internal fvec4 bench_scalar_normalize(fvec4 v)
+{
+  f32 length = sqrtf(v.x*v.x + v.y*v.y + v.z*v.z + v.w*v.w);
+  if (length > 0.0f)
+  {
+    f32 inverse = 1.0f / length;
+    for (u8 i = 0; i < 4; ++i) v.array[i] *= inverse;
+  }
+  return v;
+}
+
+
+internal void bench_matmul()
+{
+  i64 start = platform_clock_time();
+  for (u32 pass = 0; pass < BENCH_PASSES; ++pass)
+  {
+    for (u32 i = 0; i < BENCH_COUNT; ++i) bench_scalar_mul(bench->reference[i], bench->a[i], bench->b[i]);
+  }
+  f64 scalar_ns = bench_ns_per_op(start);
+  start = platform_clock_time();
+  for (u32 pass = 0; pass < BENCH_PASSES; ++pass)
+  {
+    for (u32 i = 0; i < BENCH_COUNT; ++i) fmat4_mul(bench->out[i], bench->a[i], bench->b[i]);
+  }
+  f64 simd_ns = bench_ns_per_op(start);
+  start = platform_clock_time();
+  for (u32 pass = 0; pass < BENCH_PASSES; ++pass)
+  {
+    for (u32 i = 0; i < BENCH_COUNT; ++i) bench->glm_out[i] = bench->glm_a[i] * bench->glm_b[i];
+  }
+  f64 glm_ns = bench_ns_per_op(start);
+  f32 diff = bench_max_diff(&bench->out[0][0][0], &bench->reference[0][0][0], BENCH_COUNT * 16);
+  f32 glm_diff = bench_max_diff((f32*)bench->glm_out, &bench->reference[0][0][0], BENCH_COUNT * 16);
+  printf("mat4 * mat4      scalar %7.2f ns  simd %7.2f ns  glm %7.2f ns  max diff %g / %g\n",
+         scalar_ns, simd_ns, glm_ns, diff, glm_diff);
+}
+
+
+internal void bench_transform()
+{
+  i64 start = platform_clock_time();
+  for (u32 pass = 0; pass < BENCH_PASSES; ++pass)
+  {
+    for (u32 i = 0; i < BENCH_COUNT; ++i) bench->vec_reference[i] = bench_scalar_transform(bench->a[i], bench->vecs[i]);
+  }
+  f64 scalar_ns = bench_ns_per_op(start);
+  start = platform_clock_time();
+  for (u32 pass = 0; pass < BENCH_PASSES; ++pass)
+  {
+    for (u32 i = 0; i < BENCH_COUNT; ++i) bench->vec_out[i] = fmat4_mul_vec4(bench->a[i], bench->vecs[i]);
+  }
+  f64 simd_ns = bench_ns_per_op(start);
+  start = platform_clock_time();
+  for (u32 pass = 0; pass < BENCH_PASSES; ++pass)
+  {
+    for (u32 i = 0; i < BENCH_COUNT; ++i) bench->glm_vec_out[i] = bench->glm_a[i] * bench->glm_vecs[i];
+  }
+  f64 glm_ns = bench_ns_per_op(start);
+  f32 diff = bench_max_diff(bench->vec_out[0].array, bench->vec_reference[0].array, BENCH_COUNT * 4);
+  f32 glm_diff = bench_max_diff((f32*)bench->glm_vec_out, bench->vec_reference[0].array, BENCH_COUNT * 4);
+  printf("mat4 * vec4      scalar %7.2f ns  simd %7.2f ns  glm %7.2f ns  max diff %g / %g\n",
+         scalar_ns, simd_ns, glm_ns, diff, glm_diff);
+}
+
+
+internal void bench_normalize()
+{
+  i64 start = platform_clock_time();
+  for (u32 pass = 0; pass < BENCH_PASSES; ++pass)
+  {
+    for (u32 i = 0; i < BENCH_COUNT; ++i) bench->vec_reference[i] = bench_scalar_normalize(bench->vecs[i]);
+  }
+  f64 scalar_ns = bench_ns_per_op(start);
+  start = platform_clock_time();
+  for (u32 pass = 0; pass < BENCH_PASSES; ++pass)
+  {
+    for (u32 i = 0; i < BENCH_COUNT; ++i) bench->vec_out[i] = fvec4_normalize_fast(bench->vecs[i]);
+  }
+  f64 simd_ns = bench_ns_per_op(start);
+  start = platform_clock_time();
+  for (u32 pass = 0; pass < BENCH_PASSES; ++pass)
+  {
+    for (u32 i = 0; i < BENCH_COUNT; ++i) bench->glm_vec_out[i] = glm::normalize(bench->glm_vecs[i]);
+  }
+  f64 glm_ns = bench_ns_per_op(start);
+  f32 diff = bench_max_diff(bench->vec_out[0].array, bench->vec_reference[0].array, BENCH_COUNT * 4);
+  f32 glm_diff = bench_max_diff((f32*)bench->glm_vec_out, bench->vec_reference[0].array, BENCH_COUNT * 4);
+  printf("normalize vec4   scalar %7.2f ns  simd %7.2f ns  glm %7.2f ns  max diff %g / %g\n",
+         scalar_ns, simd_ns, glm_ns, diff, glm_diff);
+}
+
+
+bool app_is_running()
+{
+  return bench->running;
+}
+
+
+arena app_init()
+{
+  size_t memory_size = (size_t) Megabytes(64);
+  void *raw_memory = platform_memory_alloc(0, memory_size);
+  arena app_memory = arena_init(raw_memory, memory_size);
+  arena *memory = &app_memory;
+  bench = arena_push_struct(memory, bench_state);
+  platform_init(memory);
+  bench->timer = platform_clock_init(60.0f);
+  bench->a = arena_push_array(memory, BENCH_COUNT, fmat4);
+  bench->b = arena_push_array(memory, BENCH_COUNT, fmat4);
+  bench->out = arena_push_array(memory, BENCH_COUNT, fmat4);
+  bench->reference = arena_push_array(memory, BENCH_COUNT, fmat4);
+  bench->vecs = arena_push_array(memory, BENCH_COUNT, fvec4);
+  bench->vec_out = arena_push_array(memory, BENCH_COUNT, fvec4);
+  bench->vec_reference = arena_push_array(memory, BENCH_COUNT, fvec4);
+  bench->glm_a = arena_push_array(memory, BENCH_COUNT, glm::mat4);
+  bench->glm_b = arena_push_array(memory, BENCH_COUNT, glm::mat4);
+  bench->glm_out = arena_push_array(memory, BENCH_COUNT, glm::mat4);
+  bench->glm_vecs = arena_push_array(memory, BENCH_COUNT, glm::vec4);
+  bench->glm_vec_out = arena_push_array(memory, BENCH_COUNT, glm::vec4);
+  u32 seed = 0x9e3779b9u;
+  for (u32 i = 0; i < BENCH_COUNT; ++i)
+  {
+    for (u32 k = 0; k < 16; ++k)
+    {
+      (&bench->a[i][0][0])[k] = bench_random(&seed);
+      (&bench->b[i][0][0])[k] = bench_random(&seed);
+    }
+    for (u32 k = 0; k < 4; ++k) bench->vecs[i].array[k] = bench_random(&seed);
+    memcpy(&bench->glm_a[i], bench->a[i], sizeof(fmat4));
+    memcpy(&bench->glm_b[i], bench->b[i], sizeof(fmat4));
+    memcpy(&bench->glm_vecs[i], &bench->vecs[i], sizeof(fvec4));
+  }
+  bench->running = true;
+  return app_memory;
+}
+
+
+void app_update(arena *a)
+{
+  bench_matmul();
+  bench_transform();
+  bench_normalize();
+  bench->running = false;
+}
@@ -0,0 +1,474 @@
+#include "application.h"
+
+#include "linalg.h"
+#include "platform.h"
+#include "data3d.cpp"
+#include "text.cpp"
+
+#include <stdlib.h>
+
+// Windowless app timing the hot core, linalg, text and model routines.
+// Every case runs warmup samples, then timed samples of a fixed amount of work, and reports
+// nanoseconds per item (min, percentiles, mean) and cycles per item as JSON, so runs from
+// different commits can be compared. Quits when done.
+//   BENCH_OUT   JSON file to write, stdout when unset.
+//   BENCH_FONT  .ttf for real glyph metrics in text_add, zeroed metrics when unset.
+//   BENCH_LABEL Copied into the JSON, e.g. the commit hash.
+
+#define BENCH_WARMUP        3
+#define BENCH_SAMPLES       31
+#define BENCH_MAX_CASES     32
+#define BENCH_LINALG_COUNT  1024
+#define BENCH_ALLOC_COUNT   1024
+#define BENCH_STRING_CALLS  256
+#define BENCH_TEXT_LENGTH   256
+#define BENCH_SPHERE_RINGS  64    // 2 * rings * segments triangles.
+#define BENCH_SPHERE_SEGS   128
+#define BENCH_VOXEL_RES     64
+#define BENCH_OBJ_FILE      "micro_bench.obj"
+
+
+// One unit of timed work. Reset runs untimed before every sample, e.g. to refill an arena or
+// restore inputs a run writes over.
+typedef void bench_func(void *data);
+
+struct bench_case
+{
+  const char *name;
+  const char *unit;   // What one item is.
+  bench_func *run;
+  bench_func *reset;
+  void       *data;
+  u64         items;  // Items per run.
+  u32         runs;   // Runs per sample.
+};
+
+
+struct bench_result
+{
+  f64 min;
+  f64 p50;
+  f64 p90;
+  f64 p99;
+  f64 max;
+  f64 mean;
+  f64 cycles;  // Median cycles per item, 0 where there's no cycle counter.
+};
+
+
+struct bench_linalg
+{
+  fmat4         *a;
+  fmat4         *b;
+  fmat4         *out;
+  fvec4         *vecs;
+  fvec4         *vec_out;
+  transform_trs  trs;
+};
+
+
+struct bench_voxel
+{
+  mesh     model;
+  vertex  *pristine;  // The voxelizers move the vertices into grid space.
+  arena   *scratch;
+  voxel_grid (*voxelize)(mesh model, u32 resolution, arena *vert_buffer, arena *elem_buffer, arena *memory);
+};
+
+
+struct bench_state
+{
+  struct clock  timer;
+  arena         scratch;    // Reset by the cases between samples.
+  arena         text;
+  bench_case    cases[BENCH_MAX_CASES];
+  bench_result  results[BENCH_MAX_CASES];
+  u32           case_count;
+  bench_linalg  linalg;
+  bench_voxel   voxel[3];
+  char         *line;       // BENCH_TEXT_LENGTH printable characters.
+  char         *long_string;
+  u64           sink;       // Keeps results the compiler could otherwise drop.
+  bool          running;
+};
+
+global bench_state *bench;
+
+
+// No renderer in this build, text.cpp and data3d.cpp only reach these from their GPU setup.
+#ifndef _D3D
+texture* texture2d_init(arena *a, void* pixels, i32 width, i32 height, i32 channels)
+{
+  return 0;
+}
+
+
+rbuffer* rbuffer_dynamic_init(arena *a, buffer_type t, void *data, u32 stride, u32 byte_count)
+{
+  return 0;
+}
+#endif
+
+
+void shader_storage_init(u32 binding_index, void *data, size_t byte_count)
+{
+}
+
+
+internal f32 bench_random(u32 *seed)
+{
+  // xorshift32, in [-1, 1)
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 17;
+  *seed ^= *seed << 5;
+  return (f32)(*seed >> 8) * (2.0f / 16777216.0f) - 1.0f;
+}
+
+
+internal u64 bench_cycles()
+{
+  // Time stamp counter: reference cycles at a fixed rate, not core clocks under turbo.
+#if ARCH_x86_64
+  return __builtin_ia32_rdtsc();
+#else
+  return 0;
+#endif
+}
+
+
+internal void bench_add(const char *name, const char *unit, bench_func *run, bench_func *reset, void *data, u64 items, u32 runs)
+{
+  ASSERT(bench->case_count < BENCH_MAX_CASES, "ERROR: Too many benchmark cases.");
+  bench_case *c = &bench->cases[bench->case_count++];
+  c->name = name;
+  c->unit = unit;
+  c->run = run;
+  c->reset = reset;
+  c->data = data;
+  c->items = items;
+  c->runs = runs;
+}
+
+
+internal void bench_sort(f64 *values, u32 count)
+{
+  for (u32 i = 1; i < count; ++i)
+  {
+    f64 value = values[i];
+    u32 j = i;
+    for (; j > 0 && values[j - 1] > value; --j) values[j] = values[j - 1];
+    values[j] = value;
+  }
+}
+
+
+internal f64 bench_percentile(f64 *sorted, u32 count, f64 percent)
+{
+  // Nearest rank
+  u32 rank = (u32)ceil(percent * 0.01 * count);
+  rank = myclamp(rank, 1, count);
+  return sorted[rank - 1];
+}
+
+
+internal bench_result bench_measure(bench_case *c)
+{
+  f64 ns[BENCH_SAMPLES];
+  f64 cycles[BENCH_SAMPLES];
+  f64 items = (f64)(c->items * c->runs);
+  for (u32 sample = 0; sample < BENCH_WARMUP + BENCH_SAMPLES; ++sample)
+  {
+    if (c->reset) c->reset(c->data);
+    u64 cycles_start = bench_cycles();
+    i64 start = platform_clock_time();
+    for (u32 run = 0; run < c->runs; ++run) c->run(c->data);
+    i64 end = platform_clock_time();
+    u64 cycles_end = bench_cycles();
+    if (sample < BENCH_WARMUP) continue;
+    f64 secs = (f64)(end - start) * bench->timer.secs_per_count;
+    ns[sample - BENCH_WARMUP] = secs * 1e9 / items;
+    cycles[sample - BENCH_WARMUP] = (f64)(cycles_end - cycles_start) / items;
+  }
+  bench_result result = {};
+  f64 total = 0.0;
+  for (u32 i = 0; i < BENCH_SAMPLES; ++i) total += ns[i];
+  bench_sort(ns, BENCH_SAMPLES);
+  bench_sort(cycles, BENCH_SAMPLES);
+  result.min = ns[0];
+  result.p50 = bench_percentile(ns, BENCH_SAMPLES, 50.0);
+  result.p90 = bench_percentile(ns, BENCH_SAMPLES, 90.0);
+  result.p99 = bench_percentile(ns, BENCH_SAMPLES, 99.0);
+  result.max = ns[BENCH_SAMPLES - 1];
+  result.mean = total / BENCH_SAMPLES;
+  result.cycles = bench_percentile(cycles, BENCH_SAMPLES, 50.0);
+  return result;
+}
+
+
+internal void bench_json_write(FILE *out)
+{
+  const char *label = getenv("BENCH_LABEL");
+  fprintf(out, "{\n");
+  fprintf(out, "  \"label\": \"%s\",\n", label ? label : "");
+  fprintf(out, "  \"warmup\": %u,\n", BENCH_WARMUP);
+  fprintf(out, "  \"samples\": %u,\n", BENCH_SAMPLES);
+  fprintf(out, "  \"cases\": [\n");
+  for (u32 i = 0; i < bench->case_count; ++i)
+  {
+    bench_case *c = &bench->cases[i];
+    bench_result *r = &bench->results[i];
+    fprintf(out, "    { \"name\": \"%s\", \"unit\": \"%s\", \"items\": %llu, ",
+            c->name, c->unit, (unsigned long long)(c->items * c->runs));
+    fprintf(out, "\"ns_per_item\": { \"min\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f, \"mean\": %.4f }, ",
+            r->min, r->p50, r->p90, r->p99, r->max, r->mean);
+    fprintf(out, "\"cycles_per_item\": %.4f }%s\n", r->cycles, (i + 1 < bench->case_count) ? "," : "");
+  }
+  fprintf(out, "  ]\n");
+  fprintf(out, "}\n");
+}
+
+
+// Core
+internal void bench_scratch_reset(void *data)
+{
+  arena_free_all(&bench->scratch);
+}
+
+
+internal void bench_arena_alloc(void *data)
+{
+  for (u32 i = 0; i < BENCH_ALLOC_COUNT; ++i)
+  {
+    // Odd sizes so every call realigns.
+    void *allocation = arena_alloc_align(&bench->scratch, 40 + (i & 7), 16);
+    bench->sink += (uintptr_t)allocation;
+  }
+}
+
+
+internal void bench_string_length(void *data)
+{
+  for (u32 i = 0; i < BENCH_STRING_CALLS; ++i)
+  {
+    bench->sink += string_length(bench->long_string);
+  }
+}
+
+
+// Linalg
+internal void bench_fmat4_mul(void *data)
+{
+  bench_linalg *l = (bench_linalg*) data;
+  for (u32 i = 0; i < BENCH_LINALG_COUNT; ++i) fmat4_mul(l->out[i], l->a[i], l->b[i]);
+}
+
+
+internal void bench_fmat4_mul_vec4(void *data)
+{
+  bench_linalg *l = (bench_linalg*) data;
+  for (u32 i = 0; i < BENCH_LINALG_COUNT; ++i) l->vec_out[i] = fmat4_mul_vec4(l->a[i], l->vecs[i]);
+}
+
+
+internal void bench_fvec4_normalize(void *data)
+{
+  bench_linalg *l = (bench_linalg*) data;
+  for (u32 i = 0; i < BENCH_LINALG_COUNT; ++i) l->vec_out[i] = fvec4_normalize_fast(l->vecs[i]);
+}
+
+
+internal void bench_fmat4_inverse_affine(void *data)
+{
+  bench_linalg *l = (bench_linalg*) data;
+  for (u32 i = 0; i < BENCH_LINALG_COUNT; ++i) fmat4_inverse_affine(l->out[i], l->a[i]);
+}
+
+
+internal void bench_transform_compose(void *data)
+{
+  bench_linalg *l = (bench_linalg*) data;
+  transform_batch_compose(l->out, l->trs, BENCH_LINALG_COUNT);
+}
+
+
+// Text
+internal void bench_text_reset(void *data)
+{
+  arena_free_all(&bench->text);
+}
+
+
+internal void bench_text_add(void *data)
+{
+  text_add(&bench->text, bench->line, BENCH_TEXT_LENGTH, 720, glm::vec3(-1.0f, 0.0f, 0.0f), 1.0f, glm::vec4(1.0f), 1.0f / 720.0f);
+}
+
+
+// Models
+internal void bench_model_load(void *data)
+{
+  arena *scratch = &bench->scratch;
+  mesh model = model_load_obj(BENCH_OBJ_FILE, scratch, scratch);
+  bench->sink += model.vert_count;
+}
+
+
+internal void bench_voxel_reset(void *data)
+{
+  bench_voxel *v = (bench_voxel*) data;
+  memcpy(v->model.vertices, v->pristine, v->model.vert_count * sizeof(vertex));
+  arena_free_all(v->scratch);
+}
+
+
+internal void bench_voxelize(void *data)
+{
+  bench_voxel *v = (bench_voxel*) data;
+  voxel_grid grid = v->voxelize(v->model, BENCH_VOXEL_RES, v->scratch, v->scratch, v->scratch);
+  bench->sink += grid.contents[0];
+}
+
+
+// UV sphere, every triangle listed with its own corners like model_load_obj produces.
+internal void bench_obj_write(const char *file)
+{
+  FILE *obj = fopen(file, "w");
+  ASSERT(obj, "ERROR: Failed to create the benchmark model.");
+  const f32 pi = 3.14159265f;
+  for (u32 ring = 0; ring <= BENCH_SPHERE_RINGS; ++ring)
+  {
+    f32 theta = pi * (f32)ring / BENCH_SPHERE_RINGS;
+    for (u32 seg = 0; seg <= BENCH_SPHERE_SEGS; ++seg)
+    {
+      f32 phi = 2.0f * pi * (f32)seg / BENCH_SPHERE_SEGS;
+      fprintf(obj, "v %f %f %f\n", sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+    }
+  }
+  u32 stride = BENCH_SPHERE_SEGS + 1;
+  for (u32 ring = 0; ring < BENCH_SPHERE_RINGS; ++ring)
+  {
+    for (u32 seg = 0; seg < BENCH_SPHERE_SEGS; ++seg)
+    {
+      // OBJ indices start at 1.
+      u32 v0 = ring * stride + seg + 1;
+      u32 v1 = v0 + stride;
+      fprintf(obj, "f %u %u %u\n", v0, v1, v1 + 1);
+      fprintf(obj, "f %u %u %u\n", v0, v1 + 1, v0 + 1);
+    }
+  }
+  fclose(obj);
+}
+
+
+internal void bench_linalg_init(arena *memory)
+{
+  bench_linalg *l = &bench->linalg;
+  l->a = arena_push_array(memory, BENCH_LINALG_COUNT, fmat4);
+  l->b = arena_push_array(memory, BENCH_LINALG_COUNT, fmat4);
+  l->out = arena_push_array(memory, BENCH_LINALG_COUNT, fmat4);
+  l->vecs = arena_push_array(memory, BENCH_LINALG_COUNT, fvec4);
+  l->vec_out = arena_push_array(memory, BENCH_LINALG_COUNT, fvec4);
+  l->trs = transform_trs_init(memory, BENCH_LINALG_COUNT);
+  u32 seed = 0x9e3779b9u;
+  for (u32 i = 0; i < BENCH_LINALG_COUNT; ++i)
+  {
+    for (u32 k = 0; k < 16; ++k)
+    {
+      (&l->a[i][0][0])[k] = bench_random(&seed);
+      (&l->b[i][0][0])[k] = bench_random(&seed);
+    }
+    // Affine: the inverse needs a bottom row of 0 0 0 1.
+    l->a[i][0][3] = 0.0f;
+    l->a[i][1][3] = 0.0f;
+    l->a[i][2][3] = 0.0f;
+    l->a[i][3][3] = 1.0f;
+    l->a[i][0][0] += 4.0f;
+    l->a[i][1][1] += 4.0f;
+    l->a[i][2][2] += 4.0f;
+    for (u32 k = 0; k < 4; ++k) l->vecs[i].array[k] = bench_random(&seed);
+    l->trs.tx[i] = bench_random(&seed);
+    l->trs.ty[i] = bench_random(&seed);
+    l->trs.tz[i] = bench_random(&seed);
+    l->trs.qw[i] = 1.0f;
+    l->trs.sx[i] = 1.0f;
+    l->trs.sy[i] = 1.0f;
+    l->trs.sz[i] = 1.0f;
+  }
+}
+
+
+bool app_is_running()
+{
+  return bench->running;
+}
+
+
+arena app_init()
+{
+  size_t memory_size = (size_t) Gigabytes(1);
+  void *raw_memory = platform_memory_alloc(0, memory_size);
+  arena app_memory = arena_init(raw_memory, memory_size);
+  arena *memory = &app_memory;
+  bench = arena_push_struct(memory, bench_state);
+  platform_init(memory);
+  bench->timer = platform_clock_init(60.0f);
+  bench->scratch = subarena_init(memory, Megabytes(256));
+  bench->text = subarena_init(memory, 2 * BENCH_TEXT_LENGTH * 6 * sizeof(char_vertex));
+  // Core
+  bench->long_string = arena_push_array(memory, 401, char);
+  memset(bench->long_string, 'a', 400);
+  bench_add("arena_alloc_align", "alloc", bench_arena_alloc, bench_scratch_reset, 0, BENCH_ALLOC_COUNT, 16);
+  bench_add("string_length", "byte", bench_string_length, 0, 0, BENCH_STRING_CALLS * 400, 4);
+  // Linalg
+  bench_linalg_init(memory);
+  bench_linalg *l = &bench->linalg;
+  bench_add("fmat4_mul", "matrix", bench_fmat4_mul, 0, l, BENCH_LINALG_COUNT, 16);
+  bench_add("fmat4_mul_vec4", "vector", bench_fmat4_mul_vec4, 0, l, BENCH_LINALG_COUNT, 16);
+  bench_add("fvec4_normalize_fast", "vector", bench_fvec4_normalize, 0, l, BENCH_LINALG_COUNT, 16);
+  bench_add("fmat4_inverse_affine", "matrix", bench_fmat4_inverse_affine, 0, l, BENCH_LINALG_COUNT, 16);
+  bench_add("transform_batch_compose", "matrix", bench_transform_compose, 0, l, BENCH_LINALG_COUNT, 16);
+  // Text
+  const char *font = getenv("BENCH_FONT");
+  if (font) text_atlas_init(memory, font);
+  bench->line = arena_push_array(memory, BENCH_TEXT_LENGTH, char);
+  for (u32 i = 0; i < BENCH_TEXT_LENGTH; ++i) bench->line[i] = (char)(CHAR_START + (i * 7) % CHAR_COUNT);
+  bench_add("text_add", "char", bench_text_add, bench_text_reset, 0, BENCH_TEXT_LENGTH, 2);
+  // Models
+  bench_obj_write(BENCH_OBJ_FILE);
+  u32 tri_count = 2 * BENCH_SPHERE_RINGS * BENCH_SPHERE_SEGS;
+  bench_add("model_load_obj", "triangle", bench_model_load, bench_scratch_reset, 0, tri_count, 1);
+  mesh sphere = model_load_obj(BENCH_OBJ_FILE, memory, memory);
+  bench_voxel *voxel = bench->voxel;
+  voxel[0].voxelize = model_voxelize;
+  voxel[1].voxelize = model_voxelize2;
+  voxel[2].voxelize = model_voxelize_solid;
+  const char *voxel_names[] = { "model_voxelize", "model_voxelize2", "model_voxelize_solid" };
+  for (u32 i = 0; i < ARRAY_COUNT(bench->voxel); ++i)
+  {
+    // Each variant moves its own copy of the vertices.
+    voxel[i].model = sphere;
+    voxel[i].model.vertices = arena_push_array(memory, sphere.vert_count, vertex);
+    voxel[i].pristine = sphere.vertices;
+    voxel[i].scratch = &bench->scratch;
+    bench_add(voxel_names[i], "triangle", bench_voxelize, bench_voxel_reset, &voxel[i], tri_count, 1);
+  }
+  bench->running = true;
+  return app_memory;
+}
+
+
+void app_update(arena *a)
+{
+  for (u32 i = 0; i < bench->case_count; ++i)
+  {
+    fprintf(stderr, "%s\n", bench->cases[i].name);
+    bench->results[i] = bench_measure(&bench->cases[i]);
+  }
+  remove(BENCH_OBJ_FILE);
+  const char *out_file = getenv("BENCH_OUT");
+  FILE *out = out_file ? fopen(out_file, "w") : stdout;
+  ASSERT(out, "ERROR: Failed to open the benchmark output.");
+  bench_json_write(out);
+  if (out != stdout) fclose(out);
+  bench->running = false;
+}
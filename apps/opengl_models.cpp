@@ -115,24 +115,14 @@ int main(int argc, char **argv)
   // Free scratch
   arena_free_all(&scratch);
 
-  // Set up instanced cube rendering for grid.
-  mesh cube = primitive_cube(&scratch);
-  rbuffer instance_buffer = rbuffer_init((void*)cube.vertices, cube.vert_count*sizeof(vertex));
-  rbuffer_attribute(instance_buffer, 0, 3, 3*sizeof(f32), (void*)0);
-  rbuffer_elements_init(&instance_buffer, cube.indices, cube.index_count*sizeof(u32));
-  u32 instance_program = render_program_init( &scratch, "shaders\\instance.vert", "shaders\\instance.frag");
-  fvec3 grid_shape = fvec3_uniform(voxel_count);
-  voxel_grid_init(&scratch, grid_shape);
-
-  // I want the grid to be controlled as a 3D texture.
-  u32 grid_element_count = grid_shape.x * grid_shape.y * grid_shape.z;
-  // u8 *grid_data = arena_push_array(&scratch, grid_element_count, u8);
-  // memset(grid_data, 255, grid_element_count * sizeof(u8));
-  for (size_t i = 0; i < grid_element_count; ++i) grid.contents[i] = grid.contents[i] * 255;
-
-  u32 grid_texture_id = texture3d_init(grid.contents, grid_shape);
-  // TODO: Renderer needs a better way of handling texture slots
-  i32 grid_texture_slot = 1;
+  // The grid's surface as merged quads, instead of an instanced cube per voxel.
+  u32 voxel_face_max = 6 * voxel_count * voxel_count * voxel_count;
+  arena vert_buffer_voxels = subarena_init(&memory, voxel_face_max * 4 * sizeof(vertex1));
+  arena elem_buffer_voxels = subarena_init(&memory, voxel_face_max * 6 * sizeof(u32));
+  entity voxel_surface = voxel_grid_mesh(grid, voxel_count, fvec4_init(0.0f, 1.0f, 0.0f, 1.0f), &vert_buffer_voxels, &elem_buffer_voxels, &scratch);
+  rbuffer voxel_gpu = rbuffer_init(vert_buffer_voxels.buffer, vert_buffer_voxels.offset_new);
+  rbuffer_attribute(voxel_gpu, 0, 3, sizeof(vertex1), (void*)0);
+  rbuffer_elements_init(&voxel_gpu, elem_buffer_voxels.buffer, elem_buffer_voxels.offset_new);
 
   // Set up the angular speed variable for the rotation
   bool rotation_on = false;
@@ -247,31 +237,9 @@ int main(int argc, char **argv)
     draw_lines_elements(lines_gpu, lines_program, elem_count, 0);
     */
 
-    // Set color for instance grid
-    fvec3 color = {};
-    color.array[0] = 0.0f;
-    color.array[1] = 1.0f;
-    color.array[2] = 0.0f;
-    uniform_set_vec3(instance_program, "mycolor", color);
-
-    // Draw instance cube
-    glm::mat4 grid_model = glm::mat4(1.0f);
-    glm::vec3 grid_center = glm::vec3(target.x, target.y, target.z);
-    fvec3 bbox_min = model_min(bbox);
-    // fvec3 bbox_max = model_max(bbox);
-    fvec3 temp = fvec3_scale(fvec3_sub(bbox_max, bbox_min), 0.5f);
-    glm::vec3 grid_shape2 = glm::vec3(temp.x, temp.y, temp.z);
-    // Normally it goes t * r * s, but here rotation should be last so it is rotated about the model center.
-    grid_model = glm::translate(grid_model, grid_center);
-    grid_model = glm::rotate(grid_model, angle, rotation_axis_norm);
-    grid_model = glm::scale(grid_model, grid_shape2);
-    glm::mat4 grid_mvp = view_projection * grid_model;
-    uniform_set_mat4(instance_program, "view_projection", &grid_mvp[0][0]);
-    // Grid Texture
-    texture3d_bind(grid_texture_slot, grid_texture_id);
-    uniform_set_i32(instance_program, "voxels", grid_texture_slot);
-    uniform_set_vec3(instance_program, "dimension", grid_shape);
-    draw_lines_instanced(instance_buffer, instance_program, (grid_shape.x * grid_shape.y * grid_shape.z));
+    // Draw the voxel surface, already in model space so it turns with the bounding box
+    uniform_set_mat4(lines_program, "view_projection", &mvp[0][0]);
+    draw_wireframe_elements(voxel_gpu, lines_program, voxel_surface.count, (void*)0);
 
     // Finalize and draw frame
     frame_render();
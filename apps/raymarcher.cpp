@@ -211,9 +211,9 @@ void app_init( arena *memory )
   f32 znear = 0.1f;
   f32 zfar = 100.0f;
   glm::mat4 projection = glm::perspective(fov_deg, aspect, znear, zfar);
-  // Compute inverses for raymarching shader
-  state->cam.view_inv = glm::inverse(view);
-  state->cam.proj_inv = glm::inverse(projection);
+  // Compute inverses for raymarching shader, the view is rigid and the projection sparse
+  fmat4_inverse_rigid( *(fmat4*)&state->cam.view_inv, *(fmat4*)&view );
+  fmat4_inverse_perspective( *(fmat4*)&state->cam.proj_inv, *(fmat4*)&projection );
   // Initialize volume rotation (will be updated in render loop)
   state->cam.wrld_inv = glm::mat4(1.0f); // Identity for now
   state->camera_ray = rbuffer_dynamic_init( memory, BUFF_CONST, &state->cam, 0, sizeof(camera) );
@@ -292,9 +292,9 @@ void app_update( arena *memory )
   // Add raymarching quad to buffers
   model3d raybox2d = primitive_box2d( &state->vbuffer_cpu, &state->ebuffer_cpu, fvec4_uniform(0.0f) );
   model3d button_test = primitive_box2d( &state->vbuffer_cpu, &state->ebuffer_cpu, fvec4_init(1.0f, 0.0f, 0.0f, 1.0f) );
-  // TODO: Update whole buffer or just what you need with offset_new?
-  rbuffer_update( state->vbuffer_gpu, state->vbuffer_cpu.buffer, state->vbuffer_cpu.length );
-  rbuffer_update( state->ebuffer_gpu, state->ebuffer_cpu.buffer, state->ebuffer_cpu.length );
+  // Only upload what was written this frame
+  rbuffer_update( state->vbuffer_gpu, state->vbuffer_cpu.buffer, state->vbuffer_cpu.offset_new );
+  rbuffer_update( state->ebuffer_gpu, state->ebuffer_cpu.buffer, state->ebuffer_cpu.offset_new );
   // Update volume rotation
   static f32 angle = 0.0f;
   angle += (PI/4.0f) * state->timer.delta; // rad += (rad/s)*s
@@ -302,7 +302,8 @@ void app_update( arena *memory )
   if (angle > 2.0*PI) angle -= 2.0*PI;
   glm::vec3 rotation_axis = glm::vec3(0.0f, 1.0f, 0.0f); // Y-axis
   glm::mat4 volume_rotation = glm::rotate(glm::mat4(1.0f), angle, rotation_axis);
-  state->cam.wrld_inv = glm::inverse(volume_rotation);
+  // Pure rotation, the inverse is the transpose
+  fmat4_transpose( *(fmat4*)&state->cam.wrld_inv, *(fmat4*)&volume_rotation );
   render_constant_set( state->camera_ray, 0 );
   rbuffer_update( state->camera_ray, &state->cam, sizeof(camera));
   // Draw raymarched quad
@@ -386,9 +387,8 @@ int main(int argc, char **argv)
     ebuffer_cpu.length
   );
   primitive_box2d( &vbuffer_cpu, &ebuffer_cpu );
-  // TODO: Update whole buffer or just what you need with offset_new?
-  rbuffer_update( vbuffer_gpu, vbuffer_cpu.buffer, vbuffer_cpu.length );
-  rbuffer_update( ebuffer_gpu, ebuffer_cpu.buffer, ebuffer_cpu.length );
+  rbuffer_update( vbuffer_gpu, vbuffer_cpu.buffer, vbuffer_cpu.offset_new );
+  rbuffer_update( ebuffer_gpu, ebuffer_cpu.buffer, ebuffer_cpu.offset_new );
   // Load shaders
   shaders_ptr tri_prog = shader_init(&memory);
   shader_load(tri_prog, VERTEX, "shaders/test.hlsl", "VSMain", "vs_5_0");
@@ -519,8 +519,8 @@ int main(int argc, char **argv)
     ui_ebuffer_cpu.length
   );
   primitive_box2d( &ui_vbuffer_cpu, &ui_ebuffer_cpu );
-  rbuffer_update( ui_vbuffer_gpu, ui_vbuffer_cpu.buffer, ui_vbuffer_cpu.length );
-  rbuffer_update( ui_ebuffer_gpu, ui_ebuffer_cpu.buffer, ui_ebuffer_cpu.length );
+  rbuffer_update( ui_vbuffer_gpu, ui_vbuffer_cpu.buffer, ui_vbuffer_cpu.offset_new );
+  rbuffer_update( ui_ebuffer_gpu, ui_ebuffer_cpu.buffer, ui_ebuffer_cpu.offset_new );
   // UI Shaders
   shaders_ptr ui_shaders = shader_init(&memory);
   shader_load(ui_shaders, VERTEX, "shaders/ui.hlsl", "VSMain", "vs_5_0");
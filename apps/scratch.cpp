@@ -2,20 +2,29 @@
 
 #include "linalg.h"
 #include "collision.cpp"
+#include "fixed_step.cpp"
+#include "frame_pacer.cpp"
+#include "mesh_bvh.cpp"
+#include "mesh_quantize.cpp"
 #include "input.h"
 #include "platform.h"
 #include "render.h"
+#include "render_commands.cpp"
+#include "occlusion_cull.cpp"
 #include "primitives.cpp"
+#include "profiler.cpp"
+#include "quaternion.cpp"
 #include "render_boundary.h"
 
-#include "text.cpp"
-
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
 #define MAX_COUNT_VERTEX   1000
 #define MAX_COUNT_TEXT     10000
-#define MAX_COUNT_ENTITIES 100
+#define MAX_COUNT_ENTITIES 100    // Initial entity capacity, the table doubles when full
+#define MAX_COUNT_INSTANCES 4096   // Initial instance capacity, grows with the entity table
+#define MAX_COUNT_OCCLUDER_TRIS 4096
+#define SIM_TICK_RATE      120.0  // Simulation ticks per second, independent of the frame rate.
 
 
 enum shader_names
@@ -25,6 +34,8 @@ enum shader_names
   SHADER_GEOMETRY,
   SHADER_GRID,
   SHADER_PORTAL,
+  SHADER_INSTANCED,
+  SHADER_QUANTIZED,
   SHADER_COUNT,
 };
 
@@ -48,10 +59,23 @@ struct uidata
 struct entities
 {
   u64 total;
-  u64 vert_start[MAX_COUNT_ENTITIES];
-  u64 elem_start[MAX_COUNT_ENTITIES];
-  u64 elem_count[MAX_COUNT_ENTITIES];
-  glm::mat4 world_transforms[MAX_COUNT_ENTITIES];
+  u64 capacity;
+  u64 *vert_start;
+  u64 *elem_start;
+  u64 *elem_count;
+  u32 *shader;
+  cull_bounds *bounds;  // Local bounds of the entity's mesh.
+  glm::mat4 *world_transforms;
+  u32 *visible;         // Rows that survived culling this frame.
+  u64 visible_count;
+};
+
+
+// Game state advanced by the fixed step and interpolated for drawing.
+struct sim_state
+{
+  f32 theta;       // Pyramid spin and orbit angle, wraps at 2π.
+  f32 wave_phase;  // Shader animation phase, wraps at 2π to avoid precision loss.
 };
 
 
@@ -59,17 +83,37 @@ struct appstate
 {
   platform_window     window;
   clock               timer;
-  arena               vbuffer_cpu; // Vertex buffer
-  arena               ebuffer_cpu; // Element buffer
-  arena               tbuffer_cpu; // Text buffer
+  frame_pacer         pacer;
+  arena               scratch;     // Temporary memory, empty between frames
+  fixed_step          sim;
+  sim_state           view;        // Simulation state interpolated to this frame's time
+  arena               vbuffer_cpu; // Vertex buffer, mapped GPU memory during the frame
+  arena               ebuffer_cpu; // Element buffer, mapped GPU memory during the frame
+  arena               tbuffer_cpu; // Text buffer, mapped GPU memory during the frame
   rbuffer            *vbuffer_gpu;
   rbuffer            *ebuffer_gpu;
   rbuffer            *tbuffer_gpu;
-  arena               uibuffer_cpu; // Vertex buffer
-  rbuffer            *uibuffer_gpu;
+  rbuffer            *uibuffer_gpu; // Ring buffer, the few UI quads are appended without a discard
   rbuffer            *cam_ui_gpu;
   rbuffer            *cam_game_gpu;
   rbuffer            *world_gpu;
+  arena               objects_cpu;  // Per object constants, mapped GPU memory during the frame
+  rbuffer            *objects_gpu;
+  arena               instances_cpu; // Per instance transforms, mapped GPU memory during the frame
+  rbuffer            *instances_gpu;
+  u64                 instance_capacity;
+  arena               entity_memory;
+  occlusion_buffer    occlusion;
+  arena               occluder_vbuffer; // Occluder meshes, CPU memory the rasterizer can read back
+  arena               occluder_ebuffer;
+  struct entity       portal_occluder;  // struct: the entity member below hides the type
+  bvh                 pyramid_tree;     // Pyramid triangles in its local space, for cursor picking
+  rbuffer            *crate_vbuffer_gpu; // Quantized box, uploaded once
+  rbuffer            *crate_ebuffer_gpu;
+  struct entity       crate;
+  quantize_bounds     crate_bounds;     // Goes in the crate's world matrix, its positions are in [0, 1]
+  render_commands     commands;
+  render_backend      backend;
   input_state         inputs[KEY_COUNT];
   entities            entity;
 };
@@ -77,16 +121,141 @@ struct appstate
 global appstate *state;
 
 
-internal void entity_load(entity e, glm::mat4 world)
+internal f32 angle_wrap(f32 angle)
+{
+  return (angle > 2.0f*PI) ? angle - 2.0f*PI : angle;
+}
+
+
+internal f32 angle_lerp(f32 a, f32 b, f32 t)
+{
+  // Go the short way round when b has wrapped past 2π.
+  f32 diff = b - a;
+  if (diff < -PI) diff += 2.0f*PI;
+  return angle_wrap(a + diff * t);
+}
+
+
+internal void sim_tick(void *app, const void *from, void *to, f64 dt)
+{
+  const sim_state *a = (const sim_state*) from;
+  sim_state *b = (sim_state*) to;
+  f32 theta_velocity = PI/2.0f;
+  b->theta = angle_wrap(a->theta + theta_velocity * (f32)dt); // rad += (rad/s)*s
+  b->wave_phase = angle_wrap(a->wave_phase + (f32)dt);
+}
+
+
+internal void sim_render(void *app, const void *prev, const void *curr, f64 alpha)
+{
+  const sim_state *a = (const sim_state*) prev;
+  const sim_state *b = (const sim_state*) curr;
+  appstate *s = (appstate*) app;
+  s->view.theta = angle_lerp(a->theta, b->theta, (f32)alpha);
+  s->view.wave_phase = angle_lerp(a->wave_phase, b->wave_phase, (f32)alpha);
+}
+
+
+internal void entities_grow(entities *table, arena *a)
+{
+  // The old columns stay behind in the arena, doubling keeps them smaller than the live table.
+  u64 capacity = (table->capacity) ? table->capacity * 2 : MAX_COUNT_ENTITIES;
+  u64 *vert_start = arena_push_array(a, capacity, u64);
+  u64 *elem_start = arena_push_array(a, capacity, u64);
+  u64 *elem_count = arena_push_array(a, capacity, u64);
+  u32 *shader     = arena_push_array(a, capacity, u32);
+  cull_bounds *bounds = arena_push_array(a, capacity, cull_bounds);
+  glm::mat4 *world_transforms = arena_push_array(a, capacity, glm::mat4);
+  u32 *visible    = arena_push_array(a, capacity, u32);
+  if (table->total)
+  {
+    memcpy(vert_start, table->vert_start, table->total * sizeof(u64));
+    memcpy(elem_start, table->elem_start, table->total * sizeof(u64));
+    memcpy(elem_count, table->elem_count, table->total * sizeof(u64));
+    memcpy(shader,     table->shader,     table->total * sizeof(u32));
+    memcpy(bounds,     table->bounds,     table->total * sizeof(cull_bounds));
+    memcpy(world_transforms, table->world_transforms, table->total * sizeof(glm::mat4));
+  }
+  table->vert_start = vert_start;
+  table->elem_start = elem_start;
+  table->elem_count = elem_count;
+  table->shader     = shader;
+  table->bounds     = bounds;
+  table->world_transforms = world_transforms;
+  table->visible    = visible;
+  table->capacity = capacity;
+}
+
+
+internal void entity_load(entity e, glm::mat4 world, u32 shader, cull_bounds bounds)
 {
+  if (state->entity.total == state->entity.capacity)
+  {
+    entities_grow(&state->entity, &state->entity_memory);
+  }
   state->entity.vert_start[state->entity.total] = e.vert_start;
   state->entity.elem_start[state->entity.total] = e.elem_start;
   state->entity.elem_count[state->entity.total] = e.count;
+  state->entity.shader[state->entity.total] = shader;
+  state->entity.bounds[state->entity.total] = bounds;
   state->entity.world_transforms[state->entity.total] = world;
   state->entity.total++;
 }
 
 
+// BVH over a CPU copy of the pyramid, the frame's copy is in write only GPU memory.
+internal bvh pick_tree_build( arena *a )
+{
+  arena_savepoint save = arena_save( &state->scratch );
+  arena vbuffer = subarena_init( &state->scratch, 16 * sizeof(vertex1) );
+  arena ebuffer = subarena_init( &state->scratch, 32 * sizeof(u32) );
+  entity pyramid = primitive_pyramid( &vbuffer, &ebuffer, fvec4_init(1.0f, 0.0f, 0.0f, 1.0f) );
+  mesh m = {};
+  m.vert_count = (u32)(vbuffer.offset_new / sizeof(vertex1));
+  m.vertices = arena_push_array( &state->scratch, m.vert_count, vertex );
+  for (u32 i = 0; i < m.vert_count; ++i)
+  {
+    m.vertices[i].pos = ((vertex1*)vbuffer.buffer)[i].pos;
+  }
+  m.indices = (u32*)ebuffer.buffer + pyramid.elem_start;
+  m.index_count = (u32)pyramid.count;
+  bvh tree = bvh_build( m, a, &state->scratch );
+  arena_pop( save );
+  return tree;
+}
+
+
+// Box in 16 byte vertices, it never changes so it goes up once instead of into the frame's buffers.
+internal void crate_build( arena *a )
+{
+  arena_savepoint save = arena_save( &state->scratch );
+  arena vbuffer = subarena_init( &state->scratch, 16 * sizeof(vertex1) );
+  arena ebuffer = subarena_init( &state->scratch, 64 * sizeof(u32) );
+  arena qbuffer = subarena_init( &state->scratch, 16 * sizeof(vertex_quantized) );
+  entity box = primitive_box3d( &vbuffer, &ebuffer );
+  state->crate = entity_quantize( box, &vbuffer, &ebuffer, &qbuffer, &state->crate_bounds );
+  state->crate_vbuffer_gpu = rbuffer_init( a, BUFF_VERTS, qbuffer.buffer, sizeof(vertex_quantized), (u32)qbuffer.offset_new );
+  state->crate_ebuffer_gpu = rbuffer_init( a, BUFF_ELEMS, ebuffer.buffer, sizeof(u32), (u32)ebuffer.offset_new );
+  arena_pop( save );
+}
+
+
+// Triangle of the pyramid under the cursor, BVH_EMPTY if none. cursor is in pixels from the window center.
+internal u32 pick_pyramid( fvec2 cursor, glm::mat4 view_proj, glm::mat4 world )
+{
+  // Cursor ray from the near to the far plane, taken into the pyramid's local space
+  glm::vec2 ndc = glm::vec2( cursor.x / (0.5f * state->window.width), cursor.y / (0.5f * state->window.height) );
+  glm::mat4 clip_to_local = glm::inverse( view_proj * world );
+  glm::vec4 near_point = clip_to_local * glm::vec4( ndc.x, ndc.y, 0.0f, 1.0f );
+  glm::vec4 far_point  = clip_to_local * glm::vec4( ndc.x, ndc.y, 1.0f, 1.0f );
+  fvec3 origin = fvec3_init( near_point.x / near_point.w, near_point.y / near_point.w, near_point.z / near_point.w );
+  fvec3 end    = fvec3_init( far_point.x / far_point.w, far_point.y / far_point.w, far_point.z / far_point.w );
+  bvh_hit hit = {};
+  fvec3 dir = fvec3_sub( end, origin );
+  return bvh_raycast( &state->pyramid_tree, origin, dir, 1.0f, &hit ) ? hit.triangle : BVH_EMPTY;
+}
+
+
 internal void input_reset( input_state *map )
 {
   for (i32 i = 0; i < KEY_COUNT; ++i)
@@ -129,7 +298,8 @@ internal bool ui_button( fvec2 cursor, fvec3 pos, fvec3 scale, fvec4 color)
     identity, 
     glm::vec3(scale.x, scale.y, scale.z)
   );
-  entity_load( button, (t*s) );
+  cull_bounds box_bounds = { fvec3_init(-1.0f, -1.0f, 0.0f), fvec3_init(1.0f, 1.0f, 0.0f) };
+  entity_load( button, (t*s), SHADER_INSTANCED, box_bounds );
   return is_clicked;
 }
 
@@ -152,25 +322,24 @@ arena app_init()
   void *raw_memory = platform_memory_alloc(memory_base, memory_size);
   arena app_memory = arena_init(raw_memory, memory_size);
   arena *memory = &app_memory;
+  arena_tag(memory, "app");
   // Create internal global state
   state = arena_push_struct(memory, appstate);
   // Start the platform layer
   platform_init(memory);
+  profile_init(memory);
+  state->scratch = subarena_init( memory, Megabytes(64) );
+  arena_tag( &state->scratch, "scratch" );
   // Create a window for the application
   state->window = platform_window_init();
   // Initialize renderer
   render_init(memory);
   render_data_init( memory, SHADER_COUNT );
-  // Begin render buffers
-  state->vbuffer_cpu  = subarena_init( memory, MAX_COUNT_VERTEX * sizeof(vertex1) );
-  state->ebuffer_cpu  = subarena_init( memory, MAX_COUNT_VERTEX * sizeof(u32) );
-  state->tbuffer_cpu  = text_buffer_init( memory, MAX_COUNT_TEXT );
-  state->uibuffer_cpu = subarena_init( memory, MAX_COUNT_VERTEX * sizeof(uidata) );
-  // Vertex stride: float4 position (16 bytes) + float2 texcoord (8 bytes) = 24 bytes
-  state->vbuffer_gpu = rbuffer_dynamic_init( memory, BUFF_VERTS, state->vbuffer_cpu.buffer, sizeof(vertex1), state->vbuffer_cpu.length);
-  state->ebuffer_gpu = rbuffer_dynamic_init( memory, BUFF_ELEMS, state->ebuffer_cpu.buffer, sizeof(u32), state->ebuffer_cpu.length);
-  state->tbuffer_gpu = text_gpu_init( memory, state->tbuffer_cpu.buffer, MAX_COUNT_TEXT );
-  state->uibuffer_gpu = rbuffer_dynamic_init( memory, BUFF_VERTS, state->uibuffer_cpu.buffer, sizeof(uidata), state->uibuffer_cpu.length);
+  // Begin render buffers. The CPU side arenas are mapped over them each frame.
+  state->vbuffer_gpu = rbuffer_dynamic_init( memory, BUFF_VERTS, nullptr, sizeof(vertex1), MAX_COUNT_VERTEX * sizeof(vertex1));
+  state->ebuffer_gpu = rbuffer_dynamic_init( memory, BUFF_ELEMS, nullptr, sizeof(u32), MAX_COUNT_VERTEX * sizeof(u32));
+  state->tbuffer_gpu = text_gpu_init( memory, nullptr, MAX_COUNT_TEXT );
+  state->uibuffer_gpu = rbuffer_ring_init( memory, BUFF_VERTS, sizeof(uidata), MAX_COUNT_VERTEX * sizeof(uidata));
   // Shaders
   shader_load( SHADER_UI, VERTEX, "shaders/ui.hlsl", "VSMain", "vs_5_0");
   shader_load( SHADER_UI, PIXEL,  "shaders/ui.hlsl", "PSMain", "ps_5_0");
@@ -184,6 +353,12 @@ arena app_init()
   shader_load( SHADER_PORTAL, VERTEX, "shaders/portal.hlsl", "VSMain", "vs_5_0");
   shader_load( SHADER_PORTAL, PIXEL,  "shaders/portal.hlsl", "PSMain", "ps_5_0");
   rbuffer_vertex_describe(SHADER_PORTAL, VERTEX_WORLD);
+  shader_load( SHADER_INSTANCED, VERTEX, "shaders/instanced.hlsl", "VSMain", "vs_5_0");
+  shader_load( SHADER_INSTANCED, PIXEL,  "shaders/instanced.hlsl", "PSMain", "ps_5_0");
+  rbuffer_vertex_describe(SHADER_INSTANCED, VERTEX_WORLD_INSTANCED);
+  shader_load( SHADER_QUANTIZED, VERTEX, "shaders/game.hlsl", "VSMain", "vs_5_0");
+  shader_load( SHADER_QUANTIZED, PIXEL,  "shaders/game.hlsl", "PSMain", "ps_5_0");
+  rbuffer_vertex_describe(SHADER_QUANTIZED, VERTEX_WORLD_QUANTIZED);
   shader_load( SHADER_TEXT, VERTEX, "shaders/text.hlsl", "VSMain", "vs_5_0");
   shader_load( SHADER_TEXT, PIXEL,  "shaders/text.hlsl", "PSMain", "ps_5_0");
   rbuffer_vertex_describe(SHADER_TEXT, VERTEX_WORLD);
@@ -192,6 +367,25 @@ arena app_init()
   state->cam_game_gpu = rbuffer_dynamic_init( memory, BUFF_CONST, nullptr, 0, sizeof(camera) );
   // Transform
   state->world_gpu = rbuffer_dynamic_init( memory, BUFF_CONST, nullptr, 0, sizeof(glm::mat4) );
+  // Per object transforms for the whole frame, one 256 byte constant range each
+  state->objects_gpu = rbuffer_dynamic_init( memory, BUFF_CONST, nullptr, 0, MAX_COUNT_ENTITIES * RENDER_CONSTANT_ALIGN );
+  // Instanced entities, their transforms are vertex data in slot 1
+  state->instance_capacity = MAX_COUNT_INSTANCES;
+  state->instances_gpu = rbuffer_dynamic_init( memory, BUFF_VERTS, nullptr, sizeof(glm::mat4), MAX_COUNT_INSTANCES * sizeof(glm::mat4) );
+  state->entity_memory = subarena_init( memory, Megabytes(64) );
+  arena_tag( &state->entity_memory, "entities" );
+  entities_grow( &state->entity, &state->entity_memory );
+  // Low resolution depth for occlusion culling
+  state->occlusion = occlusion_init( memory, 256, 128, MAX_COUNT_OCCLUDER_TRIS );
+  // Built once here, the frame's copy is in write only GPU memory
+  state->occluder_vbuffer = subarena_init( memory, MAX_COUNT_VERTEX * sizeof(vertex1) );
+  state->occluder_ebuffer = subarena_init( memory, MAX_COUNT_VERTEX * sizeof(u32) );
+  state->portal_occluder = primitive_box3d( &state->occluder_vbuffer, &state->occluder_ebuffer );
+  state->pyramid_tree = pick_tree_build( memory );
+  crate_build( memory );
+  // Draw commands
+  state->commands = render_commands_init( memory, MAX_COUNT_ENTITIES );
+  state->backend  = render_backend_native();
   // Floor texture
   texture *floor = texture2d_read( "assets/stadium.bmp", memory );
   texture_bind(floor, 0);
@@ -204,6 +398,11 @@ arena app_init()
   state->timer = platform_clock_init(60.0f);
   platform_window_show();
   platform_clock_reset(&state->timer);
+  // Paced by the CPU instead of blocking on vsync in Present
+  render_vsync(0);
+  state->pacer = frame_pacer_init(&state->timer);
+  sim_state initial = {};
+  state->sim = fixed_step_init(memory, SIM_TICK_RATE, &initial, sizeof(initial), sim_tick, sim_render, state);
   return app_memory;
 }
 
@@ -212,6 +411,8 @@ void app_update(arena *a)
 {
   // Tick
   platform_clock_update(&state->timer);
+  profile_frame();
+  PROFILE_BEGIN("input");
   // Reset input from last frame...
   input_reset(state->inputs);
   // Read all platform messages for this frame
@@ -220,15 +421,26 @@ void app_update(arena *a)
   platform_cursor_client_position( &cursor.x, &cursor.y, state->window.width, state->window.height);
   if (state->inputs[KEY_ESCAPE] == INPUT_DOWN)
   {
+    profile_trace_write("profile_trace.json");
     platform_window_close();
   }
-  // Reset buffers
-  arena_free_all( &state->vbuffer_cpu );
-  arena_free_all( &state->ebuffer_cpu );
-  arena_free_all( &state->tbuffer_cpu );
-  arena_free_all( &state->uibuffer_cpu );
+  PROFILE_END();
+  // Map this frame's buffers so geometry is written straight into GPU memory
+  state->vbuffer_cpu  = rbuffer_map( state->vbuffer_gpu );
+  state->ebuffer_cpu  = rbuffer_map( state->ebuffer_gpu );
+  state->tbuffer_cpu  = rbuffer_map( state->tbuffer_gpu );
+  state->objects_cpu  = rbuffer_map( state->objects_gpu );
+  arena_tag( &state->vbuffer_cpu, "vbuffer" );
+  arena_tag( &state->ebuffer_cpu, "ebuffer" );
+  arena_tag( &state->tbuffer_cpu, "tbuffer" );
+  arena_tag( &state->objects_cpu, "objects" );
+  render_commands_reset( &state->commands );
   // Reset entity count
   state->entity.total = 0;
+  PROFILE_BEGIN("simulate");
+  fixed_step_frame(&state->sim, state->timer.delta);
+  PROFILE_END();
+  PROFILE_BEGIN("update");
   // Game logic
   f32 aspect = (f32)state->window.width / (f32)state->window.height;
   f32 half_height = 0.5f * state->window.height;
@@ -242,10 +454,27 @@ void app_update(arena *a)
   glm::vec3 test_pos2 = glm::vec3( -half_width, half_height-200.f, 0.0f);
   glm::vec3 test_pos3 = glm::vec3( -half_width, half_height-300.f, 0.0f);
   glm::vec3 test_pos4 = glm::vec3( -half_width, half_height-400.f, 0.0f);
+  glm::vec3 test_pos5 = glm::vec3( -half_width, half_height-500.f, 0.0f);
   f32 text_scale = 1.0f; // 2.0f / state->window.height; // NDC
   const char *string = "Title";
   u64 str_length = string_length(string);
   text_add( &state->tbuffer_cpu, string, str_length, state->window.height, test_pos1, 1.00f, {1.0f, 1.0f, 1.0f, 1.0f}, text_scale);
+  profile_overlay( &state->tbuffer_cpu, state->window.height, test_pos2, 0.25f, text_scale);
+  frame_pacer_stats pacing = frame_pacer_stats_get(&state->pacer);
+  char pacing_text[96];
+  i32 pacing_length = snprintf(pacing_text, sizeof(pacing_text), "pacing %.2f ms  jitter %.3f ms  p99 %.2f ms  missed %u",
+                               pacing.mean_ms, pacing.jitter_ms, pacing.p99_ms, pacing.missed);
+  text_add( &state->tbuffer_cpu, pacing_text, pacing_length, state->window.height, test_pos3, 0.25f, {1.0f, 1.0f, 0.0f, 1.0f}, text_scale);
+  // State calls the backend made and the ones its cache dropped as redundant, last frame
+  render_stats binds = render_stats_last();
+  char binds_text[96];
+  i32 binds_length = snprintf(binds_text, sizeof(binds_text), "state calls %u  skipped %u  (shaders %u/%u  constants %u/%u)",
+                              binds.issued, binds.skipped,
+                              binds.issued_by_state[RSTATE_VS_SHADER] + binds.issued_by_state[RSTATE_PS_SHADER],
+                              binds.skipped_by_state[RSTATE_VS_SHADER] + binds.skipped_by_state[RSTATE_PS_SHADER],
+                              binds.issued_by_state[RSTATE_VS_CONSTANTS] + binds.issued_by_state[RSTATE_PS_CONSTANTS],
+                              binds.skipped_by_state[RSTATE_VS_CONSTANTS] + binds.skipped_by_state[RSTATE_PS_CONSTANTS]);
+  text_add( &state->tbuffer_cpu, binds_text, binds_length, state->window.height, test_pos4, 0.25f, {1.0f, 1.0f, 0.0f, 1.0f}, text_scale);
   // Set the UI camera
   camera uicam = {};
   uicam.view = identity;
@@ -256,79 +485,132 @@ void app_update(arena *a)
   game_cam.pos = glm::vec3(  0.0f, 0.0f, -6.0f);
   game_cam.view = glm::lookAt(game_cam.pos, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
   game_cam.proj = glm::perspective( 45.0f, aspect, 0.1f, 100.0f);
-  // Phase accumulation for shader animation (wraps at 2π to avoid precision loss)
-  constexpr f32 TWO_PI = 6.28318530718f;
-  static f32 wave_phase = 0.0f;
-  wave_phase += state->timer.delta;
-  if (wave_phase > TWO_PI) {
-    wave_phase -= TWO_PI;
-  }
-  game_cam.delta_time = wave_phase;
+  // Phase for shader animation
+  game_cam.delta_time = state->view.wave_phase;
   render_constant_set( state->cam_game_gpu, 0 );
   rbuffer_update( state->cam_game_gpu, &game_cam, sizeof(game_cam) );
   // Update world transform
   render_constant_set(state->world_gpu, 1);
-  static f32 theta = 0.0f;
-  f32 theta_velocity =  PI/2.0f;
-  theta += theta_velocity * state->timer.delta; // rad += (rad/s)*s
-  // wrap theta so it doesn't explode
-  if (theta > 2.0*PI) theta -= 2.0*PI;
-  glm::vec3 rotation_axis = glm::vec3(0.0f, 1.0f, 0.0f); // Y-axis
-  glm::mat4 pyramid_world = identity;
-  pyramid_world = glm::rotate(identity, theta, rotation_axis) * pyramid_world;
-  pyramid_world = glm::rotate(identity, PI, glm::vec3(1.0f, 0.0f, 0.0f) ) * pyramid_world;
+  f32 theta = state->view.theta;
+  // Spin around Y, then flip upside down
+  quat spin = quat_from_axis_angle(fvec3_init(0.0f, 1.0f, 0.0f), theta);
+  quat flip = quat_from_axis_angle(fvec3_init(1.0f, 0.0f, 0.0f), PI);
+  glm::mat4 pyramid_world;
+  quat_to_fmat4(*(fmat4*)&pyramid_world, quat_mul(flip, spin));
   // Translate the pyramid in a circle (XZ)
   f32 radius = 5.0f;
   f32 angle = -theta;
-  glm::vec2 position = glm::vec2(0.0f);
-  position.x = radius * sinf(angle);
-  position.y = radius * cosf(angle);
-  pyramid_world =  glm::translate(identity, glm::vec3(position.x, 1.0f, position.y)) * pyramid_world;
+  pyramid_world[3] = glm::vec4(radius * sinf(angle), 1.0f, radius * cosf(angle), 1.0f);
+  // Pyramid face under the cursor
+  u32 picked = pick_pyramid( cursor, game_cam.proj * game_cam.view, pyramid_world );
+  char pick_text[64];
+  i32 pick_length = (picked == BVH_EMPTY) ? snprintf(pick_text, sizeof(pick_text), "cursor over nothing")
+                                          : snprintf(pick_text, sizeof(pick_text), "cursor over pyramid triangle %u", picked);
+  text_add( &state->tbuffer_cpu, pick_text, pick_length, state->window.height, test_pos5, 0.25f, {1.0f, 1.0f, 0.0f, 1.0f}, text_scale);
   // Portal position
   glm::mat4 portal_world = identity;
   portal_world *= glm::scale(identity, glm::vec3(1.0f, 2.0f, 1.0f));
   // portal_world *= glm::rotate(identity, theta, rotation_axis);
   // portal_world *= glm::translate(identity, glm::vec3(0.0f, 1.1f, 0.0f));
+  // Crate beside the portal, the bounds matrix comes first to take its positions out of [0, 1]
+  glm::mat4 crate_world = glm::translate(identity, glm::vec3(-3.0f, 0.5f, 0.0f)) * glm::scale(identity, glm::vec3(0.5f));
+  glm::mat4 crate_unpack;
+  quantize_bounds_matrix( *(fmat4*)&crate_unpack, state->crate_bounds );
+  crate_world = crate_world * crate_unpack;
   // Ground plane
   glm::mat4 grid_world = identity;  // Ground plane already in XZ, no transform needed
   // Add UI elements
-  uidata *test = arena_push_struct(&state->uibuffer_cpu, uidata);
-  test->col = glm::vec4(1.0f, 0.0f, 1.0f, 1.0f);
-  test->world = glm::translate(identity, glm::vec3(-half_width+50.0f+5.0f, half_height-50.0f-5.0f, 0.0f)) * glm::scale(identity, glm::vec3(50.0f));
-  // Update vertex and element buffers
-  rbuffer_update( state->vbuffer_gpu, state->vbuffer_cpu.buffer, state->vbuffer_cpu.offset_new );
-  rbuffer_update( state->ebuffer_gpu, state->ebuffer_cpu.buffer, state->ebuffer_cpu.offset_new );
-  rbuffer_update( state->tbuffer_gpu, state->tbuffer_cpu.buffer, state->tbuffer_cpu.offset_new );
-  rbuffer_update( state->uibuffer_gpu, state->uibuffer_cpu.buffer, state->uibuffer_cpu.offset_new );
+  uidata test = {};
+  test.col = glm::vec4(1.0f, 0.0f, 1.0f, 1.0f);
+  test.world = glm::translate(identity, glm::vec3(-half_width+50.0f+5.0f, half_height-50.0f-5.0f, 0.0f)) * glm::scale(identity, glm::vec3(50.0f));
+  // Only the bytes written go up, into space the GPU is done with. Skipped if the ring is full.
+  u32 ui_offset = 0;
+  bool ui_pushed = rbuffer_ring_push( state->uibuffer_gpu, &test, sizeof(test), &ui_offset );
+  // Per object transforms, bound by offset at draw time. An object that doesn't fit isn't drawn.
+  u32 grid_constants = 0, pyramid_constants = 0, portal_constants = 0, crate_constants = 0;
+  bool grid_pushed    = rbuffer_constant_push( &state->objects_cpu, &grid_world, sizeof(grid_world), &grid_constants );
+  bool pyramid_pushed = rbuffer_constant_push( &state->objects_cpu, &pyramid_world, sizeof(pyramid_world), &pyramid_constants );
+  bool portal_pushed  = rbuffer_constant_push( &state->objects_cpu, &portal_world, sizeof(portal_world), &portal_constants );
+  bool crate_pushed   = rbuffer_constant_push( &state->objects_cpu, &crate_world, sizeof(crate_world), &crate_constants );
+  // Entities drawn as one instanced draw per mesh and shader
+  cull_bounds pyramid_bounds = { fvec3_init(-1.0f, -1.0f, -1.0f), fvec3_init(1.0f, 1.0f, 1.0f) };
+  entity_load( player, pyramid_world, SHADER_INSTANCED, pyramid_bounds );
+  PROFILE_END();
+  PROFILE_BEGIN("cull");
+  // Only the entities inside the game camera's frustum get drawn
+  glm::mat4 view_proj = game_cam.proj * game_cam.view;
+  cull_frustum frustum = cull_frustum_from_matrix( *(fmat4*)&view_proj );
+  state->entity.visible_count = frustum_cull( frustum, state->entity.bounds, (fmat4*)state->entity.world_transforms, state->entity.total, state->entity.visible, &state->scratch );
+  // and aren't hidden behind the portal
+  occlusion_clear( &state->occlusion );
+  glm::mat4 portal_mvp = view_proj * portal_world;
+  occlusion_add_occluder( &state->occlusion, *(fmat4*)&portal_mvp, state->portal_occluder, (vertex1*)state->occluder_vbuffer.buffer, (u32*)state->occluder_ebuffer.buffer );
+  occlusion_rasterize( &state->occlusion, &state->scratch );
+  state->entity.visible_count = occlusion_cull( &state->occlusion, *(fmat4*)&view_proj, state->entity.bounds, (fmat4*)state->entity.world_transforms, state->entity.visible, state->entity.visible_count, &state->scratch );
+  render_instances_source instanced = {};
+  instanced.count      = state->entity.visible_count;
+  instanced.indices    = state->entity.visible;
+  instanced.vert_start = state->entity.vert_start;
+  instanced.elem_start = state->entity.elem_start;
+  instanced.elem_count = state->entity.elem_count;
+  instanced.shader     = state->entity.shader;
+  instanced.transforms = (fmat4*)state->entity.world_transforms;
+  PROFILE_END();
+  PROFILE_BEGIN("render");
+  // Mapped once the entity count is known, every entity gets an instance slot
+  if (state->entity.capacity > state->instance_capacity)
+  {
+    rbuffer_close( state->instances_gpu );
+    state->instance_capacity = state->entity.capacity;
+    state->instances_gpu = rbuffer_dynamic_init( a, BUFF_VERTS, nullptr, sizeof(glm::mat4), (u32)(state->instance_capacity * sizeof(glm::mat4)) );
+  }
+  state->instances_cpu = rbuffer_map( state->instances_gpu );
+  arena_tag( &state->instances_cpu, "instances" );
+  render_commands_instanced( &state->commands, instanced, state->vbuffer_gpu, state->ebuffer_gpu, state->instances_gpu, &state->instances_cpu, &state->scratch );
+  // Done writing geometry, the buffers have to be unmapped before drawing
+  rbuffer_unmap( state->instances_gpu );
+  rbuffer_unmap( state->objects_gpu );
+  rbuffer_unmap( state->vbuffer_gpu );
+  rbuffer_unmap( state->ebuffer_gpu );
+  rbuffer_unmap( state->tbuffer_gpu );
   render_constant_set(state->world_gpu, 2);
   // Begin frame rendering
   frame_init(frame_background.array);
-  // Set vertex buffer
-  rbuffer_vertex_set( 0, state->vbuffer_gpu );
-  // Set index buffer
-  rbuffer_index_set( state->ebuffer_gpu );
+  // Queue geometry, sorted and submitted below
+  render_command *cmd = nullptr;
+  // cmd = render_commands_draw_elems( &state->commands, render_key(0, SHADER_GRID, 0, 0.0f), SHADER_GRID, state->vbuffer_gpu, state->ebuffer_gpu, grid.count, grid.elem_start, grid.vert_start );
+  // render_command_constant_range( cmd, state->objects_gpu, 1, grid_constants, sizeof(grid_world) );
+  // cmd = render_commands_draw_elems( &state->commands, render_key(0, SHADER_GEOMETRY, 0, 0.0f), SHADER_GEOMETRY, state->vbuffer_gpu, state->ebuffer_gpu, player.count, player.elem_start, player.vert_start );
+  // render_command_constant_range( cmd, state->objects_gpu, 1, pyramid_constants, sizeof(pyramid_world) );
+  if (portal_pushed)
+  {
+    cmd = render_commands_draw_elems( &state->commands, render_key(0, SHADER_PORTAL, 0, 0.0f), SHADER_PORTAL, state->vbuffer_gpu, state->ebuffer_gpu, portal.count, portal.elem_start, portal.vert_start );
+    render_command_constant_range( cmd, state->objects_gpu, 1, portal_constants, sizeof(portal_world) );
+  }
+  if (crate_pushed)
+  {
+    cmd = render_commands_draw_elems( &state->commands, render_key(0, SHADER_QUANTIZED, 0, 0.0f), SHADER_QUANTIZED, state->crate_vbuffer_gpu, state->crate_ebuffer_gpu, state->crate.count, state->crate.elem_start, state->crate.vert_start );
+    render_command_constant_range( cmd, state->objects_gpu, 1, crate_constants, sizeof(crate_world) );
+  }
   // Draw geometry
-  shader_set( SHADER_GRID );
-  rbuffer_update( state->world_gpu, &grid_world, sizeof(grid_world) );
-  // render_draw_elems( grid.count, grid.elem_start, grid.vert_start );
-  shader_set( SHADER_GEOMETRY );
-  rbuffer_update( state->world_gpu, &pyramid_world, sizeof(pyramid_world) );
-  // render_draw_elems( player.count, player.elem_start, player.vert_start );
-  shader_set( SHADER_PORTAL );
-  rbuffer_update( state->world_gpu, &portal_world, sizeof(portal_world) );
-  render_draw_elems( portal.count, portal.elem_start, portal.vert_start );
+  render_commands_submit( &state->commands, &state->backend, &state->scratch );
   // Draw UI
   rbuffer_vertex_set( 0, state->uibuffer_gpu );
   render_constant_set( state->cam_ui_gpu, 0 );
   rbuffer_update( state->cam_ui_gpu, &uicam, sizeof(uicam) );
   shader_set( SHADER_UI );
-  // render_draw_instances(6, 1);
+  // The quad's instance data is wherever the ring put it this frame, offsets are stride aligned.
+  if (ui_pushed) render_draw_instances( 6, 1, ui_offset / sizeof(uidata) );
   // Draw text
   rbuffer_vertex_set( 0, state->tbuffer_gpu );
   render_constant_set( state->world_gpu, 0 );
   rbuffer_update( state->world_gpu, &uicam.proj, sizeof(uicam.proj) );
   shader_set( SHADER_TEXT );
   u32 text_vert_count = text_vertex_count(&state->tbuffer_cpu);
-  // render_draw_ui(text_vert_count);
+  render_draw_ui(text_vert_count);
   frame_render();
+  PROFILE_END();
+  PROFILE_BEGIN("pace");
+  frame_pacer_wait(&state->pacer);
+  PROFILE_END();
 }
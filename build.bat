@@ -14,7 +14,7 @@ pushd "src"
 
 set assembly=main
 set app_src_dir=..\apps
-set app_flags=-D_D3D -D_DEBUG
+set app_flags=-D_D3D -D_DEBUG -DARENA_TELEMETRY=1
 set compiler_flags=-g -std=c++20 -Wvarargs -Wall -Werror -Wno-unused-function -Wno-unused-variable -Wno-unused-but-set-variable -Wno-deprecated
 set includes=-I. -I..\external -I%app_src_dir%
 set linker_flags=-luser32 -lgdi32 -lwinmm -ld3d11 -ldxgi -lopengl32 -ld3dcompiler
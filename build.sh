@@ -0,0 +1,37 @@
+#!/bin/sh
+# Build script for the headless apps (benchmarks and tools) on Linux.
+# Usage: ./build.sh [app]   Ex. apps/file.cpp -> ./build.sh file
+set -e
+
+# Build directory
+outdir="$(pwd)/bin"
+mkdir -p "$outdir"
+
+# What are you building? Ex. apps/file.cpp -> app2build=file
+app2build=${1:-micro_bench}
+
+# Go into source code directory
+cd src
+
+assembly=$app2build
+app_src_dir=../apps
+# Optimized and without _DEBUG, the apps built here are timed.
+app_flags="-O2 -march=native"
+compiler_flags="-g -std=c++20 -Wvarargs -Wall -Werror -Wno-unused-function -Wno-unused-variable -Wno-unused-but-set-variable -Wno-deprecated"
+includes="-I. -I../external -I$app_src_dir"
+linker_flags="-lpthread -ldl -lm"
+
+# Build application
+echo "$assembly compiling..."
+
+${CXX:-clang++} \
+$compiler_flags \
+$app_flags \
+$CXXFLAGS \
+main.cpp core.cpp linalg.cpp platform_linux.cpp $app_src_dir/$app2build.cpp \
+-o \
+"$outdir/$assembly" \
+$includes \
+$linker_flags
+
+echo "Building $assembly complete"
@@ -0,0 +1,319 @@
+#include "core.h"
+#include "linalg.h"
+
+#include <stdlib.h>
+
+// Broad-phase collision: find the pairs of objects whose AABBs overlap.
+// Boxes live in SoA arrays indexed by object id. Two interchangeable pair finders:
+//
+// Sort and sweep keeps the ids ordered by their min on one axis between frames. Objects move
+// little per frame so the insertion sort that restores the order is close to linear, then a sweep
+// only compares boxes whose intervals on that axis overlap. The axis is the one the box centers
+// spread along the most, so the fewest intervals overlap. It is re-picked every sweep, and the ids
+// are sorted from scratch when it changes.
+//
+// The spatial hash drops every box into the uniform grid cells it touches and compares the
+// boxes sharing a cell. A pair is reported only from the cell holding the min corner of the
+// two boxes' intersection, so boxes sharing several cells are reported once. Best when the
+// boxes are about the cell size and evenly dense.
+
+#define BROADPHASE_HASH_X 73856093u
+#define BROADPHASE_HASH_Y 19349663u
+#define BROADPHASE_HASH_Z 83492791u
+#define BROADPHASE_AXIS_SWITCH 1.5   // Another axis must spread this much more before re-sorting on it.
+
+
+struct broadphase_pair
+{
+  u32 a;  // a < b.
+  u32 b;
+};
+
+
+struct broadphase_sort_key
+{
+  f32 key;
+  u32 id;
+};
+
+
+struct broadphase
+{
+  u32  count;
+  u32  capacity;
+  f32 *min_x;
+  f32 *min_y;
+  f32 *min_z;
+  f32 *max_x;
+  f32 *max_y;
+  f32 *max_z;
+  // Sort and sweep.
+  u32  axis;      // 0, 1, 2 for x, y, z.
+  bool sorted;    // order is sorted on axis, false until the first sweep.
+  u32 *order;     // Ids by min on axis, kept between frames.
+  f32 *sweep[6];  // min, max on axis then on the other two, gathered in order for the sweep.
+  broadphase_sort_key *keys;  // For sorting from scratch when the axis changes.
+  // Spatial hash.
+  f32  cell_size;
+};
+
+
+struct broadphase_cell_entry
+{
+  i32 cell[3];
+  u32 id;
+};
+
+
+broadphase broadphase_init(arena *a, u32 capacity, f32 cell_size)
+{
+  broadphase bp = {};
+  bp.capacity = capacity;
+  bp.cell_size = cell_size;
+  bp.min_x = arena_push_array(a, capacity, f32);
+  bp.min_y = arena_push_array(a, capacity, f32);
+  bp.min_z = arena_push_array(a, capacity, f32);
+  bp.max_x = arena_push_array(a, capacity, f32);
+  bp.max_y = arena_push_array(a, capacity, f32);
+  bp.max_z = arena_push_array(a, capacity, f32);
+  bp.order = arena_push_array(a, capacity, u32);
+  bp.keys = arena_push_array(a, capacity, broadphase_sort_key);
+  for (u32 k = 0; k < 6; ++k)
+  {
+    bp.sweep[k] = arena_push_array(a, capacity, f32);
+  }
+  return bp;
+}
+
+
+void broadphase_update(broadphase *bp, u32 id, fvec3 min, fvec3 max)
+{
+  bp->min_x[id] = min.x;
+  bp->min_y[id] = min.y;
+  bp->min_z[id] = min.z;
+  bp->max_x[id] = max.x;
+  bp->max_y[id] = max.y;
+  bp->max_z[id] = max.z;
+}
+
+
+/// @brief Add a box, returns its id.
+u32 broadphase_add(broadphase *bp, fvec3 min, fvec3 max)
+{
+  ASSERT(bp->count < bp->capacity, "Broad-phase is full.");
+  u32 id = bp->count++;
+  broadphase_update(bp, id, min, max);
+  bp->order[id] = id;
+  return id;
+}
+
+
+internal u32 broadphase_pair_push(broadphase_pair *pairs, u32 max_pairs, u32 found, u32 a, u32 b)
+{
+  if (found < max_pairs)
+  {
+    pairs[found].a = (a < b) ? a : b;
+    pairs[found].b = (a < b) ? b : a;
+  }
+  return found + 1;
+}
+
+
+internal int broadphase_sort_key_compare(const void *a, const void *b)
+{
+  f32 ka = ((broadphase_sort_key*)a)->key;
+  f32 kb = ((broadphase_sort_key*)b)->key;
+  return (ka > kb) - (ka < kb);
+}
+
+
+// The axis the box centers vary the most along. Sticks with current unless another spreads margin times more.
+internal u32 broadphase_sweep_axis(broadphase *bp, u32 current, f64 margin)
+{
+  f32 *mins[3] = { bp->min_x, bp->min_y, bp->min_z };
+  f32 *maxs[3] = { bp->max_x, bp->max_y, bp->max_z };
+  f64 variance[3] = {};
+  for (u32 k = 0; k < 3; ++k)
+  {
+    // Twice the center, the scale doesn't change which axis wins.
+    f64 sum = 0.0, sum_sq = 0.0;
+    for (u32 id = 0; id < bp->count; ++id)
+    {
+      f64 c = (f64)mins[k][id] + (f64)maxs[k][id];
+      sum += c;
+      sum_sq += c * c;
+    }
+    f64 mean = sum / bp->count;
+    variance[k] = sum_sq / bp->count - mean * mean;
+  }
+  u32 best = current;
+  for (u32 k = 0; k < 3; ++k)
+  {
+    if (variance[k] > variance[best] * margin) best = k;
+  }
+  return best;
+}
+
+
+/// @brief Overlapping pairs by sort and sweep. Writes up to max_pairs, returns how many overlap.
+u32 broadphase_sweep(broadphase *bp, broadphase_pair *pairs, u32 max_pairs)
+{
+  if (bp->count == 0) return 0;
+  f32 *mins[3] = { bp->min_x, bp->min_y, bp->min_z };
+  f32 *maxs[3] = { bp->max_x, bp->max_y, bp->max_z };
+  u32 *order = bp->order;
+  u32 axis = broadphase_sweep_axis(bp, bp->axis, bp->sorted ? BROADPHASE_AXIS_SWITCH : 1.0);
+  if (!bp->sorted || axis != bp->axis)
+  {
+    // The old order says nothing about the new axis, insertion sort would be quadratic.
+    for (u32 i = 0; i < bp->count; ++i)
+    {
+      bp->keys[i].key = mins[axis][order[i]];
+      bp->keys[i].id = order[i];
+    }
+    qsort(bp->keys, bp->count, sizeof(broadphase_sort_key), broadphase_sort_key_compare);
+    for (u32 i = 0; i < bp->count; ++i)
+    {
+      order[i] = bp->keys[i].id;
+    }
+    bp->axis = axis;
+    bp->sorted = true;
+  }
+  // Restore the order, nearly sorted after a frame of small movements.
+  f32 *lo = mins[axis];
+  for (u32 i = 1; i < bp->count; ++i)
+  {
+    u32 id = order[i];
+    f32 key = lo[id];
+    u32 j = i;
+    while (j > 0 && lo[order[j - 1]] > key)
+    {
+      order[j] = order[j - 1];
+      --j;
+    }
+    order[j] = id;
+  }
+  // Gather in sweep order so the inner loop reads contiguous memory.
+  u32 u = (axis + 1) % 3;
+  u32 v = (axis + 2) % 3;
+  f32 *s0 = bp->sweep[0], *s1 = bp->sweep[1];
+  f32 *su0 = bp->sweep[2], *su1 = bp->sweep[3];
+  f32 *sv0 = bp->sweep[4], *sv1 = bp->sweep[5];
+  for (u32 i = 0; i < bp->count; ++i)
+  {
+    u32 id = order[i];
+    s0[i] = mins[axis][id];
+    s1[i] = maxs[axis][id];
+    su0[i] = mins[u][id];
+    su1[i] = maxs[u][id];
+    sv0[i] = mins[v][id];
+    sv1[i] = maxs[v][id];
+  }
+  u32 found = 0;
+  for (u32 i = 0; i < bp->count; ++i)
+  {
+    f32 end = s1[i];
+    for (u32 j = i + 1; j < bp->count && s0[j] <= end; ++j)
+    {
+      bool overlap = (su0[j] <= su1[i]) && (su1[j] >= su0[i]) && (sv0[j] <= sv1[i]) && (sv1[j] >= sv0[i]);
+      if (overlap)
+      {
+        found = broadphase_pair_push(pairs, max_pairs, found, order[i], order[j]);
+      }
+    }
+  }
+  return found;
+}
+
+
+internal i32 broadphase_cell(f32 v, f32 inv_cell)
+{
+  return (i32)floorf(v * inv_cell);
+}
+
+
+/// @brief Overlapping pairs by spatial hashing. Writes up to max_pairs, returns how many overlap.
+u32 broadphase_hash(broadphase *bp, broadphase_pair *pairs, u32 max_pairs, arena *scratch)
+{
+  if (bp->count == 0) return 0;
+  arena_savepoint save = arena_save(scratch);
+  f32 inv_cell = 1.0f / bp->cell_size;
+  // Count the cells every box touches.
+  u32 entry_count = 0;
+  for (u32 id = 0; id < bp->count; ++id)
+  {
+    u32 nx = broadphase_cell(bp->max_x[id], inv_cell) - broadphase_cell(bp->min_x[id], inv_cell) + 1;
+    u32 ny = broadphase_cell(bp->max_y[id], inv_cell) - broadphase_cell(bp->min_y[id], inv_cell) + 1;
+    u32 nz = broadphase_cell(bp->max_z[id], inv_cell) - broadphase_cell(bp->min_z[id], inv_cell) + 1;
+    entry_count += nx * ny * nz;
+  }
+  u32 table_size = 16;
+  while (table_size < entry_count * 2) table_size <<= 1;
+  u32 *bucket_start = arena_push_array(scratch, (table_size + 1), u32);
+  u32 *entry_bucket = arena_push_array(scratch, entry_count, u32);
+  broadphase_cell_entry *unsorted = arena_push_array(scratch, entry_count, broadphase_cell_entry);
+  broadphase_cell_entry *entries = arena_push_array(scratch, entry_count, broadphase_cell_entry);
+  u32 e = 0;
+  for (u32 id = 0; id < bp->count; ++id)
+  {
+    i32 x0 = broadphase_cell(bp->min_x[id], inv_cell), x1 = broadphase_cell(bp->max_x[id], inv_cell);
+    i32 y0 = broadphase_cell(bp->min_y[id], inv_cell), y1 = broadphase_cell(bp->max_y[id], inv_cell);
+    i32 z0 = broadphase_cell(bp->min_z[id], inv_cell), z1 = broadphase_cell(bp->max_z[id], inv_cell);
+    for (i32 z = z0; z <= z1; ++z)
+    {
+      for (i32 y = y0; y <= y1; ++y)
+      {
+        for (i32 x = x0; x <= x1; ++x)
+        {
+          u32 h = ((u32)x * BROADPHASE_HASH_X) ^ ((u32)y * BROADPHASE_HASH_Y) ^ ((u32)z * BROADPHASE_HASH_Z);
+          u32 bucket = h & (table_size - 1);
+          unsorted[e] = { { x, y, z }, id };
+          entry_bucket[e] = bucket;
+          bucket_start[bucket + 1]++;
+          ++e;
+        }
+      }
+    }
+  }
+  // Counting sort by bucket.
+  for (u32 b = 0; b < table_size; ++b)
+  {
+    bucket_start[b + 1] += bucket_start[b];
+  }
+  u32 *cursor = arena_push_array(scratch, table_size, u32);
+  for (u32 i = 0; i < entry_count; ++i)
+  {
+    u32 b = entry_bucket[i];
+    entries[bucket_start[b] + cursor[b]++] = unsorted[i];
+  }
+  u32 found = 0;
+  for (u32 b = 0; b < table_size; ++b)
+  {
+    for (u32 i = bucket_start[b]; i < bucket_start[b + 1]; ++i)
+    {
+      broadphase_cell_entry *ei = &entries[i];
+      u32 a = ei->id;
+      for (u32 j = i + 1; j < bucket_start[b + 1]; ++j)
+      {
+        broadphase_cell_entry *ej = &entries[j];
+        // Different cells can share a bucket.
+        if (ei->cell[0] != ej->cell[0] || ei->cell[1] != ej->cell[1] || ei->cell[2] != ej->cell[2]) continue;
+        u32 c = ej->id;
+        bool overlap = (bp->min_x[a] <= bp->max_x[c]) && (bp->max_x[a] >= bp->min_x[c]) &&
+                       (bp->min_y[a] <= bp->max_y[c]) && (bp->max_y[a] >= bp->min_y[c]) &&
+                       (bp->min_z[a] <= bp->max_z[c]) && (bp->max_z[a] >= bp->min_z[c]);
+        if (!overlap) continue;
+        // Only the cell with the intersection's min corner reports the pair.
+        f32 ix = (bp->min_x[a] > bp->min_x[c]) ? bp->min_x[a] : bp->min_x[c];
+        f32 iy = (bp->min_y[a] > bp->min_y[c]) ? bp->min_y[a] : bp->min_y[c];
+        f32 iz = (bp->min_z[a] > bp->min_z[c]) ? bp->min_z[a] : bp->min_z[c];
+        if (broadphase_cell(ix, inv_cell) != ei->cell[0] ||
+            broadphase_cell(iy, inv_cell) != ei->cell[1] ||
+            broadphase_cell(iz, inv_cell) != ei->cell[2]) continue;
+        found = broadphase_pair_push(pairs, max_pairs, found, a, c);
+      }
+    }
+  }
+  arena_pop(save);
+  return found;
+}
@@ -54,6 +54,41 @@ string string_init(const char *array)
 
 #pragma region Memory handlers
 
+#if ARENA_TELEMETRY
+global arena_stats arena_tags[ARENA_MAX_TAGS];
+global u32 arena_tag_count;
+#endif
+
+
+internal void arena_stats_alloc(arena *a, size_t size)
+{
+#if ARENA_TELEMETRY
+  arena_stats *stats = a->stats;
+  if (!stats) return;
+  u32 bucket = 0;
+  while (bucket < ARENA_HISTOGRAM_BUCKETS - 1 && ((size_t)16 << bucket) < size) bucket++;
+  stats->histogram[bucket]++;
+  stats->alloc_count++;
+  stats->alloc_bytes += size;
+  stats->largest = (size > stats->largest) ? size : stats->largest;
+  stats->in_use = a->offset_new;
+  stats->high_water = (a->offset_new > stats->high_water) ? a->offset_new : stats->high_water;
+#endif
+}
+
+
+internal void arena_stats_reset(arena *a)
+{
+#if ARENA_TELEMETRY
+  if (!a->stats) return;
+  a->stats->in_use = a->offset_new;
+  // Only resets to empty make it a scratch arena. Persistent arenas pop back to their
+  // long lived data after temporary use, that data isn't a leak.
+  if (a->offset_new == 0) a->stats->reset_count++;
+#endif
+}
+
+
 arena arena_init(void *buffer, size_t size)
 {
   arena out = {};
@@ -79,6 +114,7 @@ void arena_pop(arena_savepoint point)
 {
   point.original->offset_old = point.offset_old;
   point.original->offset_new = point.offset_new;
+  arena_stats_reset(point.original);
 }
 
 
@@ -115,6 +151,7 @@ void *arena_alloc_align(arena *arena, size_t size, size_t align)
   arena->offset_new = offset+size;
   // Zero new memory by default
   memset((u8*)ptr, 0, size);
+  arena_stats_alloc(arena, size);
   return ptr;
 }
 
@@ -158,6 +195,7 @@ void arena_free_last(arena *a)
   i32 diff = a->offset_new - a->offset_old;
   memset((void*)ptr, 0, diff);
   a->offset_new = a->offset_old;
+  arena_stats_reset(a);
 }
 
 
@@ -165,6 +203,62 @@ void arena_free_all(arena *a)
 {
   a->offset_new = 0;
   a->offset_old = 0;
+  arena_stats_reset(a);
+}
+
+
+/// @brief Start counting a's allocations under tag. Arenas remapped every frame can be tagged every
+/// frame, the same tag keeps adding to the same stats. Does nothing without ARENA_TELEMETRY.
+void arena_tag(arena *a, const char *tag)
+{
+#if ARENA_TELEMETRY
+  arena_stats *stats = 0;
+  for (u32 i = 0; i < arena_tag_count; ++i)
+  {
+    if (strcmp(arena_tags[i].tag, tag) == 0) stats = &arena_tags[i];
+  }
+  if (!stats)
+  {
+    ASSERT(arena_tag_count < ARENA_MAX_TAGS, "ERROR: Too many arena tags.");
+    stats = &arena_tags[arena_tag_count++];
+    stats->tag = tag;
+  }
+  stats->capacity = (a->length > stats->capacity) ? a->length : stats->capacity;
+  stats->in_use = a->offset_new;
+  stats->high_water = (a->offset_new > stats->high_water) ? a->offset_new : stats->high_water;
+  a->stats = stats;
+#endif
+}
+
+
+/// @brief Print every tagged arena's peak and current use, allocation counts and size histogram.
+/// Arenas that get emptied during the run but still hold memory at shutdown are flagged as possible leaks.
+void arena_report(FILE *out)
+{
+#if ARENA_TELEMETRY
+  fprintf(out, "%-20s %12s %12s %7s %12s %10s %12s\n", "arena", "capacity KB", "peak KB", "peak %", "in use KB", "allocs", "largest KB");
+  for (u32 i = 0; i < arena_tag_count; ++i)
+  {
+    arena_stats *stats = &arena_tags[i];
+    f64 peak_percent = (stats->capacity) ? 100.0 * (f64)stats->high_water / (f64)stats->capacity : 0.0;
+    fprintf(out, "%-20s %12.1f %12.1f %6.1f%% %12.1f %10llu %12.1f\n", stats->tag,
+            stats->capacity / 1024.0, stats->high_water / 1024.0, peak_percent, stats->in_use / 1024.0,
+            stats->alloc_count, stats->largest / 1024.0);
+    fprintf(out, "  sizes:");
+    for (u32 bucket = 0; bucket < ARENA_HISTOGRAM_BUCKETS; ++bucket)
+    {
+      if (!stats->histogram[bucket]) continue;
+      const char *bound = (bucket < ARENA_HISTOGRAM_BUCKETS - 1) ? "<=" : ">";
+      u64 size = (bucket < ARENA_HISTOGRAM_BUCKETS - 1) ? (16ull << bucket) : (16ull << (bucket - 1));
+      fprintf(out, " %s%llu:%llu", bound, size, stats->histogram[bucket]);
+    }
+    fprintf(out, "\n");
+    if (stats->reset_count && stats->in_use)
+    {
+      fprintf(out, "  possible leak: %zu bytes still allocated after being emptied %llu times\n", stats->in_use, stats->reset_count);
+    }
+  }
+#endif
 }
 
 #pragma endregion
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 // Unsigned int types.
 typedef unsigned char u8;
@@ -26,6 +27,31 @@ typedef char bool8;
 
 // Our data types
 
+// Arena telemetry: arenas given a tag with arena_tag count their allocations and remember their
+// peak use, arena_report prints it all. Off by default, it adds a pointer to every arena.
+#ifndef ARENA_TELEMETRY
+#define ARENA_TELEMETRY 0
+#endif
+#define ARENA_MAX_TAGS          64
+#define ARENA_HISTOGRAM_BUCKETS 16
+
+
+/// @brief Usage of every arena that carries the same tag, kept for the whole run.
+typedef struct arena_stats arena_stats;
+struct arena_stats
+{
+  const char *tag;
+  size_t capacity;
+  size_t high_water;    // Largest offset ever reached, padding included.
+  size_t in_use;        // Offset after the last allocation or reset.
+  size_t largest;       // Largest single allocation.
+  u64 alloc_count;
+  u64 alloc_bytes;
+  u64 reset_count;      // Pops and frees back to empty, arenas reset like this should be empty at shutdown.
+  u64 histogram[ARENA_HISTOGRAM_BUCKETS];  // Bucket i counts sizes up to 16 << i bytes, the last one everything larger.
+};
+
+
 /// @brief An arena is a memory management data structure. It is a tool for working on a block of memory.
 typedef struct arena arena;
 struct arena 
@@ -34,6 +60,9 @@ struct arena
   size_t length;
   size_t offset_old;
   size_t offset_new;
+#if ARENA_TELEMETRY
+  arena_stats *stats;   // Null until tagged, copies of the arena share it.
+#endif
 };
 
 /// @brief A struct to save the current state of the arena so that you can reset to the saved locations.
@@ -178,6 +207,9 @@ void              arena_free_all(arena *a);
 
 arena             subarena_init( arena *parent, size_t byte_count );
 
+void              arena_tag(arena *a, const char *tag);
+void              arena_report(FILE *out);
+
 #if _DEBUG
   #define DEBUG(message) printf(message); fflush(stdout);
   #ifdef COMPILER_CLANG
@@ -1,31 +1,11 @@
-
+#include "data3d.h"
+#include "transform_batch.cpp"
 
 #define TINYOBJ_LOADER_C_IMPLEMENTATION
 #include "tinyobj_loader_c.h"
 
-
-// Application data types
-struct vertex
-{
-  fvec3 pos;
-};
-
-
-struct mesh
-{
-  vertex *vertices;
-  u32 *indices;
-  u32 vert_count;
-  u32 index_count;
-};
-
-
-struct voxel_grid
-{
-  u8 *contents;
-  fvec3 min;
-  fvec3 max;
-};
+// Defined by the OpenGL renderer.
+void shader_storage_init(u32 binding_index, void *data, size_t byte_count);
 
 
 internal mesh bbox_create(fvec3 min, fvec3 max, arena *vert_buffer, arena *elem_buffer)
@@ -309,26 +289,27 @@ void voxel_grid_init(arena *a, fvec3 counts)
   u32 row_elem_count = counts.x;
   u32 slice_elem_count = counts.x * counts.y;
   f32 cube_min = -1.0f;
-  glm::mat4 *modelmats = arena_push_array(a, cube_count, glm::mat4); 
-  // Create instance transforms
+  glm::mat4 *modelmats = arena_push_array(a, cube_count, glm::mat4);
+  // Voxel centers, no rotation, composed to translate * scale in one batch
+  transform_trs trs = transform_trs_init(a, cube_count);
   for (int k = 0; k < counts.z; k++)
   {
     for (int j = 0; j < counts.y; j++)
     {
       for (int i = 0; i < counts.x; i++)
       {
-        // Transformations are applied in reverse multiplication order.
-        glm::mat4 transform = glm::mat4(1.0f);
-        f32 pos_x = cube_min + (2*i + 1) * x_scale;  // voxel center x
-        f32 pos_y = cube_min + (2*j + 1) * y_scale;  // voxel center y
-        f32 pos_z = cube_min + (2*k + 1) * z_scale;  // voxel center z
-        transform = glm::translate(transform, glm::vec3(pos_x, pos_y, pos_z));
-        transform = glm::scale(transform, glm::vec3(x_scale, y_scale, z_scale));
-        u32 element = i + (j * row_elem_count) + (k * slice_elem_count); 
-        modelmats[element] = transform;
+        u32 element = i + (j * row_elem_count) + (k * slice_elem_count);
+        trs.tx[element] = cube_min + (2*i + 1) * x_scale;  // voxel center x
+        trs.ty[element] = cube_min + (2*j + 1) * y_scale;  // voxel center y
+        trs.tz[element] = cube_min + (2*k + 1) * z_scale;  // voxel center z
+        trs.qw[element] = 1.0f;
+        trs.sx[element] = x_scale;
+        trs.sy[element] = y_scale;
+        trs.sz[element] = z_scale;
       }
     }
   }
+  transform_batch_compose((fmat4*)modelmats, trs, cube_count);
   // Keep transforms in storage buffer
   size_t transform_buffer_size = cube_count * sizeof(glm::mat4);
   shader_storage_init(0, (void*)&modelmats[0], transform_buffer_size);
@@ -573,21 +554,21 @@ voxel_grid model_voxelize2(mesh model, u32 resolution, arena *vert_buffer, arena
 
     // determine bounding box in xz
     fvec2 vmin = fvec2_init(
-      min(v0.x, min(v1.x, v2.x)),
-      min(v0.z, min(v1.z, v2.z))
+      fminf(v0.x, fminf(v1.x, v2.x)),
+      fminf(v0.z, fminf(v1.z, v2.z))
     );
     fvec2 vmax = fvec2_init(
-      max(v0.x, max(v1.x, v2.x)),
-      max(v0.z, max(v1.z, v2.z))
+      fmaxf(v0.x, fmaxf(v1.x, v2.x)),
+      fmaxf(v0.z, fmaxf(v1.z, v2.z))
     );
     // derive bounding box of covered voxel columns
     ivec2 voxmin = ivec2_init(
-      max(0, i32(floor(vmin.x + 0.4999f))),
-      max(0, i32(floor(vmin.y + 0.4999f)))
+      i32(fmaxf(0.0f, floorf(vmin.x + 0.4999f))),
+      i32(fmaxf(0.0f, floorf(vmin.y + 0.4999f)))
     );
     ivec2 voxmax = ivec2_init(
-      min(i32(resolution), i32(floor(vmax.x + 0.5f))),
-      min(i32(resolution), i32(floor(vmax.y + 0.5f)))
+      i32(fminf(f32(resolution), floorf(vmax.x + 0.5f))),
+      i32(fminf(f32(resolution), floorf(vmax.y + 0.5f)))
     );
 
     // check if any voxel columns are covered at all
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "core.h"
+#include "linalg.h"
+#include "render_boundary.h"
+
+
+// Application data types
+struct vertex
+{
+  fvec3 pos;
+};
+
+
+struct mesh
+{
+  vertex *vertices;
+  u32 *indices;
+  u32 vert_count;
+  u32 index_count;
+};
+
+
+struct voxel_grid
+{
+  u8 *contents;
+  fvec3 min;
+  fvec3 max;
+};
+
+
+mesh        primitive_cube(arena *a);
+mesh        model_load_obj(const char *file, arena *vert_buffer, arena *elem_buffer);
+fvec3       model_max(mesh model);
+fvec3       model_min(mesh model);
+fvec3       model_centroid(mesh model);
+mesh        model_bbox_add(arena *vert_buffer, arena *elem_buffer, mesh model);
+i64         model_starting_offset(arena *a, mesh model);
+void        voxel_grid_init(arena *a, fvec3 counts);
+voxel_grid  model_voxelize(mesh model, u32 resolution, arena *vert_buffer, arena *elem_buffer, arena *memory);
+voxel_grid  model_voxelize2(mesh model, u32 resolution, arena *vert_buffer, arena *elem_buffer, arena *memory);
+voxel_grid  model_voxelize_solid(mesh model, u32 resolution, arena *vert_buffer, arena *elem_buffer, arena *memory);
+entity      voxel_grid_mesh(voxel_grid grid, u32 resolution, fvec4 color, arena *vbuffer, arena *ebuffer, arena *scratch);
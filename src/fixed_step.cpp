@@ -0,0 +1,89 @@
+#include "core.h"
+
+// Fixed timestep simulation. Frame time is added to an accumulator and the simulation advances
+// in whole ticks of dt, so it behaves the same at any frame rate. Rendering interpolates between
+// the last two simulated states by the leftover fraction of a tick.
+// The simulation state is a plain block of memory the module keeps in slots: tick reads one state
+// and writes the next, render reads the previous and current states.
+
+#define FIXED_STEP_MAX_TICKS 5   // Per frame. Time past this after a spike is dropped, not caught up.
+#define FIXED_STEP_SLOTS     3   // Previous and current for render, one more for the tick to write.
+
+
+// Advance the simulation one tick: from is read only, to gets the next state.
+typedef void fixed_step_tick(void *app, const void *from, void *to, f64 dt);
+// Prepare the frame from the states either side of the render time, alpha in [0, 1).
+typedef void fixed_step_render(void *app, const void *prev, const void *curr, f64 alpha);
+
+
+struct fixed_step
+{
+  f64 dt;
+  f64 accumulator;        // Simulation time owed, less than dt after each frame.
+  f64 alpha;              // accumulator / dt, how far render time is past the current state.
+  f64 dropped;            // Seconds skipped because a frame needed more than FIXED_STEP_MAX_TICKS.
+  u64 tick_count;
+  void *slots[FIXED_STEP_SLOTS];
+  u32 prev;
+  u32 curr;
+  fixed_step_tick *tick;
+  fixed_step_render *render;
+  void *app;
+};
+
+
+/// @brief initial is copied in as both the previous and current state.
+fixed_step fixed_step_init(arena *a, f64 tick_rate, const void *initial, u32 state_size,
+                           fixed_step_tick *tick, fixed_step_render *render, void *app)
+{
+  fixed_step s = {};
+  s.dt = 1.0 / tick_rate;
+  for (u32 i = 0; i < FIXED_STEP_SLOTS; ++i)
+  {
+    s.slots[i] = arena_alloc(a, state_size);
+    memcpy(s.slots[i], initial, state_size);
+  }
+  s.prev = 0;
+  s.curr = 1;
+  s.tick = tick;
+  s.render = render;
+  s.app = app;
+  return s;
+}
+
+
+// Add a frame's time, return how many ticks it pays for.
+internal u32 fixed_step_accumulate(fixed_step *s, f64 frame_delta)
+{
+  s->accumulator += (frame_delta > 0.0) ? frame_delta : 0.0;
+  f64 budget = FIXED_STEP_MAX_TICKS * s->dt;
+  if (s->accumulator > budget)
+  {
+    s->dropped += s->accumulator - budget;
+    s->accumulator = budget;
+  }
+  u32 ticks = (u32)(s->accumulator / s->dt);
+  s->accumulator -= ticks * s->dt;
+  return ticks;
+}
+
+
+// One tick into the slot render isn't reading, then it becomes current and the old current previous.
+internal void fixed_step_advance(fixed_step *s)
+{
+  u32 next = 3 - s->prev - s->curr;  // Slots 0, 1 and 2, the one that is neither.
+  s->tick(s->app, s->slots[s->curr], s->slots[next], s->dt);
+  s->prev = s->curr;
+  s->curr = next;
+  s->tick_count++;
+}
+
+
+/// @brief Run one frame: the ticks frame_delta pays for, then render prep.
+void fixed_step_frame(fixed_step *s, f64 frame_delta)
+{
+  u32 ticks = fixed_step_accumulate(s, frame_delta);
+  for (u32 i = 0; i < ticks; ++i) fixed_step_advance(s);
+  s->alpha = s->accumulator / s->dt;
+  s->render(s->app, s->slots[s->prev], s->slots[s->curr], s->alpha);
+}
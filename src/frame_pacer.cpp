@@ -0,0 +1,126 @@
+#include "core.h"
+#include "platform.h"
+
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+// Frame pacing without vsync. frame_pacer_wait holds each frame until its deadline: it sleeps on
+// the platform's high resolution timer until shortly before, then spins the tail so wake up
+// latency doesn't show up as jitter. Light frames give their time back to the OS instead of
+// blocking in Present. Frame intervals are kept for jitter statistics.
+
+#define FRAME_PACER_SPIN_SECS  0.001   // Spin this long before the deadline, covers the timer's wake up slack.
+#define FRAME_PACER_HISTORY    256     // Frame intervals kept for the statistics.
+
+
+struct frame_pacer
+{
+  f64 secs_per_count;
+  i64 period;                  // Target frame length.
+  i64 spin;
+  i64 deadline;                // When the next frame may start.
+  i64 last;                    // When the last wait returned.
+  f64 history[FRAME_PACER_HISTORY];  // Frame intervals in milliseconds, a ring.
+  u32 history_head;
+  u32 history_count;
+  u32 missed;                  // Frames that overran a whole period, the schedule restarts after them.
+  f64 oversleep_max;           // Worst timer wake up past its target, milliseconds.
+};
+
+
+struct frame_pacer_stats
+{
+  f64 mean_ms;
+  f64 jitter_ms;   // Standard deviation of the frame interval.
+  f64 min_ms;
+  f64 max_ms;
+  f64 p99_ms;
+  u32 missed;
+  f64 oversleep_max_ms;
+};
+
+
+/// @brief Pace frames to c's secs_per_frame. Starts the schedule from now.
+frame_pacer frame_pacer_init(struct clock *c)
+{
+  frame_pacer p = {};
+  p.secs_per_count = c->secs_per_count;
+  p.period = (i64)(c->secs_per_frame / c->secs_per_count);
+  p.spin = (i64)(FRAME_PACER_SPIN_SECS / c->secs_per_count);
+  p.last = platform_clock_time();
+  p.deadline = p.last + p.period;
+  return p;
+}
+
+
+/// @brief Call once per frame after presenting. Returns when the next frame is due.
+void frame_pacer_wait(frame_pacer *p)
+{
+  i64 now = platform_clock_time();
+  if (now > p->deadline + p->period)
+  {
+    // A whole frame late: start over from now rather than rush the next frames to catch up.
+    p->missed++;
+    p->deadline = now;
+  }
+  else
+  {
+    i64 wake = p->deadline - p->spin;
+    if (now < wake)
+    {
+      platform_sleep_until(wake);
+      f64 oversleep = (f64)(platform_clock_time() - wake) * p->secs_per_count * 1000.0;
+      p->oversleep_max = (oversleep > p->oversleep_max) ? oversleep : p->oversleep_max;
+    }
+    while (platform_clock_time() < p->deadline)
+    {
+#if defined(__SSE2__) || defined(_M_X64)
+      _mm_pause();
+#endif
+    }
+    now = platform_clock_time();
+  }
+  p->history[p->history_head] = (f64)(now - p->last) * p->secs_per_count * 1000.0;
+  p->history_head = (p->history_head + 1) % FRAME_PACER_HISTORY;
+  p->history_count += (p->history_count < FRAME_PACER_HISTORY);
+  p->last = now;
+  p->deadline += p->period;
+}
+
+
+/// @brief Statistics over the last FRAME_PACER_HISTORY frames.
+frame_pacer_stats frame_pacer_stats_get(frame_pacer *p)
+{
+  frame_pacer_stats stats = {};
+  stats.missed = p->missed;
+  stats.oversleep_max_ms = p->oversleep_max;
+  u32 count = p->history_count;
+  if (count == 0) return stats;
+  f64 sorted[FRAME_PACER_HISTORY];
+  f64 total = 0.0;
+  for (u32 i = 0; i < count; ++i)
+  {
+    // Insertion sort, the history is short.
+    f64 value = p->history[i];
+    total += value;
+    u32 j = i;
+    for (; j > 0 && sorted[j - 1] > value; --j) sorted[j] = sorted[j - 1];
+    sorted[j] = value;
+  }
+  stats.mean_ms = total / count;
+  f64 variance = 0.0;
+  for (u32 i = 0; i < count; ++i)
+  {
+    f64 diff = p->history[i] - stats.mean_ms;
+    variance += diff * diff;
+  }
+  stats.jitter_ms = sqrt(variance / count);
+  stats.min_ms = sorted[0];
+  stats.max_ms = sorted[count - 1];
+  u32 rank = (u32)ceil(0.99 * count);
+  stats.p99_ms = sorted[myclamp(rank, 1, count) - 1];
+  return stats;
+}
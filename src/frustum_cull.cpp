@@ -0,0 +1,224 @@
+#include "core.h"
+#include "data3d.h"
+#include "linalg.h"
+#include "platform.h"
+#include "render_boundary.h"
+
+// View frustum culling for entity tables.
+// Every entity carries the local bounds of its mesh. The boxes go to world space in center and
+// extent form (extent through the absolute matrix, so rotated boxes stay conservative) and are
+// tested against the six frustum planes four at a time. Big tables are split in chunks over the
+// job threads, then the survivors are compacted into one ordered index list for the draw stage.
+
+#define CULL_CHUNK_SIZE     1024  // Entities per job.
+#define CULL_PARALLEL_COUNT 4096  // Below this the jobs cost more than they save.
+
+
+struct cull_bounds
+{
+  fvec3 min;
+  fvec3 max;
+};
+
+
+// Planes point inward: p is inside when dot(plane.xyz, p) + plane.w >= 0 for all six.
+struct cull_frustum
+{
+  fvec4 planes[6];
+};
+
+
+struct cull_job
+{
+  cull_frustum *frustum;
+  cull_bounds  *bounds;
+  fmat4        *transforms;
+  u32           count;
+  u32          *visible;       // Chunk c writes from c*CULL_CHUNK_SIZE.
+  u32          *chunk_counts;
+};
+
+
+/// @brief Tight bounds of a mesh. Unlike model_min/model_max the origin doesn't have to be inside.
+cull_bounds cull_bounds_mesh(mesh model)
+{
+  cull_bounds b = {};
+  if (model.vert_count == 0) return b;
+  b.min = model.vertices[0].pos;
+  b.max = model.vertices[0].pos;
+  for (u32 i = 1; i < model.vert_count; ++i)
+  {
+    b.min = fvec3_min(b.min, model.vertices[i].pos);
+    b.max = fvec3_max(b.max, model.vertices[i].pos);
+  }
+  return b;
+}
+
+
+/// @brief Bounds of the vertices an entity's elements reference.
+cull_bounds cull_bounds_entity(entity e, vertex1 *vertices, u32 *elements)
+{
+  cull_bounds b = {};
+  if (e.count == 0) return b;
+  vertex1 *base = vertices + e.vert_start;
+  u32 *elems = elements + e.elem_start;
+  b.min = base[elems[0]].pos;
+  b.max = base[elems[0]].pos;
+  for (u64 i = 1; i < e.count; ++i)
+  {
+    b.min = fvec3_min(b.min, base[elems[i]].pos);
+    b.max = fvec3_max(b.max, base[elems[i]].pos);
+  }
+  return b;
+}
+
+
+/// @brief Extract the planes from proj*view (glm layout, m[column][row]). Depth has to go 0 to 1.
+cull_frustum cull_frustum_from_matrix(fmat4 view_proj)
+{
+  cull_frustum f = {};
+  fvec4 rows[4];
+  for (u32 r = 0; r < 4; ++r)
+  {
+    rows[r] = fvec4_init(view_proj[0][r], view_proj[1][r], view_proj[2][r], view_proj[3][r]);
+  }
+  for (u32 axis = 0; axis < 3; ++axis)
+  {
+    for (u32 k = 0; k < 4; ++k)
+    {
+      f.planes[axis*2 + 0].array[k] = rows[3].array[k] + rows[axis].array[k];
+      f.planes[axis*2 + 1].array[k] = rows[3].array[k] - rows[axis].array[k];
+    }
+  }
+  // Depth goes 0 to 1, the near plane is z >= 0.
+  f.planes[4] = rows[2];
+  return f;
+}
+
+
+internal bool cull_box_visible(cull_frustum *f, fmat4 world, cull_bounds b)
+{
+  f32 lc[3] = { 0.5f*(b.min.x + b.max.x), 0.5f*(b.min.y + b.max.y), 0.5f*(b.min.z + b.max.z) };
+  f32 le[3] = { 0.5f*(b.max.x - b.min.x), 0.5f*(b.max.y - b.min.y), 0.5f*(b.max.z - b.min.z) };
+  f32 c[3];
+  f32 e[3];
+  for (u32 r = 0; r < 3; ++r)
+  {
+    c[r] = world[3][r] + world[0][r]*lc[0] + world[1][r]*lc[1] + world[2][r]*lc[2];
+    e[r] = fabsf(world[0][r])*le[0] + fabsf(world[1][r])*le[1] + fabsf(world[2][r])*le[2];
+  }
+  for (u32 p = 0; p < 6; ++p)
+  {
+    fvec4 n = f->planes[p];
+    f32 d = n.x*c[0] + n.y*c[1] + n.z*c[2] + n.w;
+    f32 r = fabsf(n.x)*e[0] + fabsf(n.y)*e[1] + fabsf(n.z)*e[2];
+    if (d + r < 0.0f) return false;
+  }
+  return true;
+}
+
+
+internal u32 cull_range(cull_frustum *f, cull_bounds *bounds, fmat4 *transforms, u32 start, u32 end, u32 *out)
+{
+  u32 written = 0;
+  u32 i = start;
+  #if LINALG_SSE
+    __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 n[6][4];
+    __m128 n_abs[6][3];
+    for (u32 p = 0; p < 6; ++p)
+    {
+      for (u32 k = 0; k < 4; ++k) n[p][k] = _mm_set1_ps(f->planes[p].array[k]);
+      for (u32 k = 0; k < 3; ++k) n_abs[p][k] = _mm_andnot_ps(sign, n[p][k]);
+    }
+    for (; i + 4 <= end; i += 4)
+    {
+      // One box per register while transforming, then transpose to one axis per register.
+      __m128 c[4];
+      __m128 e[4];
+      for (u32 k = 0; k < 4; ++k)
+      {
+        cull_bounds *b = &bounds[i + k];
+        f32 *m = &transforms[i + k][0][0];
+        __m128 bmin = _mm_setr_ps(b->min.x, b->min.y, b->min.z, 0.0f);
+        __m128 bmax = _mm_setr_ps(b->max.x, b->max.y, b->max.z, 0.0f);
+        __m128 lc = _mm_mul_ps(_mm_add_ps(bmin, bmax), half);
+        __m128 le = _mm_mul_ps(_mm_sub_ps(bmax, bmin), half);
+        __m128 col0 = _mm_loadu_ps(m + 0);
+        __m128 col1 = _mm_loadu_ps(m + 4);
+        __m128 col2 = _mm_loadu_ps(m + 8);
+        __m128 col3 = _mm_loadu_ps(m + 12);
+        c[k] = _mm_add_ps(col3, _mm_add_ps(_mm_mul_ps(col0, _mm_shuffle_ps(lc, lc, 0x00)),
+                                _mm_add_ps(_mm_mul_ps(col1, _mm_shuffle_ps(lc, lc, 0x55)),
+                                           _mm_mul_ps(col2, _mm_shuffle_ps(lc, lc, 0xaa)))));
+        e[k] = _mm_add_ps(_mm_mul_ps(_mm_andnot_ps(sign, col0), _mm_shuffle_ps(le, le, 0x00)),
+               _mm_add_ps(_mm_mul_ps(_mm_andnot_ps(sign, col1), _mm_shuffle_ps(le, le, 0x55)),
+                          _mm_mul_ps(_mm_andnot_ps(sign, col2), _mm_shuffle_ps(le, le, 0xaa))));
+      }
+      _MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+      _MM_TRANSPOSE4_PS(e[0], e[1], e[2], e[3]);
+      __m128 outside = _mm_setzero_ps();
+      for (u32 p = 0; p < 6; ++p)
+      {
+        __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(n[p][0], c[0]), _mm_mul_ps(n[p][1], c[1])),
+                              _mm_add_ps(_mm_mul_ps(n[p][2], c[2]), n[p][3]));
+        __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(n_abs[p][0], e[0]), _mm_mul_ps(n_abs[p][1], e[1])),
+                              _mm_mul_ps(n_abs[p][2], e[2]));
+        outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+      }
+      u32 mask = ~(u32)_mm_movemask_ps(outside);
+      // Branch free compaction: always write, only advance for visible boxes.
+      for (u32 k = 0; k < 4; ++k)
+      {
+        out[written] = i + k;
+        written += (mask >> k) & 1;
+      }
+    }
+  #endif
+  for (; i < end; ++i)
+  {
+    out[written] = i;
+    written += cull_box_visible(f, transforms[i], bounds[i]) ? 1 : 0;
+  }
+  return written;
+}
+
+
+internal void cull_chunk(void *data, u32 chunk)
+{
+  cull_job *job = (cull_job*) data;
+  u32 start = chunk * CULL_CHUNK_SIZE;
+  u32 end = (start + CULL_CHUNK_SIZE < job->count) ? start + CULL_CHUNK_SIZE : job->count;
+  job->chunk_counts[chunk] = cull_range(job->frustum, job->bounds, job->transforms, start, end, job->visible + start);
+}
+
+
+/// @brief Write the indices of the boxes that touch the frustum into visible (count long), in order.
+/// bounds are local, transforms take them to world space. Returns the number written.
+u32 frustum_cull(cull_frustum frustum, cull_bounds *bounds, fmat4 *transforms, u32 count, u32 *visible, arena *scratch)
+{
+  if (count < CULL_PARALLEL_COUNT)
+  {
+    return cull_range(&frustum, bounds, transforms, 0, count, visible);
+  }
+  arena_savepoint save = arena_save(scratch);
+  cull_job job = {};
+  job.frustum = &frustum;
+  job.bounds = bounds;
+  job.transforms = transforms;
+  job.count = count;
+  job.visible = visible;
+  u32 chunk_count = (count + CULL_CHUNK_SIZE - 1) / CULL_CHUNK_SIZE;
+  job.chunk_counts = arena_push_array(scratch, chunk_count, u32);
+  platform_jobs_run(cull_chunk, &job, chunk_count);
+  // Every chunk wrote at its own start, close the gaps. Moves only go left so order is kept.
+  u32 total = job.chunk_counts[0];
+  for (u32 c = 1; c < chunk_count; ++c)
+  {
+    memmove(visible + total, visible + c * CULL_CHUNK_SIZE, job.chunk_counts[c] * sizeof(u32));
+    total += job.chunk_counts[c];
+  }
+  arena_pop(save);
+  return total;
+}
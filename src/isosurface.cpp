@@ -0,0 +1,424 @@
+#include "data3d.h"
+#include "platform.h"
+#include "render_boundary.h"
+
+// Marching cubes isosurface extraction for density volumes and signed distance fields.
+// The volume is cut into slabs along z that are meshed in parallel. Inside a slab, each
+// crossing edge gets one vertex that every cell touching it shares, via rolling caches of
+// the two sample planes around the current layer of cells.
+//
+// Corner c of a cell sits at offset (c&1, (c>>1)&1, (c>>2)&1). Edge (axis*4 + k) runs along
+// axis from the corner whose other two bits are k.
+
+#define ISO_MAX_TRIS 5
+
+
+struct density_volume
+{
+  f32  *values;   // width*height*depth samples, x fastest.
+  u32   width;
+  u32   height;
+  u32   depth;
+  fvec3 min;      // World space bounds. Samples sit at the centers of width*height*depth cells.
+  fvec3 max;
+};
+
+
+struct iso_slab_cache
+{
+  u32 *xedges[2];  // Vertex index of each x edge on the lower and upper sample plane.
+  u32 *yedges[2];
+  u32 *zedges;     // Vertex index of each z edge between the two planes.
+};
+
+
+struct iso_job
+{
+  density_volume  vol;
+  f32             iso;
+  bool            inside_below;   // SDF convention: values under iso are inside.
+  fvec4           color;
+  fvec3           unit;
+  u32             slab_layers;    // Cell layers per slab.
+  u32            *vert_counts;
+  u32            *elem_counts;
+  u32            *vert_offsets;
+  u32            *elem_offsets;
+  iso_slab_cache *caches;
+  vertex1        *vertices;       // Null during the count pass.
+  u32            *indices;
+};
+
+
+// Triangles per corner configuration, as edge indices terminated by -1.
+global i8   iso_tri_table[256][ISO_MAX_TRIS * 3 + 1];
+global u8   iso_tri_count[256];
+global bool iso_tables_ready;
+
+
+internal inline u32 iso_edge_corner(u32 edge, u32 end)
+{
+  u32 axis = edge / 4;
+  u32 k = edge % 4;
+  u32 o1 = (axis + 1) % 3;
+  u32 o2 = (axis + 2) % 3;
+  u32 corner = ((k & 1) << o1) | ((k >> 1) << o2);
+  return end ? (corner | (1 << axis)) : corner;
+}
+
+
+internal inline u32 iso_edge_between(u32 a, u32 b)
+{
+  u32 diff = a ^ b;
+  u32 axis = (diff == 1) ? 0 : ((diff == 2) ? 1 : 2);
+  u32 base = a & ~diff;
+  u32 o1 = (axis + 1) % 3;
+  u32 o2 = (axis + 2) % 3;
+  u32 k = ((base >> o1) & 1) | (((base >> o2) & 1) << 1);
+  return axis * 4 + k;
+}
+
+
+// Bit per cube face (axis*2 + side) the edge lies on.
+internal inline u32 iso_edge_faces(u32 edge)
+{
+  u32 axis = edge / 4;
+  u32 k = edge % 4;
+  u32 o1 = (axis + 1) % 3;
+  u32 o2 = (axis + 2) % 3;
+  return (1 << (o1 * 2 + (k & 1))) | (1 << (o2 * 2 + (k >> 1)));
+}
+
+
+// Triangulate loop[first..last] under the chord between them, keeping its winding. Chords
+// (edges that aren't contour segments) may not join two vertices of one cube face: the cell
+// across that face can use the same pair, and the edge would end up in four triangles.
+internal bool iso_loop_triangulate(u32 *loop, u32 first, u32 last, i8 *tris, u32 *count)
+{
+  if (last - first < 2) return true;
+  u32 start_count = *count;
+  for (u32 k = first + 1; k < last; ++k)
+  {
+    bool chord_a = (k - first > 1) && (iso_edge_faces(loop[first]) & iso_edge_faces(loop[k]));
+    bool chord_b = (last - k > 1) && (iso_edge_faces(loop[k]) & iso_edge_faces(loop[last]));
+    if (chord_a || chord_b || *count == ISO_MAX_TRIS) continue;
+    tris[*count * 3 + 0] = (i8) loop[first];
+    tris[*count * 3 + 1] = (i8) loop[k];
+    tris[*count * 3 + 2] = (i8) loop[last];
+    (*count)++;
+    if (iso_loop_triangulate(loop, first, k, tris, count) &&
+        iso_loop_triangulate(loop, k, last, tris, count))
+    {
+      return true;
+    }
+    *count = start_count;
+  }
+  return false;
+}
+
+
+// Build the triangle table from the cube's faces instead of storing the classic one.
+// On every face the contour segments are oriented so the inside region is on their left
+// seen from outside the cube, and ambiguous faces always cut off the inside corners. The
+// rule only depends on the face, so neighbouring cells agree on the contour. Loops are then
+// triangulated without chords across a face, so every edge is shared by exactly two triangles.
+internal void iso_tables_init()
+{
+  if (iso_tables_ready) return;
+  for (u32 config = 0; config < 256; ++config)
+  {
+    i8 next[12];
+    memset(next, -1, sizeof(next));
+    for (u32 face = 0; face < 6; ++face)
+    {
+      u32 axis = face / 2;
+      u32 side = face % 2;
+      u32 u = (axis + 1) % 3;
+      u32 v = (axis + 2) % 3;
+      // Face corners counter-clockwise seen from outside the cube.
+      u32 base = side << axis;
+      u32 quad[4] = { base, base | (1 << u), base | (1 << u) | (1 << v), base | (1 << v) };
+      if (side == 0)
+      {
+        u32 temp = quad[1];
+        quad[1] = quad[3];
+        quad[3] = temp;
+      }
+      // Walk the face boundary and record where it enters (out->in) and leaves the inside.
+      u32 crossings[4];
+      bool entering[4];
+      u32 crossing_count = 0;
+      for (u32 i = 0; i < 4; ++i)
+      {
+        u32 a = quad[i];
+        u32 b = quad[(i + 1) % 4];
+        bool a_in = (config >> a) & 1;
+        bool b_in = (config >> b) & 1;
+        if (a_in == b_in) continue;
+        crossings[crossing_count] = iso_edge_between(a, b);
+        entering[crossing_count] = b_in;
+        crossing_count++;
+      }
+      // Each leaving crossing connects back to the entering crossing just before it.
+      for (u32 i = 0; i < crossing_count; ++i)
+      {
+        if (entering[i]) continue;
+        u32 prev = (i + crossing_count - 1) % crossing_count;
+        next[crossings[i]] = (i8) crossings[prev];
+      }
+    }
+    // Chain the segments into loops and fan triangulate them.
+    bool visited[12] = {};
+    u32 count = 0;
+    for (u32 start = 0; start < 12; ++start)
+    {
+      if (next[start] < 0 || visited[start]) continue;
+      u32 loop[12];
+      u32 loop_length = 0;
+      u32 edge = start;
+      while (!visited[edge])
+      {
+        visited[edge] = true;
+        loop[loop_length++] = edge;
+        edge = (u32) next[edge];
+      }
+      // The closing segment loop[last] -> loop[0] is a contour segment, not a chord.
+      bool triangulated = iso_loop_triangulate(loop, 0, loop_length - 1, iso_tri_table[config], &count);
+      ASSERT(triangulated, "Marching cubes loop has no triangulation without face chords.");
+    }
+    iso_tri_table[config][count * 3] = -1;
+    iso_tri_count[config] = (u8) count;
+  }
+  iso_tables_ready = true;
+}
+
+
+internal inline f32 iso_sample(density_volume *vol, u32 x, u32 y, u32 z)
+{
+  return vol->values[x + (y * vol->width) + (z * vol->width * vol->height)];
+}
+
+
+internal inline bool iso_inside(iso_job *job, f32 value)
+{
+  return job->inside_below ? (value < job->iso) : (value >= job->iso);
+}
+
+
+internal u32 iso_vertex_write(iso_job *job, u32 *local, u32 x, u32 y, u32 z, u32 axis)
+{
+  u32 x1 = x + (axis == 0);
+  u32 y1 = y + (axis == 1);
+  u32 z1 = z + (axis == 2);
+  f32 v0 = iso_sample(&job->vol, x, y, z);
+  f32 v1 = iso_sample(&job->vol, x1, y1, z1);
+  f32 t = (job->iso - v0) / (v1 - v0);
+  t = myclamp(t, 0.0f, 1.0f);
+  fvec3 p0 = fvec3_init((f32)x + 0.5f, (f32)y + 0.5f, (f32)z + 0.5f);
+  p0.array[axis] += t;
+  vertex1 *out = &job->vertices[*local];
+  out->pos.x = job->vol.min.x + p0.x * job->unit.x;
+  out->pos.y = job->vol.min.y + p0.y * job->unit.y;
+  out->pos.z = job->vol.min.z + p0.z * job->unit.z;
+  out->col = job->color;
+  out->tex = fvec2_init(0.0f, 0.0f);
+  u32 index = *local;
+  (*local)++;
+  return index;
+}
+
+
+// Count (vertices == null) or write one slab of cells.
+internal void iso_slab_mesh(iso_job *job, u32 slab)
+{
+  density_volume *vol = &job->vol;
+  u32 w = vol->width;
+  u32 h = vol->height;
+  u32 z0 = slab * job->slab_layers;
+  u32 z1 = z0 + job->slab_layers;
+  z1 = (z1 > vol->depth - 1) ? vol->depth - 1 : z1;
+  bool writing = (job->vertices != nullptr);
+  iso_slab_cache *cache = &job->caches[slab];
+  u32 vert_local = writing ? job->vert_offsets[slab] : 0;
+  u32 elem_local = writing ? job->elem_offsets[slab] : 0;
+  u32 vert_count = 0;
+  u32 elem_count = 0;
+  for (u32 plane = z0; plane <= z1; ++plane)
+  {
+    u32 *xedges = cache->xedges[(plane - z0) & 1];
+    u32 *yedges = cache->yedges[(plane - z0) & 1];
+    // Vertices on this sample plane.
+    for (u32 y = 0; y < h; ++y)
+    {
+      for (u32 x = 0; x < w; ++x)
+      {
+        bool here = iso_inside(job, iso_sample(vol, x, y, plane));
+        if ((x + 1 < w) && (here != iso_inside(job, iso_sample(vol, x + 1, y, plane))))
+        {
+          if (writing) xedges[y * w + x] = iso_vertex_write(job, &vert_local, x, y, plane, 0);
+          vert_count++;
+        }
+        if ((y + 1 < h) && (here != iso_inside(job, iso_sample(vol, x, y + 1, plane))))
+        {
+          if (writing) yedges[y * w + x] = iso_vertex_write(job, &vert_local, x, y, plane, 1);
+          vert_count++;
+        }
+      }
+    }
+    if (plane == z0) continue;
+    // Vertices between the previous plane and this one.
+    u32 layer = plane - 1;
+    for (u32 y = 0; y < h; ++y)
+    {
+      for (u32 x = 0; x < w; ++x)
+      {
+        bool below = iso_inside(job, iso_sample(vol, x, y, layer));
+        bool above = iso_inside(job, iso_sample(vol, x, y, plane));
+        if (below == above) continue;
+        if (writing) cache->zedges[y * w + x] = iso_vertex_write(job, &vert_local, x, y, layer, 2);
+        vert_count++;
+      }
+    }
+    // Triangles for the layer of cells between the two planes.
+    u32 lower = (layer - z0) & 1;
+    u32 upper = (plane - z0) & 1;
+    for (u32 y = 0; y + 1 < h; ++y)
+    {
+      for (u32 x = 0; x + 1 < w; ++x)
+      {
+        u32 config = 0;
+        for (u32 c = 0; c < 8; ++c)
+        {
+          f32 value = iso_sample(vol, x + (c & 1), y + ((c >> 1) & 1), layer + ((c >> 2) & 1));
+          config |= (u32)iso_inside(job, value) << c;
+        }
+        u32 tri_count = iso_tri_count[config];
+        elem_count += tri_count * 3;
+        if (!writing) continue;
+        for (u32 i = 0; i < tri_count * 3; ++i)
+        {
+          u32 edge = (u32) iso_tri_table[config][i];
+          u32 axis = edge / 4;
+          u32 corner = iso_edge_corner(edge, 0);
+          u32 ox = corner & 1;
+          u32 oy = (corner >> 1) & 1;
+          u32 oz = (corner >> 2) & 1;
+          u32 plane_index = oz ? upper : lower;
+          u32 index = 0;
+          switch (axis)
+          {
+            case (0): index = cache->xedges[plane_index][(y + oy) * w + x];        break;
+            case (1): index = cache->yedges[plane_index][y * w + (x + ox)];        break;
+            case (2): index = cache->zedges[(y + oy) * w + (x + ox)];              break;
+          };
+          job->indices[elem_local++] = index;
+        }
+      }
+    }
+  }
+  if (!writing)
+  {
+    job->vert_counts[slab] = vert_count;
+    job->elem_counts[slab] = elem_count;
+  }
+  ASSERT(!writing || (vert_local == job->vert_offsets[slab] + vert_count), "Isosurface vertex count mismatch.");
+}
+
+
+internal void iso_slab_job(void *data, u32 slab)
+{
+  iso_slab_mesh((iso_job*) data, slab);
+}
+
+
+density_volume density_volume_from_u8( u8 *data, u32 width, u32 height, u32 depth, fvec3 min, fvec3 max, arena *a )
+{
+  // Same [0, 1] range the GPU sees when sampling an R8_UNORM texture3d.
+  density_volume vol = {};
+  u32 count = width * height * depth;
+  vol.values = arena_push_array(a, count, f32);
+  vol.width = width;
+  vol.height = height;
+  vol.depth = depth;
+  vol.min = min;
+  vol.max = max;
+  for (u32 i = 0; i < count; ++i)
+  {
+    vol.values[i] = (f32)data[i] * (1.0f / 255.0f);
+  }
+  return vol;
+}
+
+
+internal entity isosurface_mesh( density_volume vol, f32 iso, bool inside_below, fvec4 color, arena *vbuffer, arena *ebuffer, arena *scratch )
+{
+  entity output = {};
+  output.vert_start = vbuffer->offset_new / sizeof(vertex1);
+  output.elem_start = ebuffer->offset_new / sizeof(u32);
+  if (vol.width < 2 || vol.height < 2 || vol.depth < 2) return output;
+  iso_tables_init();
+  arena_savepoint save = arena_save(scratch);
+  iso_job job = {};
+  job.vol = vol;
+  job.iso = iso;
+  job.inside_below = inside_below;
+  job.color = color;
+  job.unit.x = (vol.max.x - vol.min.x) / (f32)vol.width;
+  job.unit.y = (vol.max.y - vol.min.y) / (f32)vol.height;
+  job.unit.z = (vol.max.z - vol.min.z) / (f32)vol.depth;
+  // A few slabs per thread keeps the workers busy when the surface is unevenly spread.
+  u32 layer_count = vol.depth - 1;
+  u32 slab_target = platform_thread_count() * 4;
+  job.slab_layers = (layer_count + slab_target - 1) / slab_target;
+  u32 slab_count = (layer_count + job.slab_layers - 1) / job.slab_layers;
+  job.vert_counts  = arena_push_array(scratch, slab_count, u32);
+  job.elem_counts  = arena_push_array(scratch, slab_count, u32);
+  job.vert_offsets = arena_push_array(scratch, slab_count, u32);
+  job.elem_offsets = arena_push_array(scratch, slab_count, u32);
+  job.caches       = arena_push_array(scratch, slab_count, iso_slab_cache);
+  u32 plane_size = vol.width * vol.height;
+  for (u32 i = 0; i < slab_count; ++i)
+  {
+    iso_slab_cache *cache = &job.caches[i];
+    cache->xedges[0] = arena_push_array(scratch, plane_size, u32);
+    cache->xedges[1] = arena_push_array(scratch, plane_size, u32);
+    cache->yedges[0] = arena_push_array(scratch, plane_size, u32);
+    cache->yedges[1] = arena_push_array(scratch, plane_size, u32);
+    cache->zedges    = arena_push_array(scratch, plane_size, u32);
+  }
+  // Pass 1: count vertices and elements per slab.
+  platform_jobs_run(iso_slab_job, &job, slab_count);
+  u32 vert_total = 0;
+  u32 elem_total = 0;
+  for (u32 i = 0; i < slab_count; ++i)
+  {
+    job.vert_offsets[i] = vert_total;
+    job.elem_offsets[i] = elem_total;
+    vert_total += job.vert_counts[i];
+    elem_total += job.elem_counts[i];
+  }
+  // Pass 2: write each slab into its range of the render arenas.
+  output.count = elem_total;
+  if (elem_total > 0)
+  {
+    job.vertices = arena_push_array(vbuffer, vert_total, vertex1);
+    job.indices  = arena_push_array(ebuffer, elem_total, u32);
+    platform_jobs_run(iso_slab_job, &job, slab_count);
+  }
+  arena_pop(save);
+  return output;
+}
+
+
+entity isosurface_extract( density_volume vol, f32 iso, fvec4 color, arena *vbuffer, arena *ebuffer, arena *scratch )
+{
+  // Density convention: values at or above iso are inside.
+  return isosurface_mesh(vol, iso, false, color, vbuffer, ebuffer, scratch);
+}
+
+
+entity isosurface_extract_sdf( density_volume vol, f32 iso, fvec4 color, arena *vbuffer, arena *ebuffer, arena *scratch )
+{
+  // Signed distance convention: values below iso are inside.
+  return isosurface_mesh(vol, iso, true, color, vbuffer, ebuffer, scratch);
+}
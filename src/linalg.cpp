@@ -151,21 +151,21 @@ fvec3 fvec3_scale(fvec3 vec, f32 scalar)
 }
 
 
-inline f32 dot2(fvec2 a, fvec2 b)
+f32 dot2(fvec2 a, fvec2 b)
 {
   f32 product = (a.x*b.x) + (a.y*b.y);
   return product;
 }
 
 
-inline f32 dot3(fvec3 a, fvec3 b)
+f32 dot3(fvec3 a, fvec3 b)
 {
   f32 product = (a.x*b.x) + (a.y*b.y) + (a.z*b.z);
   return product;
 }
 
 
-inline fvec3 normalize3(fvec3 vec)
+fvec3 normalize3(fvec3 vec)
 {
   f32 vec_length = sqrtf(dot3(vec, vec));
   if (vec_length > 0.0f)
@@ -177,14 +177,28 @@ inline fvec3 normalize3(fvec3 vec)
 }
 
 
-inline f32 cross2(fvec2 a, fvec2 b)
+/// @brief normalize3 through the reciprocal square root estimate, relative error around 1e-6.
+fvec3 fvec3_normalize_fast(fvec3 vec)
+{
+  f32 length_sq = dot3(vec, vec);
+  if (length_sq <= 0.0f) return vec;
+  #if LINALG_SSE
+    f32 inverse = _mm_cvtss_f32(linalg_rsqrt(_mm_set_ss(length_sq)));
+  #else
+    f32 inverse = 1.0f / sqrtf(length_sq);
+  #endif
+  return fvec3_scale(vec, inverse);
+}
+
+
+f32 cross2(fvec2 a, fvec2 b)
 {
   f32 out = (a.x * b.y) - (b.x * a.y);
   return out;
 }
 
 
-inline fvec3 cross3(fvec3 a, fvec3 b)
+fvec3 cross3(fvec3 a, fvec3 b)
 {
   fvec3 out = {};
   out.x = (a.y*b.z) - (a.z*b.y);
@@ -217,25 +231,72 @@ inline void fmat4_col_scale(fmat4 mat, u8 index, f32 scalar)
 }
 
 
-inline void matmul4(fmat4 out, fmat4 a, fmat4 b)
+/// @brief out = a * b, columns first like glm. out may be a or b.
+void fmat4_mul(fmat4 out, fmat4 a, fmat4 b)
 {
-  for (u8 row = 0; row < 4; ++row)
-  {
+  #if LINALG_SSE
+    __m128 a0 = _mm_loadu_ps(a[0]);
+    __m128 a1 = _mm_loadu_ps(a[1]);
+    __m128 a2 = _mm_loadu_ps(a[2]);
+    __m128 a3 = _mm_loadu_ps(a[3]);
+    __m128 col[4];
+    for (u8 j = 0; j < 4; ++j)
+    {
+      __m128 bj = _mm_loadu_ps(b[j]);
+      __m128 r = _mm_mul_ps(a0, _mm_shuffle_ps(bj, bj, 0x00));
+      r = linalg_fmadd(a1, _mm_shuffle_ps(bj, bj, 0x55), r);
+      r = linalg_fmadd(a2, _mm_shuffle_ps(bj, bj, 0xaa), r);
+      col[j] = linalg_fmadd(a3, _mm_shuffle_ps(bj, bj, 0xff), r);
+    }
+    for (u8 j = 0; j < 4; ++j) _mm_storeu_ps(out[j], col[j]);
+  #else
+    fmat4 result;
     for (u8 col = 0; col < 4; ++col)
     {
-      for (u8 index = 0; index < 4; ++index)
+      for (u8 row = 0; row < 4; ++row)
       {
-        out[row][col] += a[row][index] * b[index][col];
+        result[col][row] = a[0][row]*b[col][0] + a[1][row]*b[col][1] + a[2][row]*b[col][2] + a[3][row]*b[col][3];
       }
     }
-  }
+    memcpy(out, result, sizeof(fmat4));
+  #endif
 }
 
 
-void fmat4_rotate(fmat4 out, f32 angle_rad, fvec3 axis)
+/// @brief m * (p, 1) without the perspective divide.
+fvec3 fmat4_mul_point(fmat4 m, fvec3 p)
 {
-  fmat4 final = {};
+  fvec4 r = fmat4_mul_vec4(m, fvec4_init(p.x, p.y, p.z, 1.0f));
+  return fvec3_init(r.x, r.y, r.z);
+}
 
+
+/// @brief out may be m.
+void fmat4_transpose(fmat4 out, fmat4 m)
+{
+  #if LINALG_SSE
+    __m128 c0 = _mm_loadu_ps(m[0]);
+    __m128 c1 = _mm_loadu_ps(m[1]);
+    __m128 c2 = _mm_loadu_ps(m[2]);
+    __m128 c3 = _mm_loadu_ps(m[3]);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    _mm_storeu_ps(out[0], c0);
+    _mm_storeu_ps(out[1], c1);
+    _mm_storeu_ps(out[2], c2);
+    _mm_storeu_ps(out[3], c3);
+  #else
+    fmat4 result;
+    for (u8 i = 0; i < 4; ++i)
+    {
+      for (u8 j = 0; j < 4; ++j) result[i][j] = m[j][i];
+    }
+    memcpy(out, result, sizeof(fmat4));
+  #endif
+}
+
+
+void fmat4_rotate(fmat4 out, f32 angle_rad, fvec3 axis)
+{
   axis = normalize3(axis);  // Ensure axis is normalized
 
   f32 c = cosf(angle_rad);
@@ -257,43 +318,153 @@ void fmat4_rotate(fmat4 out, f32 angle_rad, fvec3 axis)
   rotate[0][3] = 0.0f;
   rotate[1][3] = 0.0f;
   rotate[2][3] = 0.0f;
+  rotate[3][0] = 0.0f;
+  rotate[3][1] = 0.0f;
+  rotate[3][2] = 0.0f;
   rotate[3][3] = 1.0f;
-  matmul4(final, out, rotate);
-  memcpy(out, final, sizeof(fmat4));
+  fmat4_mul(out, rotate, out);
 }
 
 
 void fmat4_perspective(fmat4 out, f32 fov_rad, f32 aspect, f32 znear, f32 zfar)
 {
-  f32 tan_half_fov = tanf(fov_rad / 2.0f);
-  memset(out, 0, sizeof(fmat4));
-  out[0][0] = 1.0f / (aspect * tan_half_fov);
-  out[1][1] = 1.0f / tan_half_fov;
-  out[2][2] = -(zfar + znear) / (zfar - znear);
-  out[2][3] = -1.0f;
-  out[3][2] = -(2.0f * zfar * znear) / (zfar - znear);
+  mat_to_fmat4(mat_perspective(fov_rad, aspect, znear, zfar), out);
 }
 
 
 void fmat4_lookat(fmat4 out, fvec3 eye, fvec3 center, fvec3 up)
 {
-  fvec3 f, s, u;
-
-  f = normalize3(fvec3_sub(center, eye));
-  s = normalize3(cross3(f, up));
-  u = cross3(s, f);
-
-  fmat4_identity(out);
-  out[0][0] = s.x;
-  out[1][0] = s.y;
-  out[2][0] = s.z;
-  out[0][1] = u.x;
-  out[1][1] = u.y;
-  out[2][1] = u.z;
-  out[0][2] = -f.x;
-  out[1][2] = -f.y;
-  out[2][2] = -f.z;
-  out[3][0] = -dot3(s, eye);
-  out[3][1] = -dot3(u, eye);
-  out[3][2] =  dot3(f, eye);
+  vec<3> e = { { eye.x, eye.y, eye.z } };
+  vec<3> c = { { center.x, center.y, center.z } };
+  vec<3> u = { { up.x, up.y, up.z } };
+  mat_to_fmat4(mat_lookat(e, c, u), out);
+}
+
+
+/// @brief Inverse of rotation plus translation: [R t] -> [R^T -R^T t]. out may be m.
+void fmat4_inverse_rigid(fmat4 out, fmat4 m)
+{
+  f32 t[3] = { m[3][0], m[3][1], m[3][2] };
+  fmat4 result;
+  for (u8 c = 0; c < 3; ++c)
+  {
+    for (u8 r = 0; r < 3; ++r) result[c][r] = m[r][c];
+    result[c][3] = 0.0f;
+  }
+  for (u8 r = 0; r < 3; ++r)
+  {
+    result[3][r] = -(result[0][r]*t[0] + result[1][r]*t[1] + result[2][r]*t[2]);
+  }
+  result[3][3] = 1.0f;
+  memcpy(out, result, sizeof(fmat4));
+}
+
+
+/// @brief Inverse of any 3x3 part plus translation, bottom row must be 0 0 0 1. out may be m.
+void fmat4_inverse_affine(fmat4 out, fmat4 m)
+{
+  mat<3, 3> a = {};
+  for (u8 c = 0; c < 3; ++c)
+  {
+    for (u8 r = 0; r < 3; ++r) a[c][r] = m[c][r];
+  }
+  mat<3, 3> inv = mat_inverse(a);
+  vec<3> t = { { m[3][0], m[3][1], m[3][2] } };
+  vec<3> inv_t = inv * t;
+  for (u8 c = 0; c < 3; ++c)
+  {
+    for (u8 r = 0; r < 3; ++r) out[c][r] = inv[c][r];
+    out[c][3] = 0.0f;
+  }
+  for (u8 r = 0; r < 3; ++r) out[3][r] = -inv_t[r];
+  out[3][3] = 1.0f;
+}
+
+
+/// @brief Inverse of a projection from fmat4_perspective or glm::perspective, off center allowed.
+/// Only the x, y, z scales, the center offsets in column 2, the depth terms and the w row are read.
+void fmat4_inverse_perspective(fmat4 out, fmat4 m)
+{
+  ASSERT(m[3][3] == 0.0f && m[2][3] != 0.0f, "Not a perspective projection.");
+  f32 a = m[0][0], b = m[1][1];
+  f32 p = m[2][0], q = m[2][1];
+  f32 c = m[2][2], d = m[3][2];
+  f32 e = m[2][3];
+  memset(out, 0, sizeof(fmat4));
+  out[0][0] = 1.0f / a;
+  out[3][0] = -p / (a * e);
+  out[1][1] = 1.0f / b;
+  out[3][1] = -q / (b * e);
+  out[3][2] = 1.0f / e;
+  out[2][3] = 1.0f / d;
+  out[3][3] = -c / (d * e);
+}
+
+
+void transform_identity(transform *t)
+{
+  fmat4_identity(t->forward);
+  fmat4_identity(t->inverse);
+}
+
+
+void transform_set_rigid(transform *t, fmat4 m)
+{
+  memcpy(t->forward, m, sizeof(fmat4));
+  fmat4_inverse_rigid(t->inverse, m);
+}
+
+
+void transform_set_affine(transform *t, fmat4 m)
+{
+  memcpy(t->forward, m, sizeof(fmat4));
+  fmat4_inverse_affine(t->inverse, m);
+}
+
+
+// The ops below apply after the current transform (forward = op * forward), so the inverse picks
+// up the op's inverse on the other side (inverse = inverse * op^-1). Each op's inverse is trivial.
+
+void transform_translate(transform *t, fvec3 offset)
+{
+  for (u8 c = 0; c < 4; ++c)
+  {
+    f32 w = t->forward[c][3];
+    t->forward[c][0] += offset.x * w;
+    t->forward[c][1] += offset.y * w;
+    t->forward[c][2] += offset.z * w;
+  }
+  for (u8 r = 0; r < 4; ++r)
+  {
+    t->inverse[3][r] -= t->inverse[0][r]*offset.x + t->inverse[1][r]*offset.y + t->inverse[2][r]*offset.z;
+  }
+}
+
+
+void transform_rotate(transform *t, f32 angle_rad, fvec3 axis)
+{
+  fmat4_rotate(t->forward, angle_rad, axis);
+  // R^-1 is the rotation the other way.
+  fmat4 undo;
+  fmat4_identity(undo);
+  fmat4_rotate(undo, -angle_rad, axis);
+  fmat4_mul(t->inverse, t->inverse, undo);
+}
+
+
+void transform_scale(transform *t, fvec3 scale)
+{
+  ASSERT(scale.x != 0.0f && scale.y != 0.0f && scale.z != 0.0f, "Scale has no inverse.");
+  for (u8 c = 0; c < 4; ++c)
+  {
+    t->forward[c][0] *= scale.x;
+    t->forward[c][1] *= scale.y;
+    t->forward[c][2] *= scale.z;
+  }
+  for (u8 r = 0; r < 4; ++r)
+  {
+    t->inverse[0][r] /= scale.x;
+    t->inverse[1][r] /= scale.y;
+    t->inverse[2][r] /= scale.z;
+  }
 }
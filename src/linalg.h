@@ -2,6 +2,8 @@
 
 #include "core.h"
 
+#include <math.h>
+
 
 #ifdef _D3D
 #define GLM_FORCE_LEFT_HANDED
@@ -11,6 +13,12 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+// x64 always has SSE2. Modules with their own SIMD kernels key off this too.
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define LINALG_SSE 1
+#endif
+
 
 #define PI 	3.14159265358979323846f
 #define DegreesToRadians(degrees) (degrees*(PI/180.0f))
@@ -70,6 +78,61 @@ union fvec4
 typedef f32 fmat4[4][4];
 
 
+// SSE helpers shared by the 4-wide ops and the batch kernels. fvec4 and fmat4 keep their packed
+// layout since vertex1 and the GPU buffers depend on it, so loads are unaligned (no slower on aligned data).
+#if LINALG_SSE
+internal inline __m128 linalg_load(fvec4 v)
+{
+  return _mm_loadu_ps(v.array);
+}
+
+
+internal inline fvec4 linalg_store(__m128 r)
+{
+  fvec4 v;
+  _mm_storeu_ps(v.array, r);
+  return v;
+}
+
+
+// a*b + c, a single rounding when the target has FMA.
+internal inline __m128 linalg_fmadd(__m128 a, __m128 b, __m128 c)
+{
+  #ifdef __FMA__
+    return _mm_fmadd_ps(a, b, c);
+  #else
+    return _mm_add_ps(_mm_mul_ps(a, b), c);
+  #endif
+}
+
+
+// Dot product broadcast to all lanes.
+internal inline __m128 linalg_dot(__m128 a, __m128 b)
+{
+  __m128 m = _mm_mul_ps(a, b);
+  __m128 s = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_add_ps(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+
+// 12 bit estimate plus one Newton step, about 22 bits.
+internal inline __m128 linalg_rsqrt(__m128 x)
+{
+  __m128 y = _mm_rsqrt_ps(x);
+  __m128 yyx = _mm_mul_ps(_mm_mul_ps(y, y), x);
+  return _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), y), _mm_sub_ps(_mm_set1_ps(3.0f), yyx));
+}
+#endif
+
+
+// A matrix with its inverse, both kept current by the transform_* ops.
+struct transform
+{
+  fmat4 forward;
+  fmat4 inverse;
+};
+
+
 typedef struct model_view_projection model_view_projection;
 struct model_view_projection
 {
@@ -81,13 +144,427 @@ struct model_view_projection
 
 
 fvec2 fvec2_init(f32 x, f32 y);
+ivec2 ivec2_init(i32 x, i32 y);
 fvec3 fvec3_init(f32 x, f32 y, f32 z);
 fvec4 fvec4_init(f32 x, f32 y, f32 z, f32 w);
+fvec2 fvec2_sub(fvec2 a, fvec2 b);
+fvec2 fvec2_scale(fvec2 vec, f32 scalar);
+fvec2 fvec2_min(fvec2 a, fvec2 b);
+fvec2 fvec2_max(fvec2 a, fvec2 b);
+f32   dot2(fvec2 a, fvec2 b);
+f32   cross2(fvec2 a, fvec2 b);
 fvec3 fvec3_add(fvec3 a, fvec3 b);
 fvec3 fvec3_sub(fvec3 a, fvec3 b);
 fvec3 fvec3_scale(fvec3 vec, f32 scalar);
+fvec3 fvec3_min(fvec3 a, fvec3 b);
+fvec3 fvec3_max(fvec3 a, fvec3 b);
+f32   fvec3_max_elem(fvec3 a);
+f32   dot3(fvec3 a, fvec3 b);
+fvec3 cross3(fvec3 a, fvec3 b);
+fvec3 normalize3(fvec3 vec);
+fvec3 fvec3_normalize_fast(fvec3 vec);
 void fmat4_identity(fmat4 mat);
+void fmat4_mul(fmat4 out, fmat4 a, fmat4 b);
+fvec3 fmat4_mul_point(fmat4 m, fvec3 p);
+void fmat4_transpose(fmat4 out, fmat4 m);
 void fmat4_rotate(fmat4 out, f32 angle_rad, fvec3 axis);
 void fmat4_perspective(fmat4 out, f32 fov_rad, f32 aspect, f32 znear, f32 zfar);
 void fmat4_lookat(fmat4 out, fvec3 eye, fvec3 center, fvec3 up);
-// void fmat4_lookat_cmaj(fmat4 m, fvec3 eye, fvec3 center, fvec3 up);
\ No newline at end of file
+void fmat4_inverse_rigid(fmat4 out, fmat4 m);
+void fmat4_inverse_affine(fmat4 out, fmat4 m);
+void fmat4_inverse_perspective(fmat4 out, fmat4 m);
+void transform_identity(transform *t);
+void transform_set_rigid(transform *t, fmat4 m);
+void transform_set_affine(transform *t, fmat4 m);
+void transform_translate(transform *t, fvec3 offset);
+void transform_rotate(transform *t, f32 angle_rad, fvec3 axis);
+void transform_scale(transform *t, fvec3 scale);
+// void fmat4_lookat_cmaj(fmat4 m, fvec3 eye, fvec3 center, fvec3 up);
+
+
+// The 4-wide ops are defined here so they inline. Out of line, an fvec4 by value goes through two
+// 8 byte registers and back to memory before the 16 byte load, a store forwarding stall per call.
+
+internal inline fvec4 fvec4_add(fvec4 a, fvec4 b)
+{
+  #if LINALG_SSE
+    return linalg_store(_mm_add_ps(linalg_load(a), linalg_load(b)));
+  #else
+    for (u8 i = 0; i < 4; ++i) a.array[i] += b.array[i];
+    return a;
+  #endif
+}
+
+
+internal inline fvec4 fvec4_sub(fvec4 a, fvec4 b)
+{
+  #if LINALG_SSE
+    return linalg_store(_mm_sub_ps(linalg_load(a), linalg_load(b)));
+  #else
+    for (u8 i = 0; i < 4; ++i) a.array[i] -= b.array[i];
+    return a;
+  #endif
+}
+
+
+internal inline fvec4 fvec4_mul(fvec4 a, fvec4 b)
+{
+  #if LINALG_SSE
+    return linalg_store(_mm_mul_ps(linalg_load(a), linalg_load(b)));
+  #else
+    for (u8 i = 0; i < 4; ++i) a.array[i] *= b.array[i];
+    return a;
+  #endif
+}
+
+
+internal inline fvec4 fvec4_scale(fvec4 vec, f32 scalar)
+{
+  #if LINALG_SSE
+    return linalg_store(_mm_mul_ps(linalg_load(vec), _mm_set1_ps(scalar)));
+  #else
+    for (u8 i = 0; i < 4; ++i) vec.array[i] *= scalar;
+    return vec;
+  #endif
+}
+
+
+/// @brief a*b + c per component.
+internal inline fvec4 fvec4_fmadd(fvec4 a, fvec4 b, fvec4 c)
+{
+  #if LINALG_SSE
+    return linalg_store(linalg_fmadd(linalg_load(a), linalg_load(b), linalg_load(c)));
+  #else
+    for (u8 i = 0; i < 4; ++i) c.array[i] += a.array[i] * b.array[i];
+    return c;
+  #endif
+}
+
+
+internal inline fvec4 fvec4_min(fvec4 a, fvec4 b)
+{
+  #if LINALG_SSE
+    return linalg_store(_mm_min_ps(linalg_load(a), linalg_load(b)));
+  #else
+    for (u8 i = 0; i < 4; ++i) a.array[i] = (a.array[i] <= b.array[i]) ? a.array[i] : b.array[i];
+    return a;
+  #endif
+}
+
+
+internal inline fvec4 fvec4_max(fvec4 a, fvec4 b)
+{
+  #if LINALG_SSE
+    return linalg_store(_mm_max_ps(linalg_load(a), linalg_load(b)));
+  #else
+    for (u8 i = 0; i < 4; ++i) a.array[i] = (a.array[i] >= b.array[i]) ? a.array[i] : b.array[i];
+    return a;
+  #endif
+}
+
+
+internal inline f32 fvec4_dot(fvec4 a, fvec4 b)
+{
+  #if LINALG_SSE
+    return _mm_cvtss_f32(linalg_dot(linalg_load(a), linalg_load(b)));
+  #else
+    return (a.x*b.x) + (a.y*b.y) + (a.z*b.z) + (a.w*b.w);
+  #endif
+}
+
+
+/// @brief Normalize all four components, zero length vectors come back as zero.
+internal inline fvec4 fvec4_normalize_fast(fvec4 vec)
+{
+  #if LINALG_SSE
+    __m128 v = linalg_load(vec);
+    __m128 length_sq = linalg_dot(v, v);
+    __m128 nonzero = _mm_cmpgt_ps(length_sq, _mm_setzero_ps());
+    return linalg_store(_mm_and_ps(_mm_mul_ps(v, linalg_rsqrt(length_sq)), nonzero));
+  #else
+    f32 length_sq = fvec4_dot(vec, vec);
+    if (length_sq <= 0.0f) return fvec4{};
+    return fvec4_scale(vec, 1.0f / sqrtf(length_sq));
+  #endif
+}
+
+
+internal inline fvec4 fmat4_mul_vec4(fmat4 m, fvec4 v)
+{
+  #if LINALG_SSE
+    __m128 r = _mm_mul_ps(_mm_loadu_ps(m[0]), _mm_set1_ps(v.x));
+    r = linalg_fmadd(_mm_loadu_ps(m[1]), _mm_set1_ps(v.y), r);
+    r = linalg_fmadd(_mm_loadu_ps(m[2]), _mm_set1_ps(v.z), r);
+    r = linalg_fmadd(_mm_loadu_ps(m[3]), _mm_set1_ps(v.w), r);
+    return linalg_store(r);
+  #else
+    fvec4 out;
+    for (u8 row = 0; row < 4; ++row)
+    {
+      out.array[row] = m[0][row]*v.x + m[1][row]*v.y + m[2][row]*v.z + m[3][row]*v.w;
+    }
+    return out;
+  #endif
+}
+
+
+// Fixed size vectors and matrices, for code that knows its sizes at compile time.
+// Everything is constexpr with constant loop bounds, so constant inputs fold away and the rest
+// compiles to straight line code. Same layout as fmat4: m[column][row].
+
+#include <type_traits>
+
+template <u32 N>
+struct vec
+{
+  f32 e[N];
+  constexpr f32       &operator[](u32 i)       { return e[i]; }
+  constexpr const f32 &operator[](u32 i) const { return e[i]; }
+};
+
+
+template <u32 R, u32 C>
+struct mat
+{
+  vec<R> col[C];
+  constexpr vec<R>       &operator[](u32 c)       { return col[c]; }
+  constexpr const vec<R> &operator[](u32 c) const { return col[c]; }
+};
+
+
+// Newton iterations when constant evaluated, sqrtf at run time.
+constexpr f32 linalg_sqrt(f32 x)
+{
+  if (!std::is_constant_evaluated()) return sqrtf(x);
+  if (x <= 0.0f) return 0.0f;
+  f64 r = (x > 1.0f) ? x : 1.0;
+  for (u32 i = 0; i < 64; ++i)
+  {
+    f64 next = 0.5 * (r + x / r);
+    if (next == r) break;
+    r = next;
+  }
+  return (f32)r;
+}
+
+
+// Taylor series when constant evaluated, valid for |x| < pi/2. tanf at run time.
+constexpr f32 linalg_tan(f32 x)
+{
+  if (!std::is_constant_evaluated()) return tanf(x);
+  f64 s = x, c = 1.0;
+  f64 sin_term = x, cos_term = 1.0;
+  for (u32 k = 1; k < 16; ++k)
+  {
+    sin_term *= -(f64)x * x / ((2.0*k) * (2.0*k + 1.0));
+    cos_term *= -(f64)x * x / ((2.0*k - 1.0) * (2.0*k));
+    s += sin_term;
+    c += cos_term;
+  }
+  return (f32)(s / c);
+}
+
+
+template <u32 N>
+constexpr vec<N> operator+(vec<N> a, vec<N> b)
+{
+  for (u32 i = 0; i < N; ++i) a[i] += b[i];
+  return a;
+}
+
+
+template <u32 N>
+constexpr vec<N> operator-(vec<N> a, vec<N> b)
+{
+  for (u32 i = 0; i < N; ++i) a[i] -= b[i];
+  return a;
+}
+
+
+template <u32 N>
+constexpr vec<N> operator*(vec<N> a, f32 s)
+{
+  for (u32 i = 0; i < N; ++i) a[i] *= s;
+  return a;
+}
+
+
+template <u32 N>
+constexpr f32 vec_dot(vec<N> a, vec<N> b)
+{
+  f32 sum = 0.0f;
+  for (u32 i = 0; i < N; ++i) sum += a[i] * b[i];
+  return sum;
+}
+
+
+constexpr vec<3> vec_cross(vec<3> a, vec<3> b)
+{
+  return { { a[1]*b[2] - a[2]*b[1], a[2]*b[0] - a[0]*b[2], a[0]*b[1] - a[1]*b[0] } };
+}
+
+
+template <u32 N>
+constexpr vec<N> vec_normalize(vec<N> v)
+{
+  f32 length = linalg_sqrt(vec_dot(v, v));
+  return (length > 0.0f) ? v * (1.0f / length) : v;
+}
+
+
+template <u32 N>
+constexpr mat<N, N> mat_identity()
+{
+  mat<N, N> m = {};
+  for (u32 i = 0; i < N; ++i) m[i][i] = 1.0f;
+  return m;
+}
+
+
+template <u32 R, u32 C>
+constexpr mat<C, R> mat_transpose(const mat<R, C> &m)
+{
+  mat<C, R> t = {};
+  for (u32 c = 0; c < C; ++c)
+  {
+    for (u32 r = 0; r < R; ++r) t[r][c] = m[c][r];
+  }
+  return t;
+}
+
+
+template <u32 R, u32 C>
+constexpr vec<R> operator*(const mat<R, C> &m, vec<C> v)
+{
+  vec<R> out = {};
+  for (u32 c = 0; c < C; ++c)
+  {
+    for (u32 r = 0; r < R; ++r) out[r] += m[c][r] * v[c];
+  }
+  return out;
+}
+
+
+template <u32 R, u32 K, u32 C>
+constexpr mat<R, C> operator*(const mat<R, K> &a, const mat<K, C> &b)
+{
+  mat<R, C> out = {};
+  for (u32 c = 0; c < C; ++c) out[c] = a * b[c];
+  return out;
+}
+
+
+// 4x4 written out, one column of a per lane of the result like fmat4_mul.
+constexpr mat<4, 4> operator*(const mat<4, 4> &a, const mat<4, 4> &b)
+{
+  mat<4, 4> out = {};
+  for (u32 c = 0; c < 4; ++c)
+  {
+    vec<4> bc = b[c];
+    out[c] = a[0] * bc[0] + a[1] * bc[1] + a[2] * bc[2] + a[3] * bc[3];
+  }
+  return out;
+}
+
+
+constexpr mat<2, 2> mat_inverse(const mat<2, 2> &m)
+{
+  f32 det = m[0][0]*m[1][1] - m[1][0]*m[0][1];
+  ASSERT(det != 0.0f, "Inverting a singular matrix.");
+  f32 inv = 1.0f / det;
+  return { { { {  m[1][1]*inv, -m[0][1]*inv } },
+             { { -m[1][0]*inv,  m[0][0]*inv } } } };
+}
+
+
+constexpr mat<3, 3> mat_inverse(const mat<3, 3> &m)
+{
+  // Columns of the inverse's transpose are the cross products of the columns.
+  vec<3> r0 = vec_cross(m[1], m[2]);
+  vec<3> r1 = vec_cross(m[2], m[0]);
+  vec<3> r2 = vec_cross(m[0], m[1]);
+  f32 det = vec_dot(m[0], r0);
+  ASSERT(det != 0.0f, "Inverting a singular matrix.");
+  f32 inv = 1.0f / det;
+  mat<3, 3> rows = { { r0 * inv, r1 * inv, r2 * inv } };
+  return mat_transpose(rows);
+}
+
+
+constexpr mat<4, 4> mat_inverse(const mat<4, 4> &m)
+{
+  // Cofactors from the 2x2 minors of the top and bottom row pairs.
+  f32 a00 = m[0][0], a01 = m[0][1], a02 = m[0][2], a03 = m[0][3];
+  f32 a10 = m[1][0], a11 = m[1][1], a12 = m[1][2], a13 = m[1][3];
+  f32 a20 = m[2][0], a21 = m[2][1], a22 = m[2][2], a23 = m[2][3];
+  f32 a30 = m[3][0], a31 = m[3][1], a32 = m[3][2], a33 = m[3][3];
+  f32 b00 = a00*a11 - a01*a10, b01 = a00*a12 - a02*a10, b02 = a00*a13 - a03*a10;
+  f32 b03 = a01*a12 - a02*a11, b04 = a01*a13 - a03*a11, b05 = a02*a13 - a03*a12;
+  f32 b06 = a20*a31 - a21*a30, b07 = a20*a32 - a22*a30, b08 = a20*a33 - a23*a30;
+  f32 b09 = a21*a32 - a22*a31, b10 = a21*a33 - a23*a31, b11 = a22*a33 - a23*a32;
+  f32 det = b00*b11 - b01*b10 + b02*b09 + b03*b08 - b04*b07 + b05*b06;
+  ASSERT(det != 0.0f, "Inverting a singular matrix.");
+  f32 inv = 1.0f / det;
+  return { { { { (a11*b11 - a12*b10 + a13*b09)*inv, (a02*b10 - a01*b11 - a03*b09)*inv,
+                 (a31*b05 - a32*b04 + a33*b03)*inv, (a22*b04 - a21*b05 - a23*b03)*inv } },
+             { { (a12*b08 - a10*b11 - a13*b07)*inv, (a00*b11 - a02*b08 + a03*b07)*inv,
+                 (a32*b02 - a30*b05 - a33*b01)*inv, (a20*b05 - a22*b02 + a23*b01)*inv } },
+             { { (a10*b10 - a11*b08 + a13*b06)*inv, (a01*b08 - a00*b10 - a03*b06)*inv,
+                 (a30*b04 - a31*b02 + a33*b00)*inv, (a21*b02 - a20*b04 - a23*b00)*inv } },
+             { { (a11*b07 - a10*b09 - a12*b06)*inv, (a00*b09 - a01*b07 + a02*b06)*inv,
+                 (a31*b01 - a30*b03 - a32*b00)*inv, (a20*b03 - a21*b01 + a22*b00)*inv } } } };
+}
+
+
+/// @brief Same matrix as fmat4_perspective, a constant when the parameters are.
+constexpr mat<4, 4> mat_perspective(f32 fov_rad, f32 aspect, f32 znear, f32 zfar)
+{
+  f32 tan_half_fov = linalg_tan(fov_rad / 2.0f);
+  mat<4, 4> out = {};
+  out[0][0] = 1.0f / (aspect * tan_half_fov);
+  out[1][1] = 1.0f / tan_half_fov;
+  out[2][2] = -(zfar + znear) / (zfar - znear);
+  out[2][3] = -1.0f;
+  out[3][2] = -(2.0f * zfar * znear) / (zfar - znear);
+  return out;
+}
+
+
+/// @brief Same matrix as fmat4_lookat, a constant when the parameters are.
+constexpr mat<4, 4> mat_lookat(vec<3> eye, vec<3> center, vec<3> up)
+{
+  vec<3> f = vec_normalize(center - eye);
+  vec<3> s = vec_normalize(vec_cross(f, up));
+  vec<3> u = vec_cross(s, f);
+  mat<4, 4> out = mat_identity<4>();
+  for (u32 i = 0; i < 3; ++i)
+  {
+    out[i][0] = s[i];
+    out[i][1] = u[i];
+    out[i][2] = -f[i];
+  }
+  out[3][0] = -vec_dot(s, eye);
+  out[3][1] = -vec_dot(u, eye);
+  out[3][2] =  vec_dot(f, eye);
+  return out;
+}
+
+
+constexpr mat<4, 4> mat_from_fmat4(fmat4 m)
+{
+  mat<4, 4> out = {};
+  for (u32 c = 0; c < 4; ++c)
+  {
+    for (u32 r = 0; r < 4; ++r) out[c][r] = m[c][r];
+  }
+  return out;
+}
+
+
+constexpr void mat_to_fmat4(const mat<4, 4> &m, fmat4 out)
+{
+  for (u32 c = 0; c < 4; ++c)
+  {
+    for (u32 r = 0; r < 4; ++r) out[c][r] = m[c][r];
+  }
+}
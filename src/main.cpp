@@ -7,6 +7,8 @@ int main(int argc, char **argv)
   {
     app_update( &memory );
   }
+  // Peak use of the tagged arenas, prints nothing without ARENA_TELEMETRY.
+  arena_report(stdout);
 
   return 0;
 }
@@ -0,0 +1,742 @@
+#include "core.h"
+#include "data3d.h"
+#include "linalg.h"
+#include "platform.h"
+
+// Bounding volume hierarchy over a mesh's triangles, for picking and collision queries.
+// Built as a binary tree with binned SAH: the top levels are split on the calling thread until
+// there is enough independent work, then every remaining subtree is built by a job. The binary
+// tree is then collapsed into 4-wide nodes stored in depth first order, with the four child boxes
+// laid out by axis so one node is tested against a ray, point or box with a few SIMD ops.
+// Triangles are copied in leaf order, so a leaf reads one contiguous run.
+
+#define BVH_BINS          16
+#define BVH_LEAF_MAX      4
+#define BVH_MAX_TASKS     256     // Subtrees handed to the jobs.
+#define BVH_TASK_MIN      1024    // Smaller ranges aren't worth a job of their own.
+#define BVH_STACK_SIZE    64
+#define BVH_EMPTY         0xffffffff
+#define BVH_FAR           3.402823466e+38f  // Largest f32.
+
+
+// Four children. Inner children have count 0 and child is a node index, leaves have count
+// triangles from child. Unused slots have inverted bounds so every test misses them.
+struct bvh_node4
+{
+  f32 min_x[4];
+  f32 min_y[4];
+  f32 min_z[4];
+  f32 max_x[4];
+  f32 max_y[4];
+  f32 max_z[4];
+  u32 child[4];
+  u32 count[4];
+};
+
+
+struct bvh_tri
+{
+  fvec3 v0;
+  fvec3 v1;
+  fvec3 v2;
+};
+
+
+struct bvh
+{
+  bvh_node4 *nodes;
+  u32        node_count;
+  bvh_tri   *tris;       // Leaf order.
+  u32       *tri_ids;    // Original triangle index of every entry in tris.
+  u32        tri_count;
+};
+
+
+struct bvh_hit
+{
+  f32 t;
+  f32 u;         // Barycentrics of v1 and v2.
+  f32 v;
+  u32 triangle;  // Original triangle index, index_count/3 range.
+};
+
+
+struct bvh_closest
+{
+  fvec3 point;
+  f32   distance_sq;
+  u32   triangle;
+};
+
+
+// Build time structures.
+
+struct bvh_bounds
+{
+  fvec3 min;
+  fvec3 max;
+};
+
+
+struct bvh_bnode
+{
+  bvh_bounds bounds;
+  u32        left;
+  u32        right;
+  u32        start;
+  u32        count;   // Leaf when > 0.
+};
+
+
+struct bvh_task
+{
+  u32 node;
+  u32 start;
+  u32 end;
+};
+
+
+struct bvh_build_job
+{
+  mesh        model;
+  bvh_bounds *prim_bounds;
+  fvec3      *centroids;
+  u32        *refs;       // Triangle indices, partitioned in place.
+  bvh_bnode  *nodes;      // Range [start, end) builds its nodes in [2*start, 2*end), the top levels after 2*count.
+  bvh_task   *tasks;
+  u32         prim_count;
+};
+
+
+internal bvh_bounds bvh_bounds_empty()
+{
+  bvh_bounds b;
+  b.min = fvec3_init( BVH_FAR,  BVH_FAR,  BVH_FAR);
+  b.max = fvec3_init(-BVH_FAR, -BVH_FAR, -BVH_FAR);
+  return b;
+}
+
+
+internal void bvh_bounds_grow(bvh_bounds *b, bvh_bounds other)
+{
+  b->min = fvec3_min(b->min, other.min);
+  b->max = fvec3_max(b->max, other.max);
+}
+
+
+internal f32 bvh_half_area(bvh_bounds b)
+{
+  fvec3 d = fvec3_sub(b.max, b.min);
+  if (d.x < 0.0f) return 0.0f;
+  return d.x*d.y + d.y*d.z + d.z*d.x;
+}
+
+
+internal void bvh_prim_job(void *data, u32 chunk)
+{
+  bvh_build_job *job = (bvh_build_job*) data;
+  u32 start = chunk * BVH_TASK_MIN;
+  u32 end = (start + BVH_TASK_MIN < job->prim_count) ? start + BVH_TASK_MIN : job->prim_count;
+  for (u32 i = start; i < end; ++i)
+  {
+    fvec3 a = job->model.vertices[job->model.indices[i*3 + 0]].pos;
+    fvec3 b = job->model.vertices[job->model.indices[i*3 + 1]].pos;
+    fvec3 c = job->model.vertices[job->model.indices[i*3 + 2]].pos;
+    job->prim_bounds[i].min = fvec3_min(a, fvec3_min(b, c));
+    job->prim_bounds[i].max = fvec3_max(a, fvec3_max(b, c));
+    job->centroids[i] = fvec3_scale(fvec3_add(job->prim_bounds[i].min, job->prim_bounds[i].max), 0.5f);
+    job->refs[i] = i;
+  }
+}
+
+
+/// Binned SAH split of refs[start, end). Returns false when a leaf is cheaper, else the
+/// partition point in mid.
+internal bool bvh_split(bvh_build_job *job, u32 start, u32 end, bvh_bounds bounds, u32 *mid)
+{
+  u32 count = end - start;
+  if (count <= 1) return false;
+  fvec3 cmin = job->centroids[job->refs[start]];
+  fvec3 cmax = cmin;
+  for (u32 i = start + 1; i < end; ++i)
+  {
+    cmin = fvec3_min(cmin, job->centroids[job->refs[i]]);
+    cmax = fvec3_max(cmax, job->centroids[job->refs[i]]);
+  }
+  f32 best_cost = BVH_FAR;
+  u32 best_axis = 0;
+  u32 best_bin = 0;
+  for (u32 axis = 0; axis < 3; ++axis)
+  {
+    f32 extent = cmax.array[axis] - cmin.array[axis];
+    if (extent <= 0.0f) continue;
+    f32 scale = (f32)BVH_BINS / extent;
+    bvh_bounds bins[BVH_BINS];
+    u32 counts[BVH_BINS] = {};
+    for (u32 b = 0; b < BVH_BINS; ++b) bins[b] = bvh_bounds_empty();
+    for (u32 i = start; i < end; ++i)
+    {
+      u32 ref = job->refs[i];
+      u32 b = (u32)((job->centroids[ref].array[axis] - cmin.array[axis]) * scale);
+      b = (b >= BVH_BINS) ? BVH_BINS - 1 : b;
+      counts[b]++;
+      bvh_bounds_grow(&bins[b], job->prim_bounds[ref]);
+    }
+    // Sweep from the right to get the cost of every plane between bins.
+    f32 right_area[BVH_BINS];
+    u32 right_count[BVH_BINS];
+    bvh_bounds acc = bvh_bounds_empty();
+    u32 acc_count = 0;
+    for (u32 b = BVH_BINS - 1; b > 0; --b)
+    {
+      bvh_bounds_grow(&acc, bins[b]);
+      acc_count += counts[b];
+      right_area[b] = bvh_half_area(acc);
+      right_count[b] = acc_count;
+    }
+    acc = bvh_bounds_empty();
+    acc_count = 0;
+    for (u32 b = 0; b < BVH_BINS - 1; ++b)
+    {
+      bvh_bounds_grow(&acc, bins[b]);
+      acc_count += counts[b];
+      if (acc_count == 0 || right_count[b + 1] == 0) continue;
+      f32 cost = acc_count * bvh_half_area(acc) + right_count[b + 1] * right_area[b + 1];
+      if (cost < best_cost)
+      {
+        best_cost = cost;
+        best_axis = axis;
+        best_bin = b;
+      }
+    }
+  }
+  if (best_cost == BVH_FAR) return false;  // All centroids in one spot.
+  // Traversal costs about as much as one triangle test.
+  f32 leaf_cost = count * bvh_half_area(bounds);
+  f32 split_cost = bvh_half_area(bounds) + best_cost;
+  if (count <= BVH_LEAF_MAX && leaf_cost <= split_cost) return false;
+  f32 scale = (f32)BVH_BINS / (cmax.array[best_axis] - cmin.array[best_axis]);
+  u32 i = start;
+  u32 j = end;
+  while (i < j)
+  {
+    u32 b = (u32)((job->centroids[job->refs[i]].array[best_axis] - cmin.array[best_axis]) * scale);
+    b = (b >= BVH_BINS) ? BVH_BINS - 1 : b;
+    if (b <= best_bin)
+    {
+      ++i;
+    }
+    else
+    {
+      --j;
+      u32 temp = job->refs[i];
+      job->refs[i] = job->refs[j];
+      job->refs[j] = temp;
+    }
+  }
+  *mid = i;
+  return true;
+}
+
+
+internal bvh_bounds bvh_range_bounds(bvh_build_job *job, u32 start, u32 end)
+{
+  bvh_bounds b = bvh_bounds_empty();
+  for (u32 i = start; i < end; ++i) bvh_bounds_grow(&b, job->prim_bounds[job->refs[i]]);
+  return b;
+}
+
+
+internal void bvh_subtree_job(void *data, u32 task_index)
+{
+  bvh_build_job *job = (bvh_build_job*) data;
+  bvh_task task = job->tasks[task_index];
+  u32 next = task.start * 2;
+  bvh_task stack[BVH_STACK_SIZE];
+  u32 top = 0;
+  stack[top++] = task;
+  while (top)
+  {
+    bvh_task t = stack[--top];
+    bvh_bnode *node = &job->nodes[t.node];
+    u32 mid;
+    if (!bvh_split(job, t.start, t.end, node->bounds, &mid))
+    {
+      node->start = t.start;
+      node->count = t.end - t.start;
+      continue;
+    }
+    node->left = next++;
+    node->right = next++;
+    job->nodes[node->left].bounds = bvh_range_bounds(job, t.start, mid);
+    job->nodes[node->right].bounds = bvh_range_bounds(job, mid, t.end);
+    ASSERT(top + 2 <= BVH_STACK_SIZE, "BVH too deep.");
+    // Bigger half first on the stack, so the smaller one is built first and the stack stays shallow.
+    bvh_task left = { node->left, t.start, mid };
+    bvh_task right = { node->right, mid, t.end };
+    if (mid - t.start > t.end - mid)
+    {
+      stack[top++] = left;
+      stack[top++] = right;
+    }
+    else
+    {
+      stack[top++] = right;
+      stack[top++] = left;
+    }
+  }
+}
+
+
+internal void bvh_node4_set(bvh_node4 *n, u32 slot, bvh_bounds b, u32 child, u32 count)
+{
+  n->min_x[slot] = b.min.x;
+  n->min_y[slot] = b.min.y;
+  n->min_z[slot] = b.min.z;
+  n->max_x[slot] = b.max.x;
+  n->max_y[slot] = b.max.y;
+  n->max_z[slot] = b.max.z;
+  n->child[slot] = child;
+  n->count[slot] = count;
+}
+
+
+// Collapse the binary subtree under root into 4-wide node out, children depth first after it.
+internal void bvh_collapse(bvh *result, bvh_bnode *bnodes, u32 root, u32 out)
+{
+  u32 children[4] = { bnodes[root].left, bnodes[root].right };
+  u32 child_count = 2;
+  // Open the biggest inner child until there are four.
+  while (child_count < 4)
+  {
+    i32 open = -1;
+    f32 open_area = -1.0f;
+    for (u32 c = 0; c < child_count; ++c)
+    {
+      bvh_bnode *n = &bnodes[children[c]];
+      if (n->count == 0 && bvh_half_area(n->bounds) > open_area)
+      {
+        open = (i32)c;
+        open_area = bvh_half_area(n->bounds);
+      }
+    }
+    if (open < 0) break;
+    bvh_bnode *n = &bnodes[children[open]];
+    children[open] = n->left;
+    children[child_count++] = n->right;
+  }
+  bvh_node4 *node = &result->nodes[out];
+  bvh_bounds none = bvh_bounds_empty();
+  for (u32 slot = 0; slot < 4; ++slot) bvh_node4_set(node, slot, none, BVH_EMPTY, 0);
+  for (u32 c = 0; c < child_count; ++c)
+  {
+    bvh_bnode *n = &bnodes[children[c]];
+    if (n->count)
+    {
+      bvh_node4_set(node, c, n->bounds, n->start, n->count);
+    }
+    else
+    {
+      u32 index = result->node_count++;
+      bvh_node4_set(node, c, n->bounds, index, 0);
+      bvh_collapse(result, bnodes, children[c], index);
+      node = &result->nodes[out];
+    }
+  }
+}
+
+
+/// @brief Build a BVH over model's triangles. The result lives in a, scratch is only used during the build.
+bvh bvh_build(mesh model, arena *a, arena *scratch)
+{
+  bvh result = {};
+  u32 prim_count = model.index_count / 3;
+  if (prim_count == 0) return result;
+  arena_savepoint save = arena_save(scratch);
+  bvh_build_job job = {};
+  job.model = model;
+  job.prim_count = prim_count;
+  job.prim_bounds = arena_push_array(scratch, prim_count, bvh_bounds);
+  job.centroids = arena_push_array(scratch, prim_count, fvec3);
+  job.refs = arena_push_array(scratch, prim_count, u32);
+  u32 top_capacity = BVH_MAX_TASKS * 2 + 1;
+  job.nodes = arena_push_array(scratch, (prim_count * 2 + top_capacity), bvh_bnode);
+  job.tasks = arena_push_array(scratch, BVH_MAX_TASKS, bvh_task);
+  platform_jobs_run(bvh_prim_job, &job, (prim_count + BVH_TASK_MIN - 1) / BVH_TASK_MIN);
+  // Split the top levels here until there are enough subtrees for the jobs. Tasks are kept in a
+  // queue, the biggest range is split next.
+  u32 top_next = prim_count * 2;
+  u32 root = top_next++;
+  job.nodes[root].bounds = bvh_range_bounds(&job, 0, prim_count);
+  u32 task_count = 0;
+  job.tasks[task_count++] = { root, 0, prim_count };
+  u32 task_target = platform_thread_count() * 4;
+  task_target = (task_target > BVH_MAX_TASKS) ? BVH_MAX_TASKS : task_target;
+  while (task_count < task_target)
+  {
+    u32 biggest = 0;
+    for (u32 t = 1; t < task_count; ++t)
+    {
+      if (job.tasks[t].end - job.tasks[t].start > job.tasks[biggest].end - job.tasks[biggest].start) biggest = t;
+    }
+    bvh_task t = job.tasks[biggest];
+    if (t.end - t.start < BVH_TASK_MIN) break;
+    bvh_bnode *node = &job.nodes[t.node];
+    u32 mid;
+    if (!bvh_split(&job, t.start, t.end, node->bounds, &mid)) break;
+    node->left = top_next++;
+    node->right = top_next++;
+    job.nodes[node->left].bounds = bvh_range_bounds(&job, t.start, mid);
+    job.nodes[node->right].bounds = bvh_range_bounds(&job, mid, t.end);
+    job.tasks[biggest] = { node->left, t.start, mid };
+    job.tasks[task_count++] = { node->right, mid, t.end };
+  }
+  platform_jobs_run(bvh_subtree_job, &job, task_count);
+  // Flatten. A binary tree over n triangles collapses to fewer than n 4-wide nodes.
+  result.nodes = arena_push_array(a, prim_count, bvh_node4);
+  result.tri_count = prim_count;
+  result.tris = arena_push_array(a, prim_count, bvh_tri);
+  result.tri_ids = arena_push_array(a, prim_count, u32);
+  for (u32 i = 0; i < prim_count; ++i)
+  {
+    u32 t = job.refs[i];
+    result.tri_ids[i] = t;
+    result.tris[i].v0 = model.vertices[model.indices[t*3 + 0]].pos;
+    result.tris[i].v1 = model.vertices[model.indices[t*3 + 1]].pos;
+    result.tris[i].v2 = model.vertices[model.indices[t*3 + 2]].pos;
+  }
+  result.node_count = 1;
+  bvh_bnode *root_node = &job.nodes[root];
+  if (root_node->count)
+  {
+    // A single leaf still gets a node so the queries have one entry point.
+    bvh_bounds none = bvh_bounds_empty();
+    for (u32 slot = 1; slot < 4; ++slot) bvh_node4_set(&result.nodes[0], slot, none, BVH_EMPTY, 0);
+    bvh_node4_set(&result.nodes[0], 0, root_node->bounds, root_node->start, root_node->count);
+  }
+  else
+  {
+    bvh_collapse(&result, job.nodes, root, 0);
+  }
+  arena_pop(save);
+  return result;
+}
+
+
+// Lanes whose slot is hit by the ray, written as entry distances (BVH_FAR when missed).
+internal void bvh_node_ray(bvh_node4 *n, fvec3 origin, fvec3 inv_dir, f32 t_max, f32 *t_enter)
+{
+  #if LINALG_SSE
+    __m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+    __m128 ix = _mm_set1_ps(inv_dir.x), iy = _mm_set1_ps(inv_dir.y), iz = _mm_set1_ps(inv_dir.z);
+    __m128 tx0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(n->min_x), ox), ix);
+    __m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(n->max_x), ox), ix);
+    __m128 ty0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(n->min_y), oy), iy);
+    __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(n->max_y), oy), iy);
+    __m128 tz0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(n->min_z), oz), iz);
+    __m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(n->max_z), oz), iz);
+    __m128 near = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1)), _mm_max_ps(_mm_min_ps(tz0, tz1), _mm_setzero_ps()));
+    __m128 far = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx0, tx1), _mm_max_ps(ty0, ty1)), _mm_min_ps(_mm_max_ps(tz0, tz1), _mm_set1_ps(t_max)));
+    __m128 hit = _mm_cmple_ps(near, far);
+    _mm_storeu_ps(t_enter, _mm_or_ps(_mm_and_ps(hit, near), _mm_andnot_ps(hit, _mm_set1_ps(BVH_FAR))));
+  #else
+    for (u32 k = 0; k < 4; ++k)
+    {
+      f32 tx0 = (n->min_x[k] - origin.x) * inv_dir.x, tx1 = (n->max_x[k] - origin.x) * inv_dir.x;
+      f32 ty0 = (n->min_y[k] - origin.y) * inv_dir.y, ty1 = (n->max_y[k] - origin.y) * inv_dir.y;
+      f32 tz0 = (n->min_z[k] - origin.z) * inv_dir.z, tz1 = (n->max_z[k] - origin.z) * inv_dir.z;
+      f32 near = fmaxf(fmaxf(fminf(tx0, tx1), fminf(ty0, ty1)), fmaxf(fminf(tz0, tz1), 0.0f));
+      f32 far = fminf(fminf(fmaxf(tx0, tx1), fmaxf(ty0, ty1)), fminf(fmaxf(tz0, tz1), t_max));
+      t_enter[k] = (near <= far) ? near : BVH_FAR;
+    }
+  #endif
+}
+
+
+// Moller-Trumbore.
+internal bool bvh_ray_triangle(bvh_tri *tri, fvec3 origin, fvec3 dir, f32 t_max, f32 *t_out, f32 *u_out, f32 *v_out)
+{
+  fvec3 e1 = fvec3_sub(tri->v1, tri->v0);
+  fvec3 e2 = fvec3_sub(tri->v2, tri->v0);
+  fvec3 p = cross3(dir, e2);
+  f32 det = dot3(e1, p);
+  if (fabsf(det) < 1e-12f) return false;
+  f32 inv_det = 1.0f / det;
+  fvec3 s = fvec3_sub(origin, tri->v0);
+  f32 u = dot3(s, p) * inv_det;
+  if (u < 0.0f || u > 1.0f) return false;
+  fvec3 q = cross3(s, e1);
+  f32 v = dot3(dir, q) * inv_det;
+  if (v < 0.0f || u + v > 1.0f) return false;
+  f32 t = dot3(e2, q) * inv_det;
+  if (t < 0.0f || t >= t_max) return false;
+  *t_out = t;
+  *u_out = u;
+  *v_out = v;
+  return true;
+}
+
+
+/// @brief Nearest hit along origin + t*dir for t in [0, t_max). dir doesn't have to be normalized.
+bool bvh_raycast(bvh *tree, fvec3 origin, fvec3 dir, f32 t_max, bvh_hit *hit)
+{
+  if (tree->node_count == 0) return false;
+  // Zero components give +-inf, which the slab test handles.
+  fvec3 inv_dir = fvec3_init(1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z);
+  bool found = false;
+  u32 stack[BVH_STACK_SIZE * 3];
+  f32 stack_t[BVH_STACK_SIZE * 3];
+  u32 top = 0;
+  stack[top] = 0;
+  stack_t[top++] = 0.0f;
+  while (top)
+  {
+    --top;
+    if (stack_t[top] >= t_max) continue;
+    bvh_node4 *n = &tree->nodes[stack[top]];
+    f32 t_enter[4];
+    bvh_node_ray(n, origin, inv_dir, t_max, t_enter);
+    // Leaves right away, inner nodes pushed far to near so the nearest pops first.
+    u32 order[4];
+    u32 order_count = 0;
+    for (u32 k = 0; k < 4; ++k)
+    {
+      // Empty slots have to be skipped by hand, the slab test swaps their inverted bounds back.
+      if (n->child[k] == BVH_EMPTY || t_enter[k] == BVH_FAR) continue;
+      if (n->count[k])
+      {
+        for (u32 i = n->child[k]; i < n->child[k] + n->count[k]; ++i)
+        {
+          f32 t, u, v;
+          if (bvh_ray_triangle(&tree->tris[i], origin, dir, t_max, &t, &u, &v))
+          {
+            t_max = t;
+            hit->t = t;
+            hit->u = u;
+            hit->v = v;
+            hit->triangle = tree->tri_ids[i];
+            found = true;
+          }
+        }
+        continue;
+      }
+      u32 at = order_count++;
+      while (at > 0 && t_enter[order[at - 1]] < t_enter[k])
+      {
+        order[at] = order[at - 1];
+        --at;
+      }
+      order[at] = k;
+    }
+    for (u32 o = 0; o < order_count; ++o)
+    {
+      ASSERT(top < BVH_STACK_SIZE * 3, "BVH traversal stack overflow.");
+      stack[top] = n->child[order[o]];
+      stack_t[top++] = t_enter[order[o]];
+    }
+  }
+  return found;
+}
+
+
+internal void bvh_node_point_distance(bvh_node4 *n, fvec3 p, f32 *dist_sq)
+{
+  #if LINALG_SSE
+    __m128 px = _mm_set1_ps(p.x), py = _mm_set1_ps(p.y), pz = _mm_set1_ps(p.z);
+    __m128 zero = _mm_setzero_ps();
+    __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(n->min_x), px), _mm_sub_ps(px, _mm_loadu_ps(n->max_x))), zero);
+    __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(n->min_y), py), _mm_sub_ps(py, _mm_loadu_ps(n->max_y))), zero);
+    __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(n->min_z), pz), _mm_sub_ps(pz, _mm_loadu_ps(n->max_z))), zero);
+    _mm_storeu_ps(dist_sq, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+  #else
+    for (u32 k = 0; k < 4; ++k)
+    {
+      f32 dx = fmaxf(fmaxf(n->min_x[k] - p.x, p.x - n->max_x[k]), 0.0f);
+      f32 dy = fmaxf(fmaxf(n->min_y[k] - p.y, p.y - n->max_y[k]), 0.0f);
+      f32 dz = fmaxf(fmaxf(n->min_z[k] - p.z, p.z - n->max_z[k]), 0.0f);
+      dist_sq[k] = dx*dx + dy*dy + dz*dz;
+    }
+  #endif
+}
+
+
+// Ericson, Real-Time Collision Detection 5.1.5.
+internal fvec3 bvh_closest_on_triangle(bvh_tri *tri, fvec3 p)
+{
+  fvec3 a = tri->v0, b = tri->v1, c = tri->v2;
+  fvec3 ab = fvec3_sub(b, a);
+  fvec3 ac = fvec3_sub(c, a);
+  fvec3 ap = fvec3_sub(p, a);
+  f32 d1 = dot3(ab, ap);
+  f32 d2 = dot3(ac, ap);
+  if (d1 <= 0.0f && d2 <= 0.0f) return a;
+  fvec3 bp = fvec3_sub(p, b);
+  f32 d3 = dot3(ab, bp);
+  f32 d4 = dot3(ac, bp);
+  if (d3 >= 0.0f && d4 <= d3) return b;
+  f32 vc = d1*d4 - d3*d2;
+  if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return fvec3_add(a, fvec3_scale(ab, d1 / (d1 - d3)));
+  fvec3 cp = fvec3_sub(p, c);
+  f32 d5 = dot3(ab, cp);
+  f32 d6 = dot3(ac, cp);
+  if (d6 >= 0.0f && d5 <= d6) return c;
+  f32 vb = d5*d2 - d1*d6;
+  if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return fvec3_add(a, fvec3_scale(ac, d2 / (d2 - d6)));
+  f32 va = d3*d6 - d5*d4;
+  if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+  {
+    return fvec3_add(b, fvec3_scale(fvec3_sub(c, b), (d4 - d3) / ((d4 - d3) + (d5 - d6))));
+  }
+  f32 denom = 1.0f / (va + vb + vc);
+  return fvec3_add(a, fvec3_add(fvec3_scale(ab, vb * denom), fvec3_scale(ac, vc * denom)));
+}
+
+
+/// @brief Closest point on the mesh to p within max_distance. Returns false when nothing is that close.
+bool bvh_closest_point(bvh *tree, fvec3 p, f32 max_distance, bvh_closest *out)
+{
+  if (tree->node_count == 0) return false;
+  f32 best = max_distance * max_distance;
+  bool found = false;
+  u32 stack[BVH_STACK_SIZE * 3];
+  f32 stack_d[BVH_STACK_SIZE * 3];
+  u32 top = 0;
+  stack[top] = 0;
+  stack_d[top++] = 0.0f;
+  while (top)
+  {
+    --top;
+    if (stack_d[top] > best) continue;
+    bvh_node4 *n = &tree->nodes[stack[top]];
+    f32 dist_sq[4];
+    bvh_node_point_distance(n, p, dist_sq);
+    u32 order[4];
+    u32 order_count = 0;
+    for (u32 k = 0; k < 4; ++k)
+    {
+      if (n->child[k] == BVH_EMPTY || dist_sq[k] > best) continue;
+      if (n->count[k])
+      {
+        for (u32 i = n->child[k]; i < n->child[k] + n->count[k]; ++i)
+        {
+          fvec3 q = bvh_closest_on_triangle(&tree->tris[i], p);
+          fvec3 d = fvec3_sub(q, p);
+          f32 d_sq = dot3(d, d);
+          if (d_sq <= best)
+          {
+            best = d_sq;
+            out->point = q;
+            out->distance_sq = d_sq;
+            out->triangle = tree->tri_ids[i];
+            found = true;
+          }
+        }
+        continue;
+      }
+      u32 at = order_count++;
+      while (at > 0 && dist_sq[order[at - 1]] < dist_sq[k])
+      {
+        order[at] = order[at - 1];
+        --at;
+      }
+      order[at] = k;
+    }
+    for (u32 o = 0; o < order_count; ++o)
+    {
+      ASSERT(top < BVH_STACK_SIZE * 3, "BVH traversal stack overflow.");
+      stack[top] = n->child[order[o]];
+      stack_d[top++] = dist_sq[order[o]];
+    }
+  }
+  return found;
+}
+
+
+// Separating axis test of a triangle against a box given as center and half extents
+// (Akenine-Moller): 9 edge cross axes, the 3 box axes and the triangle normal.
+internal bool bvh_triangle_box(bvh_tri *tri, fvec3 center, fvec3 half)
+{
+  fvec3 v[3] = { fvec3_sub(tri->v0, center), fvec3_sub(tri->v1, center), fvec3_sub(tri->v2, center) };
+  fvec3 e[3] = { fvec3_sub(v[1], v[0]), fvec3_sub(v[2], v[1]), fvec3_sub(v[0], v[2]) };
+  for (u32 i = 0; i < 3; ++i)
+  {
+    for (u32 axis = 0; axis < 3; ++axis)
+    {
+      fvec3 unit = {};
+      unit.array[axis] = 1.0f;
+      fvec3 a = cross3(unit, e[i]);
+      f32 p0 = dot3(v[0], a), p1 = dot3(v[1], a), p2 = dot3(v[2], a);
+      f32 r = half.x*fabsf(a.x) + half.y*fabsf(a.y) + half.z*fabsf(a.z);
+      if (fminf(p0, fminf(p1, p2)) > r || fmaxf(p0, fmaxf(p1, p2)) < -r) return false;
+    }
+  }
+  for (u32 axis = 0; axis < 3; ++axis)
+  {
+    f32 lo = fminf(v[0].array[axis], fminf(v[1].array[axis], v[2].array[axis]));
+    f32 hi = fmaxf(v[0].array[axis], fmaxf(v[1].array[axis], v[2].array[axis]));
+    if (lo > half.array[axis] || hi < -half.array[axis]) return false;
+  }
+  fvec3 normal = cross3(e[0], e[1]);
+  f32 d = dot3(normal, v[0]);
+  f32 r = half.x*fabsf(normal.x) + half.y*fabsf(normal.y) + half.z*fabsf(normal.z);
+  return fabsf(d) <= r;
+}
+
+
+internal u32 bvh_node_box(bvh_node4 *n, fvec3 min, fvec3 max)
+{
+  #if LINALG_SSE
+    __m128 overlap = _mm_and_ps(
+      _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(n->min_x), _mm_set1_ps(max.x)), _mm_cmpge_ps(_mm_loadu_ps(n->max_x), _mm_set1_ps(min.x))),
+      _mm_and_ps(
+        _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(n->min_y), _mm_set1_ps(max.y)), _mm_cmpge_ps(_mm_loadu_ps(n->max_y), _mm_set1_ps(min.y))),
+        _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(n->min_z), _mm_set1_ps(max.z)), _mm_cmpge_ps(_mm_loadu_ps(n->max_z), _mm_set1_ps(min.z)))));
+    return (u32)_mm_movemask_ps(overlap);
+  #else
+    u32 mask = 0;
+    for (u32 k = 0; k < 4; ++k)
+    {
+      bool hit = n->min_x[k] <= max.x && n->max_x[k] >= min.x &&
+                 n->min_y[k] <= max.y && n->max_y[k] >= min.y &&
+                 n->min_z[k] <= max.z && n->max_z[k] >= min.z;
+      mask |= (hit ? 1u : 0u) << k;
+    }
+    return mask;
+  #endif
+}
+
+
+/// @brief Write the original indices of the triangles touching the box into out, up to max_out.
+/// Returns how many touch it, which can be more than were written.
+u32 bvh_overlap_aabb(bvh *tree, fvec3 min, fvec3 max, u32 *out, u32 max_out)
+{
+  if (tree->node_count == 0) return 0;
+  fvec3 center = fvec3_scale(fvec3_add(min, max), 0.5f);
+  fvec3 half = fvec3_scale(fvec3_sub(max, min), 0.5f);
+  u32 found = 0;
+  u32 stack[BVH_STACK_SIZE * 3];
+  u32 top = 0;
+  stack[top++] = 0;
+  while (top)
+  {
+    bvh_node4 *n = &tree->nodes[stack[--top]];
+    u32 mask = bvh_node_box(n, min, max);
+    for (u32 k = 0; k < 4; ++k)
+    {
+      if (!(mask & (1u << k))) continue;
+      if (n->count[k])
+      {
+        for (u32 i = n->child[k]; i < n->child[k] + n->count[k]; ++i)
+        {
+          if (!bvh_triangle_box(&tree->tris[i], center, half)) continue;
+          if (found < max_out) out[found] = tree->tri_ids[i];
+          found++;
+        }
+        continue;
+      }
+      ASSERT(top < BVH_STACK_SIZE * 3, "BVH traversal stack overflow.");
+      stack[top++] = n->child[k];
+    }
+  }
+  return found;
+}
@@ -0,0 +1,336 @@
+#include "data3d.h"
+#include "render_boundary.h"
+
+#include <stdlib.h>
+
+// Index and vertex buffer reordering for the GPU's post-transform cache, overdraw and vertex fetch.
+// Vertex cache order uses Tipsify (Sander, Nehab, Barczak 2007), which also gives the cluster
+// boundaries the overdraw pass sorts. Positions are read through a byte stride so the same code
+// runs on mesh vertices and on vertex1 data in the render arenas (pos is the first member of both).
+
+#define MESH_CACHE_SIZE 16
+
+
+struct mesh_optimize_stats
+{
+  f32 acmr_before;  // Average cache miss ratio: transformed vertices per triangle (0.5 - 3.0).
+  f32 acmr_after;
+  u32 vert_count_before;
+  u32 vert_count_after;
+};
+
+
+struct index_cluster
+{
+  u32 start;  // First triangle.
+  u32 count;  // Triangle count.
+  f32 sort_key;
+};
+
+
+internal inline fvec3 vertex_position(void *vertices, u32 stride, u32 index)
+{
+  fvec3 *pos = (fvec3*) ((u8*)vertices + (size_t)index * stride);
+  return *pos;
+}
+
+
+/// @brief Simulate a FIFO post-transform cache and return the average cache miss ratio.
+f32 index_acmr(u32 *indices, u32 index_count, u32 vert_count, u32 cache_size, arena *scratch)
+{
+  if (index_count < 3) return 0.0f;
+  arena_savepoint save = arena_save(scratch);
+  // A vertex is in the cache while fewer than cache_size misses happened since it was loaded.
+  u32 *loaded_at = arena_push_array(scratch, vert_count, u32);
+  u32 misses = 0;
+  for (u32 i = 0; i < index_count; ++i)
+  {
+    u32 v = indices[i];
+    bool cached = (loaded_at[v] > 0) && (misses - loaded_at[v] < cache_size);
+    if (!cached)
+    {
+      misses++;
+      loaded_at[v] = misses;
+    }
+  }
+  arena_pop(save);
+  return (f32)misses / (f32)(index_count / 3);
+}
+
+
+/// @brief Merge vertices with identical positions and remap the indices. Returns the new vertex count.
+u32 mesh_weld(mesh *model, arena *scratch)
+{
+  arena_savepoint save = arena_save(scratch);
+  u32 table_size = 1;
+  while (table_size < model->vert_count * 2) table_size <<= 1;
+  // Open addressing hash table of vertex indices, empty slots are ~0.
+  u32 *table = arena_push_array(scratch, table_size, u32);
+  memset(table, 0xff, table_size * sizeof(u32));
+  u32 *remap = arena_push_array(scratch, model->vert_count, u32);
+  u32 unique_count = 0;
+  for (u32 i = 0; i < model->vert_count; ++i)
+  {
+    fvec3 p = model->vertices[i].pos;
+    u32 bits[3];
+    memcpy(bits, p.array, sizeof(bits));
+    u32 hash = (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+    u32 slot = hash & (table_size - 1);
+    for (;;)
+    {
+      u32 existing = table[slot];
+      if (existing == ~0u)
+      {
+        table[slot] = unique_count;
+        model->vertices[unique_count] = model->vertices[i];
+        remap[i] = unique_count;
+        unique_count++;
+        break;
+      }
+      if (memcmp(&model->vertices[existing].pos, &p, sizeof(fvec3)) == 0)
+      {
+        remap[i] = existing;
+        break;
+      }
+      slot = (slot + 1) & (table_size - 1);
+    }
+  }
+  for (u32 i = 0; i < model->index_count; ++i)
+  {
+    model->indices[i] = remap[model->indices[i]];
+  }
+  model->vert_count = unique_count;
+  arena_pop(save);
+  return unique_count;
+}
+
+
+/// @brief Reorder triangles for the vertex cache with Tipsify.
+/// Writes the start triangle of every cluster (a restart after a dead end) into clusters and returns how many there are.
+u32 index_cache_optimize(u32 *indices, u32 index_count, u32 vert_count, u32 cache_size, u32 *clusters, arena *scratch)
+{
+  u32 tri_count = index_count / 3;
+  if (tri_count == 0) return 0;
+  arena_savepoint save = arena_save(scratch);
+  // Vertex -> triangle adjacency.
+  u32 *live = arena_push_array(scratch, vert_count, u32);
+  u32 *adjacency_start = arena_push_array(scratch, (vert_count + 1), u32);
+  u32 *adjacency = arena_push_array(scratch, index_count, u32);
+  for (u32 i = 0; i < index_count; ++i) live[indices[i]]++;
+  for (u32 v = 0; v < vert_count; ++v) adjacency_start[v + 1] = adjacency_start[v] + live[v];
+  u32 *fill = arena_push_array(scratch, vert_count, u32);
+  for (u32 i = 0; i < index_count; ++i)
+  {
+    u32 v = indices[i];
+    adjacency[adjacency_start[v] + fill[v]++] = i / 3;
+  }
+  u32 *cache_time = arena_push_array(scratch, vert_count, u32);
+  bool *emitted = arena_push_array(scratch, tri_count, bool);
+  u32 *dead_end = arena_push_array(scratch, index_count, u32);
+  u32 *candidates = arena_push_array(scratch, index_count, u32);
+  u32 *output = arena_push_array(scratch, index_count, u32);
+  u32 dead_end_count = 0;
+  u32 output_count = 0;
+  u32 cluster_count = 0;
+  u32 time = cache_size + 1;
+  u32 cursor = 0;
+  i64 fan = -1;
+  // Find the first vertex with triangles.
+  while (cursor < vert_count && live[cursor] == 0) cursor++;
+  if (cursor < vert_count) fan = cursor;
+  clusters[cluster_count++] = 0;
+  while (fan >= 0)
+  {
+    u32 candidate_count = 0;
+    u32 f = (u32) fan;
+    for (u32 a = adjacency_start[f]; a < adjacency_start[f + 1]; ++a)
+    {
+      u32 t = adjacency[a];
+      if (emitted[t]) continue;
+      for (u32 c = 0; c < 3; ++c)
+      {
+        u32 v = indices[t * 3 + c];
+        output[output_count++] = v;
+        dead_end[dead_end_count++] = v;
+        candidates[candidate_count++] = v;
+        live[v]--;
+        if (time - cache_time[v] > cache_size)
+        {
+          cache_time[v] = time;
+          time++;
+        }
+      }
+      emitted[t] = true;
+    }
+    // Next fanning vertex: the candidate still in the cache that will stay there the longest.
+    fan = -1;
+    i64 best_priority = -1;
+    for (u32 i = 0; i < candidate_count; ++i)
+    {
+      u32 v = candidates[i];
+      if (live[v] == 0) continue;
+      i64 priority = 0;
+      if (time - cache_time[v] + 2 * live[v] <= cache_size)
+      {
+        priority = time - cache_time[v];
+      }
+      if (priority > best_priority)
+      {
+        best_priority = priority;
+        fan = v;
+      }
+    }
+    if (fan >= 0) continue;
+    // Dead end: back up through recently used vertices, then scan for any vertex with triangles left.
+    while (dead_end_count > 0)
+    {
+      u32 v = dead_end[--dead_end_count];
+      if (live[v] > 0) { fan = v; break; }
+    }
+    while (fan < 0 && cursor < vert_count)
+    {
+      if (live[cursor] > 0) { fan = cursor; break; }
+      cursor++;
+    }
+    if (fan >= 0 && output_count < index_count)
+    {
+      clusters[cluster_count++] = output_count / 3;
+    }
+  }
+  memcpy(indices, output, index_count * sizeof(u32));
+  arena_pop(save);
+  return cluster_count;
+}
+
+
+internal int index_cluster_compare(const void *a, const void *b)
+{
+  f32 ka = ((index_cluster*)a)->sort_key;
+  f32 kb = ((index_cluster*)b)->sort_key;
+  return (ka < kb) - (ka > kb);
+}
+
+
+/// @brief Sort triangle clusters so outward facing ones draw first and occlude the rest.
+void index_overdraw_optimize(u32 *indices, u32 index_count, void *vertices, u32 stride, u32 vert_count, u32 *cluster_starts, u32 cluster_count, arena *scratch)
+{
+  u32 tri_count = index_count / 3;
+  if (cluster_count < 2) return;
+  arena_savepoint save = arena_save(scratch);
+  // Mesh centroid.
+  fvec3 center = {};
+  for (u32 v = 0; v < vert_count; ++v)
+  {
+    center = fvec3_add(center, vertex_position(vertices, stride, v));
+  }
+  center = fvec3_scale(center, 1.0f / (f32)vert_count);
+  index_cluster *clusters = arena_push_array(scratch, cluster_count, index_cluster);
+  for (u32 c = 0; c < cluster_count; ++c)
+  {
+    u32 start = cluster_starts[c];
+    u32 end = (c + 1 < cluster_count) ? cluster_starts[c + 1] : tri_count;
+    fvec3 centroid = {};
+    fvec3 normal = {};
+    f32 area_total = 0.0f;
+    for (u32 t = start; t < end; ++t)
+    {
+      fvec3 p0 = vertex_position(vertices, stride, indices[t * 3 + 0]);
+      fvec3 p1 = vertex_position(vertices, stride, indices[t * 3 + 1]);
+      fvec3 p2 = vertex_position(vertices, stride, indices[t * 3 + 2]);
+      fvec3 n = cross3(fvec3_sub(p1, p0), fvec3_sub(p2, p0));
+      f32 area = sqrtf(dot3(n, n));
+      fvec3 tri_center = fvec3_scale(fvec3_add(p0, fvec3_add(p1, p2)), 1.0f / 3.0f);
+      centroid = fvec3_add(centroid, fvec3_scale(tri_center, area));
+      normal = fvec3_add(normal, n);
+      area_total += area;
+    }
+    if (area_total > 0.0f) centroid = fvec3_scale(centroid, 1.0f / area_total);
+    // Front faces wind clockwise around their outward normal here (see primitive_box3d), so flip it.
+    f32 normal_length = sqrtf(dot3(normal, normal));
+    if (normal_length > 0.0f) normal = fvec3_scale(normal, -1.0f / normal_length);
+    clusters[c].start = start;
+    clusters[c].count = end - start;
+    clusters[c].sort_key = dot3(fvec3_sub(centroid, center), normal);
+  }
+  qsort(clusters, cluster_count, sizeof(index_cluster), index_cluster_compare);
+  u32 *output = arena_push_array(scratch, index_count, u32);
+  u32 offset = 0;
+  for (u32 c = 0; c < cluster_count; ++c)
+  {
+    memcpy(&output[offset], &indices[clusters[c].start * 3], clusters[c].count * 3 * sizeof(u32));
+    offset += clusters[c].count * 3;
+  }
+  memcpy(indices, output, index_count * sizeof(u32));
+  arena_pop(save);
+}
+
+
+/// @brief Reorder vertices by first use in the index buffer. Unreferenced vertices are dropped.
+/// Returns the new vertex count.
+u32 vertex_fetch_optimize(u32 *indices, u32 index_count, void *vertices, u32 stride, u32 vert_count, arena *scratch)
+{
+  arena_savepoint save = arena_save(scratch);
+  u32 *remap = arena_push_array(scratch, vert_count, u32);
+  memset(remap, 0xff, vert_count * sizeof(u32));
+  u8 *copy = (u8*) arena_alloc(scratch, (size_t)vert_count * stride);
+  memcpy(copy, vertices, (size_t)vert_count * stride);
+  u32 next = 0;
+  for (u32 i = 0; i < index_count; ++i)
+  {
+    u32 v = indices[i];
+    if (remap[v] == ~0u)
+    {
+      remap[v] = next;
+      memcpy((u8*)vertices + (size_t)next * stride, copy + (size_t)v * stride, stride);
+      next++;
+    }
+    indices[i] = remap[v];
+  }
+  arena_pop(save);
+  return next;
+}
+
+
+internal mesh_optimize_stats buffers_optimize(u32 *indices, u32 index_count, void *vertices, u32 stride, u32 vert_count, arena *scratch)
+{
+  mesh_optimize_stats stats = {};
+  stats.vert_count_before = vert_count;
+  stats.acmr_before = index_acmr(indices, index_count, vert_count, MESH_CACHE_SIZE, scratch);
+  arena_savepoint save = arena_save(scratch);
+  u32 *cluster_starts = arena_push_array(scratch, (index_count / 3 + 1), u32);
+  u32 cluster_count = index_cache_optimize(indices, index_count, vert_count, MESH_CACHE_SIZE, cluster_starts, scratch);
+  index_overdraw_optimize(indices, index_count, vertices, stride, vert_count, cluster_starts, cluster_count, scratch);
+  arena_pop(save);
+  stats.vert_count_after = vertex_fetch_optimize(indices, index_count, vertices, stride, vert_count, scratch);
+  stats.acmr_after = index_acmr(indices, index_count, stats.vert_count_after, MESH_CACHE_SIZE, scratch);
+  return stats;
+}
+
+
+/// @brief Weld, then reorder for vertex cache, overdraw and vertex fetch. Meant for meshes from model_load_obj.
+mesh_optimize_stats mesh_optimize(mesh *model, arena *scratch)
+{
+  u32 vert_count_loaded = model->vert_count;
+  f32 acmr_loaded = index_acmr(model->indices, model->index_count, model->vert_count, MESH_CACHE_SIZE, scratch);
+  mesh_weld(model, scratch);
+  mesh_optimize_stats stats = buffers_optimize(model->indices, model->index_count, model->vertices, sizeof(vertex), model->vert_count, scratch);
+  model->vert_count = stats.vert_count_after;
+  stats.acmr_before = acmr_loaded;
+  stats.vert_count_before = vert_count_loaded;
+  return stats;
+}
+
+
+/// @brief Optimize an entity in place in the vertex1/u32 arenas, e.g. one returned by a primitive_* function.
+/// Its vertices are the ones from vert_start up to the largest index it uses.
+mesh_optimize_stats entity_optimize(entity e, arena *vbuffer, arena *ebuffer, arena *scratch)
+{
+  u32 *indices = (u32*) ebuffer->buffer + e.elem_start;
+  vertex1 *vertices = (vertex1*) vbuffer->buffer + e.vert_start;
+  u32 vert_count = 0;
+  for (u32 i = 0; i < e.count; ++i)
+  {
+    vert_count = (indices[i] + 1 > vert_count) ? indices[i] + 1 : vert_count;
+  }
+  return buffers_optimize(indices, e.count, vertices, sizeof(vertex1), vert_count, scratch);
+}
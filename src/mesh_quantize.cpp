@@ -0,0 +1,226 @@
+#include "data3d.h"
+#include "render_boundary.h"
+
+// Encode and decode between vertex1 (36 bytes) and vertex_quantized (16 bytes).
+// Positions are stored as unorm16 inside the mesh bounds, so the GPU reads them back in [0, 1]
+// and quantize_bounds_matrix maps them to model space. Multiply it into the world matrix.
+
+
+struct quantize_bounds
+{
+  fvec3 min;
+  fvec3 max;
+};
+
+
+/// @brief Float to IEEE half, round to nearest even. Out of range values become infinity.
+u16 f32_to_f16(f32 value)
+{
+  u32 bits;
+  memcpy(&bits, &value, sizeof(bits));
+  u32 sign = (bits >> 16) & 0x8000;
+  u32 exponent = (bits >> 23) & 0xff;
+  u32 mantissa = bits & 0x7fffff;
+  if (exponent == 0xff)
+  {
+    // Inf stays inf, NaN stays a quiet NaN.
+    return (u16)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+  }
+  i32 half_exponent = (i32)exponent - 127 + 15;
+  if (half_exponent >= 31)
+  {
+    return (u16)(sign | 0x7c00);
+  }
+  if (half_exponent <= 0)
+  {
+    // Subnormal half or zero.
+    if (half_exponent < -10) return (u16)sign;
+    mantissa |= 0x800000;
+    u32 shift = (u32)(14 - half_exponent);
+    u32 half_mantissa = mantissa >> shift;
+    u32 remainder = mantissa & ((1u << shift) - 1);
+    u32 halfway = 1u << (shift - 1);
+    if (remainder > halfway || (remainder == halfway && (half_mantissa & 1))) half_mantissa++;
+    return (u16)(sign | half_mantissa);
+  }
+  u32 half = sign | ((u32)half_exponent << 10) | (mantissa >> 13);
+  u32 remainder = mantissa & 0x1fff;
+  // A carry out of the mantissa correctly bumps the exponent.
+  if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) half++;
+  return (u16)half;
+}
+
+
+f32 f16_to_f32(u16 value)
+{
+  u32 sign = (u32)(value & 0x8000) << 16;
+  u32 exponent = (value >> 10) & 0x1f;
+  u32 mantissa = value & 0x3ff;
+  u32 bits;
+  if (exponent == 0)
+  {
+    if (mantissa == 0)
+    {
+      bits = sign;
+    }
+    else
+    {
+      // Normalize the subnormal.
+      exponent = 127 - 15 + 1;
+      while ((mantissa & 0x400) == 0)
+      {
+        mantissa <<= 1;
+        exponent--;
+      }
+      bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+  }
+  else if (exponent == 31)
+  {
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  }
+  else
+  {
+    bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+  }
+  f32 result;
+  memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+
+internal inline u32 unorm_encode(f32 value, u32 max_value)
+{
+  if (!(value > 0.0f)) return 0;
+  if (value >= 1.0f) return max_value;
+  return (u32)(value * (f32)max_value + 0.5f);
+}
+
+
+/// @brief Pack an rgba color in [0, 1] into 4 bytes, r in the lowest byte (DXGI_FORMAT_R8G8B8A8_UNORM).
+u32 color_rgba8_encode(fvec4 color)
+{
+  u32 result = 0;
+  for (u32 i = 0; i < 4; ++i)
+  {
+    result |= unorm_encode(color.array[i], 255) << (i * 8);
+  }
+  return result;
+}
+
+
+fvec4 color_rgba8_decode(u32 color)
+{
+  fvec4 result = {};
+  for (u32 i = 0; i < 4; ++i)
+  {
+    result.array[i] = (f32)((color >> (i * 8)) & 0xff) / 255.0f;
+  }
+  return result;
+}
+
+
+vertex_quantized vertex_quantize(vertex1 v, quantize_bounds bounds)
+{
+  vertex_quantized result = {};
+  for (u32 i = 0; i < 3; ++i)
+  {
+    f32 extent = bounds.max.array[i] - bounds.min.array[i];
+    f32 normalized = (extent > 0.0f) ? (v.pos.array[i] - bounds.min.array[i]) / extent : 0.0f;
+    result.pos[i] = (u16) unorm_encode(normalized, 0xffff);
+  }
+  result.col = color_rgba8_encode(v.col);
+  result.tex[0] = f32_to_f16(v.tex.x);
+  result.tex[1] = f32_to_f16(v.tex.y);
+  return result;
+}
+
+
+vertex1 vertex_dequantize(vertex_quantized v, quantize_bounds bounds)
+{
+  vertex1 result = {};
+  for (u32 i = 0; i < 3; ++i)
+  {
+    f32 extent = bounds.max.array[i] - bounds.min.array[i];
+    result.pos.array[i] = bounds.min.array[i] + ((f32)v.pos[i] / 65535.0f) * extent;
+  }
+  result.col = color_rgba8_decode(v.col);
+  result.tex.x = f16_to_f32(v.tex[0]);
+  result.tex.y = f16_to_f32(v.tex[1]);
+  return result;
+}
+
+
+/// @brief Bounds of the positions in a vertex array. pos has to be the first member.
+quantize_bounds quantize_bounds_compute(void *vertices, u32 stride, u32 vert_count)
+{
+  quantize_bounds bounds = {};
+  for (u32 i = 0; i < vert_count; ++i)
+  {
+    fvec3 pos = *(fvec3*) ((u8*)vertices + (size_t)i * stride);
+    if (i == 0)
+    {
+      bounds.min = pos;
+      bounds.max = pos;
+    }
+    bounds.min = fvec3_min(bounds.min, pos);
+    bounds.max = fvec3_max(bounds.max, pos);
+  }
+  return bounds;
+}
+
+
+/// @brief Model matrix taking quantized positions from [0, 1] back to the mesh bounds.
+/// Same memory layout as glm::mat4 (translation in out[3]), so it can be multiplied into the world matrix.
+void quantize_bounds_matrix(fmat4 out, quantize_bounds bounds)
+{
+  fmat4_identity(out);
+  out[0][0] = bounds.max.x - bounds.min.x;
+  out[1][1] = bounds.max.y - bounds.min.y;
+  out[2][2] = bounds.max.z - bounds.min.z;
+  out[3][0] = bounds.min.x;
+  out[3][1] = bounds.min.y;
+  out[3][2] = bounds.min.z;
+}
+
+
+/// @brief Quantize an entity's vertices into a vertex_quantized arena. The index buffer is shared with the original.
+/// Its vertices are the ones from vert_start up to the largest index it uses.
+entity entity_quantize(entity e, arena *vbuffer, arena *ebuffer, arena *qbuffer, quantize_bounds *bounds_out)
+{
+  u32 *indices = (u32*) ebuffer->buffer + e.elem_start;
+  vertex1 *vertices = (vertex1*) vbuffer->buffer + e.vert_start;
+  u32 vert_count = 0;
+  for (u32 i = 0; i < e.count; ++i)
+  {
+    vert_count = (indices[i] + 1 > vert_count) ? indices[i] + 1 : vert_count;
+  }
+  quantize_bounds bounds = quantize_bounds_compute(vertices, sizeof(vertex1), vert_count);
+  entity output = e;
+  output.vert_start = qbuffer->offset_new / sizeof(vertex_quantized);
+  vertex_quantized *quantized = arena_push_array(qbuffer, vert_count, vertex_quantized);
+  for (u32 i = 0; i < vert_count; ++i)
+  {
+    quantized[i] = vertex_quantize(vertices[i], bounds);
+  }
+  *bounds_out = bounds;
+  return output;
+}
+
+
+/// @brief Quantize a mesh from model_load_obj. It has no colors or texture coordinates so every vertex gets color and zero UVs.
+vertex_quantized * mesh_quantize(mesh *model, fvec4 color, arena *qbuffer, quantize_bounds *bounds_out)
+{
+  // Tight bounds: model_min/model_max always include the origin.
+  quantize_bounds bounds = quantize_bounds_compute(model->vertices, sizeof(vertex), model->vert_count);
+  vertex_quantized *quantized = arena_push_array(qbuffer, model->vert_count, vertex_quantized);
+  vertex1 v = {};
+  v.col = color;
+  for (u32 i = 0; i < model->vert_count; ++i)
+  {
+    v.pos = model->vertices[i].pos;
+    quantized[i] = vertex_quantize(v, bounds);
+  }
+  *bounds_out = bounds;
+  return quantized;
+}
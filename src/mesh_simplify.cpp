@@ -0,0 +1,406 @@
+#include "data3d.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+// Quadric error edge collapse (Garland, Heckbert 1997) over mesh.
+// Collapses are half edge: a vertex moves onto a neighbour, so vertex data never changes and every
+// LOD is just another index buffer over the same vertices. Work is done in passes: each pass sorts
+// the edges by cost and collapses the cheapest ones whose neighbourhoods don't overlap.
+// Collapses must pass the link condition (Dey et al. 1999): the two ends may only share the
+// neighbours across the edge's own triangles, otherwise the collapse pinches the surface into a
+// non-manifold fold, like closing a torus' tube.
+// Weld the mesh first (mesh_weld), model_load_obj output has no shared vertices to collapse.
+
+#define SIMPLIFY_BOUNDARY_WEIGHT 10.0
+
+
+struct quadric
+{
+  f64 a2, ab, ac, ad;
+  f64     b2, bc, bd;
+  f64         c2, cd;
+  f64             d2;
+  f64 weight;
+};
+
+
+struct simplify_edge
+{
+  u32 from;
+  u32 to;
+  f32 cost;
+};
+
+
+struct mesh_lod
+{
+  u32 *indices;
+  u32  index_count;
+  f32  error;  // Summed collapse costs from the full mesh, see mesh_simplify. Model units.
+};
+
+
+internal void quadric_add_plane(quadric *q, f64 a, f64 b, f64 c, f64 d, f64 weight)
+{
+  q->a2 += weight * a * a; q->ab += weight * a * b; q->ac += weight * a * c; q->ad += weight * a * d;
+  q->b2 += weight * b * b; q->bc += weight * b * c; q->bd += weight * b * d;
+  q->c2 += weight * c * c; q->cd += weight * c * d;
+  q->d2 += weight * d * d;
+  q->weight += weight;
+}
+
+
+internal void quadric_add(quadric *q, quadric *other)
+{
+  q->a2 += other->a2; q->ab += other->ab; q->ac += other->ac; q->ad += other->ad;
+  q->b2 += other->b2; q->bc += other->bc; q->bd += other->bd;
+  q->c2 += other->c2; q->cd += other->cd;
+  q->d2 += other->d2;
+  q->weight += other->weight;
+}
+
+
+internal f64 quadric_evaluate(quadric *q, fvec3 p)
+{
+  f64 x = p.x, y = p.y, z = p.z;
+  f64 result = q->a2 * x * x + 2.0 * q->ab * x * y + 2.0 * q->ac * x * z + 2.0 * q->ad * x
+             + q->b2 * y * y + 2.0 * q->bc * y * z + 2.0 * q->bd * y
+             + q->c2 * z * z + 2.0 * q->cd * z
+             + q->d2;
+  return (result > 0.0) ? result : 0.0;
+}
+
+
+internal inline u64 edge_key(u32 a, u32 b)
+{
+  return (a < b) ? (((u64)a << 32) | b) : (((u64)b << 32) | a);
+}
+
+
+internal int simplify_edge_compare(const void *a, const void *b)
+{
+  f32 ca = ((simplify_edge*)a)->cost;
+  f32 cb = ((simplify_edge*)b)->cost;
+  return (ca > cb) - (ca < cb);
+}
+
+
+struct edge_table
+{
+  u64 *keys;   // ~0 is empty.
+  u32 *counts; // Triangles using the edge.
+  u32  size;
+};
+
+
+internal u32 edge_table_find(edge_table *table, u64 key)
+{
+  u32 hash = (u32)((key * 0x9E3779B97F4A7C15ull) >> 32);
+  u32 slot = hash & (table->size - 1);
+  while (table->keys[slot] != ~0ull && table->keys[slot] != key)
+  {
+    slot = (slot + 1) & (table->size - 1);
+  }
+  return slot;
+}
+
+
+// Rejects the collapse if any triangle that survives it would flip or become a sliver.
+internal bool collapse_flips(mesh *model, u32 *indices, u32 *adjacency, u32 adjacency_start, u32 adjacency_end, u32 from, u32 to)
+{
+  fvec3 target = model->vertices[to].pos;
+  for (u32 a = adjacency_start; a < adjacency_end; ++a)
+  {
+    u32 *tri = &indices[adjacency[a] * 3];
+    if (tri[0] == to || tri[1] == to || tri[2] == to) continue;
+    fvec3 p[3];
+    fvec3 q[3];
+    for (u32 c = 0; c < 3; ++c)
+    {
+      p[c] = model->vertices[tri[c]].pos;
+      q[c] = (tri[c] == from) ? target : p[c];
+    }
+    fvec3 before = cross3(fvec3_sub(p[1], p[0]), fvec3_sub(p[2], p[0]));
+    fvec3 after  = cross3(fvec3_sub(q[1], q[0]), fvec3_sub(q[2], q[0]));
+    f32 before_length = sqrtf(dot3(before, before));
+    f32 after_length  = sqrtf(dot3(after, after));
+    if (after_length == 0.0f) return true;
+    if (dot3(before, after) < 0.25f * before_length * after_length) return true;
+  }
+  return false;
+}
+
+
+// True if from and to share a neighbour that isn't the third vertex of a triangle on their edge.
+// mark has a slot per vertex, stamp is new for every call.
+internal bool collapse_breaks_link(u32 *indices, u32 *adjacency, u32 *adjacency_start, u32 from, u32 to, u32 *mark, u32 stamp)
+{
+  for (u32 a = adjacency_start[from]; a < adjacency_start[from + 1]; ++a)
+  {
+    u32 *tri = &indices[adjacency[a] * 3];
+    for (u32 c = 0; c < 3; ++c) mark[tri[c]] = stamp;
+  }
+  u32 common = 0;
+  u32 opposite = 0;
+  for (u32 a = adjacency_start[to]; a < adjacency_start[to + 1]; ++a)
+  {
+    u32 *tri = &indices[adjacency[a] * 3];
+    opposite += (tri[0] == from || tri[1] == from || tri[2] == from);
+    for (u32 c = 0; c < 3; ++c)
+    {
+      u32 v = tri[c];
+      if (v == from || v == to || mark[v] != stamp) continue;
+      // Counted once
+      mark[v] = stamp + 1;
+      common++;
+    }
+  }
+  return common > opposite;
+}
+
+
+/// @brief Simplify the triangles in indices down to about target_index_count indices. Works in place.
+/// Returns the new index count and writes the largest collapse cost to error_out: the area weighted
+/// RMS distance from the kept vertex to the planes of the triangles merged into it, in model units.
+/// An estimate of the geometric error, not a bound on the distance to the input.
+u32 mesh_simplify(mesh *model, u32 *indices, u32 index_count, u32 target_index_count, f32 *error_out, arena *scratch)
+{
+  arena_savepoint save = arena_save(scratch);
+  u32 vert_count = model->vert_count;
+  f32 error_max = 0.0f;
+  // Quadrics from the input triangles, area weighted.
+  quadric *quadrics = arena_push_array(scratch, vert_count, quadric);
+  for (u32 t = 0; t < index_count / 3; ++t)
+  {
+    fvec3 p0 = model->vertices[indices[t * 3 + 0]].pos;
+    fvec3 p1 = model->vertices[indices[t * 3 + 1]].pos;
+    fvec3 p2 = model->vertices[indices[t * 3 + 2]].pos;
+    fvec3 n = cross3(fvec3_sub(p1, p0), fvec3_sub(p2, p0));
+    f32 length = sqrtf(dot3(n, n));
+    if (length == 0.0f) continue;
+    n = fvec3_scale(n, 1.0f / length);
+    f64 d = -dot3(n, p0);
+    f64 area = 0.5 * length;
+    for (u32 c = 0; c < 3; ++c)
+    {
+      quadric_add_plane(&quadrics[indices[t * 3 + c]], n.x, n.y, n.z, d, area);
+    }
+  }
+  // Working memory for the passes.
+  u32 table_size = 1;
+  while (table_size < index_count * 2) table_size <<= 1;
+  edge_table edges = {};
+  edges.size = table_size;
+  edges.keys = arena_push_array(scratch, table_size, u64);
+  edges.counts = arena_push_array(scratch, table_size, u32);
+  u32 *edge_slots = arena_push_array(scratch, index_count, u32);
+  simplify_edge *candidates = arena_push_array(scratch, index_count, simplify_edge);
+  u32 *adjacency_start = arena_push_array(scratch, (vert_count + 1), u32);
+  u32 *adjacency = arena_push_array(scratch, index_count, u32);
+  u32 *fill = arena_push_array(scratch, vert_count, u32);
+  u32 *remap = arena_push_array(scratch, vert_count, u32);
+  bool *locked = arena_push_array(scratch, vert_count, bool);
+  bool *boundary = arena_push_array(scratch, vert_count, bool);
+  bool *pinned = arena_push_array(scratch, vert_count, bool);
+  u32 *mark = arena_push_array(scratch, vert_count, u32);
+  u32 stamp = 0;
+  // Boundary edges get a plane through the edge, perpendicular to the triangle, so borders stay put.
+  memset(edges.keys, 0xff, table_size * sizeof(u64));
+  for (u32 i = 0; i < index_count; ++i)
+  {
+    u32 a = indices[i];
+    u32 b = indices[(i % 3 == 2) ? i - 2 : i + 1];
+    u32 slot = edge_table_find(&edges, edge_key(a, b));
+    edges.keys[slot] = edge_key(a, b);
+    edges.counts[slot]++;
+  }
+  for (u32 i = 0; i < index_count; ++i)
+  {
+    u32 a = indices[i];
+    u32 b = indices[(i % 3 == 2) ? i - 2 : i + 1];
+    u32 count = edges.counts[edge_table_find(&edges, edge_key(a, b))];
+    if (count == 2) continue;
+    if (count > 2)
+    {
+      // Non-manifold edges are left alone.
+      pinned[a] = true;
+      pinned[b] = true;
+      continue;
+    }
+    boundary[a] = true;
+    boundary[b] = true;
+    u32 t = i / 3;
+    fvec3 p0 = model->vertices[indices[t * 3 + 0]].pos;
+    fvec3 p1 = model->vertices[indices[t * 3 + 1]].pos;
+    fvec3 p2 = model->vertices[indices[t * 3 + 2]].pos;
+    fvec3 face = cross3(fvec3_sub(p1, p0), fvec3_sub(p2, p0));
+    fvec3 edge = fvec3_sub(model->vertices[b].pos, model->vertices[a].pos);
+    fvec3 n = cross3(edge, face);
+    f32 length = sqrtf(dot3(n, n));
+    if (length == 0.0f) continue;
+    n = fvec3_scale(n, 1.0f / length);
+    f64 d = -dot3(n, model->vertices[a].pos);
+    f64 weight = SIMPLIFY_BOUNDARY_WEIGHT * dot3(edge, edge);
+    quadric_add_plane(&quadrics[a], n.x, n.y, n.z, d, weight);
+    quadric_add_plane(&quadrics[b], n.x, n.y, n.z, d, weight);
+  }
+
+  while (index_count > target_index_count)
+  {
+    // Vertex -> triangle adjacency.
+    memset(adjacency_start, 0, (vert_count + 1) * sizeof(u32));
+    memset(fill, 0, vert_count * sizeof(u32));
+    for (u32 i = 0; i < index_count; ++i) adjacency_start[indices[i] + 1]++;
+    for (u32 v = 0; v < vert_count; ++v) adjacency_start[v + 1] += adjacency_start[v];
+    for (u32 i = 0; i < index_count; ++i)
+    {
+      u32 v = indices[i];
+      adjacency[adjacency_start[v] + fill[v]++] = i / 3;
+    }
+    // Unique edges, each with its cheaper valid direction.
+    memset(edges.keys, 0xff, table_size * sizeof(u64));
+    memset(edges.counts, 0, table_size * sizeof(u32));
+    u32 edge_count = 0;
+    for (u32 i = 0; i < index_count; ++i)
+    {
+      u32 a = indices[i];
+      u32 b = indices[(i % 3 == 2) ? i - 2 : i + 1];
+      u32 slot = edge_table_find(&edges, edge_key(a, b));
+      if (edges.counts[slot]++ == 0)
+      {
+        edges.keys[slot] = edge_key(a, b);
+        edge_slots[edge_count++] = slot;
+      }
+    }
+    u32 candidate_count = 0;
+    for (u32 e = 0; e < edge_count; ++e)
+    {
+      u64 key = edges.keys[edge_slots[e]];
+      bool on_boundary = (edges.counts[edge_slots[e]] == 1);
+      u32 ends[2] = { (u32)(key >> 32), (u32)(key & 0xffffffff) };
+      simplify_edge best = {};
+      best.cost = INFINITY;
+      for (u32 direction = 0; direction < 2; ++direction)
+      {
+        u32 from = ends[direction];
+        u32 to = ends[1 - direction];
+        if (pinned[from]) continue;
+        // A boundary vertex may only slide along the boundary.
+        if (boundary[from] && !on_boundary) continue;
+        quadric q = quadrics[from];
+        quadric_add(&q, &quadrics[to]);
+        f32 cost = (f32) sqrt(quadric_evaluate(&q, model->vertices[to].pos) / (q.weight > 0.0 ? q.weight : 1.0));
+        if (cost < best.cost)
+        {
+          best.from = from;
+          best.to = to;
+          best.cost = cost;
+        }
+      }
+      if (best.cost < INFINITY) candidates[candidate_count++] = best;
+    }
+    qsort(candidates, candidate_count, sizeof(simplify_edge), simplify_edge_compare);
+    // Collapse the cheapest edges, locking each one-ring so the adjacency stays valid for the pass.
+    memset(locked, 0, vert_count * sizeof(bool));
+    for (u32 v = 0; v < vert_count; ++v) remap[v] = v;
+    u32 removed_target = (index_count - target_index_count) / 3;
+    u32 removed = 0;
+    u32 collapses = 0;
+    for (u32 c = 0; c < candidate_count && removed < removed_target; ++c)
+    {
+      u32 from = candidates[c].from;
+      u32 to = candidates[c].to;
+      if (locked[from] || locked[to]) continue;
+      u32 start = adjacency_start[from];
+      u32 end = adjacency_start[from + 1];
+      if (collapse_flips(model, indices, adjacency, start, end, from, to)) continue;
+      stamp += 2;
+      if (collapse_breaks_link(indices, adjacency, adjacency_start, from, to, mark, stamp)) continue;
+      for (u32 a = start; a < end; ++a)
+      {
+        u32 *tri = &indices[adjacency[a] * 3];
+        locked[tri[0]] = true;
+        locked[tri[1]] = true;
+        locked[tri[2]] = true;
+        if (tri[0] == to || tri[1] == to || tri[2] == to) removed++;
+      }
+      remap[from] = to;
+      quadric_add(&quadrics[to], &quadrics[from]);
+      error_max = (candidates[c].cost > error_max) ? candidates[c].cost : error_max;
+      collapses++;
+    }
+    if (collapses == 0) break;
+    // Apply the pass and drop the triangles that collapsed.
+    u32 write = 0;
+    for (u32 i = 0; i < index_count; i += 3)
+    {
+      u32 a = remap[indices[i + 0]];
+      u32 b = remap[indices[i + 1]];
+      u32 c = remap[indices[i + 2]];
+      if (a == b || b == c || a == c) continue;
+      indices[write++] = a;
+      indices[write++] = b;
+      indices[write++] = c;
+    }
+    index_count = write;
+  }
+  arena_pop(save);
+  if (error_out) *error_out = error_max;
+  return index_count;
+}
+
+
+/// @brief Build up to lod_count LODs, each with about ratio times the triangles of the one before.
+/// lods[0] is the full mesh. Index buffers are pushed onto a, all LODs share model's vertices.
+/// Returns the number of LODs made, fewer than asked for when the mesh can't be reduced further.
+u32 mesh_lod_chain(mesh *model, mesh_lod *lods, u32 lod_count, f32 ratio, arena *a, arena *scratch)
+{
+  if (lod_count == 0) return 0;
+  lods[0].indices = model->indices;
+  lods[0].index_count = model->index_count;
+  lods[0].error = 0.0f;
+  u32 made = 1;
+  for (u32 i = 1; i < lod_count; ++i)
+  {
+    mesh_lod *previous = &lods[i - 1];
+    u32 target = ((u32)(previous->index_count / 3 * ratio)) * 3;
+    u32 *indices = arena_push_array(a, previous->index_count, u32);
+    memcpy(indices, previous->indices, previous->index_count * sizeof(u32));
+    f32 error = 0.0f;
+    u32 count = mesh_simplify(model, indices, previous->index_count, target, &error, scratch);
+    // Stop once a step barely removes anything, the rest would just be copies.
+    if (count == 0 || count > previous->index_count - previous->index_count / 20)
+    {
+      arena_free_last(a);
+      break;
+    }
+    lods[i].indices = indices;
+    lods[i].index_count = count;
+    // Costs are measured against the previous LOD, so they add up along the chain.
+    lods[i].error = previous->error + error;
+    made++;
+  }
+  return made;
+}
+
+
+/// @brief Size in pixels of a model space error seen at distance with a perspective camera.
+f32 lod_screen_error(f32 error, f32 distance, f32 fov_y_rad, f32 screen_height)
+{
+  if (distance <= 0.0f) return INFINITY;
+  return error * screen_height / (2.0f * distance * tanf(fov_y_rad * 0.5f));
+}
+
+
+/// @brief Coarsest LOD whose screen error stays under max_pixels.
+u32 mesh_lod_select(mesh_lod *lods, u32 lod_count, f32 distance, f32 fov_y_rad, f32 screen_height, f32 max_pixels)
+{
+  u32 selected = 0;
+  for (u32 i = 1; i < lod_count; ++i)
+  {
+    if (lod_screen_error(lods[i].error, distance, fov_y_rad, screen_height) > max_pixels) break;
+    selected = i;
+  }
+  return selected;
+}
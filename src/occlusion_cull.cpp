@@ -0,0 +1,400 @@
+#include "frustum_cull.cpp"
+
+// Software occlusion culling.
+// A few big occluders are rasterized on the CPU into a small depth buffer (0 near, 1 far), a
+// hierarchical buffer keeps the farthest depth of every block, and entity boxes are tested
+// against it before they are submitted. A box is hidden when its nearest point is behind every
+// block its screen rectangle touches.
+//
+// Triangles are binned into screen tiles and each tile is rasterized by one job, four pixels at a
+// time. Triangles crossing the near plane are dropped: losing an occluder only costs culling,
+// never correctness. Pixels are sampled at their centers.
+
+#define OCCLUSION_TILE_WIDTH  32
+#define OCCLUSION_TILE_HEIGHT 16
+#define OCCLUSION_BLOCK_SIZE  8      // Pixels per side of a hierarchical depth block.
+#define OCCLUSION_NEAR_W      1e-5f
+
+
+struct occlusion_tri
+{
+  f32 x[3];  // Pixels, y down.
+  f32 y[3];
+  f32 z[3];
+};
+
+
+struct occlusion_buffer
+{
+  u32            width;          // Multiples of the tile size.
+  u32            height;
+  u32            tiles_x;
+  u32            tiles_y;
+  f32           *depth;          // width*height.
+  f32           *blocks;         // Farthest depth of each block, (width/8)*(height/8).
+  u32            blocks_x;
+  u32            blocks_y;
+  occlusion_tri *tris;           // Occluder triangles added this frame.
+  u32            tri_count;
+  u32            tri_capacity;
+};
+
+
+struct occlusion_raster_job
+{
+  occlusion_buffer *ob;
+  u32              *bin_offsets;  // tiles+1 prefix sums into bin_tris.
+  u32              *bin_tris;
+};
+
+
+struct occlusion_test_job
+{
+  occlusion_buffer *ob;
+  fmat4            *view_proj;
+  cull_bounds      *bounds;
+  fmat4            *transforms;
+  u32              *indices;      // Rows to test, chunk c filters its own range in place.
+  u32               count;
+  u32              *chunk_counts;
+};
+
+
+occlusion_buffer occlusion_init(arena *a, u32 width, u32 height, u32 max_triangles)
+{
+  occlusion_buffer ob = {};
+  ob.tiles_x = (width + OCCLUSION_TILE_WIDTH - 1) / OCCLUSION_TILE_WIDTH;
+  ob.tiles_y = (height + OCCLUSION_TILE_HEIGHT - 1) / OCCLUSION_TILE_HEIGHT;
+  ob.width = ob.tiles_x * OCCLUSION_TILE_WIDTH;
+  ob.height = ob.tiles_y * OCCLUSION_TILE_HEIGHT;
+  ob.blocks_x = ob.width / OCCLUSION_BLOCK_SIZE;
+  ob.blocks_y = ob.height / OCCLUSION_BLOCK_SIZE;
+  ob.depth = arena_push_array(a, (size_t)ob.width * ob.height, f32);
+  ob.blocks = arena_push_array(a, (size_t)ob.blocks_x * ob.blocks_y, f32);
+  ob.tris = arena_push_array(a, max_triangles, occlusion_tri);
+  ob.tri_capacity = max_triangles;
+  return ob;
+}
+
+
+/// @brief Start a frame: drop last frame's occluders. The depth is cleared by occlusion_rasterize.
+void occlusion_clear(occlusion_buffer *ob)
+{
+  ob->tri_count = 0;
+}
+
+
+internal void occlusion_project(fmat4 m, fvec3 p, f32 *out)
+{
+  for (u32 r = 0; r < 4; ++r)
+  {
+    out[r] = m[0][r]*p.x + m[1][r]*p.y + m[2][r]*p.z + m[3][r];
+  }
+}
+
+
+internal void occlusion_to_screen(occlusion_buffer *ob, f32 *clip, f32 *x, f32 *y, f32 *z)
+{
+  f32 inv_w = 1.0f / clip[3];
+  *x = (clip[0]*inv_w*0.5f + 0.5f) * (f32)ob->width;
+  *y = (0.5f - clip[1]*inv_w*0.5f) * (f32)ob->height;
+  #ifdef _D3D
+    *z = clip[2]*inv_w;
+  #else
+    *z = clip[2]*inv_w*0.5f + 0.5f;
+  #endif
+}
+
+
+/// @brief Add an entity's triangles as an occluder. mvp is proj*view*world.
+/// The mesh is read back, so keep it in CPU memory, not in a write only mapped GPU buffer.
+void occlusion_add_occluder(occlusion_buffer *ob, fmat4 mvp, entity e, vertex1 *vertices, u32 *elements)
+{
+  vertex1 *base = vertices + e.vert_start;
+  u32 *elems = elements + e.elem_start;
+  for (u64 i = 0; i + 2 < e.count; i += 3)
+  {
+    f32 clip[3][4];
+    bool near_cut = false;
+    for (u32 k = 0; k < 3; ++k)
+    {
+      occlusion_project(mvp, base[elems[i + k]].pos, clip[k]);
+      near_cut |= (clip[k][3] <= OCCLUSION_NEAR_W);
+    }
+    if (near_cut) continue;
+    occlusion_tri t = {};
+    for (u32 k = 0; k < 3; ++k)
+    {
+      occlusion_to_screen(ob, clip[k], &t.x[k], &t.y[k], &t.z[k]);
+    }
+    // Both windings are kept, so orient every triangle the same way for the edge functions.
+    f32 area = (t.x[1] - t.x[0])*(t.y[2] - t.y[0]) - (t.x[2] - t.x[0])*(t.y[1] - t.y[0]);
+    if (area == 0.0f) continue;
+    if (area < 0.0f)
+    {
+      f32 temp;
+      temp = t.x[1]; t.x[1] = t.x[2]; t.x[2] = temp;
+      temp = t.y[1]; t.y[1] = t.y[2]; t.y[2] = temp;
+      temp = t.z[1]; t.z[1] = t.z[2]; t.z[2] = temp;
+    }
+    // Out of room, the rest are dropped: fewer occluders only cost culling.
+    if (ob->tri_count == ob->tri_capacity) return;
+    ob->tris[ob->tri_count++] = t;
+  }
+}
+
+
+internal void occlusion_tri_rect(occlusion_buffer *ob, occlusion_tri *t, i32 *x0, i32 *y0, i32 *x1, i32 *y1)
+{
+  f32 min_x = fminf(t->x[0], fminf(t->x[1], t->x[2]));
+  f32 max_x = fmaxf(t->x[0], fmaxf(t->x[1], t->x[2]));
+  f32 min_y = fminf(t->y[0], fminf(t->y[1], t->y[2]));
+  f32 max_y = fmaxf(t->y[0], fmaxf(t->y[1], t->y[2]));
+  // Inclusive pixel range, clamped to the buffer. Empty when x1 < x0 or y1 < y0.
+  *x0 = (min_x < 0.0f) ? 0 : (i32)min_x;
+  *y0 = (min_y < 0.0f) ? 0 : (i32)min_y;
+  *x1 = (max_x >= (f32)ob->width)  ? (i32)ob->width - 1  : (i32)max_x;
+  *y1 = (max_y >= (f32)ob->height) ? (i32)ob->height - 1 : (i32)max_y;
+}
+
+
+internal void occlusion_tile_raster(void *data, u32 tile)
+{
+  occlusion_raster_job *job = (occlusion_raster_job*) data;
+  occlusion_buffer *ob = job->ob;
+  i32 tile_x0 = (tile % ob->tiles_x) * OCCLUSION_TILE_WIDTH;
+  i32 tile_y0 = (tile / ob->tiles_x) * OCCLUSION_TILE_HEIGHT;
+  i32 tile_x1 = tile_x0 + OCCLUSION_TILE_WIDTH - 1;
+  i32 tile_y1 = tile_y0 + OCCLUSION_TILE_HEIGHT - 1;
+  for (i32 y = tile_y0; y <= tile_y1; ++y)
+  {
+    f32 *row = ob->depth + (size_t)y * ob->width;
+    for (i32 x = tile_x0; x <= tile_x1; ++x) row[x] = 1.0f;
+  }
+  for (u32 b = job->bin_offsets[tile]; b < job->bin_offsets[tile + 1]; ++b)
+  {
+    occlusion_tri *t = &ob->tris[job->bin_tris[b]];
+    i32 x0, y0, x1, y1;
+    occlusion_tri_rect(ob, t, &x0, &y0, &x1, &y1);
+    x0 = (x0 < tile_x0) ? tile_x0 : x0;
+    y0 = (y0 < tile_y0) ? tile_y0 : y0;
+    x1 = (x1 > tile_x1) ? tile_x1 : x1;
+    y1 = (y1 > tile_y1) ? tile_y1 : y1;
+    // Whole groups of four, the tile width is a multiple of four.
+    x0 &= ~3;
+    // Edge k is inside when a*x + b*y + c >= 0.
+    f32 ea[3], eb[3], ec[3];
+    for (u32 k = 0; k < 3; ++k)
+    {
+      u32 n = (k + 1) % 3;
+      ea[k] = t->y[k] - t->y[n];
+      eb[k] = t->x[n] - t->x[k];
+      ec[k] = t->x[k]*t->y[n] - t->x[n]*t->y[k];
+    }
+    // Depth is linear in screen space.
+    f32 dx1 = t->x[1] - t->x[0], dy1 = t->y[1] - t->y[0], dz1 = t->z[1] - t->z[0];
+    f32 dx2 = t->x[2] - t->x[0], dy2 = t->y[2] - t->y[0], dz2 = t->z[2] - t->z[0];
+    f32 inv_area = 1.0f / (dx1*dy2 - dx2*dy1);
+    f32 za = (dz1*dy2 - dz2*dy1) * inv_area;
+    f32 zb = (dx1*dz2 - dx2*dz1) * inv_area;
+    f32 zc = t->z[0] - za*t->x[0] - zb*t->y[0];
+    #if LINALG_SSE
+      __m128 lane = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+      __m128 zero = _mm_setzero_ps();
+      for (i32 y = y0; y <= y1; ++y)
+      {
+        f32 py = (f32)y + 0.5f;
+        f32 *row = ob->depth + (size_t)y * ob->width;
+        __m128 e_row[3];
+        for (u32 k = 0; k < 3; ++k) e_row[k] = _mm_set1_ps(eb[k]*py + ec[k]);
+        __m128 z_row = _mm_set1_ps(zb*py + zc);
+        for (i32 x = x0; x <= x1; x += 4)
+        {
+          __m128 px = _mm_add_ps(_mm_set1_ps((f32)x), lane);
+          __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ea[0]), px), e_row[0]);
+          __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ea[1]), px), e_row[1]);
+          __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ea[2]), px), e_row[2]);
+          __m128 inside = _mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_and_ps(_mm_cmpge_ps(e1, zero), _mm_cmpge_ps(e2, zero)));
+          if (_mm_movemask_ps(inside) == 0) continue;
+          __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(za), px), z_row);
+          __m128 old = _mm_loadu_ps(row + x);
+          __m128 nearer = _mm_min_ps(old, z);
+          _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+        }
+      }
+    #else
+      for (i32 y = y0; y <= y1; ++y)
+      {
+        f32 py = (f32)y + 0.5f;
+        f32 *row = ob->depth + (size_t)y * ob->width;
+        for (i32 x = x0; x <= x1; ++x)
+        {
+          f32 px = (f32)x + 0.5f;
+          bool inside = (ea[0]*px + eb[0]*py + ec[0] >= 0.0f) &&
+                        (ea[1]*px + eb[1]*py + ec[1] >= 0.0f) &&
+                        (ea[2]*px + eb[2]*py + ec[2] >= 0.0f);
+          f32 z = za*px + zb*py + zc;
+          if (inside && z < row[x]) row[x] = z;
+        }
+      }
+    #endif
+  }
+  // Farthest depth of the tile's blocks.
+  for (i32 by = tile_y0 / OCCLUSION_BLOCK_SIZE; by <= tile_y1 / OCCLUSION_BLOCK_SIZE; ++by)
+  {
+    for (i32 bx = tile_x0 / OCCLUSION_BLOCK_SIZE; bx <= tile_x1 / OCCLUSION_BLOCK_SIZE; ++bx)
+    {
+      f32 farthest = 0.0f;
+      for (i32 y = by * OCCLUSION_BLOCK_SIZE; y < (by + 1) * OCCLUSION_BLOCK_SIZE; ++y)
+      {
+        f32 *row = ob->depth + (size_t)y * ob->width;
+        for (i32 x = bx * OCCLUSION_BLOCK_SIZE; x < (bx + 1) * OCCLUSION_BLOCK_SIZE; ++x)
+        {
+          farthest = (row[x] > farthest) ? row[x] : farthest;
+        }
+      }
+      ob->blocks[by * ob->blocks_x + bx] = farthest;
+    }
+  }
+}
+
+
+/// @brief Rasterize this frame's occluders and rebuild the block depths.
+void occlusion_rasterize(occlusion_buffer *ob, arena *scratch)
+{
+  arena_savepoint save = arena_save(scratch);
+  u32 tile_count = ob->tiles_x * ob->tiles_y;
+  occlusion_raster_job job = {};
+  job.ob = ob;
+  job.bin_offsets = arena_push_array(scratch, (tile_count + 1), u32);
+  // Pass 1: count the triangles touching each tile.
+  for (u32 i = 0; i < ob->tri_count; ++i)
+  {
+    i32 x0, y0, x1, y1;
+    occlusion_tri_rect(ob, &ob->tris[i], &x0, &y0, &x1, &y1);
+    for (i32 ty = y0 / OCCLUSION_TILE_HEIGHT; ty <= y1 / OCCLUSION_TILE_HEIGHT && y0 <= y1; ++ty)
+    {
+      for (i32 tx = x0 / OCCLUSION_TILE_WIDTH; tx <= x1 / OCCLUSION_TILE_WIDTH && x0 <= x1; ++tx)
+      {
+        job.bin_offsets[ty * ob->tiles_x + tx + 1]++;
+      }
+    }
+  }
+  for (u32 t = 0; t < tile_count; ++t)
+  {
+    job.bin_offsets[t + 1] += job.bin_offsets[t];
+  }
+  // Pass 2: fill the bins.
+  job.bin_tris = arena_push_array(scratch, job.bin_offsets[tile_count], u32);
+  u32 *cursor = arena_push_array(scratch, tile_count, u32);
+  for (u32 i = 0; i < ob->tri_count; ++i)
+  {
+    i32 x0, y0, x1, y1;
+    occlusion_tri_rect(ob, &ob->tris[i], &x0, &y0, &x1, &y1);
+    for (i32 ty = y0 / OCCLUSION_TILE_HEIGHT; ty <= y1 / OCCLUSION_TILE_HEIGHT && y0 <= y1; ++ty)
+    {
+      for (i32 tx = x0 / OCCLUSION_TILE_WIDTH; tx <= x1 / OCCLUSION_TILE_WIDTH && x0 <= x1; ++tx)
+      {
+        u32 tile = ty * ob->tiles_x + tx;
+        job.bin_tris[job.bin_offsets[tile] + cursor[tile]++] = i;
+      }
+    }
+  }
+  platform_jobs_run(occlusion_tile_raster, &job, tile_count);
+  arena_pop(save);
+}
+
+
+/// @brief False when the box is certainly hidden behind the occluders. mvp is proj*view*world.
+bool occlusion_visible(occlusion_buffer *ob, fmat4 mvp, cull_bounds b)
+{
+  f32 min_x = (f32)ob->width, max_x = 0.0f;
+  f32 min_y = (f32)ob->height, max_y = 0.0f;
+  f32 min_z = 1.0f;
+  for (u32 corner = 0; corner < 8; ++corner)
+  {
+    fvec3 p = fvec3_init((corner & 1) ? b.max.x : b.min.x, (corner & 2) ? b.max.y : b.min.y, (corner & 4) ? b.max.z : b.min.z);
+    f32 clip[4];
+    occlusion_project(mvp, p, clip);
+    // Crossing the near plane, the screen rectangle is unbounded.
+    if (clip[3] <= OCCLUSION_NEAR_W) return true;
+    f32 x, y, z;
+    occlusion_to_screen(ob, clip, &x, &y, &z);
+    min_x = fminf(min_x, x);
+    max_x = fmaxf(max_x, x);
+    min_y = fminf(min_y, y);
+    max_y = fmaxf(max_y, y);
+    min_z = fminf(min_z, z);
+  }
+  // Off screen is the frustum test's call.
+  if (max_x < 0.0f || max_y < 0.0f || min_x >= (f32)ob->width || min_y >= (f32)ob->height) return true;
+  i32 bx0 = (min_x < 0.0f) ? 0 : (i32)min_x / OCCLUSION_BLOCK_SIZE;
+  i32 by0 = (min_y < 0.0f) ? 0 : (i32)min_y / OCCLUSION_BLOCK_SIZE;
+  i32 bx1 = (max_x >= (f32)ob->width)  ? (i32)ob->blocks_x - 1 : (i32)max_x / OCCLUSION_BLOCK_SIZE;
+  i32 by1 = (max_y >= (f32)ob->height) ? (i32)ob->blocks_y - 1 : (i32)max_y / OCCLUSION_BLOCK_SIZE;
+  for (i32 by = by0; by <= by1; ++by)
+  {
+    for (i32 bx = bx0; bx <= bx1; ++bx)
+    {
+      if (min_z <= ob->blocks[by * ob->blocks_x + bx]) return true;
+    }
+  }
+  return false;
+}
+
+
+internal void occlusion_mvp(fmat4 out, fmat4 view_proj, fmat4 world)
+{
+  for (u32 c = 0; c < 4; ++c)
+  {
+    for (u32 r = 0; r < 4; ++r)
+    {
+      out[c][r] = view_proj[0][r]*world[c][0] + view_proj[1][r]*world[c][1] + view_proj[2][r]*world[c][2] + view_proj[3][r]*world[c][3];
+    }
+  }
+}
+
+
+internal void occlusion_test_chunk(void *data, u32 chunk)
+{
+  occlusion_test_job *job = (occlusion_test_job*) data;
+  u32 start = chunk * CULL_CHUNK_SIZE;
+  u32 end = (start + CULL_CHUNK_SIZE < job->count) ? start + CULL_CHUNK_SIZE : job->count;
+  u32 written = 0;
+  for (u32 i = start; i < end; ++i)
+  {
+    u32 row = job->indices[i];
+    fmat4 mvp;
+    occlusion_mvp(mvp, *job->view_proj, job->transforms[row]);
+    job->indices[start + written] = row;
+    written += occlusion_visible(job->ob, mvp, job->bounds[row]) ? 1 : 0;
+  }
+  job->chunk_counts[chunk] = written;
+}
+
+
+/// @brief Drop the hidden rows from indices (e.g. the output of frustum_cull), keeping the order.
+/// Returns the new count.
+u32 occlusion_cull(occlusion_buffer *ob, fmat4 view_proj, cull_bounds *bounds, fmat4 *transforms, u32 *indices, u32 count, arena *scratch)
+{
+  if (count == 0) return 0;
+  arena_savepoint save = arena_save(scratch);
+  occlusion_test_job job = {};
+  job.ob = ob;
+  job.view_proj = (fmat4*)view_proj;
+  job.bounds = bounds;
+  job.transforms = transforms;
+  job.indices = indices;
+  job.count = count;
+  u32 chunk_count = (count + CULL_CHUNK_SIZE - 1) / CULL_CHUNK_SIZE;
+  job.chunk_counts = arena_push_array(scratch, chunk_count, u32);
+  platform_jobs_run(occlusion_test_chunk, &job, chunk_count);
+  u32 total = job.chunk_counts[0];
+  for (u32 c = 1; c < chunk_count; ++c)
+  {
+    memmove(indices + total, indices + c * CULL_CHUNK_SIZE, job.chunk_counts[c] * sizeof(u32));
+    total += job.chunk_counts[c];
+  }
+  arena_pop(save);
+  return total;
+}
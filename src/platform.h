@@ -25,6 +25,9 @@ struct clock
   bool paused;        // A flag for pausing the timer.
 };
 
+// A unit of work run by the job system. Index is the job number in [0, count).
+typedef void platform_job(void *data, u32 index);
+
 // TODO: Move controller type info to main.cpp
 enum control_state
 {
@@ -64,7 +67,10 @@ void             platform_clock_update(clock *c);
 void*            platform_dll_load(const char *filepath);
 void*            platform_dll_func_load(void *dll, const char *func_name);
 void             platform_sleep(u32 miliseconds);
+void             platform_sleep_until(i64 deadline);
 void             platform_cursor_client_position(f32 *xout, f32 *yout, f64 width, f64 height);
+u32              platform_thread_count();
+void             platform_jobs_run(platform_job *job, void *data, u32 count);
 
 // TODO: Delete this, see if you can use the C++ tinyobj
 void             platform_file_data(void* ctx, const char* filename, const int is_mtl, const char* obj_filename, char** data, size_t* len);
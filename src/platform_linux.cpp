@@ -0,0 +1,345 @@
+// platform.h first: time.h declares a clock() function that hides the clock struct after it.
+#include "platform.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Headless Linux platform layer for the tools and windowless apps: memory, files, clock and the
+// job system. There is no window, the window calls do nothing and the app runs until it stops.
+
+#define MAX_COUNT_THREADS 64
+#define JOBS_CLOSED       0x40000000
+
+
+// The batch of jobs currently being worked on by the thread pool.
+// claim packs the batch's generation in the high half and the next job index in the low half,
+// so a worker still holding an old batch's claim can't take an index from the new one.
+struct job_batch
+{
+  platform_job *job;
+  void *data;
+  u32 count;
+  volatile u64 claim;  // Generation << 32 | next job index to claim.
+  volatile u32 done;   // Number of jobs finished.
+};
+
+
+struct platform_state
+{
+  bool is_running;
+  pthread_t workers[MAX_COUNT_THREADS];
+  u32 worker_count;
+  sem_t jobs_ready;    // Posted once per worker when a batch starts.
+  job_batch batch;
+};
+
+
+// Internal global state
+global platform_state *linstate;
+
+
+internal char* file_mmap(size_t* len, const char* filename)
+{
+  int file = open(filename, O_RDONLY);
+  if (file < 0) // E.g. Model may not have materials.
+  {
+    return NULL;
+  }
+  struct stat info = {};
+  fstat(file, &info);
+  void *view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+  close(file);
+  ASSERT(view != MAP_FAILED, "ERROR: Failed to map file.");
+  (*len) = (size_t)info.st_size;
+  return (char*)view;
+}
+
+
+void platform_file_data(void* ctx, const char* filename, const int is_mtl, const char* obj_filename, char** data, size_t* len)
+{
+  // mmap(), so no free() required.
+  (void)ctx;
+  if (!filename)
+  {
+    ASSERT(filename != NULL, "ERROR: Invalid file.");
+    fprintf(stderr, "null filename\n");
+    (*data) = NULL;
+    (*len) = 0;
+    return;
+  }
+  size_t data_len = 0;
+  *data = file_mmap(&data_len, filename);
+  (*len) = data_len;
+}
+
+
+// Claim and run jobs from the current batch until there are none left.
+internal void jobs_work(job_batch *batch)
+{
+  u64 claim = __atomic_load_n(&batch->claim, __ATOMIC_ACQUIRE);
+  for (;;)
+  {
+    // Read the batch under the claim seen, the exchange only succeeds if no new batch began since.
+    u32 index = (u32) claim;
+    platform_job *job = __atomic_load_n(&batch->job, __ATOMIC_RELAXED);
+    void *data = __atomic_load_n(&batch->data, __ATOMIC_RELAXED);
+    u32 count = __atomic_load_n(&batch->count, __ATOMIC_RELAXED);
+    if (index >= count) break;
+    if (!__atomic_compare_exchange_n(&batch->claim, &claim, claim + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) continue;
+    job(data, index);
+    __atomic_fetch_add(&batch->done, 1, __ATOMIC_RELEASE);
+    claim = __atomic_load_n(&batch->claim, __ATOMIC_ACQUIRE);
+  }
+}
+
+
+internal void* jobs_worker_main(void *param)
+{
+  platform_state *s = (platform_state*) param;
+  for (;;)
+  {
+    sem_wait(&s->jobs_ready);
+    jobs_work(&s->batch);
+  }
+  return 0;
+}
+
+
+internal void jobs_init()
+{
+  // The calling thread also works, so leave one core for it.
+  long core_count = sysconf(_SC_NPROCESSORS_ONLN);
+  u32 worker_count = (core_count > 1) ? (u32)core_count - 1 : 0;
+  worker_count = myclamp(worker_count, 0, MAX_COUNT_THREADS);
+  int result = sem_init(&linstate->jobs_ready, 0, 0);
+  ASSERT(result == 0, "ERROR: Failed to create job semaphore.");
+  linstate->batch.claim = JOBS_CLOSED;
+  linstate->batch.count = 0;
+  for (u32 i = 0; i < worker_count; ++i)
+  {
+    result = pthread_create(&linstate->workers[i], 0, jobs_worker_main, linstate);
+    ASSERT(result == 0, "ERROR: Failed to create worker thread.");
+  }
+  linstate->worker_count = worker_count;
+}
+
+
+void platform_init(arena *a)
+{
+  linstate = arena_push_struct(a, platform_state);
+  linstate->is_running = true;
+  jobs_init();
+}
+
+
+void* platform_memory_alloc(void *mem_base, size_t mem_size)
+{
+  // Reserved lazily by the kernel, pages are zero until touched like VirtualAlloc's.
+  void *memory = mmap(mem_base, mem_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+  ASSERT(memory != MAP_FAILED, "ERROR: Unable to allocate application memory.");
+  return memory;
+}
+
+
+platform_window platform_window_init()
+{
+  platform_window window = {};
+  return window;
+}
+
+
+void platform_window_show()
+{
+}
+
+
+void platform_window_size(platform_window *wind)
+{
+  wind->width = 0;
+  wind->height = 0;
+}
+
+
+void* platform_window_handle()
+{
+  return 0;
+}
+
+
+void platform_window_close()
+{
+  linstate->is_running = false;
+}
+
+
+bool platform_is_running()
+{
+  return linstate->is_running;
+}
+
+
+void platform_message_process( platform_window *window, input_state *inputs )
+{
+}
+
+
+void platform_opengl_init()
+{
+}
+
+
+void platform_swapbuffers()
+{
+}
+
+
+const char * platform_file_read(const char *file, arena *scratch, size_t *out_size)
+{
+  FILE *stream = fopen(file, "rb");
+  ASSERT(stream, "ERROR: Failed to read file.");
+  fseek(stream, 0, SEEK_END);
+  *out_size = ftell(stream);
+  char *contents = (char*) arena_alloc(scratch, *out_size);
+  fseek(stream, 0, SEEK_SET);
+  size_t bytes_read = fread(contents, 1, *out_size, stream);
+  bool8 success = bytes_read == *out_size;
+  ASSERT(success, "ERROR: Read incorrect number of bytes from file.");
+  fclose(stream);
+  return contents;
+}
+
+
+int platform_file_exists(const char *filepath)
+{
+  return access(filepath, R_OK) == 0;
+}
+
+
+i64 platform_clock_time()
+{
+  // Nanosecond counts
+  timespec now = {};
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (i64)now.tv_sec * 1000000000LL + (i64)now.tv_nsec;
+}
+
+
+struct clock platform_clock_init(f64 fps_target)
+{
+  struct clock c = {};
+  c.delta = -1.0f;
+  c.paused = false;
+  c.secs_per_frame = 1.0 / fps_target;
+  c.secs_per_count = 1.0 / 1000000000.0;
+  return c;
+}
+
+
+void platform_clock_reset(struct clock *c)
+{
+  i64 t_current = platform_clock_time();
+  c->base = t_current;
+  c->prev = t_current;
+  c->paused = false;
+  c->stop = 0;
+}
+
+
+void platform_clock_update(struct clock *c)
+{
+  c->curr = platform_clock_time();
+  f64 delta_ticks = (f64) (c->curr - c->prev);
+  c->delta = delta_ticks * c->secs_per_count;
+  c->prev = c->curr;
+  if (c->delta < 0.0)
+  {
+    c->delta = 0.0;
+  }
+}
+
+
+void* platform_dll_load(const char *filepath)
+{
+  void *dll_handle = dlopen(filepath, RTLD_NOW);
+  ASSERT(dll_handle, "Failed to load shared library.\n");
+  return dll_handle;
+}
+
+
+void* platform_dll_func_load(void *dll, const char *func_name)
+{
+  return dlsym(dll, func_name);
+}
+
+
+void platform_sleep(u32 miliseconds)
+{
+  timespec duration = {};
+  duration.tv_sec = miliseconds / 1000;
+  duration.tv_nsec = (long)(miliseconds % 1000) * 1000000L;
+  nanosleep(&duration, 0);
+}
+
+
+/// @brief Sleep until platform_clock_time reaches deadline. Wakes late by the scheduler's slack,
+/// spin the rest of the way for exact timing.
+void platform_sleep_until(i64 deadline)
+{
+  // Clock counts are CLOCK_MONOTONIC nanoseconds, so the deadline works as an absolute time.
+  timespec wake = {};
+  wake.tv_sec = deadline / 1000000000LL;
+  wake.tv_nsec = deadline % 1000000000LL;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, 0) == EINTR)
+  {
+  }
+}
+
+
+void platform_cursor_client_position(f32 *xout, f32 *yout, f64 width, f64 height)
+{
+  *xout = 0.0f;
+  *yout = 0.0f;
+}
+
+
+u32 platform_thread_count()
+{
+  // Workers plus the calling thread.
+  return linstate->worker_count + 1;
+}
+
+
+void platform_jobs_run(platform_job *job, void *data, u32 count)
+{
+  // Not reentrant: jobs must not call this themselves.
+  if (count == 0) return;
+  job_batch *batch = &linstate->batch;
+  // Start a new generation parked out of range: claims from the last batch fail from here on and
+  // nobody claims from this one until it is written.
+  u64 generation = (__atomic_load_n(&batch->claim, __ATOMIC_RELAXED) >> 32) + 1;
+  __atomic_exchange_n(&batch->claim, (generation << 32) | JOBS_CLOSED, __ATOMIC_ACQ_REL);
+  __atomic_store_n(&batch->job, job, __ATOMIC_RELAXED);
+  __atomic_store_n(&batch->data, data, __ATOMIC_RELAXED);
+  __atomic_store_n(&batch->count, count, __ATOMIC_RELAXED);
+  __atomic_store_n(&batch->done, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&batch->claim, generation << 32, __ATOMIC_RELEASE);
+  u32 wake_count = (count - 1 < linstate->worker_count) ? count - 1 : linstate->worker_count;
+  for (u32 i = 0; i < wake_count; ++i)
+  {
+    sem_post(&linstate->jobs_ready);
+  }
+  // Work on the batch from this thread too, then wait for the stragglers.
+  jobs_work(batch);
+  while (__atomic_load_n(&batch->done, __ATOMIC_ACQUIRE) < count)
+  {
+    sched_yield();
+  }
+}
@@ -4,12 +4,38 @@
 #include "opengl.h"
 
 
+#define MAX_COUNT_THREADS 64
+#define JOBS_CLOSED       0x40000000
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+
+// The batch of jobs currently being worked on by the thread pool.
+// claim packs the batch's generation in the high half and the next job index in the low half,
+// so a worker still holding an old batch's claim can't take an index from the new one.
+struct job_batch
+{
+  platform_job *volatile job;
+  void *volatile data;
+  volatile u32 count;
+  volatile LONG64 claim;  // Generation << 32 | next job index to claim.
+  volatile LONG done;     // Number of jobs finished.
+};
+
+
 struct platform_state
 {
   HWND handle;
   HINSTANCE instance;
   HDC render_context;
   bool is_running; 
+  HANDLE workers[MAX_COUNT_THREADS];
+  u32 worker_count;
+  HANDLE jobs_ready;   // Semaphore signaled once per worker when a batch starts.
+  job_batch batch;
+  HANDLE sleep_timer;  // Waitable timer for platform_sleep_until.
+  i64 counts_per_sec;
 };
 
 
@@ -110,10 +136,81 @@ void platform_file_data(void* ctx, const char* filename, const int is_mtl, const
 }
 
 
+// Claim and run jobs from the current batch until there are none left.
+internal void jobs_work(job_batch *batch)
+{
+  LONG64 claim = batch->claim;
+  for (;;)
+  {
+    // Read the batch under the claim seen, the exchange only succeeds if no new batch began since.
+    u32 index = (u32) claim;
+    platform_job *job = batch->job;
+    void *data = batch->data;
+    u32 count = batch->count;
+    if (index >= count) break;
+    LONG64 seen = InterlockedCompareExchange64(&batch->claim, claim + 1, claim);
+    if (seen != claim)
+    {
+      claim = seen;
+      continue;
+    }
+    job(data, index);
+    InterlockedIncrement(&batch->done);
+    claim = batch->claim;
+  }
+}
+
+
+internal DWORD WINAPI jobs_worker_main(LPVOID param)
+{
+  platform_state *s = (platform_state*) param;
+  for (;;)
+  {
+    WaitForSingleObject(s->jobs_ready, INFINITE);
+    jobs_work(&s->batch);
+  }
+  return 0;
+}
+
+
+internal void jobs_init()
+{
+  SYSTEM_INFO info = {};
+  GetSystemInfo(&info);
+  // The calling thread also works, so leave one core for it.
+  u32 core_count = (u32) info.dwNumberOfProcessors;
+  u32 worker_count = (core_count > 1) ? core_count - 1 : 0;
+  worker_count = myclamp(worker_count, 0, MAX_COUNT_THREADS);
+  windstate->jobs_ready = CreateSemaphoreA(0, 0, MAX_COUNT_THREADS, 0);
+  ASSERT(windstate->jobs_ready, "ERROR: Failed to create job semaphore.");
+  windstate->batch.claim = JOBS_CLOSED;
+  windstate->batch.count = 0;
+  for (u32 i = 0; i < worker_count; ++i)
+  {
+    windstate->workers[i] = CreateThread(0, 0, jobs_worker_main, windstate, 0, 0);
+    ASSERT(windstate->workers[i], "ERROR: Failed to create worker thread.");
+  }
+  windstate->worker_count = worker_count;
+}
+
+
 void platform_init(arena *a)
 {
   windstate = arena_push_struct(a, platform_state);
   windstate->is_running = true;
+  jobs_init();
+  // High resolution timers (Windows 10 1803+) wake within about half a millisecond. Older systems
+  // get a normal timer and a 1 ms scheduler period instead.
+  windstate->sleep_timer = CreateWaitableTimerExW(0, 0, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+  if (!windstate->sleep_timer)
+  {
+    windstate->sleep_timer = CreateWaitableTimerExW(0, 0, 0, TIMER_ALL_ACCESS);
+    timeBeginPeriod(1);
+  }
+  ASSERT(windstate->sleep_timer, "ERROR: Failed to create sleep timer.");
+  LARGE_INTEGER frequency;
+  QueryPerformanceFrequency(&frequency);
+  windstate->counts_per_sec = frequency.QuadPart;
 }
 
 
@@ -680,6 +777,21 @@ void platform_sleep(u32 miliseconds)
 }
 
 
+/// @brief Sleep until platform_clock_time reaches deadline. Wakes late by the timer's resolution,
+/// spin the rest of the way for exact timing.
+void platform_sleep_until(i64 deadline)
+{
+  i64 remaining = deadline - platform_clock_time();
+  if (remaining <= 0) return;
+  // Negative due times are relative, in 100 ns units.
+  LARGE_INTEGER due;
+  due.QuadPart = -(remaining * 10000000LL / windstate->counts_per_sec);
+  if (due.QuadPart == 0) return;
+  SetWaitableTimer(windstate->sleep_timer, &due, 0, 0, 0, FALSE);
+  WaitForSingleObject(windstate->sleep_timer, INFINITE);
+}
+
+
 void platform_cursor_client_position(f32 *xout, f32 *yout, f64 width, f64 height)
 {
   f64 w_half  = width / 2;
@@ -693,4 +805,39 @@ void platform_cursor_client_position(f32 *xout, f32 *yout, f64 width, f64 height
   ytemp = ((f32)p.y*-1.0f) + h_half;
   *xout = myclamp(xtemp, -w_half, w_half);
   *yout = myclamp(ytemp, -h_half, h_half);
-}
\ No newline at end of file
+}
+
+
+u32 platform_thread_count()
+{
+  // Workers plus the calling thread.
+  return windstate->worker_count + 1;
+}
+
+
+void platform_jobs_run(platform_job *job, void *data, u32 count)
+{
+  // Not reentrant: jobs must not call this themselves.
+  if (count == 0) return;
+  job_batch *batch = &windstate->batch;
+  // Start a new generation parked out of range: claims from the last batch fail from here on and
+  // nobody claims from this one until it is written.
+  LONG64 generation = (batch->claim >> 32) + 1;
+  InterlockedExchange64(&batch->claim, (generation << 32) | JOBS_CLOSED);
+  batch->job = job;
+  batch->data = data;
+  batch->count = count;
+  batch->done = 0;
+  InterlockedExchange64(&batch->claim, generation << 32);
+  u32 wake_count = (count - 1 < windstate->worker_count) ? count - 1 : windstate->worker_count;
+  if (wake_count > 0)
+  {
+    ReleaseSemaphore(windstate->jobs_ready, wake_count, 0);
+  }
+  // Work on the batch from this thread too, then wait for the stragglers.
+  jobs_work(batch);
+  while ((u32) batch->done < count)
+  {
+    YieldProcessor();
+  }
+}
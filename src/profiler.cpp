@@ -0,0 +1,256 @@
+#include "core.h"
+#include "platform.h"
+#include "text.cpp"
+
+// Frame profiler. Zones are timed with platform_clock_time and written into a ring per thread,
+// so recording takes no locks and the oldest events are overwritten once a ring is full.
+// profile_frame marks the frame boundary and sums up the finished frame for the text overlay,
+// profile_trace_write dumps every event still in the rings as Chrome trace JSON
+// (chrome://tracing or ui.perfetto.dev).
+// Other threads' rings are only read at frame boundaries and export, when the job system is idle.
+
+#ifndef PROFILE_ENABLED
+#define PROFILE_ENABLED 1
+#endif
+
+#define PROFILE_RING_EVENTS  8192   // Per thread, a power of two.
+#define PROFILE_MAX_DEPTH    32
+#define PROFILE_MAX_STATS    64     // Distinct zones summed up per frame.
+
+
+struct profile_event
+{
+  const char *name;   // Has to outlive the profiler, string literals or __func__.
+  i64 start;
+  i64 end;            // 0 while the zone is open.
+  u32 frame;
+  u32 depth;
+};
+
+
+struct profile_ring
+{
+  profile_event *events;
+  u64 head;                         // Events written so far, the slot is head % PROFILE_RING_EVENTS.
+  u64 open[PROFILE_MAX_DEPTH];      // Positions of the zones not yet ended.
+  u32 depth;
+};
+
+
+// One zone summed over the last finished frame.
+struct profile_stat
+{
+  const char *name;
+  f64 ms;
+  u32 calls;
+  u32 depth;   // Of its first call.
+};
+
+
+struct profiler
+{
+  profile_ring *rings;
+  u32 ring_capacity;
+  volatile u32 ring_count;
+  u32 frame;
+  i64 base;                         // Time of profile_init, trace timestamps start here.
+  i64 frame_start;
+  f64 secs_per_count;
+  f64 frame_ms;                     // Length of the last finished frame.
+  profile_stat stats[PROFILE_MAX_STATS];
+  u32 stat_count;
+};
+
+
+global profiler *profile;
+global thread_local profile_ring *profile_local;
+global const char *profile_frame_name = "frame";
+
+
+internal profile_ring* profile_ring_get()
+{
+  if (!profile_local)
+  {
+    // First zone on this thread, take the next free ring.
+    u32 index = __atomic_fetch_add(&profile->ring_count, 1, __ATOMIC_RELAXED);
+    ASSERT(index < profile->ring_capacity, "ERROR: More threads than profiler rings.");
+    profile_local = &profile->rings[index];
+  }
+  return profile_local;
+}
+
+
+/// @brief Set up one ring per platform thread, call after platform_init. The calling thread gets ring 0.
+void profile_init(arena *a)
+{
+  profile = arena_push_struct(a, profiler);
+  profile->ring_capacity = platform_thread_count();
+  profile->rings = arena_push_array(a, profile->ring_capacity, profile_ring);
+  for (u32 i = 0; i < profile->ring_capacity; ++i)
+  {
+    profile->rings[i].events = arena_push_array(a, PROFILE_RING_EVENTS, profile_event);
+  }
+  profile->secs_per_count = platform_clock_init(60.0).secs_per_count;
+  profile->base = platform_clock_time();
+  profile->frame_start = profile->base;
+  profile_ring_get();
+}
+
+
+void profile_begin(const char *name)
+{
+  profile_ring *ring = profile_ring_get();
+  ASSERT(ring->depth < PROFILE_MAX_DEPTH, "ERROR: Profile zones nested too deep.");
+  profile_event *e = &ring->events[ring->head % PROFILE_RING_EVENTS];
+  e->name = name;
+  e->end = 0;
+  e->frame = profile->frame;
+  e->depth = ring->depth;
+  ring->open[ring->depth++] = ring->head++;
+  e->start = platform_clock_time();
+}
+
+
+void profile_end()
+{
+  i64 end = platform_clock_time();
+  profile_ring *ring = profile_local;
+  ASSERT(ring && ring->depth > 0, "ERROR: profile_end without profile_begin.");
+  u64 position = ring->open[--ring->depth];
+  // Dropped if a full ring of newer events has written over it.
+  if (ring->head - position <= PROFILE_RING_EVENTS)
+  {
+    ring->events[position % PROFILE_RING_EVENTS].end = end;
+  }
+}
+
+
+// Times the enclosing scope.
+struct profile_scope
+{
+  profile_scope(const char *name) { profile_begin(name); }
+  ~profile_scope()                { profile_end(); }
+};
+
+#if PROFILE_ENABLED
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b)  PROFILE_JOIN2(a, b)
+#define PROFILE_ZONE(name)  profile_scope PROFILE_JOIN(profile_zone_, __LINE__)(name)
+#define PROFILE_FUNCTION()  PROFILE_ZONE(__func__)
+#define PROFILE_BEGIN(name) profile_begin(name)
+#define PROFILE_END()       profile_end()
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_FUNCTION()
+#define PROFILE_BEGIN(name)
+#define PROFILE_END()
+#endif
+
+
+internal void profile_stats_add(profile_event *e)
+{
+  f64 ms = (f64)(e->end - e->start) * profile->secs_per_count * 1000.0;
+  for (u32 i = 0; i < profile->stat_count; ++i)
+  {
+    profile_stat *stat = &profile->stats[i];
+    if (stat->name == e->name || strcmp(stat->name, e->name) == 0)
+    {
+      stat->ms += ms;
+      stat->calls++;
+      return;
+    }
+  }
+  if (profile->stat_count == PROFILE_MAX_STATS) return;
+  profile_stat *stat = &profile->stats[profile->stat_count++];
+  stat->name = e->name;
+  stat->ms = ms;
+  stat->calls = 1;
+  stat->depth = e->depth;
+}
+
+
+/// @brief Frame boundary, call once at the top of app_update on the thread that called profile_init.
+/// Closes the running frame and sums its zones for profile_overlay.
+void profile_frame()
+{
+  i64 now = platform_clock_time();
+  u32 finished = profile->frame;
+  // The frame itself shows up as the outermost zone in the trace.
+  profile_ring *ring = profile_ring_get();
+  profile_event *e = &ring->events[ring->head++ % PROFILE_RING_EVENTS];
+  e->name = profile_frame_name;
+  e->start = profile->frame_start;
+  e->end = now;
+  e->frame = finished;
+  e->depth = 0;
+  profile->frame_ms = (f64)(now - profile->frame_start) * profile->secs_per_count * 1000.0;
+  profile->stat_count = 0;
+  u32 ring_count = profile->ring_count;
+  for (u32 r = 0; r < ring_count; ++r)
+  {
+    profile_ring *source = &profile->rings[r];
+    // Events are in begin order, walk back to the first one of the finished frame.
+    u64 oldest = (source->head > PROFILE_RING_EVENTS) ? source->head - PROFILE_RING_EVENTS : 0;
+    u64 first = source->head;
+    while (first > oldest && source->events[(first - 1) % PROFILE_RING_EVENTS].frame >= finished) first--;
+    for (u64 i = first; i < source->head; ++i)
+    {
+      profile_event *event = &source->events[i % PROFILE_RING_EVENTS];
+      if (event->frame != finished || event->end == 0 || event->name == profile_frame_name) continue;
+      profile_stats_add(event);
+    }
+  }
+  profile->frame++;
+  profile->frame_start = now;
+}
+
+
+/// @brief Write the last frame's time and zones, indented by depth, one line each.
+/// Line spacing follows the atlas glyph size, like text_add's own metrics.
+void profile_overlay(arena *text_buffer, i32 window_height, glm::vec3 position, f32 size, f32 pixel_scale)
+{
+  f32 line_height = char_atlas().char_size * pixel_scale * size;
+  glm::vec4 color = glm::vec4(1.0f, 1.0f, 0.0f, 1.0f);
+  char line[96];
+  i32 length = snprintf(line, sizeof(line), "frame %u  %.2f ms", profile->frame - 1, profile->frame_ms);
+  text_add(text_buffer, line, (u32)length, window_height, position, size, color, pixel_scale);
+  for (u32 i = 0; i < profile->stat_count; ++i)
+  {
+    profile_stat *stat = &profile->stats[i];
+    position.y -= line_height;
+    u32 indent = 2 * (stat->depth + 1);
+    length = snprintf(line, sizeof(line), "%*s%-24s %7.3f ms  x%u", indent, "", stat->name, stat->ms, stat->calls);
+    length = myclamp(length, 0, (i32)sizeof(line) - 1);
+    text_add(text_buffer, line, (u32)length, window_height, position, size, color, pixel_scale);
+  }
+}
+
+
+/// @brief Export every finished zone still held in the rings as Chrome Trace Event JSON.
+bool profile_trace_write(const char *file)
+{
+  FILE *out = fopen(file, "w");
+  if (!out) return false;
+  f64 to_us = profile->secs_per_count * 1000000.0;
+  fprintf(out, "{\"traceEvents\":[\n");
+  bool first = true;
+  u32 ring_count = profile->ring_count;
+  for (u32 r = 0; r < ring_count; ++r)
+  {
+    profile_ring *ring = &profile->rings[r];
+    fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"%s %u\"}}",
+            first ? "" : ",\n", r, (r == 0) ? "main" : "worker", r);
+    first = false;
+    u64 oldest = (ring->head > PROFILE_RING_EVENTS) ? ring->head - PROFILE_RING_EVENTS : 0;
+    for (u64 i = oldest; i < ring->head; ++i)
+    {
+      profile_event *e = &ring->events[i % PROFILE_RING_EVENTS];
+      if (e->end == 0) continue;
+      fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u}}",
+              e->name, r, (f64)(e->start - profile->base) * to_us, (f64)(e->end - e->start) * to_us, e->frame);
+    }
+  }
+  fprintf(out, "\n],\"displayTimeUnit\":\"ms\"}\n");
+  fclose(out);
+  return true;
+}
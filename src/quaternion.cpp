@@ -0,0 +1,426 @@
+#include "core.h"
+#include "linalg.h"
+#include "transform_batch.cpp"
+
+// Quaternion rotations, dual quaternions for rigid skinning, and node hierarchies.
+// Single quaternions are plain values. Animation sized work (blending thousands of poses) runs on
+// SoA arrays four quaternions per SSE op. A hierarchy keeps its nodes' local TRS in SoA with every
+// parent stored before its children, so one pass in index order produces all world matrices.
+
+#define QUAT_SLERP_NLERP_DOT 0.9995f  // Above this the angle is too small for sin(angle) to divide by.
+
+
+union quat
+{
+  struct
+  {
+    f32 x, y, z, w;
+  };
+  f32 array[4];
+};
+
+
+// Real part rotates, dual part carries the translation: dual = 0.5 * (t, 0) * real.
+struct dquat
+{
+  quat real;
+  quat dual;
+};
+
+
+struct quat_soa
+{
+  f32 *x, *y, *z, *w;
+};
+
+
+struct hierarchy
+{
+  u32            count;
+  u32            capacity;
+  i32           *parent;        // Always lower than the node's index, -1 for roots.
+  transform_trs  local;
+  fmat4         *local_matrix;
+  fmat4         *world;
+};
+
+
+quat quat_identity()
+{
+  quat q = { .array = { 0.0f, 0.0f, 0.0f, 1.0f } };
+  return q;
+}
+
+
+/// @brief Rotation of angle_rad around axis, the axis doesn't need to be normalized.
+quat quat_from_axis_angle(fvec3 axis, f32 angle_rad)
+{
+  f32 length_sq = axis.x*axis.x + axis.y*axis.y + axis.z*axis.z;
+  if (length_sq <= 0.0f) return quat_identity();
+  f32 s = sinf(0.5f * angle_rad) / sqrtf(length_sq);
+  quat q = { .array = { axis.x * s, axis.y * s, axis.z * s, cosf(0.5f * angle_rad) } };
+  return q;
+}
+
+
+/// @brief a * b, rotates by b first then a. Same order as the matrices.
+quat quat_mul(quat a, quat b)
+{
+  quat q;
+  q.x = a.w*b.x + a.x*b.w + a.y*b.z - a.z*b.y;
+  q.y = a.w*b.y - a.x*b.z + a.y*b.w + a.z*b.x;
+  q.z = a.w*b.z + a.x*b.y - a.y*b.x + a.z*b.w;
+  q.w = a.w*b.w - a.x*b.x - a.y*b.y - a.z*b.z;
+  return q;
+}
+
+
+quat quat_conjugate(quat q)
+{
+  q.x = -q.x;
+  q.y = -q.y;
+  q.z = -q.z;
+  return q;
+}
+
+
+quat quat_normalize(quat q)
+{
+  fvec4 v = fvec4_normalize_fast(fvec4_init(q.x, q.y, q.z, q.w));
+  memcpy(q.array, v.array, sizeof(q.array));
+  return q;
+}
+
+
+fvec3 quat_rotate(quat q, fvec3 v)
+{
+  // v + 2w(u x v) + 2u x (u x v), u the vector part.
+  fvec3 u = fvec3_init(q.x, q.y, q.z);
+  fvec3 uv = fvec3_init(u.y*v.z - u.z*v.y, u.z*v.x - u.x*v.z, u.x*v.y - u.y*v.x);
+  fvec3 uuv = fvec3_init(u.y*uv.z - u.z*uv.y, u.z*uv.x - u.x*uv.z, u.x*uv.y - u.y*uv.x);
+  return fvec3_add(v, fvec3_add(fvec3_scale(uv, 2.0f*q.w), fvec3_scale(uuv, 2.0f)));
+}
+
+
+/// @brief Rotation matrix of a unit quaternion, same as fmat4_rotate on the identity.
+void quat_to_fmat4(fmat4 out, quat q)
+{
+  f32 x = q.x, y = q.y, z = q.z, w = q.w;
+  out[0][0] = 1.0f - 2.0f*(y*y + z*z);
+  out[0][1] = 2.0f*(x*y + w*z);
+  out[0][2] = 2.0f*(x*z - w*y);
+  out[0][3] = 0.0f;
+  out[1][0] = 2.0f*(x*y - w*z);
+  out[1][1] = 1.0f - 2.0f*(x*x + z*z);
+  out[1][2] = 2.0f*(y*z + w*x);
+  out[1][3] = 0.0f;
+  out[2][0] = 2.0f*(x*z + w*y);
+  out[2][1] = 2.0f*(y*z - w*x);
+  out[2][2] = 1.0f - 2.0f*(x*x + y*y);
+  out[2][3] = 0.0f;
+  out[3][0] = 0.0f;
+  out[3][1] = 0.0f;
+  out[3][2] = 0.0f;
+  out[3][3] = 1.0f;
+}
+
+
+/// @brief Normalized lerp along the shorter arc. Not constant speed, fine for close rotations.
+quat quat_nlerp(quat a, quat b, f32 t)
+{
+  f32 d = a.x*b.x + a.y*b.y + a.z*b.z + a.w*b.w;
+  f32 tb = (d < 0.0f) ? -t : t;
+  quat q;
+  for (u32 k = 0; k < 4; ++k) q.array[k] = a.array[k]*(1.0f - t) + b.array[k]*tb;
+  return quat_normalize(q);
+}
+
+
+/// @brief Constant speed interpolation along the shorter arc.
+quat quat_slerp(quat a, quat b, f32 t)
+{
+  f32 d = a.x*b.x + a.y*b.y + a.z*b.z + a.w*b.w;
+  f32 sign = 1.0f;
+  if (d < 0.0f)
+  {
+    d = -d;
+    sign = -1.0f;
+  }
+  if (d > QUAT_SLERP_NLERP_DOT) return quat_nlerp(a, b, t);
+  f32 angle = acosf(d);
+  f32 inv_sin = 1.0f / sinf(angle);
+  f32 wa = sinf((1.0f - t) * angle) * inv_sin;
+  f32 wb = sinf(t * angle) * inv_sin * sign;
+  quat q;
+  for (u32 k = 0; k < 4; ++k) q.array[k] = a.array[k]*wa + b.array[k]*wb;
+  return q;
+}
+
+
+quat_soa quat_soa_init(arena *a, u32 capacity)
+{
+  quat_soa q = {};
+  q.x = arena_push_array(a, capacity, f32);
+  q.y = arena_push_array(a, capacity, f32);
+  q.z = arena_push_array(a, capacity, f32);
+  q.w = arena_push_array(a, capacity, f32);
+  return q;
+}
+
+
+/// @brief The rotations of a TRS table, shares its memory.
+quat_soa quat_soa_from_trs(transform_trs trs)
+{
+  quat_soa q = { trs.qx, trs.qy, trs.qz, trs.qw };
+  return q;
+}
+
+
+#if LINALG_SSE
+// 0 <= x <= pi/2, Taylor to x^11, error below 1e-7.
+internal inline __m128 quat_sin_ps(__m128 x)
+{
+  __m128 x2 = _mm_mul_ps(x, x);
+  __m128 p = _mm_set1_ps(-1.0f / 39916800.0f);
+  p = linalg_fmadd(p, x2, _mm_set1_ps(1.0f / 362880.0f));
+  p = linalg_fmadd(p, x2, _mm_set1_ps(-1.0f / 5040.0f));
+  p = linalg_fmadd(p, x2, _mm_set1_ps(1.0f / 120.0f));
+  p = linalg_fmadd(p, x2, _mm_set1_ps(-1.0f / 6.0f));
+  p = linalg_fmadd(p, x2, _mm_set1_ps(1.0f));
+  return _mm_mul_ps(p, x);
+}
+
+
+// 0 <= x <= 1, Abramowitz and Stegun 4.4.46, error below 2e-8.
+internal inline __m128 quat_acos_ps(__m128 x)
+{
+  __m128 p = _mm_set1_ps(-0.0012624911f);
+  p = linalg_fmadd(p, x, _mm_set1_ps(0.0066700901f));
+  p = linalg_fmadd(p, x, _mm_set1_ps(-0.0170881256f));
+  p = linalg_fmadd(p, x, _mm_set1_ps(0.0308918810f));
+  p = linalg_fmadd(p, x, _mm_set1_ps(-0.0501743046f));
+  p = linalg_fmadd(p, x, _mm_set1_ps(0.0889789874f));
+  p = linalg_fmadd(p, x, _mm_set1_ps(-0.2145988016f));
+  p = linalg_fmadd(p, x, _mm_set1_ps(1.5707963050f));
+  return _mm_mul_ps(p, _mm_sqrt_ps(_mm_sub_ps(_mm_set1_ps(1.0f), x)));
+}
+
+
+// Blend four quaternions per lane with per lane weights, then normalize.
+internal inline void quat_blend_store_ps(quat_soa a, quat_soa b, quat_soa out, u32 i, __m128 wa, __m128 wb)
+{
+  f32 *src_a[4] = { a.x, a.y, a.z, a.w };
+  f32 *src_b[4] = { b.x, b.y, b.z, b.w };
+  f32 *dst[4] = { out.x, out.y, out.z, out.w };
+  __m128 q[4];
+  __m128 length_sq = _mm_setzero_ps();
+  for (u32 k = 0; k < 4; ++k)
+  {
+    q[k] = linalg_fmadd(_mm_loadu_ps(src_a[k] + i), wa, _mm_mul_ps(_mm_loadu_ps(src_b[k] + i), wb));
+    length_sq = linalg_fmadd(q[k], q[k], length_sq);
+  }
+  __m128 inv_length = linalg_rsqrt(length_sq);
+  for (u32 k = 0; k < 4; ++k) _mm_storeu_ps(dst[k] + i, _mm_mul_ps(q[k], inv_length));
+}
+
+
+internal inline __m128 quat_dot_ps(quat_soa a, quat_soa b, u32 i)
+{
+  __m128 d = _mm_mul_ps(_mm_loadu_ps(a.x + i), _mm_loadu_ps(b.x + i));
+  d = linalg_fmadd(_mm_loadu_ps(a.y + i), _mm_loadu_ps(b.y + i), d);
+  d = linalg_fmadd(_mm_loadu_ps(a.z + i), _mm_loadu_ps(b.z + i), d);
+  return linalg_fmadd(_mm_loadu_ps(a.w + i), _mm_loadu_ps(b.w + i), d);
+}
+#endif
+
+
+internal inline quat quat_soa_get(quat_soa q, u32 i)
+{
+  quat out = { .array = { q.x[i], q.y[i], q.z[i], q.w[i] } };
+  return out;
+}
+
+
+internal inline void quat_soa_set(quat_soa q, u32 i, quat v)
+{
+  q.x[i] = v.x;
+  q.y[i] = v.y;
+  q.z[i] = v.z;
+  q.w[i] = v.w;
+}
+
+
+/// @brief out[i] = nlerp(a[i], b[i], t). out may be a or b.
+void quat_nlerp_batch(quat_soa a, quat_soa b, f32 t, quat_soa out, u32 count)
+{
+  u32 i = 0;
+  #if LINALG_SSE
+    __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 wa = _mm_set1_ps(1.0f - t);
+    __m128 tb = _mm_set1_ps(t);
+    for (; i + 4 <= count; i += 4)
+    {
+      // Flip b's weight where the dot is negative to take the shorter arc.
+      __m128 d_sign = _mm_and_ps(quat_dot_ps(a, b, i), sign);
+      quat_blend_store_ps(a, b, out, i, wa, _mm_xor_ps(tb, d_sign));
+    }
+  #endif
+  for (; i < count; ++i)
+  {
+    quat_soa_set(out, i, quat_nlerp(quat_soa_get(a, i), quat_soa_get(b, i), t));
+  }
+}
+
+
+/// @brief out[i] = slerp(a[i], b[i], t). out may be a or b.
+void quat_slerp_batch(quat_soa a, quat_soa b, f32 t, quat_soa out, u32 count)
+{
+  u32 i = 0;
+  #if LINALG_SSE
+    __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 vt = _mm_set1_ps(t);
+    __m128 one_t = _mm_set1_ps(1.0f - t);
+    __m128 nlerp_above = _mm_set1_ps(QUAT_SLERP_NLERP_DOT);
+    for (; i + 4 <= count; i += 4)
+    {
+      __m128 d = quat_dot_ps(a, b, i);
+      __m128 d_sign = _mm_and_ps(d, sign);
+      d = _mm_andnot_ps(sign, d);
+      d = _mm_min_ps(d, one);
+      __m128 angle = quat_acos_ps(d);
+      __m128 inv_sin = _mm_div_ps(one, quat_sin_ps(angle));
+      __m128 wa = _mm_mul_ps(quat_sin_ps(_mm_mul_ps(one_t, angle)), inv_sin);
+      __m128 wb = _mm_mul_ps(quat_sin_ps(_mm_mul_ps(vt, angle)), inv_sin);
+      // Nearly equal rotations fall back to nlerp weights, the blend renormalizes either way.
+      __m128 use_nlerp = _mm_cmpgt_ps(d, nlerp_above);
+      wa = _mm_or_ps(_mm_and_ps(use_nlerp, one_t), _mm_andnot_ps(use_nlerp, wa));
+      wb = _mm_or_ps(_mm_and_ps(use_nlerp, vt), _mm_andnot_ps(use_nlerp, wb));
+      quat_blend_store_ps(a, b, out, i, wa, _mm_xor_ps(wb, d_sign));
+    }
+  #endif
+  for (; i < count; ++i)
+  {
+    quat_soa_set(out, i, quat_slerp(quat_soa_get(a, i), quat_soa_get(b, i), t));
+  }
+}
+
+
+/// @brief Blend two poses: lerp translation and scale, slerp rotation. out may be a or b.
+void trs_blend(transform_trs a, transform_trs b, f32 t, transform_trs out, u32 count)
+{
+  f32 *src_a[6] = { a.tx, a.ty, a.tz, a.sx, a.sy, a.sz };
+  f32 *src_b[6] = { b.tx, b.ty, b.tz, b.sx, b.sy, b.sz };
+  f32 *dst[6] = { out.tx, out.ty, out.tz, out.sx, out.sy, out.sz };
+  for (u32 k = 0; k < 6; ++k)
+  {
+    // Plain loops over contiguous floats, the compiler vectorizes these.
+    for (u32 i = 0; i < count; ++i) dst[k][i] = src_a[k][i] + (src_b[k][i] - src_a[k][i]) * t;
+  }
+  quat_slerp_batch(quat_soa_from_trs(a), quat_soa_from_trs(b), t, quat_soa_from_trs(out), count);
+}
+
+
+dquat dquat_from_rotation_translation(quat rotation, fvec3 translation)
+{
+  dquat dq = {};
+  dq.real = rotation;
+  quat t = { .array = { translation.x, translation.y, translation.z, 0.0f } };
+  dq.dual = quat_mul(t, rotation);
+  for (u32 k = 0; k < 4; ++k) dq.dual.array[k] *= 0.5f;
+  return dq;
+}
+
+
+/// @brief Rigid matrix of a unit dual quaternion.
+void dquat_to_fmat4(fmat4 out, dquat dq)
+{
+  quat_to_fmat4(out, dq.real);
+  // t = 2 * dual * conjugate(real)
+  quat t = quat_mul(dq.dual, quat_conjugate(dq.real));
+  out[3][0] = 2.0f * t.x;
+  out[3][1] = 2.0f * t.y;
+  out[3][2] = 2.0f * t.z;
+}
+
+
+/// @brief Dual quaternion linear blending for skinning, weights are expected to sum to one.
+/// Blends along the shorter arc of the first quaternion, then normalizes.
+dquat dquat_blend(dquat *dqs, f32 *weights, u32 count)
+{
+  dquat out = {};
+  if (count == 0) return out;
+  quat pivot = dqs[0].real;
+  for (u32 i = 0; i < count; ++i)
+  {
+    f32 d = pivot.x*dqs[i].real.x + pivot.y*dqs[i].real.y + pivot.z*dqs[i].real.z + pivot.w*dqs[i].real.w;
+    f32 w = (d < 0.0f) ? -weights[i] : weights[i];
+    for (u32 k = 0; k < 4; ++k)
+    {
+      out.real.array[k] += dqs[i].real.array[k] * w;
+      out.dual.array[k] += dqs[i].dual.array[k] * w;
+    }
+  }
+  f32 length_sq = out.real.x*out.real.x + out.real.y*out.real.y + out.real.z*out.real.z + out.real.w*out.real.w;
+  ASSERT(length_sq > 0.0f, "Blend weights cancel out.");
+  f32 inv_length = 1.0f / sqrtf(length_sq);
+  for (u32 k = 0; k < 4; ++k)
+  {
+    out.real.array[k] *= inv_length;
+    out.dual.array[k] *= inv_length;
+  }
+  return out;
+}
+
+
+hierarchy hierarchy_init(arena *a, u32 capacity)
+{
+  hierarchy h = {};
+  h.capacity = capacity;
+  h.parent = arena_push_array(a, capacity, i32);
+  h.local = transform_trs_init(a, capacity);
+  h.local_matrix = arena_push_array(a, capacity, fmat4);
+  h.world = arena_push_array(a, capacity, fmat4);
+  return h;
+}
+
+
+/// @brief Add a node under parent (-1 for a root) and return its index. Parents come first.
+u32 hierarchy_add(hierarchy *h, i32 parent, fvec3 translation, quat rotation, fvec3 scale)
+{
+  ASSERT(h->count < h->capacity, "Hierarchy is full.");
+  ASSERT(parent < (i32)h->count, "Parents have to be added before their children.");
+  u32 id = h->count++;
+  h->parent[id] = parent;
+  h->local.tx[id] = translation.x;
+  h->local.ty[id] = translation.y;
+  h->local.tz[id] = translation.z;
+  h->local.qx[id] = rotation.x;
+  h->local.qy[id] = rotation.y;
+  h->local.qz[id] = rotation.z;
+  h->local.qw[id] = rotation.w;
+  h->local.sx[id] = scale.x;
+  h->local.sy[id] = scale.y;
+  h->local.sz[id] = scale.z;
+  return id;
+}
+
+
+/// @brief Recompute every world matrix from the local TRS.
+void hierarchy_update(hierarchy *h)
+{
+  transform_batch_compose(h->local_matrix, h->local, h->count);
+  // Parents are ahead in the arrays so their world matrix is final by the time a child reads it.
+  for (u32 i = 0; i < h->count; ++i)
+  {
+    i32 p = h->parent[i];
+    if (p < 0)
+    {
+      memcpy(h->world[i], h->local_matrix[i], sizeof(fmat4));
+    }
+    else
+    {
+      transform_mul_one(h->world[i], h->world[p], h->local_matrix[i]);
+    }
+  }
+}
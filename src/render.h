@@ -26,6 +26,9 @@ enum shader_type
   COMPUTE
 };
 
+// Constant buffer ranges bound with render_constant_set_range start and end on this boundary.
+#define RENDER_CONSTANT_ALIGN 256
+
 enum buffer_type
 {
   BUFF_VERTS,
@@ -38,27 +41,61 @@ struct vert_texture
   f32 x, y, z, u, v;
 };
 
+// Pipeline state tracked by the backend so it can skip calls that change nothing.
+enum render_cache_state
+{
+  RSTATE_VS_SHADER,
+  RSTATE_PS_SHADER,
+  RSTATE_INPUT_LAYOUT,
+  RSTATE_TOPOLOGY,
+  RSTATE_DEPTH_STENCIL,
+  RSTATE_INDEX_BUFFER,
+  RSTATE_VERTEX_BUFFER,
+  RSTATE_VS_CONSTANTS,
+  RSTATE_PS_CONSTANTS,
+  RSTATE_PS_RESOURCE,
+  RSTATE_PS_SAMPLER,
+  RSTATE_COUNT
+};
+
+// API calls made and avoided in one frame.
+struct render_stats
+{
+  u32 issued;
+  u32 skipped;
+  u32 issued_by_state[RSTATE_COUNT];
+  u32 skipped_by_state[RSTATE_COUNT];
+};
+
 
 void       render_init(arena *a);
 void       render_data_init( arena *a, u64 shader_count );
 void       render_resize(i32 width, i32 height);
 void       render_close();
+void       render_vsync(i32 status);
 
 rbuffer*   rbuffer_init(arena *a, buffer_type t, void* data, u32 stride, u32 byte_count);
 void       rbuffer_close( rbuffer* b );
 rbuffer*   rbuffer_dynamic_init(arena *a, buffer_type t, void *data, u32 stride, u32 byte_count);
 void       rbuffer_update(rbuffer* buffer, void* data, u32 byte_count);
+void       rbuffer_update_range(rbuffer* buffer, void* data, u32 byte_offset, u32 byte_count);
+rbuffer*   rbuffer_ring_init(arena *a, buffer_type t, u32 stride, u32 byte_count);
+bool       rbuffer_ring_push(rbuffer* buffer, void* data, u32 byte_count, u32 *offset_out);
+arena      rbuffer_map(rbuffer* buffer);
+void       rbuffer_unmap(rbuffer* buffer);
 void       rbuffer_vertex_set( u32 slot_start, rbuffer *buffer );
 void       rbuffer_vertex_describe( u64 shader_index, vertex_type vtype );
 void       rbuffer_index_set( rbuffer *b );
 void       render_constant_set( rbuffer* b, u32 slot );
+void       render_constant_set_range( rbuffer* b, u32 slot, u32 byte_offset, u32 byte_count );
+bool       rbuffer_constant_push(arena *constants, void *data, u32 byte_count, u32 *offset_out);
 
 void       render_text_init(arena *a);
 
 void       render_draw( u32 count );
 void       render_draw_elems( u32 count, u32 elem_start, u32 vert_start);
-void       render_draw_instances( u32 vertex_count, u32 instance_count);
-void       render_draw_instances_elems( u32 elem_count, u32 instance_count );
+void       render_draw_instances( u32 vertex_count, u32 instance_count, u32 instance_start );
+void       render_draw_instances_elems( u32 elem_count, u32 instance_count, u32 elem_start, u32 vert_start, u32 instance_start );
 void       render_draw_ui( u32 count );
 void       render_draw_ui_elems(rbuffer* vbuffer, rbuffer* ebuffer, u64 shader_index, u32 count, u32 elem_start, u32 vert_start);
 
@@ -75,4 +112,5 @@ void       shader_set( u64 shader_index );
 void       shader_close(shaders *s);
 
 void       frame_init( f32 *background_color);
-void       frame_render();
\ No newline at end of file
+void       frame_render();
+render_stats render_stats_last();
\ No newline at end of file
@@ -7,7 +7,9 @@
 enum vertex_type
 {
   VERTEX_UI,
-  VERTEX_WORLD
+  VERTEX_WORLD,
+  VERTEX_WORLD_QUANTIZED,
+  VERTEX_WORLD_INSTANCED
 };
 
 
@@ -29,3 +31,15 @@ union vertex1
   f32 data[9];
 };
 
+// 16 byte version of vertex1, see mesh_quantize.cpp.
+// pos is unorm16 relative to the mesh bounds (w unused), col is rgba8 unorm, tex is half float.
+union vertex_quantized
+{
+  struct
+  {
+    u16 pos[4];
+    u32 col;
+    u16 tex[2];
+  };
+  u8 data[16];
+};
@@ -0,0 +1,54 @@
+#include "render.h"
+
+// Shadow copy of the bound pipeline state. Backends ask render_cache_set before every state call
+// and only make the call when the value changed. Values are opaque (pointers, enums) so this
+// file knows nothing about the graphics API and can be driven by a mock context.
+
+#define RENDER_CACHE_SLOTS 16
+
+
+struct render_cache
+{
+  u64          bound[RSTATE_COUNT][RENDER_CACHE_SLOTS];
+  bool         valid[RSTATE_COUNT][RENDER_CACHE_SLOTS];
+  render_stats frame;  // Counts for the frame in progress.
+  render_stats last;   // Counts for the last finished frame.
+};
+
+
+/// @brief Record that state/slot should hold value. Returns true if the API call has to be made.
+bool render_cache_set(render_cache *cache, render_cache_state state, u32 slot, u64 value)
+{
+  // Slots past the cache are never skipped.
+  bool changed = (slot >= RENDER_CACHE_SLOTS) || !cache->valid[state][slot] || (cache->bound[state][slot] != value);
+  if (changed)
+  {
+    if (slot < RENDER_CACHE_SLOTS)
+    {
+      cache->bound[state][slot] = value;
+      cache->valid[state][slot] = true;
+    }
+    cache->frame.issued++;
+    cache->frame.issued_by_state[state]++;
+  }
+  else
+  {
+    cache->frame.skipped++;
+    cache->frame.skipped_by_state[state]++;
+  }
+  return changed;
+}
+
+
+/// @brief Forget everything, e.g. after ClearState or when something else touched the context.
+void render_cache_invalidate(render_cache *cache)
+{
+  memset(cache->valid, 0, sizeof(cache->valid));
+}
+
+
+void render_cache_frame_end(render_cache *cache)
+{
+  cache->last = cache->frame;
+  cache->frame = {};
+}
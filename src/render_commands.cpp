@@ -0,0 +1,561 @@
+#include "render.h"
+
+// Deferred draw submission.
+// Draws are written to an arena as fixed size commands carrying all the state they need, sorted
+// by a 64 bit key and then replayed through a backend that only issues the state that changed.
+// The native backend calls render.h; the recording backend logs the calls instead, so frames can
+// be built and checked without a GPU. Threads can fill their own buffers and append them.
+//
+// Key layout, high to low bits: layer 4 | shader 12 | material 16 | depth 24 | unused 8.
+
+#define RENDER_KEY_LAYER_SHIFT    60
+#define RENDER_KEY_SHADER_SHIFT   48
+#define RENDER_KEY_MATERIAL_SHIFT 32
+#define RENDER_KEY_DEPTH_SHIFT    8
+#define RENDER_MAX_CONSTANT_BYTES 256
+#define RENDER_MAX_TEXTURES       2
+
+
+enum render_command_type
+{
+  RCMD_DRAW,
+  RCMD_DRAW_ELEMS,
+  RCMD_DRAW_INSTANCES_ELEMS,
+};
+
+
+enum render_call_type
+{
+  RCALL_SHADER_SET,
+  RCALL_VERTEX_SET,
+  RCALL_INDEX_SET,
+  RCALL_CONSTANT_SET,
+  RCALL_CONSTANT_SET_RANGE,
+  RCALL_BUFFER_UPDATE,
+  RCALL_TEXTURE_BIND,
+  RCALL_DRAW,
+  RCALL_DRAW_ELEMS,
+  RCALL_DRAW_INSTANCES_ELEMS,
+  RCALL_COUNT,
+};
+
+
+struct render_command
+{
+  u64                 key;
+  render_command_type type;
+  u32                 shader;
+  rbuffer            *vbuffer;
+  rbuffer            *ebuffer;
+  texture            *textures[RENDER_MAX_TEXTURES];  // Bound to slots 0..n, null leaves the slot alone.
+  rbuffer            *constants;       // Optional per draw constants, uploaded before the draw
+  u32                 constant_slot;    // or, without constant_data, bound as a range at constant_offset.
+  u32                 constant_size;
+  u32                 constant_offset;
+  u8                 *constant_data;   // Copied into the command arena.
+  u32                 count;
+  u32                 elem_start;
+  u32                 vert_start;
+  rbuffer            *instances;       // Per instance vertex data, bound to slot 1.
+  u32                 instance_start;
+  u32                 instance_count;
+};
+
+
+struct render_commands
+{
+  arena commands;  // render_command array.
+  arena payload;   // Constant data copied from the caller.
+};
+
+
+struct render_backend
+{
+  void *user;
+  void (*shader_set)(void *user, u64 shader_index);
+  void (*vertex_set)(void *user, u32 slot, rbuffer *b);
+  void (*index_set)(void *user, rbuffer *b);
+  void (*constant_set)(void *user, rbuffer *b, u32 slot);
+  void (*constant_set_range)(void *user, rbuffer *b, u32 slot, u32 byte_offset, u32 byte_count);
+  void (*buffer_update)(void *user, rbuffer *b, void *data, u32 byte_count);
+  void (*texture_bind)(void *user, texture *tex, u32 slot);
+  void (*draw)(void *user, u32 count);
+  void (*draw_elems)(void *user, u32 count, u32 elem_start, u32 vert_start);
+  void (*draw_instances_elems)(void *user, u32 elem_count, u32 instance_count, u32 elem_start, u32 vert_start, u32 instance_start);
+};
+
+
+// One logged backend call. args hold the call's parameters in order, pointers cast to u64.
+struct render_record
+{
+  render_call_type type;
+  u64              args[3];
+};
+
+
+struct render_recorder
+{
+  arena *log;  // Optional, render_record array.
+  u64    calls[RCALL_COUNT];
+};
+
+
+struct render_key_sort
+{
+  u64 key;
+  u32 index;
+};
+
+
+/// @brief Depth in [0, 1], 0 nearest. Opaque passes should use it as is, transparent ones 1 - depth.
+u64 render_key(u32 layer, u32 shader, u32 material, f32 depth)
+{
+  depth = (depth < 0.0f) ? 0.0f : (depth > 1.0f) ? 1.0f : depth;
+  u64 depth_bits = (u64)(depth * (f32)0xffffff);
+  return ((u64)(layer    & 0xf)    << RENDER_KEY_LAYER_SHIFT)    |
+         ((u64)(shader   & 0xfff)  << RENDER_KEY_SHADER_SHIFT)   |
+         ((u64)(material & 0xffff) << RENDER_KEY_MATERIAL_SHIFT) |
+         (depth_bits << RENDER_KEY_DEPTH_SHIFT);
+}
+
+
+render_commands render_commands_init(arena *parent, u32 command_count)
+{
+  render_commands result = {};
+  result.commands = subarena_init(parent, (size_t)command_count * sizeof(render_command));
+  result.payload  = subarena_init(parent, (size_t)command_count * RENDER_MAX_CONSTANT_BYTES);
+  return result;
+}
+
+
+void render_commands_reset(render_commands *rc)
+{
+  arena_free_all(&rc->commands);
+  arena_free_all(&rc->payload);
+}
+
+
+u32 render_commands_count(render_commands *rc)
+{
+  return (u32)(rc->commands.offset_new / sizeof(render_command));
+}
+
+
+internal render_command * render_command_push(render_commands *rc, u64 key, render_command_type type, u32 shader)
+{
+  render_command *cmd = arena_push_struct(&rc->commands, render_command);
+  cmd->key = key;
+  cmd->type = type;
+  cmd->shader = shader;
+  return cmd;
+}
+
+
+render_command * render_commands_draw_elems(render_commands *rc, u64 key, u32 shader, rbuffer *vbuffer, rbuffer *ebuffer, u32 count, u32 elem_start, u32 vert_start)
+{
+  render_command *cmd = render_command_push(rc, key, RCMD_DRAW_ELEMS, shader);
+  cmd->vbuffer = vbuffer;
+  cmd->ebuffer = ebuffer;
+  cmd->count = count;
+  cmd->elem_start = elem_start;
+  cmd->vert_start = vert_start;
+  return cmd;
+}
+
+
+render_command * render_commands_draw(render_commands *rc, u64 key, u32 shader, rbuffer *vbuffer, u32 count)
+{
+  render_command *cmd = render_command_push(rc, key, RCMD_DRAW, shader);
+  cmd->vbuffer = vbuffer;
+  cmd->count = count;
+  return cmd;
+}
+
+
+render_command * render_commands_draw_instances_elems(render_commands *rc, u64 key, u32 shader, rbuffer *vbuffer, rbuffer *ebuffer, u32 elem_count, u32 elem_start, u32 vert_start,
+                                                      rbuffer *instances, u32 instance_start, u32 instance_count)
+{
+  render_command *cmd = render_command_push(rc, key, RCMD_DRAW_INSTANCES_ELEMS, shader);
+  cmd->vbuffer = vbuffer;
+  cmd->ebuffer = ebuffer;
+  cmd->count = elem_count;
+  cmd->elem_start = elem_start;
+  cmd->vert_start = vert_start;
+  cmd->instances = instances;
+  cmd->instance_start = instance_start;
+  cmd->instance_count = instance_count;
+  return cmd;
+}
+
+
+/// @brief Attach constants that get uploaded to b and bound at slot right before the draw.
+void render_command_constants(render_commands *rc, render_command *cmd, rbuffer *b, u32 slot, void *data, u32 byte_count)
+{
+  ASSERT(byte_count <= RENDER_MAX_CONSTANT_BYTES, "Per draw constants are too large.");
+  cmd->constants = b;
+  cmd->constant_slot = slot;
+  cmd->constant_size = byte_count;
+  cmd->constant_data = arena_push_array(&rc->payload, byte_count, u8);
+  memcpy(cmd->constant_data, data, byte_count);
+}
+
+
+/// @brief Bind a range of a batched constant buffer (see rbuffer_constant_push) instead of uploading per draw.
+void render_command_constant_range(render_command *cmd, rbuffer *b, u32 slot, u32 byte_offset, u32 byte_count)
+{
+  cmd->constants = b;
+  cmd->constant_slot = slot;
+  cmd->constant_size = byte_count;
+  cmd->constant_offset = byte_offset;
+  cmd->constant_data = nullptr;
+}
+
+
+void render_command_texture(render_command *cmd, texture *tex, u32 slot)
+{
+  ASSERT(slot < RENDER_MAX_TEXTURES, "Texture slot out of range.");
+  cmd->textures[slot] = tex;
+}
+
+
+/// @brief Copy src's commands onto the end of dst, e.g. to merge per thread buffers before sorting.
+void render_commands_append(render_commands *dst, render_commands *src)
+{
+  u32 count = render_commands_count(src);
+  render_command *cmds = (render_command*) src->commands.buffer;
+  for (u32 i = 0; i < count; ++i)
+  {
+    render_command *cmd = arena_push_struct(&dst->commands, render_command);
+    *cmd = cmds[i];
+    if (cmd->constant_data)
+    {
+      cmd->constant_data = arena_push_array(&dst->payload, cmd->constant_size, u8);
+      memcpy(cmd->constant_data, cmds[i].constant_data, cmd->constant_size);
+    }
+  }
+}
+
+
+// Column views of an entity table. With indices (e.g. a culled visible list) only those count
+// rows are drawn, otherwise the first count rows.
+struct render_instances_source
+{
+  u64    count;
+  u32   *indices;
+  u64   *vert_start;
+  u64   *elem_start;
+  u64   *elem_count;
+  u32   *shader;
+  fmat4 *transforms;
+};
+
+
+struct render_instance_group
+{
+  u64 vert_start;
+  u64 elem_start;
+  u64 elem_count;
+  u32 shader;
+  u32 first;  // Index of the group's first instance in the instance buffer.
+  u32 count;
+};
+
+
+internal u64 render_instance_hash(u64 vert_start, u64 elem_start, u64 elem_count, u32 shader)
+{
+  u64 h = vert_start * 0x9e3779b97f4a7c15ull;
+  h ^= elem_start * 0xc2b2ae3d27d4eb4full;
+  h ^= elem_count * 0x165667b19e3779f9ull;
+  h ^= (u64)shader * 0xff51afd7ed558ccdull;
+  return h ^ (h >> 29);
+}
+
+
+/// @brief Queue one instanced draw per group of entities sharing a mesh (vertex and element range) and shader.
+/// The transforms are written into instance_memory, which is mapped over instances, grouped by draw.
+/// Size instances for the entity count: the ones that don't fit are not drawn.
+/// Returns the number of draws queued.
+u32 render_commands_instanced(render_commands *rc, render_instances_source src, rbuffer *vbuffer, rbuffer *ebuffer,
+                              rbuffer *instances, arena *instance_memory, arena *scratch)
+{
+  if (src.count == 0) return 0;
+  arena_savepoint save = arena_save(scratch);
+  // Open addressing table of group index + 1, at most half full.
+  u64 table_size = 16;
+  while (table_size < src.count * 2) table_size <<= 1;
+  u32 *table = arena_push_array(scratch, table_size, u32);
+  u32 *group_of = arena_push_array(scratch, src.count, u32);
+  render_instance_group *groups = arena_push_array(scratch, src.count, render_instance_group);
+  u32 group_count = 0;
+  for (u64 n = 0; n < src.count; ++n)
+  {
+    u64 i = (src.indices) ? src.indices[n] : n;
+    u64 slot = render_instance_hash(src.vert_start[i], src.elem_start[i], src.elem_count[i], src.shader[i]) & (table_size - 1);
+    for (;;)
+    {
+      if (table[slot] == 0)
+      {
+        render_instance_group *g = &groups[group_count];
+        g->vert_start = src.vert_start[i];
+        g->elem_start = src.elem_start[i];
+        g->elem_count = src.elem_count[i];
+        g->shader = src.shader[i];
+        table[slot] = ++group_count;
+        break;
+      }
+      render_instance_group *g = &groups[table[slot] - 1];
+      if (g->vert_start == src.vert_start[i] && g->elem_start == src.elem_start[i] &&
+          g->elem_count == src.elem_count[i] && g->shader == src.shader[i]) break;
+      slot = (slot + 1) & (table_size - 1);
+    }
+    group_of[n] = table[slot] - 1;
+    groups[group_of[n]].count++;
+  }
+  // Instance data has to start on a whole element so the draws can address it by index.
+  u64 stride = sizeof(fmat4);
+  u64 base = ((instance_memory->offset_new + stride - 1) / stride) * stride;
+  u64 room = (instance_memory->length > base) ? (instance_memory->length - base) / stride : 0;
+  // Out of room, the groups are cut short in order. Dropped instances aren't drawn.
+  u64 remaining = (src.count < room) ? src.count : room;
+  u32 first = (u32)(base / stride);
+  for (u32 g = 0; g < group_count; ++g)
+  {
+    groups[g].count = (groups[g].count < remaining) ? groups[g].count : (u32)remaining;
+    groups[g].first = first;
+    first += groups[g].count;
+    remaining -= groups[g].count;
+  }
+  u32 *cursor = arena_push_array(scratch, group_count, u32);
+  fmat4 *out = (fmat4*)instance_memory->buffer;
+  for (u64 n = 0; n < src.count; ++n)
+  {
+    u64 i = (src.indices) ? src.indices[n] : n;
+    u32 g = group_of[n];
+    if (cursor[g] == groups[g].count) continue;
+    memcpy(out[groups[g].first + cursor[g]++], src.transforms[i], sizeof(fmat4));
+  }
+  instance_memory->offset_old = base;
+  instance_memory->offset_new = base + (first - base / stride) * stride;
+  u32 draw_count = 0;
+  for (u32 g = 0; g < group_count; ++g)
+  {
+    render_instance_group *group = &groups[g];
+    if (group->count == 0) continue;
+    render_commands_draw_instances_elems(rc, render_key(0, group->shader, 0, 0.0f), group->shader, vbuffer, ebuffer,
+                                         (u32)group->elem_count, (u32)group->elem_start, (u32)group->vert_start,
+                                         instances, group->first, group->count);
+    draw_count++;
+  }
+  arena_pop(save);
+  return draw_count;
+}
+
+
+// Stable LSD radix sort on the keys, 8 bits at a time. Bytes that are the same for every key are skipped.
+internal render_key_sort * render_keys_sort(render_key_sort *keys, u32 count, arena *scratch)
+{
+  render_key_sort *temp = arena_push_array(scratch, count, render_key_sort);
+  u64 key_or = 0;
+  u64 key_and = ~0ull;
+  for (u32 i = 0; i < count; ++i)
+  {
+    key_or |= keys[i].key;
+    key_and &= keys[i].key;
+  }
+  u64 varying = key_or ^ key_and;
+  for (u32 shift = 0; shift < 64; shift += 8)
+  {
+    if (((varying >> shift) & 0xff) == 0) continue;
+    u32 histogram[256] = {};
+    for (u32 i = 0; i < count; ++i) histogram[(keys[i].key >> shift) & 0xff]++;
+    u32 offset = 0;
+    for (u32 b = 0; b < 256; ++b)
+    {
+      u32 bucket = histogram[b];
+      histogram[b] = offset;
+      offset += bucket;
+    }
+    for (u32 i = 0; i < count; ++i) temp[histogram[(keys[i].key >> shift) & 0xff]++] = keys[i];
+    render_key_sort *swap = keys;
+    keys = temp;
+    temp = swap;
+  }
+  return keys;
+}
+
+
+/// @brief Sort by key and replay through the backend, skipping state that is already bound.
+/// Anything bound before the submit (cameras, frame_init) is left as it was.
+void render_commands_submit(render_commands *rc, render_backend *backend, arena *scratch)
+{
+  u32 count = render_commands_count(rc);
+  if (count == 0) return;
+  arena_savepoint save = arena_save(scratch);
+  render_command *cmds = (render_command*) rc->commands.buffer;
+  render_key_sort *keys = arena_push_array(scratch, count, render_key_sort);
+  for (u32 i = 0; i < count; ++i)
+  {
+    keys[i].key = cmds[i].key;
+    keys[i].index = i;
+  }
+  keys = render_keys_sort(keys, count, scratch);
+  void *user = backend->user;
+  bool first = true;
+  u32 shader = 0;
+  rbuffer *vbuffer = nullptr;
+  rbuffer *ebuffer = nullptr;
+  rbuffer *instances = nullptr;
+  texture *textures[RENDER_MAX_TEXTURES] = {};
+  rbuffer *constants = nullptr;
+  u32 constant_slot = 0;
+  render_command *uploaded = nullptr;
+  for (u32 i = 0; i < count; ++i)
+  {
+    render_command *cmd = &cmds[keys[i].index];
+    if (first || cmd->shader != shader)
+    {
+      backend->shader_set(user, cmd->shader);
+      shader = cmd->shader;
+    }
+    if (cmd->vbuffer && cmd->vbuffer != vbuffer)
+    {
+      backend->vertex_set(user, 0, cmd->vbuffer);
+      vbuffer = cmd->vbuffer;
+    }
+    if (cmd->ebuffer && cmd->ebuffer != ebuffer)
+    {
+      backend->index_set(user, cmd->ebuffer);
+      ebuffer = cmd->ebuffer;
+    }
+    if (cmd->instances && cmd->instances != instances)
+    {
+      backend->vertex_set(user, 1, cmd->instances);
+      instances = cmd->instances;
+    }
+    for (u32 slot = 0; slot < RENDER_MAX_TEXTURES; ++slot)
+    {
+      if (cmd->textures[slot] && cmd->textures[slot] != textures[slot])
+      {
+        backend->texture_bind(user, cmd->textures[slot], slot);
+        textures[slot] = cmd->textures[slot];
+      }
+    }
+    if (cmd->constants && !cmd->constant_data)
+    {
+      // The backend's state cache drops repeated ranges.
+      backend->constant_set_range(user, cmd->constants, cmd->constant_slot, cmd->constant_offset, cmd->constant_size);
+      constants = nullptr;
+      uploaded = nullptr;
+    }
+    else if (cmd->constants)
+    {
+      if (cmd->constants != constants || cmd->constant_slot != constant_slot)
+      {
+        backend->constant_set(user, cmd->constants, cmd->constant_slot);
+        constants = cmd->constants;
+        constant_slot = cmd->constant_slot;
+        uploaded = nullptr;
+      }
+      // Consecutive draws with the same constants (e.g. a shared world matrix) upload once.
+      bool same = uploaded && uploaded->constants == cmd->constants && uploaded->constant_size == cmd->constant_size &&
+                  memcmp(uploaded->constant_data, cmd->constant_data, cmd->constant_size) == 0;
+      if (!same)
+      {
+        backend->buffer_update(user, cmd->constants, cmd->constant_data, cmd->constant_size);
+        uploaded = cmd;
+      }
+    }
+    first = false;
+    switch (cmd->type)
+    {
+      case RCMD_DRAW:                 backend->draw(user, cmd->count); break;
+      case RCMD_DRAW_ELEMS:           backend->draw_elems(user, cmd->count, cmd->elem_start, cmd->vert_start); break;
+      case RCMD_DRAW_INSTANCES_ELEMS: backend->draw_instances_elems(user, cmd->count, cmd->instance_count, cmd->elem_start, cmd->vert_start, cmd->instance_start); break;
+      default: ASSERT(false, "Unexpected render command.");
+    }
+  }
+  arena_pop(save);
+}
+
+
+// Recording backend.
+
+internal void recorder_log(void *user, render_call_type type, u64 a0, u64 a1, u64 a2)
+{
+  render_recorder *recorder = (render_recorder*) user;
+  recorder->calls[type]++;
+  if (recorder->log)
+  {
+    render_record *record = arena_push_struct(recorder->log, render_record);
+    record->type = type;
+    record->args[0] = a0;
+    record->args[1] = a1;
+    record->args[2] = a2;
+  }
+}
+
+internal void recorder_shader_set(void *user, u64 shader_index)                     { recorder_log(user, RCALL_SHADER_SET, shader_index, 0, 0); }
+internal void recorder_vertex_set(void *user, u32 slot, rbuffer *b)                 { recorder_log(user, RCALL_VERTEX_SET, slot, (u64)b, 0); }
+internal void recorder_index_set(void *user, rbuffer *b)                            { recorder_log(user, RCALL_INDEX_SET, (u64)b, 0, 0); }
+internal void recorder_constant_set(void *user, rbuffer *b, u32 slot)               { recorder_log(user, RCALL_CONSTANT_SET, (u64)b, slot, 0); }
+internal void recorder_constant_set_range(void *user, rbuffer *b, u32 slot, u32 byte_offset, u32 byte_count) { recorder_log(user, RCALL_CONSTANT_SET_RANGE, (u64)b, slot, byte_offset); }
+internal void recorder_buffer_update(void *user, rbuffer *b, void *data, u32 bytes) { recorder_log(user, RCALL_BUFFER_UPDATE, (u64)b, (u64)data, bytes); }
+internal void recorder_texture_bind(void *user, texture *tex, u32 slot)             { recorder_log(user, RCALL_TEXTURE_BIND, (u64)tex, slot, 0); }
+internal void recorder_draw(void *user, u32 count)                                  { recorder_log(user, RCALL_DRAW, count, 0, 0); }
+internal void recorder_draw_elems(void *user, u32 count, u32 elem_start, u32 vert_start) { recorder_log(user, RCALL_DRAW_ELEMS, count, elem_start, vert_start); }
+internal void recorder_draw_instances_elems(void *user, u32 elem_count, u32 instance_count, u32 elem_start, u32 vert_start, u32 instance_start) { recorder_log(user, RCALL_DRAW_INSTANCES_ELEMS, elem_count, instance_count, instance_start); }
+
+
+/// @brief Backend that records calls instead of rendering. Works without a GPU or window.
+/// log can be null to only count calls.
+render_backend render_backend_recording(render_recorder *recorder, arena *log)
+{
+  *recorder = {};
+  recorder->log = log;
+  render_backend backend = {};
+  backend.user                 = recorder;
+  backend.shader_set           = recorder_shader_set;
+  backend.vertex_set           = recorder_vertex_set;
+  backend.index_set            = recorder_index_set;
+  backend.constant_set         = recorder_constant_set;
+  backend.constant_set_range   = recorder_constant_set_range;
+  backend.buffer_update        = recorder_buffer_update;
+  backend.texture_bind         = recorder_texture_bind;
+  backend.draw                 = recorder_draw;
+  backend.draw_elems           = recorder_draw_elems;
+  backend.draw_instances_elems = recorder_draw_instances_elems;
+  return backend;
+}
+
+
+#if _D3D
+// Native backend, straight through to render.h.
+
+internal void native_shader_set(void *user, u64 shader_index)                     { shader_set(shader_index); }
+internal void native_vertex_set(void *user, u32 slot, rbuffer *b)                 { rbuffer_vertex_set(slot, b); }
+internal void native_index_set(void *user, rbuffer *b)                            { rbuffer_index_set(b); }
+internal void native_constant_set(void *user, rbuffer *b, u32 slot)               { render_constant_set(b, slot); }
+internal void native_constant_set_range(void *user, rbuffer *b, u32 slot, u32 byte_offset, u32 byte_count) { render_constant_set_range(b, slot, byte_offset, byte_count); }
+internal void native_buffer_update(void *user, rbuffer *b, void *data, u32 bytes) { rbuffer_update(b, data, bytes); }
+internal void native_texture_bind(void *user, texture *tex, u32 slot)             { texture_bind(tex, slot); }
+internal void native_draw(void *user, u32 count)                                  { render_draw(count); }
+internal void native_draw_elems(void *user, u32 count, u32 elem_start, u32 vert_start) { render_draw_elems(count, elem_start, vert_start); }
+internal void native_draw_instances_elems(void *user, u32 elem_count, u32 instance_count, u32 elem_start, u32 vert_start, u32 instance_start) { render_draw_instances_elems(elem_count, instance_count, elem_start, vert_start, instance_start); }
+
+
+render_backend render_backend_native()
+{
+  render_backend backend = {};
+  backend.shader_set           = native_shader_set;
+  backend.vertex_set           = native_vertex_set;
+  backend.index_set            = native_index_set;
+  backend.constant_set         = native_constant_set;
+  backend.constant_set_range   = native_constant_set_range;
+  backend.buffer_update        = native_buffer_update;
+  backend.texture_bind         = native_texture_bind;
+  backend.draw                 = native_draw;
+  backend.draw_elems           = native_draw_elems;
+  backend.draw_instances_elems = native_draw_instances_elems;
+  return backend;
+}
+#endif
@@ -1,8 +1,11 @@
 // Source code
 #include "render.h"
+#include "render_cache.cpp"
+#include "render_ring.cpp"
 
 // External code
 #include <d3d11.h>
+#include <d3d11_1.h>
 #include <dxgi.h>
 #include <dxgidebug.h>
 #include <d3dcompiler.h>
@@ -11,6 +14,11 @@
 #pragma comment(lib, "dxguid.lib")
 #endif
 
+#define RENDER_FRAMES_IN_FLIGHT 3
+#define RENDER_MAX_RINGS        16
+#define RENDER_CONSTANT_SLOTS   D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT
+#define RENDER_CONSTANT_FALLBACK 4096   // Largest range render_constant_set_range can copy without D3D11.1.
+
 /*
 1. Create array of ID3D11RasterizerState variables. It can be global and made in the init function.
 */
@@ -28,6 +36,9 @@ struct rbuffer
   ID3D11Buffer* buffer;
   u32 stride;
   u32 offset;
+  u32 byte_count;
+  render_ring *ring;  // Only for buffers from rbuffer_ring_init.
+  u8 *shadow;         // CPU copy of a constant buffer when ranges can't be bound, see render_constant_set_range.
 };
 
 struct texture
@@ -45,6 +56,7 @@ struct render_state
   ID3D11Device* device;
   IDXGISwapChain* swapchain;
   ID3D11DeviceContext* context;
+  ID3D11DeviceContext1* context1;  // D3D11.1, for binding constant buffer ranges.
   ID3D11RenderTargetView* render_target; // Pointer to object containing render target info
   D3D11_VIEWPORT viewport;
   ID3D11Texture2D* depth_buffer;
@@ -53,6 +65,16 @@ struct render_state
   ID3D11RasterizerState* rasterizer_default;
   ID3D11DepthStencilState* depth_stencil_enabled;
   ID3D11DepthStencilState* depth_stencil_disabled;
+  render_cache cache;
+  // Frame fences, oldest first from fence_first. Ring buffers are retired as these complete.
+  ID3D11Query* fences[RENDER_FRAMES_IN_FLIGHT];
+  u32 fence_first;
+  u32 fence_count;
+  render_ring* rings[RENDER_MAX_RINGS];
+  u32 ring_count;
+  u32 sync_interval;  // Present's vertical blanks to wait, 0 when the app paces itself.
+  // Without context1, ranges are copied into these per draw, one per slot. Null otherwise.
+  rbuffer* constant_fallback[RENDER_CONSTANT_SLOTS];
 };
 
 struct render_data
@@ -63,6 +85,9 @@ struct render_data
 global render_state *renderer;
 global render_data  *rdata;
 
+// Guards a context call so it only runs when the state actually changes.
+#define STATE_CHANGED(state, slot, value) if (render_cache_set(&renderer->cache, (state), (slot), (u64)(value)))
+
 
 #if defined(_DEBUG)
 // Info queue that stores debug messages
@@ -155,6 +180,36 @@ internal ID3D11InputLayout * render_vertex_description(ID3DBlob *vert_shader, ve
       descrip_count = _countof(il);
       break;
     };
+    case (VERTEX_WORLD_QUANTIZED):
+    {
+      // Positions come out in [0, 1], the bounds go in the model matrix (quantize_bounds_matrix).
+      D3D11_INPUT_ELEMENT_DESC il[] =
+      {
+        { "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0,  D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "COLOR",    0, DXGI_FORMAT_R8G8B8A8_UNORM,     0, 8,  D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT,       0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+      };
+      descrip = il;
+      descrip_count = _countof(il);
+      break;
+    };
+    case (VERTEX_WORLD_INSTANCED):
+    {
+      // vertex1 in slot 0, one world matrix per instance in slot 1.
+      D3D11_INPUT_ELEMENT_DESC il[] =
+      {
+        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT,    0, 0,  D3D11_INPUT_PER_VERTEX_DATA,   0 },
+        { "COLOR",    0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA,   0 },
+        { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT,       0, 28, D3D11_INPUT_PER_VERTEX_DATA,   0 },
+        { "WORLD",    0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0,  D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+        { "WORLD",    1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+        { "WORLD",    2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+        { "WORLD",    3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 48, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+      };
+      descrip = il;
+      descrip_count = _countof(il);
+      break;
+    };
     default: ASSERT(false, "Unexpected vertex type.");
   };
   /*
@@ -237,6 +292,7 @@ void render_init(arena *a)
 {
   // Initialize render state data
   renderer = arena_push_struct(a, render_state);
+  renderer->sync_interval = 1;
   HWND *window = (HWND*) platform_window_handle();
   // Initialize result variable used for a lot of creation
   HRESULT result;
@@ -262,6 +318,21 @@ void render_init(arena *a)
   );
   ASSERT(SUCCEEDED(result), "ERROR: Failed to create the device.");
   ASSERT(feature_level == D3D_FEATURE_LEVEL_11_0, "ERROR: Failed to init d3d11.");
+  // Constant buffer offsets need the 11.1 context and driver support.
+  D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+  renderer->device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options));
+  if (options.ConstantBufferOffsetting)
+  {
+    renderer->context->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**)&renderer->context1);
+  }
+  if (!renderer->context1)
+  {
+    for (u32 i = 0; i < RENDER_CONSTANT_SLOTS; ++i)
+    {
+      renderer->constant_fallback[i] = rbuffer_dynamic_init(a, BUFF_CONST, nullptr, 0, RENDER_CONSTANT_FALLBACK);
+      renderer->constant_fallback[i]->shadow = nullptr;  // Only ever bound whole.
+    }
+  }
 
   #if defined(_DEBUG)
   {
@@ -347,7 +418,7 @@ void render_init(arena *a)
   depthDesc.DepthFunc      = D3D11_COMPARISON_LESS;
   depthDesc.StencilEnable  = FALSE;
   renderer->device->CreateDepthStencilState(&depthDesc, &renderer->depth_stencil_enabled);
-  renderer->context->OMSetDepthStencilState(renderer->depth_stencil_enabled, 0);
+  STATE_CHANGED(RSTATE_DEPTH_STENCIL, 0, renderer->depth_stencil_enabled) renderer->context->OMSetDepthStencilState(renderer->depth_stencil_enabled, 0);
   // Depth stencil state with depth testing disabled (for UI)
   depthDesc.DepthEnable = FALSE;
   renderer->device->CreateDepthStencilState(&depthDesc, &renderer->depth_stencil_disabled);
@@ -423,6 +494,15 @@ void render_init(arena *a)
 
   // Set default rasterizer and create every kind you need
   rasterizer_init();
+
+  // Frame fences for ring buffers
+  D3D11_QUERY_DESC fence_desc = {};
+  fence_desc.Query = D3D11_QUERY_EVENT;
+  for (u32 i = 0; i < RENDER_FRAMES_IN_FLIGHT; ++i)
+  {
+    success = renderer->device->CreateQuery(&fence_desc, &renderer->fences[i]);
+    ASSERT(SUCCEEDED(success), "Failed to create frame fence.");
+  }
 }
 
 
@@ -496,6 +576,7 @@ rbuffer* rbuffer_init(arena *a, buffer_type t, void* data, u32 stride, u32 byte_
   rbuffer *out = arena_push_struct(a, rbuffer);
   out->stride = stride;
   out->offset = 0;
+  out->byte_count = byte_count;
   // Determine bind flags based on buffer type
   u32 flags = buffer_type_get(t);
   D3D11_BUFFER_DESC vbd;
@@ -524,6 +605,7 @@ rbuffer* rbuffer_dynamic_init(arena *a, buffer_type t, void *data, u32 stride, u
   rbuffer *out = arena_push_struct(a, rbuffer);
   out->stride = stride;
   out->offset = 0;
+  out->byte_count = byte_count;
   // Determine bind flags based on buffer type
   u32 flags = buffer_type_get(t);
   // Describe the buffer
@@ -537,15 +619,114 @@ rbuffer* rbuffer_dynamic_init(arena *a, buffer_type t, void *data, u32 stride, u
   // Create the buffer
   HRESULT hr = renderer->device->CreateBuffer(&desc, nullptr, &out->buffer);
   ASSERT(SUCCEEDED(hr), "Failed to create dynamic buffer.");
+  // Ranges of it get copied out per draw, so keep the contents on the CPU.
+  if (t == BUFF_CONST && !renderer->context1)
+  {
+    out->shadow = arena_push_array(a, byte_count, u8);
+  }
+  return out;
+}
+
+
+// Retire the oldest frame in flight on every ring buffer, waiting for the GPU if it isn't done yet.
+internal void render_fence_retire(bool wait)
+{
+  while (renderer->fence_count > 0)
+  {
+    ID3D11Query *fence = renderer->fences[renderer->fence_first];
+    if (renderer->context->GetData(fence, nullptr, 0, wait ? 0 : D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+    {
+      if (!wait) return;
+      YieldProcessor();
+      continue;
+    }
+    for (u32 i = 0; i < renderer->ring_count; ++i)
+    {
+      ring_frame_retire(renderer->rings[i]);
+    }
+    renderer->fence_first = (renderer->fence_first + 1) % RENDER_FRAMES_IN_FLIGHT;
+    renderer->fence_count--;
+    if (wait) return;
+  }
+}
+
+
+rbuffer* rbuffer_ring_init(arena *a, buffer_type t, u32 stride, u32 byte_count)
+{
+  // Constant buffers can only be mapped with NO_OVERWRITE on D3D11.1.
+  ASSERT(t != BUFF_CONST, "Ring buffers are for vertices and elements.");
+  ASSERT(renderer->ring_count < RENDER_MAX_RINGS, "Too many ring buffers.");
+  rbuffer *out = rbuffer_dynamic_init(a, t, nullptr, stride, byte_count);
+  out->ring = arena_push_struct(a, render_ring);
+  *out->ring = ring_init(byte_count);
+  // Line up with the frames already in flight so retiring stays in step with the fences.
+  for (u32 i = 0; i < renderer->fence_count; ++i)
+  {
+    ring_frame_end(out->ring);
+  }
+  renderer->rings[renderer->ring_count++] = out->ring;
   return out;
 }
 
 
+bool rbuffer_ring_push(rbuffer* b, void* data, u32 byte_count, u32 *offset_out)
+{
+  ASSERT(b->ring, "Not a ring buffer.");
+  // Align to the stride so offset / stride is a valid base vertex or first index.
+  while (!ring_alloc(b->ring, byte_count, b->stride, offset_out))
+  {
+    // Wait for the GPU to hand back the oldest frame. With none left in flight the frame being
+    // built has filled the ring by itself, or the data is bigger than the ring: waiting won't help.
+    if (b->ring->frame_count == 0 || renderer->fence_count == 0) return false;
+    render_fence_retire(true);
+  }
+  rbuffer_update_range(b, data, *offset_out, byte_count);
+  return true;
+}
+
+
 void render_constant_set( rbuffer* b, u32 slot )
 {
   // Shared buffer for both shaders
-  renderer->context->VSSetConstantBuffers( slot, 1, &b->buffer );
-  renderer->context->PSSetConstantBuffers( slot, 1, &b->buffer );
+  STATE_CHANGED(RSTATE_VS_CONSTANTS, slot, b->buffer) renderer->context->VSSetConstantBuffers( slot, 1, &b->buffer );
+  STATE_CHANGED(RSTATE_PS_CONSTANTS, slot, b->buffer) renderer->context->PSSetConstantBuffers( slot, 1, &b->buffer );
+}
+
+
+void render_constant_set_range( rbuffer* b, u32 slot, u32 byte_offset, u32 byte_count )
+{
+  ASSERT(byte_offset % RENDER_CONSTANT_ALIGN == 0, "Constant buffer offsets must be 256 byte aligned.");
+  if (!renderer->context1)
+  {
+    // D3D11.0: upload the range into the slot's own small buffer and bind all of it.
+    ASSERT(b->shadow, "Constant buffer has no CPU copy to bind ranges from.");
+    ASSERT(slot < RENDER_CONSTANT_SLOTS && byte_count <= RENDER_CONSTANT_FALLBACK, "Constant range too big for the fallback.");
+    rbuffer *fallback = renderer->constant_fallback[slot];
+    rbuffer_update(fallback, b->shadow + byte_offset, byte_count);
+    render_constant_set(fallback, slot);
+    return;
+  }
+  // Offsets and counts are in 16 byte constants, counts rounded up to 256 bytes.
+  UINT first = byte_offset / 16;
+  UINT count = ((byte_count + RENDER_CONSTANT_ALIGN - 1) / RENDER_CONSTANT_ALIGN) * (RENDER_CONSTANT_ALIGN / 16);
+  u64 key = (u64)b->buffer ^ ((u64)first << 40) ^ (1ull << 63);
+  STATE_CHANGED(RSTATE_VS_CONSTANTS, slot, key) renderer->context1->VSSetConstantBuffers1( slot, 1, &b->buffer, &first, &count );
+  STATE_CHANGED(RSTATE_PS_CONSTANTS, slot, key) renderer->context1->PSSetConstantBuffers1( slot, 1, &b->buffer, &first, &count );
+}
+
+
+bool rbuffer_constant_push(arena *constants, void *data, u32 byte_count, u32 *offset_out)
+{
+  // Offsets are relative to the start of the mapped buffer, so align the offset, not the address.
+  u64 offset = ((constants->offset_new + RENDER_CONSTANT_ALIGN - 1) / RENDER_CONSTANT_ALIGN) * RENDER_CONSTANT_ALIGN;
+  u64 size = ((byte_count + RENDER_CONSTANT_ALIGN - 1) / RENDER_CONSTANT_ALIGN) * RENDER_CONSTANT_ALIGN;
+  // Full, the caller skips the draw. Nothing is written past the mapped buffer.
+  if (offset + size > constants->length) return false;
+  constants->offset_old = offset;
+  constants->offset_new = offset + size;
+  memcpy((u8*)constants->buffer + offset, data, byte_count);
+  *offset_out = (u32)offset;
+  return true;
 }
 
 
@@ -557,12 +738,47 @@ void rbuffer_update(rbuffer* b, void* data, u32 byte_count)
   // Copy 3 vertices into the buffer
   memcpy(mapped.pData, data, byte_count);
   renderer->context->Unmap(b->buffer, 0);
+  if (b->shadow && b->shadow != data) memcpy(b->shadow, data, byte_count);
+}
+
+
+void rbuffer_update_range(rbuffer* b, void* data, u32 byte_offset, u32 byte_count)
+{
+  // No synchronization: only write ranges the GPU isn't reading, like fresh ring space.
+  D3D11_MAPPED_SUBRESOURCE mapped;
+  HRESULT hr = renderer->context->Map(b->buffer, 0, D3D11_MAP_WRITE_NO_OVERWRITE, 0, &mapped);
+  ASSERT(SUCCEEDED(hr), "Failed to map buffer");
+  memcpy((u8*)mapped.pData + byte_offset, data, byte_count);
+  renderer->context->Unmap(b->buffer, 0);
+}
+
+
+arena rbuffer_map(rbuffer* b)
+{
+  // Written on the CPU and uploaded whole at unmap, ranges are copied from it too.
+  if (b->shadow) return arena_init(b->shadow, b->byte_count);
+  // Discard, so the driver hands out fresh memory and we never wait on the GPU.
+  D3D11_MAPPED_SUBRESOURCE mapped;
+  HRESULT hr = renderer->context->Map(b->buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+  ASSERT(SUCCEEDED(hr), "Failed to map buffer");
+  return arena_init(mapped.pData, b->byte_count);
+}
+
+
+void rbuffer_unmap(rbuffer* b)
+{
+  if (b->shadow)
+  {
+    rbuffer_update(b, b->shadow, b->byte_count);
+    return;
+  }
+  renderer->context->Unmap(b->buffer, 0);
 }
 
 
 void rbuffer_vertex_set( u32 slot_start, rbuffer *b )
 {
-  renderer->context->IASetVertexBuffers(slot_start, 1, &b->buffer, &b->stride, &b->offset);
+  STATE_CHANGED(RSTATE_VERTEX_BUFFER, slot_start, b->buffer) renderer->context->IASetVertexBuffers(slot_start, 1, &b->buffer, &b->stride, &b->offset);
 }
 
 
@@ -575,7 +791,7 @@ void rbuffer_vertex_describe( u64 shader_index, vertex_type vtype )
 
 void rbuffer_index_set( rbuffer *b )
 {
-  renderer->context->IASetIndexBuffer(b->buffer, DXGI_FORMAT_R32_UINT, 0 );
+  STATE_CHANGED(RSTATE_INDEX_BUFFER, 0, b->buffer) renderer->context->IASetIndexBuffer(b->buffer, DXGI_FORMAT_R32_UINT, 0 );
 }
 
 
@@ -650,72 +866,88 @@ void render_text_init(arena *a)
 }
 
 
+// Every draw says which depth state it wants, so UI draws don't have to restore it afterwards.
+internal void render_draw_state(ID3D11DepthStencilState *depth)
+{
+  STATE_CHANGED(RSTATE_TOPOLOGY, 0, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST) renderer->context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+  STATE_CHANGED(RSTATE_DEPTH_STENCIL, 0, depth) renderer->context->OMSetDepthStencilState(depth, 0);
+}
+
+
 void render_draw( u32 count )
 {
-  renderer->context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+  render_draw_state(renderer->depth_stencil_enabled);
   renderer->context->Draw(count, 0);
 }
 
 
 void render_draw_elems( u32 count, u32 elem_start, u32 vert_start )
 {
-  renderer->context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+  render_draw_state(renderer->depth_stencil_enabled);
   // renderer->context->RSSetState(renderer->rasterizer_default);
   renderer->context->DrawIndexed(count, elem_start, vert_start);
 }
 
 
-void render_draw_instances( u32 vertex_count, u32 instance_count )
+void render_draw_instances( u32 vertex_count, u32 instance_count, u32 instance_start )
 {
-  renderer->context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+  render_draw_state(renderer->depth_stencil_enabled);
   renderer->context->DrawInstanced(
     vertex_count,     // [in] UINT VertexCountPerInstance,
     instance_count,   // [in] UINT InstanceCount,
     0,                // [in] UINT StartVertexLocation,
-    0                 // [in] UINT StartInstanceLocation
+    instance_start    // [in] UINT StartInstanceLocation
   );
 }
 
 
-void render_draw_instances_elems( u32 elem_count, u32 instance_count )
+void render_draw_instances_elems( u32 elem_count, u32 instance_count, u32 elem_start, u32 vert_start, u32 instance_start )
 {
-  renderer->context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+  render_draw_state(renderer->depth_stencil_enabled);
   renderer->context->DrawIndexedInstanced(
     elem_count,     // [in] UINT IndexCountPerInstance,
     instance_count, // [in] UINT InstanceCount,
-    0, // [in] UINT StartIndexLocation,
-    0, // [in] INT  BaseVertexLocation,
-    0 // [in] UINT StartInstanceLocation
+    elem_start,     // [in] UINT StartIndexLocation,
+    vert_start,     // [in] INT  BaseVertexLocation,
+    instance_start  // [in] UINT StartInstanceLocation
   );
 }
 
 
 void render_draw_ui( u32 count )
 {
-  renderer->context->OMSetDepthStencilState(renderer->depth_stencil_disabled, 0);
-  render_draw( count );
-  renderer->context->OMSetDepthStencilState(renderer->depth_stencil_enabled, 0);
+  render_draw_state(renderer->depth_stencil_disabled);
+  renderer->context->Draw(count, 0);
 }
 
 
 void render_draw_ui_elems(u32 count, u32 elem_start, u32 vert_start)
 {
-  renderer->context->OMSetDepthStencilState(renderer->depth_stencil_disabled, 0);
-  render_draw_elems(  count, elem_start, vert_start );
-  renderer->context->OMSetDepthStencilState(renderer->depth_stencil_enabled, 0);
+  render_draw_state(renderer->depth_stencil_disabled);
+  renderer->context->DrawIndexed(count, elem_start, vert_start);
 }
 
 
 void render_close()
 {
   renderer->context->ClearState();
+  render_cache_invalidate(&renderer->cache);
   renderer->render_target->Release();
   renderer->depth_view->Release();
   renderer->depth_buffer->Release();
   renderer->blend_state->Release();
+  for (u32 i = 0; i < RENDER_FRAMES_IN_FLIGHT; ++i)
+  {
+    renderer->fences[i]->Release();
+  }
   renderer->rasterizer_default->Release();
   renderer->depth_stencil_enabled->Release();
   renderer->depth_stencil_disabled->Release();
+  if (renderer->context1) renderer->context1->Release();
+  for (u32 i = 0; i < RENDER_CONSTANT_SLOTS; ++i)
+  {
+    if (renderer->constant_fallback[i]) rbuffer_close(renderer->constant_fallback[i]);
+  }
   renderer->context->Release();
   renderer->swapchain->Release();
   #if defined(_DEBUG)
@@ -941,8 +1173,8 @@ texture* texture3d_init(arena *a, void* data, i32 width, i32 height, i32 depth)
 
 void texture_bind(texture *tex, u32 slot)
 {
-  renderer->context->PSSetShaderResources(slot, 1, &tex->view);
-  renderer->context->PSSetSamplers(slot, 1, &tex->sampler);
+  STATE_CHANGED(RSTATE_PS_RESOURCE, slot, tex->view)   renderer->context->PSSetShaderResources(slot, 1, &tex->view);
+  STATE_CHANGED(RSTATE_PS_SAMPLER, slot, tex->sampler) renderer->context->PSSetSamplers(slot, 1, &tex->sampler);
 }
 
 
@@ -995,10 +1227,10 @@ void shader_load( u64 shader_index, shader_type t, const char *file, const char
 void shader_set(u64 shader_index )
 {
   shaders s = rdata->s[shader_index];
-  renderer->context->VSSetShader(s.vertex, 0, 0);
-  renderer->context->PSSetShader(s.pixel, 0, 0);
+  STATE_CHANGED(RSTATE_VS_SHADER, 0, s.vertex) renderer->context->VSSetShader(s.vertex, 0, 0);
+  STATE_CHANGED(RSTATE_PS_SHADER, 0, s.pixel)  renderer->context->PSSetShader(s.pixel, 0, 0);
   // TODO: input layout should be attached to vbuffer
-  renderer->context->IASetInputLayout(s.vertex_in);
+  STATE_CHANGED(RSTATE_INPUT_LAYOUT, 0, s.vertex_in) renderer->context->IASetInputLayout(s.vertex_in);
 }
 
 
@@ -1010,8 +1242,16 @@ void shader_close( shaders *s )
 }
 
 
+void render_vsync(i32 status)
+{
+  // 1 is on 0 is off.
+  renderer->sync_interval = (status) ? 1 : 0;
+}
+
+
 void frame_init(f32 *background_color)
 {
+  render_fence_retire(false);
   renderer->context->ClearRenderTargetView(renderer->render_target, background_color);
   renderer->context->ClearDepthStencilView(renderer->depth_view, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
 }
@@ -1022,6 +1262,24 @@ void frame_render()
   #if defined(_DEBUG)
   debug_print();
   #endif
-  renderer->swapchain->Present(1, 0); // vsync on
+  renderer->swapchain->Present(renderer->sync_interval, 0);
+  // Fence the frame so ring buffer space can be reused once the GPU is done with it.
+  if (renderer->fence_count == RENDER_FRAMES_IN_FLIGHT)
+  {
+    render_fence_retire(true);
+  }
+  for (u32 i = 0; i < renderer->ring_count; ++i)
+  {
+    ring_frame_end(renderer->rings[i]);
+  }
+  renderer->context->End(renderer->fences[(renderer->fence_first + renderer->fence_count) % RENDER_FRAMES_IN_FLIGHT]);
+  renderer->fence_count++;
+  render_cache_frame_end(&renderer->cache);
+}
+
+
+render_stats render_stats_last()
+{
+  return renderer->cache.last;
 }
 
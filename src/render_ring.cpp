@@ -0,0 +1,69 @@
+#include "core.h"
+
+// Byte ring allocator for dynamic GPU buffers. Each frame's allocations stay reserved until the
+// frame is retired (the GPU has finished with it), so new data can be written without discarding
+// the buffer. It only does the bookkeeping, the backend does the mapping and fencing.
+
+#define RING_MAX_FRAMES 4
+
+
+struct render_ring
+{
+  u32 capacity;
+  u32 head;                          // Next free byte.
+  u32 used;                          // Reserved bytes, including padding and the skipped end on wrap.
+  u32 frame_used[RING_MAX_FRAMES];   // Bytes reserved by each frame in flight, oldest first from frame_first.
+  u32 frame_first;
+  u32 frame_count;
+  u32 current_used;                  // Bytes reserved by the frame being built.
+};
+
+
+render_ring ring_init(u32 capacity)
+{
+  render_ring ring = {};
+  ring.capacity = capacity;
+  return ring;
+}
+
+
+/// @brief Reserve byte_count bytes starting at a multiple of align. Allocations never straddle the end.
+/// Returns false when the space is still owned by frames in flight, or byte_count is more than the ring holds.
+bool ring_alloc(render_ring *ring, u32 byte_count, u32 align, u32 *offset_out)
+{
+  if (align == 0) align = 1;
+  u64 start = (((u64)ring->head + align - 1) / align) * align;
+  u64 consumed = (start - ring->head) + byte_count;
+  if (start + byte_count > ring->capacity)
+  {
+    // Skip the tail end and start again from zero.
+    start = 0;
+    consumed = (u64)(ring->capacity - ring->head) + byte_count;
+  }
+  if (ring->used + consumed > ring->capacity) return false;
+  ring->head = (u32)(start + byte_count);
+  ring->used += (u32)consumed;
+  ring->current_used += (u32)consumed;
+  *offset_out = (u32)start;
+  return true;
+}
+
+
+/// @brief Close the frame being built, its space stays reserved until ring_frame_retire.
+void ring_frame_end(render_ring *ring)
+{
+  ASSERT(ring->frame_count < RING_MAX_FRAMES, "Too many frames in flight.");
+  ring->frame_used[(ring->frame_first + ring->frame_count) % RING_MAX_FRAMES] = ring->current_used;
+  ring->frame_count++;
+  ring->current_used = 0;
+}
+
+
+/// @brief The GPU finished the oldest frame in flight, release its space.
+void ring_frame_retire(render_ring *ring)
+{
+  if (ring->frame_count == 0) return;
+  ring->used -= ring->frame_used[ring->frame_first];
+  ring->frame_first = (ring->frame_first + 1) % RING_MAX_FRAMES;
+  ring->frame_count--;
+}
@@ -0,0 +1,378 @@
+#include "core.h"
+#include "linalg.h"
+#include "platform.h"
+
+// Transform kernels over whole arrays instead of one matrix per call.
+// Inputs that are read per component (TRS, points, boxes) are SoA so four items fill one SSE
+// register per component; matrices stay fmat4 since that is what the GPU buffers and the cull
+// stages take. Every kernel works on an [start, end) range, big counts are split in chunks over
+// the job threads and smaller ones run on the calling thread.
+
+#define TRANSFORM_CHUNK_SIZE     1024  // Items per job.
+#define TRANSFORM_PARALLEL_COUNT 8192  // Below this the jobs cost more than they save.
+
+
+// Translation, rotation quaternion and scale. Composes to T * R * S.
+struct transform_trs
+{
+  f32 *tx, *ty, *tz;
+  f32 *qx, *qy, *qz, *qw;
+  f32 *sx, *sy, *sz;
+};
+
+
+struct transform_points
+{
+  f32 *x, *y, *z;
+};
+
+
+struct transform_aabbs
+{
+  f32 *min_x, *min_y, *min_z;
+  f32 *max_x, *max_y, *max_z;
+};
+
+
+struct transform_job
+{
+  void (*range)(transform_job *job, u32 start, u32 end);
+  u32               count;
+  fmat4            *out;
+  fmat4            *a;
+  fmat4            *b;
+  fmat4            *m;      // Shared by every item.
+  transform_trs     trs;
+  transform_points  points_in;
+  transform_points  points_out;
+  transform_aabbs   aabbs_in;
+  transform_aabbs   aabbs_out;
+};
+
+
+transform_trs transform_trs_init(arena *a, u32 capacity)
+{
+  transform_trs trs = {};
+  f32 **fields[] = { &trs.tx, &trs.ty, &trs.tz, &trs.qx, &trs.qy, &trs.qz, &trs.qw, &trs.sx, &trs.sy, &trs.sz };
+  for (u32 k = 0; k < sizeof(fields) / sizeof(fields[0]); ++k)
+  {
+    *fields[k] = arena_push_array(a, capacity, f32);
+  }
+  return trs;
+}
+
+
+transform_points transform_points_init(arena *a, u32 capacity)
+{
+  transform_points p = {};
+  p.x = arena_push_array(a, capacity, f32);
+  p.y = arena_push_array(a, capacity, f32);
+  p.z = arena_push_array(a, capacity, f32);
+  return p;
+}
+
+
+transform_aabbs transform_aabbs_init(arena *a, u32 capacity)
+{
+  transform_aabbs b = {};
+  b.min_x = arena_push_array(a, capacity, f32);
+  b.min_y = arena_push_array(a, capacity, f32);
+  b.min_z = arena_push_array(a, capacity, f32);
+  b.max_x = arena_push_array(a, capacity, f32);
+  b.max_y = arena_push_array(a, capacity, f32);
+  b.max_z = arena_push_array(a, capacity, f32);
+  return b;
+}
+
+
+internal void transform_chunk(void *data, u32 chunk)
+{
+  transform_job *job = (transform_job*) data;
+  u32 start = chunk * TRANSFORM_CHUNK_SIZE;
+  u32 end = (start + TRANSFORM_CHUNK_SIZE < job->count) ? start + TRANSFORM_CHUNK_SIZE : job->count;
+  job->range(job, start, end);
+}
+
+
+internal void transform_run(transform_job *job)
+{
+  if (job->count < TRANSFORM_PARALLEL_COUNT)
+  {
+    job->range(job, 0, job->count);
+    return;
+  }
+  u32 chunk_count = (job->count + TRANSFORM_CHUNK_SIZE - 1) / TRANSFORM_CHUNK_SIZE;
+  platform_jobs_run(transform_chunk, job, chunk_count);
+}
+
+
+// fmat4_mul inlined for the loops. out may be a or b.
+internal inline void transform_mul_one(fmat4 out, fmat4 a, fmat4 b)
+{
+  #if LINALG_SSE
+    __m128 a0 = _mm_loadu_ps(a[0]);
+    __m128 a1 = _mm_loadu_ps(a[1]);
+    __m128 a2 = _mm_loadu_ps(a[2]);
+    __m128 a3 = _mm_loadu_ps(a[3]);
+    for (u8 j = 0; j < 4; ++j)
+    {
+      __m128 bj = _mm_loadu_ps(b[j]);
+      __m128 r = _mm_mul_ps(a0, _mm_shuffle_ps(bj, bj, 0x00));
+      r = linalg_fmadd(a1, _mm_shuffle_ps(bj, bj, 0x55), r);
+      r = linalg_fmadd(a2, _mm_shuffle_ps(bj, bj, 0xaa), r);
+      _mm_storeu_ps(out[j], linalg_fmadd(a3, _mm_shuffle_ps(bj, bj, 0xff), r));
+    }
+  #else
+    fmat4_mul(out, a, b);
+  #endif
+}
+
+
+internal void transform_mul_range(transform_job *job, u32 start, u32 end)
+{
+  for (u32 i = start; i < end; ++i)
+  {
+    // m is either side of the product when it is shared.
+    f32 (*a)[4] = job->a ? job->a[i] : *job->m;
+    f32 (*b)[4] = job->b ? job->b[i] : *job->m;
+    transform_mul_one(job->out[i], a, b);
+  }
+}
+
+
+/// @brief out[i] = a[i] * b[i]. out may be a or b.
+void transform_batch_mul(fmat4 *out, fmat4 *a, fmat4 *b, u32 count)
+{
+  transform_job job = {};
+  job.range = transform_mul_range;
+  job.count = count;
+  job.out = out;
+  job.a = a;
+  job.b = b;
+  transform_run(&job);
+}
+
+
+/// @brief out[i] = m * b[i], e.g. view_proj times every world matrix. out may be b.
+void transform_batch_mul_left(fmat4 *out, fmat4 m, fmat4 *b, u32 count)
+{
+  transform_job job = {};
+  job.range = transform_mul_range;
+  job.count = count;
+  job.out = out;
+  job.m = (fmat4*) m;
+  job.b = b;
+  transform_run(&job);
+}
+
+
+internal void transform_compose_one(transform_trs *trs, u32 i, fmat4 out)
+{
+  f32 x = trs->qx[i], y = trs->qy[i], z = trs->qz[i], w = trs->qw[i];
+  f32 sx = trs->sx[i], sy = trs->sy[i], sz = trs->sz[i];
+  out[0][0] = (1.0f - 2.0f*(y*y + z*z)) * sx;
+  out[0][1] = 2.0f*(x*y + w*z) * sx;
+  out[0][2] = 2.0f*(x*z - w*y) * sx;
+  out[0][3] = 0.0f;
+  out[1][0] = 2.0f*(x*y - w*z) * sy;
+  out[1][1] = (1.0f - 2.0f*(x*x + z*z)) * sy;
+  out[1][2] = 2.0f*(y*z + w*x) * sy;
+  out[1][3] = 0.0f;
+  out[2][0] = 2.0f*(x*z + w*y) * sz;
+  out[2][1] = 2.0f*(y*z - w*x) * sz;
+  out[2][2] = (1.0f - 2.0f*(x*x + y*y)) * sz;
+  out[2][3] = 0.0f;
+  out[3][0] = trs->tx[i];
+  out[3][1] = trs->ty[i];
+  out[3][2] = trs->tz[i];
+  out[3][3] = 1.0f;
+}
+
+
+internal void transform_compose_range(transform_job *job, u32 start, u32 end)
+{
+  transform_trs *trs = &job->trs;
+  u32 i = start;
+  #if LINALG_SSE
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 two = _mm_set1_ps(2.0f);
+    __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= end; i += 4)
+    {
+      // One item per lane while building the rotation, then transpose to one column per register.
+      __m128 x = _mm_loadu_ps(trs->qx + i), y = _mm_loadu_ps(trs->qy + i);
+      __m128 z = _mm_loadu_ps(trs->qz + i), w = _mm_loadu_ps(trs->qw + i);
+      __m128 sx = _mm_loadu_ps(trs->sx + i), sy = _mm_loadu_ps(trs->sy + i), sz = _mm_loadu_ps(trs->sz + i);
+      __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+      __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+      __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+      __m128 c0[4], c1[4], c2[4], c3[4];
+      c0[0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+      c0[1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+      c0[2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+      c0[3] = zero;
+      c1[0] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+      c1[1] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+      c1[2] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+      c1[3] = zero;
+      c2[0] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+      c2[1] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+      c2[2] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+      c2[3] = zero;
+      c3[0] = _mm_loadu_ps(trs->tx + i);
+      c3[1] = _mm_loadu_ps(trs->ty + i);
+      c3[2] = _mm_loadu_ps(trs->tz + i);
+      c3[3] = one;
+      _MM_TRANSPOSE4_PS(c0[0], c0[1], c0[2], c0[3]);
+      _MM_TRANSPOSE4_PS(c1[0], c1[1], c1[2], c1[3]);
+      _MM_TRANSPOSE4_PS(c2[0], c2[1], c2[2], c2[3]);
+      _MM_TRANSPOSE4_PS(c3[0], c3[1], c3[2], c3[3]);
+      for (u32 k = 0; k < 4; ++k)
+      {
+        _mm_storeu_ps(job->out[i + k][0], c0[k]);
+        _mm_storeu_ps(job->out[i + k][1], c1[k]);
+        _mm_storeu_ps(job->out[i + k][2], c2[k]);
+        _mm_storeu_ps(job->out[i + k][3], c3[k]);
+      }
+    }
+  #endif
+  for (; i < end; ++i)
+  {
+    transform_compose_one(trs, i, job->out[i]);
+  }
+}
+
+
+/// @brief out[i] = T * R * S from the SoA translation, unit quaternion and scale.
+void transform_batch_compose(fmat4 *out, transform_trs trs, u32 count)
+{
+  transform_job job = {};
+  job.range = transform_compose_range;
+  job.count = count;
+  job.out = out;
+  job.trs = trs;
+  transform_run(&job);
+}
+
+
+internal void transform_points_range(transform_job *job, u32 start, u32 end)
+{
+  f32 (*m)[4] = *job->m;
+  transform_points in = job->points_in;
+  transform_points out = job->points_out;
+  u32 i = start;
+  #if LINALG_SSE
+    __m128 r[3][4];
+    for (u32 row = 0; row < 3; ++row)
+    {
+      for (u32 col = 0; col < 4; ++col) r[row][col] = _mm_set1_ps(m[col][row]);
+    }
+    for (; i + 4 <= end; i += 4)
+    {
+      __m128 x = _mm_loadu_ps(in.x + i);
+      __m128 y = _mm_loadu_ps(in.y + i);
+      __m128 z = _mm_loadu_ps(in.z + i);
+      f32 *dst[3] = { out.x + i, out.y + i, out.z + i };
+      for (u32 row = 0; row < 3; ++row)
+      {
+        __m128 v = linalg_fmadd(r[row][0], x, r[row][3]);
+        v = linalg_fmadd(r[row][1], y, v);
+        _mm_storeu_ps(dst[row], linalg_fmadd(r[row][2], z, v));
+      }
+    }
+  #endif
+  for (; i < end; ++i)
+  {
+    f32 x = in.x[i], y = in.y[i], z = in.z[i];
+    out.x[i] = m[0][0]*x + m[1][0]*y + m[2][0]*z + m[3][0];
+    out.y[i] = m[0][1]*x + m[1][1]*y + m[2][1]*z + m[3][1];
+    out.z[i] = m[0][2]*x + m[1][2]*y + m[2][2]*z + m[3][2];
+  }
+}
+
+
+/// @brief out = m * (in, 1) for every point, no perspective divide. out may be in.
+void transform_batch_points(fmat4 m, transform_points in, transform_points out, u32 count)
+{
+  transform_job job = {};
+  job.range = transform_points_range;
+  job.count = count;
+  job.m = (fmat4*) m;
+  job.points_in = in;
+  job.points_out = out;
+  transform_run(&job);
+}
+
+
+internal void transform_aabbs_range(transform_job *job, u32 start, u32 end)
+{
+  transform_aabbs in = job->aabbs_in;
+  transform_aabbs out = job->aabbs_out;
+  u32 i = start;
+  #if LINALG_SSE
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 sign = _mm_set1_ps(-0.0f);
+    for (; i + 4 <= end; i += 4)
+    {
+      // Center and extent per lane, matrix columns transposed so lane k holds box k's entry.
+      __m128 bmin[3] = { _mm_loadu_ps(in.min_x + i), _mm_loadu_ps(in.min_y + i), _mm_loadu_ps(in.min_z + i) };
+      __m128 bmax[3] = { _mm_loadu_ps(in.max_x + i), _mm_loadu_ps(in.max_y + i), _mm_loadu_ps(in.max_z + i) };
+      __m128 c[3], e[3];
+      for (u32 k = 0; k < 3; ++k)
+      {
+        c[k] = _mm_mul_ps(_mm_add_ps(bmin[k], bmax[k]), half);
+        e[k] = _mm_mul_ps(_mm_sub_ps(bmax[k], bmin[k]), half);
+      }
+      __m128 cols[4][4];
+      for (u32 col = 0; col < 4; ++col)
+      {
+        for (u32 k = 0; k < 4; ++k) cols[col][k] = _mm_loadu_ps(job->a[i + k][col]);
+        _MM_TRANSPOSE4_PS(cols[col][0], cols[col][1], cols[col][2], cols[col][3]);
+      }
+      f32 *dst_min[3] = { out.min_x + i, out.min_y + i, out.min_z + i };
+      f32 *dst_max[3] = { out.max_x + i, out.max_y + i, out.max_z + i };
+      for (u32 row = 0; row < 3; ++row)
+      {
+        __m128 wc = linalg_fmadd(cols[0][row], c[0], cols[3][row]);
+        wc = linalg_fmadd(cols[1][row], c[1], wc);
+        wc = linalg_fmadd(cols[2][row], c[2], wc);
+        __m128 we = _mm_mul_ps(_mm_andnot_ps(sign, cols[0][row]), e[0]);
+        we = linalg_fmadd(_mm_andnot_ps(sign, cols[1][row]), e[1], we);
+        we = linalg_fmadd(_mm_andnot_ps(sign, cols[2][row]), e[2], we);
+        _mm_storeu_ps(dst_min[row], _mm_sub_ps(wc, we));
+        _mm_storeu_ps(dst_max[row], _mm_add_ps(wc, we));
+      }
+    }
+  #endif
+  for (; i < end; ++i)
+  {
+    f32 (*m)[4] = job->a[i];
+    f32 c[3] = { 0.5f*(in.min_x[i] + in.max_x[i]), 0.5f*(in.min_y[i] + in.max_y[i]), 0.5f*(in.min_z[i] + in.max_z[i]) };
+    f32 e[3] = { 0.5f*(in.max_x[i] - in.min_x[i]), 0.5f*(in.max_y[i] - in.min_y[i]), 0.5f*(in.max_z[i] - in.min_z[i]) };
+    f32 wc[3], we[3];
+    for (u32 row = 0; row < 3; ++row)
+    {
+      wc[row] = m[3][row] + m[0][row]*c[0] + m[1][row]*c[1] + m[2][row]*c[2];
+      we[row] = fabsf(m[0][row])*e[0] + fabsf(m[1][row])*e[1] + fabsf(m[2][row])*e[2];
+    }
+    out.min_x[i] = wc[0] - we[0];
+    out.min_y[i] = wc[1] - we[1];
+    out.min_z[i] = wc[2] - we[2];
+    out.max_x[i] = wc[0] + we[0];
+    out.max_y[i] = wc[1] + we[1];
+    out.max_z[i] = wc[2] + we[2];
+  }
+}
+
+
+/// @brief World space AABBs of local boxes, box i through transforms[i]. out may be in.
+void transform_batch_aabbs(fmat4 *transforms, transform_aabbs in, transform_aabbs out, u32 count)
+{
+  transform_job job = {};
+  job.range = transform_aabbs_range;
+  job.count = count;
+  job.a = transforms;
+  job.aabbs_in = in;
+  job.aabbs_out = out;
+  transform_run(&job);
+}
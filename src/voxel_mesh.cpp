@@ -0,0 +1,224 @@
+#include "data3d.h"
+#include "platform.h"
+#include "render_boundary.h"
+
+// Greedy surface extraction for voxel grids.
+// Only faces between a filled and an empty voxel are kept, and coplanar faces are merged into
+// the largest rectangles we can find, one 2D mask per slice. The grid is cut into chunks that
+// are meshed in parallel: the first pass counts quads per chunk, the second writes them.
+
+#define VOXEL_CHUNK_SIZE 32
+
+
+struct voxel_mesh_job
+{
+  voxel_grid grid;
+  u32        resolution;
+  u32        chunks_per_axis;
+  fvec3      unit;          // Size of one voxel.
+  fvec4      color;
+  u32       *quad_counts;   // Quads per chunk, filled by the count pass.
+  u32       *quad_offsets;  // First quad of each chunk, used by the write pass.
+  vertex1   *vertices;      // Null during the count pass.
+  u32       *indices;
+};
+
+
+internal inline bool voxel_filled(voxel_grid *grid, u32 resolution, i32 x, i32 y, i32 z)
+{
+  // Everything outside the grid is empty.
+  i32 res = (i32) resolution;
+  if (x < 0 || y < 0 || z < 0 || x >= res || y >= res || z >= res) return false;
+  u32 location = x + (y * resolution) + (z * resolution * resolution);
+  return (grid->contents[location] != 0);
+}
+
+
+internal void voxel_quad_write(voxel_mesh_job *job, u32 quad, u32 axis, bool positive, i32 *origin, u32 width, u32 height)
+{
+  // Quad axes: u and v follow the face axis cyclically so u x v points along +axis.
+  u32 u = (axis + 1) % 3;
+  u32 v = (axis + 2) % 3;
+  fvec3 corners[4] = {};
+  for (u32 i = 0; i < 4; ++i)
+  {
+    i32 p[3] = { origin[0], origin[1], origin[2] };
+    if (i == 1 || i == 2) p[u] += width;
+    if (i == 2 || i == 3) p[v] += height;
+    corners[i].x = job->grid.min.x + (f32)p[0] * job->unit.x;
+    corners[i].y = job->grid.min.y + (f32)p[1] * job->unit.y;
+    corners[i].z = job->grid.min.z + (f32)p[2] * job->unit.z;
+  }
+  // Texture coordinates span the quad in voxels so textures tile per voxel.
+  fvec2 uvs[4] = {
+    fvec2_init(0.0f, 0.0f),
+    fvec2_init((f32)width, 0.0f),
+    fvec2_init((f32)width, (f32)height),
+    fvec2_init(0.0f, (f32)height),
+  };
+  u32 vert_first = quad * 4;
+  vertex1 *verts = &job->vertices[vert_first];
+  for (u32 i = 0; i < 4; ++i)
+  {
+    verts[i].pos = corners[i];
+    verts[i].col = job->color;
+    verts[i].tex = uvs[i];
+  }
+  // Same winding as primitive_box3d: front faces wind against the outward normal.
+  u32 *elems = &job->indices[quad * 6];
+  if (positive)
+  {
+    elems[0] = vert_first + 0; elems[1] = vert_first + 2; elems[2] = vert_first + 1;
+    elems[3] = vert_first + 0; elems[4] = vert_first + 3; elems[5] = vert_first + 2;
+  }
+  else
+  {
+    elems[0] = vert_first + 0; elems[1] = vert_first + 1; elems[2] = vert_first + 2;
+    elems[3] = vert_first + 0; elems[4] = vert_first + 2; elems[5] = vert_first + 3;
+  }
+}
+
+
+// Mesh one chunk. Returns the number of quads; writes them if job->vertices is set.
+internal u32 voxel_chunk_mesh(voxel_mesh_job *job, u32 chunk)
+{
+  u32 cpa = job->chunks_per_axis;
+  i32 chunk_min[3] = {
+    (i32)((chunk % cpa) * VOXEL_CHUNK_SIZE),
+    (i32)(((chunk / cpa) % cpa) * VOXEL_CHUNK_SIZE),
+    (i32)((chunk / (cpa * cpa)) * VOXEL_CHUNK_SIZE),
+  };
+  i32 chunk_len[3] = {};
+  for (u32 i = 0; i < 3; ++i)
+  {
+    i32 remaining = (i32)job->resolution - chunk_min[i];
+    chunk_len[i] = (remaining < VOXEL_CHUNK_SIZE) ? remaining : VOXEL_CHUNK_SIZE;
+  }
+  u32 quad_count = 0;
+  u32 quad_first = job->vertices ? job->quad_offsets[chunk] : 0;
+  u8 mask[VOXEL_CHUNK_SIZE * VOXEL_CHUNK_SIZE];
+  for (u32 axis = 0; axis < 3; ++axis)
+  {
+    u32 u = (axis + 1) % 3;
+    u32 v = (axis + 2) % 3;
+    i32 len_u = chunk_len[u];
+    i32 len_v = chunk_len[v];
+    for (u32 side = 0; side < 2; ++side)
+    {
+      bool positive = (side == 0);
+      i32 step = positive ? 1 : -1;
+      for (i32 slice = 0; slice < chunk_len[axis]; ++slice)
+      {
+        // Build the mask of exposed faces in this slice.
+        i32 p[3] = {};
+        p[axis] = chunk_min[axis] + slice;
+        bool any = false;
+        for (i32 j = 0; j < len_v; ++j)
+        {
+          for (i32 i = 0; i < len_u; ++i)
+          {
+            p[u] = chunk_min[u] + i;
+            p[v] = chunk_min[v] + j;
+            i32 n[3] = { p[0], p[1], p[2] };
+            n[axis] += step;
+            bool exposed = voxel_filled(&job->grid, job->resolution, p[0], p[1], p[2]) &&
+                          !voxel_filled(&job->grid, job->resolution, n[0], n[1], n[2]);
+            mask[i + j * VOXEL_CHUNK_SIZE] = exposed;
+            any |= exposed;
+          }
+        }
+        if (!any) continue;
+        // Greedily grow rectangles: first along u, then along v while whole rows match.
+        for (i32 j = 0; j < len_v; ++j)
+        {
+          for (i32 i = 0; i < len_u; ++i)
+          {
+            if (!mask[i + j * VOXEL_CHUNK_SIZE]) continue;
+            i32 width = 1;
+            while ((i + width < len_u) && mask[(i + width) + j * VOXEL_CHUNK_SIZE]) width++;
+            i32 height = 1;
+            while (j + height < len_v)
+            {
+              bool row_full = true;
+              for (i32 k = 0; k < width; ++k)
+              {
+                if (!mask[(i + k) + (j + height) * VOXEL_CHUNK_SIZE]) { row_full = false; break; }
+              }
+              if (!row_full) break;
+              height++;
+            }
+            for (i32 h = 0; h < height; ++h)
+            {
+              memset(&mask[i + (j + h) * VOXEL_CHUNK_SIZE], 0, width);
+            }
+            if (job->vertices)
+            {
+              // Positive faces sit on the far side of the voxel.
+              i32 origin[3] = {};
+              origin[axis] = chunk_min[axis] + slice + (positive ? 1 : 0);
+              origin[u] = chunk_min[u] + i;
+              origin[v] = chunk_min[v] + j;
+              voxel_quad_write(job, quad_first + quad_count, axis, positive, origin, width, height);
+            }
+            quad_count++;
+          }
+        }
+      }
+    }
+  }
+  return quad_count;
+}
+
+
+internal void voxel_chunk_count(void *data, u32 chunk)
+{
+  voxel_mesh_job *job = (voxel_mesh_job*) data;
+  job->quad_counts[chunk] = voxel_chunk_mesh(job, chunk);
+}
+
+
+internal void voxel_chunk_write(void *data, u32 chunk)
+{
+  voxel_mesh_job *job = (voxel_mesh_job*) data;
+  voxel_chunk_mesh(job, chunk);
+}
+
+
+/// @brief Surface of the filled voxels as merged quads, appended to vbuffer and ebuffer.
+/// The grid spans min to max with resolution voxels per axis. scratch is only used during the call.
+entity voxel_grid_mesh( voxel_grid grid, u32 resolution, fvec4 color, arena *vbuffer, arena *ebuffer, arena *scratch )
+{
+  entity output = {};
+  arena_savepoint save = arena_save(scratch);
+  voxel_mesh_job job = {};
+  job.grid = grid;
+  job.resolution = resolution;
+  job.chunks_per_axis = (resolution + VOXEL_CHUNK_SIZE - 1) / VOXEL_CHUNK_SIZE;
+  job.unit = fvec3_scale(fvec3_sub(grid.max, grid.min), 1.0f / resolution);
+  job.color = color;
+  u32 chunk_count = job.chunks_per_axis * job.chunks_per_axis * job.chunks_per_axis;
+  job.quad_counts  = arena_push_array(scratch, chunk_count, u32);
+  job.quad_offsets = arena_push_array(scratch, chunk_count, u32);
+  // Pass 1: count quads per chunk.
+  platform_jobs_run(voxel_chunk_count, &job, chunk_count);
+  u32 quad_total = 0;
+  for (u32 i = 0; i < chunk_count; ++i)
+  {
+    job.quad_offsets[i] = quad_total;
+    quad_total += job.quad_counts[i];
+  }
+  // Pass 2: write every chunk straight into its slice of the render arenas.
+  u32 vert_count = quad_total * 4;
+  u32 elem_count = quad_total * 6;
+  output.vert_start = vbuffer->offset_new / sizeof(vertex1);
+  output.elem_start = ebuffer->offset_new / sizeof(u32);
+  output.count = elem_count;
+  if (quad_total > 0)
+  {
+    job.vertices = arena_push_array( vbuffer, vert_count, vertex1 );
+    job.indices  = arena_push_array( ebuffer, elem_count, u32 );
+    platform_jobs_run(voxel_chunk_write, &job, chunk_count);
+  }
+  arena_pop(save);
+  return output;
+}
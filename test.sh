@@ -0,0 +1,39 @@
+#!/bin/sh
+# Builds and runs the headless tests on Linux, exits nonzero if any fails.
+# Usage: ./test.sh [test]   Ex. tests/jobs_test.cpp -> ./test.sh jobs_test
+set -e
+
+# Build directory
+outdir="$(pwd)/bin"
+mkdir -p "$outdir"
+
+tests=${1:-$(cd tests && ls *_test.cpp | sed 's/\.cpp$//')}
+
+# Go into source code directory
+cd src
+
+test_src_dir=../tests
+# With _DEBUG, the ASSERTs are part of the test.
+app_flags="-O1 -D_DEBUG"
+compiler_flags="-g -std=c++20 -Wvarargs -Wall -Werror -Wno-unused-function -Wno-unused-variable -Wno-unused-but-set-variable -Wno-deprecated"
+includes="-I. -I../external -I$test_src_dir"
+linker_flags="-lpthread -ldl -lm"
+
+failed=0
+for test in $tests
+do
+  echo "$test compiling..."
+  # Tests include the modules they cover, platform layer included.
+  ${CXX:-clang++} \
+  $compiler_flags \
+  $app_flags \
+  $CXXFLAGS \
+  core.cpp linalg.cpp $test_src_dir/$test.cpp \
+  -o \
+  "$outdir/$test" \
+  $includes \
+  $linker_flags
+  "$outdir/$test" || failed=1
+done
+
+exit $failed
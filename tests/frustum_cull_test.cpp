@@ -0,0 +1,159 @@
+#include "platform_linux.cpp"
+#include "frustum_cull.cpp"
+#include "test.h"
+
+// Boxes placed on either side of each plane, then random rotated boxes checked against their
+// corners in clip space: a box with a corner inside has to be kept, a box whose world space
+// bounds (what the culler tests, conservative for rotated boxes) are all outside one plane has
+// to be dropped. The counts run the scalar path, the four wide path with
+// a scalar tail, and the chunked jobs, and all three have to agree with one box at a time.
+// Depth goes 0 to 1 like the D3D projection.
+
+#define TEST_BOXES 10007
+
+
+internal f32 test_random(u32 *seed)
+{
+  // xorshift32, in [0, 1)
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 17;
+  *seed ^= *seed << 5;
+  return (f32)(*seed >> 8) * (1.0f / 16777216.0f);
+}
+
+
+internal void test_translation(fmat4 m, fvec3 offset)
+{
+  fmat4_identity(m);
+  m[3][0] = offset.x;
+  m[3][1] = offset.y;
+  m[3][2] = offset.z;
+}
+
+
+internal cull_bounds test_box(f32 half)
+{
+  cull_bounds b = { fvec3_init(-half, -half, -half), fvec3_init(half, half, half) };
+  return b;
+}
+
+
+// 0 when a clip space corner is inside, otherwise the planes it's outside of as bits.
+internal u32 test_outside(fvec4 p)
+{
+  u32 bits = 0;
+  bits |= (p.x < -p.w) << 0;
+  bits |= (p.x >  p.w) << 1;
+  bits |= (p.y < -p.w) << 2;
+  bits |= (p.y >  p.w) << 3;
+  bits |= (p.z <  0.0f) << 4;
+  bits |= (p.z >  p.w) << 5;
+  return bits;
+}
+
+
+int main(int argc, char **argv)
+{
+  arena memory = test_memory(Megabytes(64));
+  platform_init(&memory);
+  arena scratch = subarena_init(&memory, Megabytes(1));
+  // Camera at z = 10 looking down -z, near 1, far 50. The projection's depth row is remapped from
+  // -1..1 to 0..1.
+  fmat4 view, proj, view_proj;
+  fmat4_lookat(view, fvec3_init(0.0f, 0.0f, 10.0f), fvec3_init(0.0f, 0.0f, 0.0f), fvec3_init(0.0f, 1.0f, 0.0f));
+  fmat4_perspective(proj, PI / 3.0f, 1.5f, 1.0f, 50.0f);
+  for (u32 c = 0; c < 4; ++c) proj[c][2] = 0.5f * (proj[c][2] + proj[c][3]);
+  fmat4_mul(view_proj, proj, view);
+  cull_frustum frustum = cull_frustum_from_matrix(view_proj);
+  // Known boxes: in the middle, behind the camera, between the camera and the near plane, past the
+  // far plane, across the left plane, far off to the side.
+  const fvec3 centers[6] = { fvec3_init(0.0f, 0.0f, 0.0f), fvec3_init(0.0f, 0.0f, 15.0f), fvec3_init(0.0f, 0.0f, 9.25f),
+                             fvec3_init(0.0f, 0.0f, -45.0f), fvec3_init(-9.2f, 0.0f, 0.0f), fvec3_init(40.0f, 0.0f, 0.0f) };
+  const f32 halves[6] = { 1.0f, 1.0f, 0.1f, 1.0f, 1.0f, 1.0f };
+  const bool expected[6] = { true, false, false, false, true, false };
+  cull_bounds known_bounds[6];
+  fmat4 known_transforms[6];
+  u32 known_visible[6];
+  for (u32 i = 0; i < 6; ++i)
+  {
+    known_bounds[i] = test_box(halves[i]);
+    test_translation(known_transforms[i], centers[i]);
+  }
+  u32 known_count = frustum_cull(frustum, known_bounds, known_transforms, 6, known_visible, &scratch);
+  u32 next = 0;
+  for (u32 i = 0; i < 6; ++i)
+  {
+    bool kept = (next < known_count && known_visible[next] == i);
+    next += kept;
+    CHECK(kept == expected[i], "box %u at %.1f %.1f %.1f %s", i, centers[i].x, centers[i].y, centers[i].z, kept ? "kept" : "culled");
+  }
+  // Random boxes, rotated, scaled and moved through a region around the frustum.
+  cull_bounds *bounds = arena_push_array(&memory, TEST_BOXES, cull_bounds);
+  fmat4 *transforms = arena_push_array(&memory, TEST_BOXES, fmat4);
+  u32 *visible = arena_push_array(&memory, TEST_BOXES, u32);
+  u32 *reference = arena_push_array(&memory, TEST_BOXES, u32);
+  u32 seed = 0x6a09e667u;
+  u32 missed = 0, kept_outside = 0;
+  for (u32 i = 0; i < TEST_BOXES; ++i)
+  {
+    fvec3 lo = fvec3_init(test_random(&seed) - 1.0f, test_random(&seed) - 1.0f, test_random(&seed) - 1.0f);
+    fvec3 size = fvec3_init(0.1f + 2.0f * test_random(&seed), 0.1f + 2.0f * test_random(&seed), 0.1f + 2.0f * test_random(&seed));
+    bounds[i].min = lo;
+    bounds[i].max = fvec3_add(lo, size);
+    fvec3 axis = normalize3(fvec3_init(test_random(&seed) - 0.5f, test_random(&seed) - 0.5f, test_random(&seed) - 0.5f + 1e-3f));
+    fmat4_identity(transforms[i]);
+    fmat4_rotate(transforms[i], 2.0f * PI * test_random(&seed), axis);
+    f32 scale = 0.5f + test_random(&seed);
+    for (u32 c = 0; c < 3; ++c)
+    {
+      for (u32 r = 0; r < 3; ++r) transforms[i][c][r] *= scale;
+    }
+    transforms[i][3][0] = 60.0f * (test_random(&seed) - 0.5f);
+    transforms[i][3][1] = 60.0f * (test_random(&seed) - 0.5f);
+    transforms[i][3][2] = 10.0f - 60.0f * test_random(&seed);
+  }
+  u32 reference_count = 0;
+  for (u32 i = 0; i < TEST_BOXES; ++i)
+  {
+    bool kept = cull_box_visible(&frustum, transforms[i], bounds[i]);
+    if (kept) reference[reference_count++] = i;
+    u32 any_inside = 0;
+    cull_bounds world = {};
+    for (u32 corner = 0; corner < 8; ++corner)
+    {
+      fvec3 p = fvec3_init((corner & 1) ? bounds[i].max.x : bounds[i].min.x,
+                           (corner & 2) ? bounds[i].max.y : bounds[i].min.y,
+                           (corner & 4) ? bounds[i].max.z : bounds[i].min.z);
+      p = fmat4_mul_point(transforms[i], p);
+      world.min = (corner == 0) ? p : fvec3_min(world.min, p);
+      world.max = (corner == 0) ? p : fvec3_max(world.max, p);
+      any_inside |= (test_outside(fmat4_mul_vec4(view_proj, fvec4_init(p.x, p.y, p.z, 1.0f))) == 0);
+    }
+    u32 all_outside = 0x3f;
+    for (u32 corner = 0; corner < 8; ++corner)
+    {
+      fvec4 p = fvec4_init((corner & 1) ? world.max.x : world.min.x,
+                           (corner & 2) ? world.max.y : world.min.y,
+                           (corner & 4) ? world.max.z : world.min.z, 1.0f);
+      all_outside &= test_outside(fmat4_mul_vec4(view_proj, p));
+    }
+    missed += (any_inside && !kept);
+    kept_outside += (all_outside && kept);
+  }
+  CHECK(missed == 0, "%u boxes with a corner inside culled", missed);
+  CHECK(kept_outside == 0, "%u boxes outside one plane kept", kept_outside);
+  CHECK(reference_count > 100 && reference_count < TEST_BOXES / 2, "%u of %u boxes visible", reference_count, TEST_BOXES);
+  // Scalar only, four wide with a scalar tail, and chunked over the jobs.
+  const u32 counts[3] = { 3, 1001, TEST_BOXES };
+  for (u32 c = 0; c < 3; ++c)
+  {
+    u32 count = counts[c];
+    u32 expected_count = 0;
+    while (expected_count < reference_count && reference[expected_count] < count) expected_count++;
+    u32 written = frustum_cull(frustum, bounds, transforms, count, visible, &scratch);
+    CHECK(written == expected_count && memcmp(visible, reference, written * sizeof(u32)) == 0,
+          "%u boxes: %u visible, %u one at a time", count, written, expected_count);
+  }
+  CHECK(scratch.offset_new == 0, "culling left %zu bytes in scratch", scratch.offset_new);
+  return test_exit("frustum_cull_test");
+}
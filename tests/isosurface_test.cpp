@@ -0,0 +1,152 @@
+#include "platform_linux.cpp"
+#include "isosurface.cpp"
+#include "test.h"
+
+#include <stdlib.h>
+
+// Marching cubes has to give closed 2-manifold surfaces. Volumes padded with outside samples are
+// extracted and every triangle edge must be used by exactly two triangles, once each way round.
+// Slabs each write the vertices of their boundary plane, so vertices are welded by position first.
+// Covers each of the 256 corner configurations on its own and random fields, which hit the
+// ambiguous faces between neighbouring cells.
+
+#define TEST_RANDOM_SIZE   24
+#define TEST_RANDOM_ROUNDS 8
+
+
+global vertex1 *test_vertices;
+
+
+internal int test_edge_compare(const void *a, const void *b)
+{
+  u64 x = *(const u64*)a;
+  u64 y = *(const u64*)b;
+  return (x < y) ? -1 : (x > y);
+}
+
+
+internal int test_vertex_compare(const void *a, const void *b)
+{
+  // Vertices on the same cube edge are computed the same way, so equal positions are bit equal.
+  return memcmp(&test_vertices[*(const u32*)a].pos, &test_vertices[*(const u32*)b].pos, sizeof(fvec3));
+}
+
+
+// Rewrite indices to the first of the vertices sharing their position.
+internal void test_weld(vertex1 *vertices, u32 vertex_count, u32 *indices, u32 count, arena *scratch)
+{
+  arena_savepoint save = arena_save(scratch);
+  u32 *order = arena_push_array(scratch, vertex_count, u32);
+  u32 *remap = arena_push_array(scratch, vertex_count, u32);
+  for (u32 i = 0; i < vertex_count; ++i) order[i] = i;
+  test_vertices = vertices;
+  qsort(order, vertex_count, sizeof(u32), test_vertex_compare);
+  for (u32 i = 0; i < vertex_count; ++i)
+  {
+    bool same = (i > 0) && (test_vertex_compare(&order[i - 1], &order[i]) == 0);
+    remap[order[i]] = same ? remap[order[i - 1]] : order[i];
+  }
+  for (u32 i = 0; i < count; ++i) indices[i] = remap[indices[i]];
+  arena_pop(save);
+}
+
+
+// Returns the number of edges that aren't shared by exactly two opposite triangle sides.
+internal u32 test_manifold_errors(u32 *indices, u32 count, arena *scratch)
+{
+  arena_savepoint save = arena_save(scratch);
+  // Each directed edge once, keyed so that the two sides of an edge sort next to each other.
+  u64 *edges = arena_push_array(scratch, count, u64);
+  u32 degenerate = 0;
+  for (u32 t = 0; t < count; t += 3)
+  {
+    for (u32 i = 0; i < 3; ++i)
+    {
+      u32 a = indices[t + i];
+      u32 b = indices[t + (i + 1) % 3];
+      degenerate += (a == b);
+      u64 lo = (a < b) ? a : b;
+      u64 hi = (a < b) ? b : a;
+      edges[t + i] = (lo << 33) | (hi << 1) | (u64)(a > b);
+    }
+  }
+  qsort(edges, count, sizeof(u64), test_edge_compare);
+  u32 errors = degenerate;
+  u32 i = 0;
+  while (i < count)
+  {
+    u32 j = i;
+    while (j < count && (edges[j] >> 1) == (edges[i] >> 1)) j++;
+    // Two uses, one in each direction.
+    bool ok = (j - i == 2) && ((edges[i] & 1) == 0) && ((edges[i + 1] & 1) == 1);
+    errors += !ok;
+    i = j;
+  }
+  arena_pop(save);
+  return errors;
+}
+
+
+internal u32 test_extract(density_volume vol, arena *memory, u32 *tri_count)
+{
+  arena_savepoint save = arena_save(memory);
+  arena vbuffer = subarena_init(memory, Megabytes(16));
+  arena ebuffer = subarena_init(memory, Megabytes(16));
+  arena scratch = subarena_init(memory, Megabytes(16));
+  entity e = isosurface_extract(vol, 0.5f, fvec4_init(1.0f, 1.0f, 1.0f, 1.0f), &vbuffer, &ebuffer, &scratch);
+  *tri_count = (u32)e.count / 3;
+  u32 *indices = (u32*)ebuffer.buffer + e.elem_start;
+  u32 vertex_count = (u32)(vbuffer.offset_new / sizeof(vertex1) - e.vert_start);
+  test_weld((vertex1*)vbuffer.buffer + e.vert_start, vertex_count, indices, (u32)e.count, &scratch);
+  u32 errors = test_manifold_errors(indices, (u32)e.count, &scratch);
+  arena_pop(save);
+  return errors;
+}
+
+
+int main(int argc, char **argv)
+{
+  arena memory = test_memory(Megabytes(256));
+  platform_init(&memory);
+  // One cell's configuration in the middle of a 4x4x4 volume.
+  u32 bad_configs = 0;
+  u32 empty_configs = 0;
+  for (u32 config = 1; config < 256; ++config)
+  {
+    f32 values[64] = {};
+    for (u32 c = 0; c < 8; ++c)
+    {
+      u32 x = 1 + (c & 1);
+      u32 y = 1 + ((c >> 1) & 1);
+      u32 z = 1 + ((c >> 2) & 1);
+      values[x + y * 4 + z * 16] = ((config >> c) & 1) ? 1.0f : 0.0f;
+    }
+    density_volume vol = { values, 4, 4, 4, fvec3_init(0.0f, 0.0f, 0.0f), fvec3_init(1.0f, 1.0f, 1.0f) };
+    u32 tri_count = 0;
+    u32 errors = test_extract(vol, &memory, &tri_count);
+    if (errors) fprintf(stderr, "config %u: %u bad edges\n", config, errors);
+    bad_configs += (errors != 0);
+    empty_configs += (tri_count == 0);
+  }
+  CHECK(bad_configs == 0, "%u of 255 configurations aren't closed manifolds", bad_configs);
+  CHECK(empty_configs == 0, "%u configurations have no triangles", empty_configs);
+  // Noise, a quarter of the way into either side of iso, so neighbouring cells disagree a lot.
+  u32 n = TEST_RANDOM_SIZE;
+  f32 *values = arena_push_array(&memory, n * n * n, f32);
+  srand(1234);
+  for (u32 round = 0; round < TEST_RANDOM_ROUNDS; ++round)
+  {
+    for (u32 z = 0; z < n; ++z)
+      for (u32 y = 0; y < n; ++y)
+        for (u32 x = 0; x < n; ++x)
+        {
+          bool border = (x == 0 || y == 0 || z == 0 || x == n - 1 || y == n - 1 || z == n - 1);
+          values[x + y * n + z * n * n] = border ? 0.0f : (f32)rand() / (f32)RAND_MAX;
+        }
+    density_volume vol = { values, n, n, n, fvec3_init(-1.0f, -1.0f, -1.0f), fvec3_init(1.0f, 1.0f, 1.0f) };
+    u32 tri_count = 0;
+    u32 errors = test_extract(vol, &memory, &tri_count);
+    CHECK(errors == 0, "random volume %u: %u of the edges of %u triangles aren't manifold", round, errors, tri_count);
+  }
+  return test_exit("isosurface_test");
+}
@@ -0,0 +1,66 @@
+// Included rather than linked so the test can add workers to the pool.
+#include "platform_linux.cpp"
+#include "test.h"
+
+// Back to back batches of different sizes through platform_jobs_run. Every job of every batch has
+// to run exactly once, a worker left over from one batch must never run or count a job of the next.
+
+#define TEST_BATCHES        100000
+#define TEST_MAX_JOBS       64
+#define TEST_EXTRA_WORKERS  7     // More workers than cores, so stragglers get preempted mid claim.
+
+
+struct test_batch
+{
+  u32 batch;
+  volatile u32 runs[TEST_MAX_JOBS];
+  volatile u32 wrong_batch;
+};
+
+
+internal void test_job(void *data, u32 index)
+{
+  test_batch *t = (test_batch*) data;
+  __atomic_fetch_add(&t->runs[index], 1, __ATOMIC_RELAXED);
+  // Hand the core around so workers get caught between claiming and finishing.
+  if (index % 3 == 0) sched_yield();
+}
+
+
+internal void test_job_other(void *data, u32 index)
+{
+  // Same data, different job: a mixed up claim shows as the wrong function for the batch.
+  test_batch *t = (test_batch*) data;
+  if ((t->batch & 1) == 0) __atomic_fetch_add(&t->wrong_batch, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&t->runs[index], 1, __ATOMIC_RELAXED);
+}
+
+
+int main(int argc, char **argv)
+{
+  arena memory = test_memory(Megabytes(16));
+  platform_init(&memory);
+  for (u32 i = 0; i < TEST_EXTRA_WORKERS && linstate->worker_count < MAX_COUNT_THREADS; ++i)
+  {
+    pthread_create(&linstate->workers[linstate->worker_count++], 0, jobs_worker_main, linstate);
+  }
+  test_batch *t = arena_push_struct(&memory, test_batch);
+  u32 seed = 0x2545f491u;
+  u32 bad_batches = 0;
+  for (u32 b = 0; b < TEST_BATCHES; ++b)
+  {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    u32 count = 1 + seed % TEST_MAX_JOBS;
+    t->batch = b;
+    for (u32 i = 0; i < TEST_MAX_JOBS; ++i) t->runs[i] = 0;
+    platform_jobs_run((b & 1) ? test_job_other : test_job, t, count);
+    bool ok = true;
+    for (u32 i = 0; i < TEST_MAX_JOBS; ++i) ok = ok && (t->runs[i] == ((i < count) ? 1u : 0u));
+    bad_batches += !ok;
+  }
+  CHECK(bad_batches == 0, "%u of %u batches ran a job other than once", bad_batches, TEST_BATCHES);
+  CHECK(t->wrong_batch == 0, "%u jobs ran under the wrong batch", t->wrong_batch);
+  return test_exit("jobs_test");
+}
@@ -0,0 +1,153 @@
+#include "platform_linux.cpp"
+#include "mesh_bvh.cpp"
+#include "test.h"
+
+// The BVH queries have to give the same answers as testing every triangle. Random triangle soups,
+// one big enough that the build hands subtrees to the jobs, and random rays, points and boxes.
+
+#define TEST_MESHES  4
+#define TEST_QUERIES 500
+#define TEST_MAX_OUT 4096
+
+
+internal f32 test_random(u32 *seed)
+{
+  // xorshift32, in [0, 1)
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 17;
+  *seed ^= *seed << 5;
+  return (f32)(*seed >> 8) * (1.0f / 16777216.0f);
+}
+
+
+internal fvec3 test_point(u32 *seed, f32 extent)
+{
+  return fvec3_init((test_random(seed) - 0.5f) * extent, (test_random(seed) - 0.5f) * extent, (test_random(seed) - 0.5f) * extent);
+}
+
+
+// Small triangles scattered through a cube of side 10.
+internal mesh test_soup(u32 tri_count, u32 *seed, arena *a)
+{
+  mesh m = {};
+  m.vert_count = tri_count * 3;
+  m.index_count = tri_count * 3;
+  m.vertices = arena_push_array(a, m.vert_count, vertex);
+  m.indices = arena_push_array(a, m.index_count, u32);
+  for (u32 t = 0; t < tri_count; ++t)
+  {
+    fvec3 center = test_point(seed, 10.0f);
+    for (u32 c = 0; c < 3; ++c)
+    {
+      m.vertices[t*3 + c].pos = fvec3_add(center, test_point(seed, 0.8f));
+      m.indices[t*3 + c] = t*3 + c;
+    }
+  }
+  return m;
+}
+
+
+internal bvh_tri test_tri(mesh m, u32 t)
+{
+  bvh_tri tri = { m.vertices[m.indices[t*3]].pos, m.vertices[m.indices[t*3 + 1]].pos, m.vertices[m.indices[t*3 + 2]].pos };
+  return tri;
+}
+
+
+internal int test_u32_compare(const void *a, const void *b)
+{
+  u32 x = *(const u32*)a;
+  u32 y = *(const u32*)b;
+  return (x < y) ? -1 : (x > y);
+}
+
+
+int main(int argc, char **argv)
+{
+  arena memory = test_memory(Megabytes(256));
+  platform_init(&memory);
+  arena scratch = subarena_init(&memory, Megabytes(64));
+  const u32 tri_counts[TEST_MESHES] = { 1, 3, 200, 20000 };
+  u32 seed = 0x3c6ef372u;
+  u32 *found = arena_push_array(&memory, TEST_MAX_OUT, u32);
+  u32 *expected = arena_push_array(&memory, TEST_MAX_OUT, u32);
+  for (u32 m_index = 0; m_index < TEST_MESHES; ++m_index)
+  {
+    arena_savepoint save = arena_save(&memory);
+    u32 tri_count = tri_counts[m_index];
+    mesh m = test_soup(tri_count, &seed, &memory);
+    bvh tree = bvh_build(m, &memory, &scratch);
+    CHECK(tree.tri_count == tri_count, "%u of %u triangles in the tree", tree.tri_count, tri_count);
+    u32 ray_errors = 0, ray_hits = 0, point_errors = 0, box_errors = 0, box_hits = 0;
+    for (u32 q = 0; q < TEST_QUERIES; ++q)
+    {
+      // Rays from outside towards somewhere inside, limited to part of the way through.
+      fvec3 origin = test_point(&seed, 30.0f);
+      fvec3 dir = fvec3_sub(test_point(&seed, 10.0f), origin);
+      f32 t_max = 0.5f + test_random(&seed);
+      bvh_hit hit = {};
+      bool any = bvh_raycast(&tree, origin, dir, t_max, &hit);
+      f32 best = t_max;
+      u32 best_tri = BVH_EMPTY;
+      for (u32 t = 0; t < tri_count; ++t)
+      {
+        bvh_tri tri = test_tri(m, t);
+        f32 t_hit, u, v;
+        if (bvh_ray_triangle(&tri, origin, dir, best, &t_hit, &u, &v))
+        {
+          best = t_hit;
+          best_tri = t;
+        }
+      }
+      ray_hits += any;
+      ray_errors += (any != (best_tri != BVH_EMPTY)) || (any && fabsf(hit.t - best) > 1e-5f);
+      // Closest point within a radius that sometimes reaches nothing.
+      fvec3 p = test_point(&seed, 14.0f);
+      f32 radius = 3.0f * test_random(&seed);
+      bvh_closest closest = {};
+      any = bvh_closest_point(&tree, p, radius, &closest);
+      f32 best_sq = radius * radius;
+      bool brute_any = false;
+      for (u32 t = 0; t < tri_count; ++t)
+      {
+        bvh_tri tri = test_tri(m, t);
+        fvec3 d = fvec3_sub(bvh_closest_on_triangle(&tri, p), p);
+        f32 d_sq = dot3(d, d);
+        if (d_sq <= best_sq)
+        {
+          best_sq = d_sq;
+          brute_any = true;
+        }
+      }
+      point_errors += (any != brute_any) || (any && fabsf(closest.distance_sq - best_sq) > 1e-4f);
+      // Boxes, the same set of triangles in any order.
+      fvec3 corner = test_point(&seed, 12.0f);
+      fvec3 size = fvec3_init(2.0f * test_random(&seed), 2.0f * test_random(&seed), 2.0f * test_random(&seed));
+      fvec3 box_max = fvec3_add(corner, size);
+      u32 count = bvh_overlap_aabb(&tree, corner, box_max, found, TEST_MAX_OUT);
+      fvec3 center = fvec3_scale(fvec3_add(corner, box_max), 0.5f);
+      fvec3 half = fvec3_scale(size, 0.5f);
+      u32 brute_count = 0;
+      for (u32 t = 0; t < tri_count; ++t)
+      {
+        bvh_tri tri = test_tri(m, t);
+        if (bvh_triangle_box(&tri, center, half) && brute_count < TEST_MAX_OUT) expected[brute_count++] = t;
+      }
+      box_hits += (count > 0);
+      if (count != brute_count || count > TEST_MAX_OUT)
+      {
+        box_errors++;
+        continue;
+      }
+      qsort(found, count, sizeof(u32), test_u32_compare);
+      box_errors += (memcmp(found, expected, count * sizeof(u32)) != 0);
+    }
+    CHECK(ray_errors == 0, "%u triangles: %u of %u rays disagree with brute force", tri_count, ray_errors, TEST_QUERIES);
+    CHECK(point_errors == 0, "%u triangles: %u of %u closest points disagree with brute force", tri_count, point_errors, TEST_QUERIES);
+    CHECK(box_errors == 0, "%u triangles: %u of %u boxes disagree with brute force", tri_count, box_errors, TEST_QUERIES);
+    // The bigger meshes are only a check if the queries actually find things.
+    CHECK(tri_count < 200 || (ray_hits > 0 && box_hits > 0), "%u triangles: %u ray hits, %u box hits", tri_count, ray_hits, box_hits);
+    arena_pop(save);
+  }
+  return test_exit("mesh_bvh_test");
+}
@@ -0,0 +1,65 @@
+#include "platform_linux.cpp"
+#include "mesh_optimize.cpp"
+#include "test.h"
+
+// index_acmr's miss counting against a literal FIFO cache: a queue of the last cache_size
+// vertices loaded, a miss pushes the vertex and drops the oldest.
+
+#define TEST_STREAMS 200
+
+
+internal u32 test_fifo_misses(u32 *indices, u32 index_count, u32 cache_size)
+{
+  u32 fifo[64];
+  u32 fifo_count = 0;
+  u32 misses = 0;
+  for (u32 i = 0; i < index_count; ++i)
+  {
+    bool hit = false;
+    for (u32 k = 0; k < fifo_count; ++k) hit |= (fifo[k] == indices[i]);
+    if (hit) continue;
+    misses++;
+    if (fifo_count == cache_size)
+    {
+      memmove(fifo, fifo + 1, (cache_size - 1) * sizeof(u32));
+      fifo_count--;
+    }
+    fifo[fifo_count++] = indices[i];
+  }
+  return misses;
+}
+
+
+int main(int argc, char **argv)
+{
+  arena memory = test_memory(Megabytes(16));
+  // A triangle repeated stays in a cache of three, a fourth vertex pushes the first one out.
+  u32 repeat[6] = { 0, 1, 2, 0, 1, 2 };
+  f32 acmr = index_acmr(repeat, 6, 3, 3, &memory);
+  CHECK(acmr == 1.5f, "repeated triangle acmr %f, expected 1.5", acmr);
+  u32 evict[6] = { 0, 1, 2, 3, 0, 1 };
+  acmr = index_acmr(evict, 6, 4, 3, &memory);
+  CHECK(acmr == 3.0f, "evicting stream acmr %f, expected 3.0", acmr);
+  // Random local streams, so both hits and evictions happen often.
+  u32 index_count = 3 * 300;
+  u32 *indices = arena_push_array(&memory, index_count, u32);
+  u32 seed = 0x1234567u;
+  u32 mismatches = 0;
+  for (u32 stream = 0; stream < TEST_STREAMS; ++stream)
+  {
+    u32 cache_size = 3 + stream % 30;
+    u32 vert_count = 8 + stream % 64;
+    for (u32 i = 0; i < index_count; ++i)
+    {
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      indices[i] = seed % vert_count;
+    }
+    u32 expected = test_fifo_misses(indices, index_count, cache_size);
+    f32 got = index_acmr(indices, index_count, vert_count, cache_size, &memory);
+    mismatches += (got != (f32)expected / (f32)(index_count / 3));
+  }
+  CHECK(mismatches == 0, "%u of %u streams disagree with a FIFO of the same size", mismatches, TEST_STREAMS);
+  return test_exit("mesh_optimize_test");
+}
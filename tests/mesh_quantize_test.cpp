@@ -0,0 +1,136 @@
+#include "platform_linux.cpp"
+#include "mesh_quantize.cpp"
+#include "test.h"
+
+#include <math.h>
+
+// Round trips through the 16 byte vertex: half floats against every half there is and the
+// rounding rules, rgba8 colors, and unorm16 positions, which have to come back within one
+// quantum (the bounds' extent / 65535) of where they were. The bounds matrix has to agree with
+// vertex_dequantize, it's what the GPU uses instead.
+
+#define TEST_VERTICES 2000
+
+
+internal f32 test_random(u32 *seed)
+{
+  // xorshift32, in [0, 1)
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 17;
+  *seed ^= *seed << 5;
+  return (f32)(*seed >> 8) * (1.0f / 16777216.0f);
+}
+
+
+internal f32 test_bits_f32(u32 bits)
+{
+  f32 result;
+  memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+
+int main(int argc, char **argv)
+{
+  arena memory = test_memory(Megabytes(16));
+  u32 seed = 0xa54ff53au;
+  // Every half converts to a float and back to the same bits, NaNs stay NaNs.
+  u32 half_errors = 0;
+  for (u32 h = 0; h <= 0xffff; ++h)
+  {
+    f32 value = f16_to_f32((u16)h);
+    u16 back = f32_to_f16(value);
+    bool nan = ((h & 0x7c00) == 0x7c00) && (h & 0x3ff);
+    half_errors += nan ? !(value != value && (back & 0x7c00) == 0x7c00 && (back & 0x3ff)) : (back != h);
+  }
+  CHECK(half_errors == 0, "%u halves don't round trip", half_errors);
+  // Floats in half range round to the nearest half, at most half a unit in the last place off.
+  u32 round_errors = 0;
+  for (u32 i = 0; i < 10000; ++i)
+  {
+    f32 value = (test_random(&seed) - 0.5f) * 2.0f * 60000.0f;
+    f32 back = f16_to_f32(f32_to_f16(value));
+    round_errors += (fabsf(back - value) > fabsf(value) * (1.0f / 2048.0f));
+  }
+  CHECK(round_errors == 0, "%u floats off by more than half a half ulp", round_errors);
+  // Ties go to even, overflow goes to infinity, the smallest subnormal survives.
+  CHECK(f32_to_f16(1.0f + 1.0f / 2048.0f) == 0x3c00, "1 + 2^-11 became %04x", f32_to_f16(1.0f + 1.0f / 2048.0f));
+  CHECK(f32_to_f16(1.0f + 3.0f / 2048.0f) == 0x3c02, "1 + 3*2^-11 became %04x", f32_to_f16(1.0f + 3.0f / 2048.0f));
+  CHECK(f32_to_f16(65519.0f) == 0x7bff && f32_to_f16(65520.0f) == 0x7c00 && f32_to_f16(-1e9f) == 0xfc00,
+        "65519 -> %04x, 65520 -> %04x, -1e9 -> %04x", f32_to_f16(65519.0f), f32_to_f16(65520.0f), f32_to_f16(-1e9f));
+  CHECK(f16_to_f32(f32_to_f16(test_bits_f32(0x33800000))) == test_bits_f32(0x33800000), "2^-24 lost");
+  // Colors: every byte value exactly, anything else to the nearest, out of range clamped.
+  u32 color_errors = 0;
+  for (u32 k = 0; k < 256; ++k)
+  {
+    fvec4 color = fvec4_init(k / 255.0f, (255 - k) / 255.0f, 0.0f, 1.0f);
+    u32 packed = color_rgba8_encode(color);
+    color_errors += (packed != (k | ((255 - k) << 8) | (0xffu << 24)));
+    fvec4 back = color_rgba8_decode(packed);
+    for (u32 c = 0; c < 4; ++c) color_errors += (back.array[c] != color.array[c]);
+  }
+  for (u32 i = 0; i < 1000; ++i)
+  {
+    fvec4 color = fvec4_init(test_random(&seed), test_random(&seed), test_random(&seed), test_random(&seed));
+    fvec4 back = color_rgba8_decode(color_rgba8_encode(color));
+    for (u32 c = 0; c < 4; ++c) color_errors += (fabsf(back.array[c] - color.array[c]) > 0.5f / 255.0f + 1e-6f);
+  }
+  CHECK(color_errors == 0, "%u color channels off", color_errors);
+  CHECK(color_rgba8_encode(fvec4_init(-1.0f, 2.0f, 0.0f, 1.0f)) == 0xff00ff00u, "out of range color packed as %08x",
+        color_rgba8_encode(fvec4_init(-1.0f, 2.0f, 0.0f, 1.0f)));
+  // Positions: an entity placed after other data in the buffers, like the primitives append them.
+  arena vbuffer = subarena_init(&memory, (TEST_VERTICES + 8) * sizeof(vertex1));
+  arena ebuffer = subarena_init(&memory, (TEST_VERTICES + 8) * sizeof(u32));
+  arena qbuffer = subarena_init(&memory, (TEST_VERTICES + 8) * sizeof(vertex_quantized));
+  arena_push_array(&vbuffer, 8, vertex1);
+  arena_push_array(&ebuffer, 8, u32);
+  arena_push_array(&qbuffer, 1, vertex_quantized);
+  entity e = {};
+  e.vert_start = vbuffer.offset_new / sizeof(vertex1);
+  e.elem_start = ebuffer.offset_new / sizeof(u32);
+  e.count = TEST_VERTICES;
+  vertex1 *vertices = arena_push_array(&vbuffer, TEST_VERTICES, vertex1);
+  u32 *indices = arena_push_array(&ebuffer, TEST_VERTICES, u32);
+  for (u32 i = 0; i < TEST_VERTICES; ++i)
+  {
+    // A long thin box off the origin, so the axes get different quanta.
+    vertices[i].pos = fvec3_init(100.0f + 50.0f * test_random(&seed), -3.0f + 0.01f * test_random(&seed), 1000.0f * (test_random(&seed) - 0.5f));
+    vertices[i].col = fvec4_init(test_random(&seed), test_random(&seed), test_random(&seed), 1.0f);
+    vertices[i].tex = fvec2_init(test_random(&seed), test_random(&seed));
+    indices[i] = TEST_VERTICES - 1 - i;
+  }
+  quantize_bounds bounds = {};
+  entity q = entity_quantize(e, &vbuffer, &ebuffer, &qbuffer, &bounds);
+  CHECK(q.vert_start == 1 && q.elem_start == e.elem_start && q.count == e.count, "quantized entity at %llu, %llu elements",
+        (unsigned long long)q.vert_start, (unsigned long long)q.count);
+  vertex_quantized *quantized = (vertex_quantized*)qbuffer.buffer + q.vert_start;
+  fmat4 to_model;
+  quantize_bounds_matrix(to_model, bounds);
+  u32 pos_errors = 0, matrix_errors = 0, attribute_errors = 0;
+  for (u32 i = 0; i < TEST_VERTICES; ++i)
+  {
+    vertex1 back = vertex_dequantize(quantized[i], bounds);
+    fvec4 unorm = fvec4_init(quantized[i].pos[0] / 65535.0f, quantized[i].pos[1] / 65535.0f, quantized[i].pos[2] / 65535.0f, 1.0f);
+    fvec4 gpu = fmat4_mul_vec4(to_model, unorm);
+    for (u32 k = 0; k < 3; ++k)
+    {
+      f32 quantum = (bounds.max.array[k] - bounds.min.array[k]) / 65535.0f;
+      // Float rounding in the decode, on top of the quantum.
+      f32 slack = 1e-6f * fabsf(bounds.min.array[k]);
+      pos_errors += (fabsf(back.pos.array[k] - vertices[i].pos.array[k]) > quantum + slack);
+      matrix_errors += (fabsf(gpu.array[k] - back.pos.array[k]) > slack + 1e-4f * quantum);
+    }
+    for (u32 c = 0; c < 4; ++c) attribute_errors += (fabsf(back.col.array[c] - vertices[i].col.array[c]) > 0.5f / 255.0f + 1e-6f);
+    attribute_errors += (fabsf(back.tex.x - vertices[i].tex.x) > 1.0f / 2048.0f) + (fabsf(back.tex.y - vertices[i].tex.y) > 1.0f / 2048.0f);
+  }
+  CHECK(pos_errors == 0, "%u position components more than a quantum off", pos_errors);
+  CHECK(matrix_errors == 0, "%u positions where the bounds matrix disagrees with vertex_dequantize", matrix_errors);
+  CHECK(attribute_errors == 0, "%u colors or texture coordinates off", attribute_errors);
+  // A flat axis doesn't divide by zero, it all lands on the plane.
+  quantize_bounds flat = { fvec3_init(0.0f, 2.0f, 0.0f), fvec3_init(1.0f, 2.0f, 1.0f) };
+  vertex1 v = {};
+  v.pos = fvec3_init(0.5f, 2.0f, 0.25f);
+  vertex1 back = vertex_dequantize(vertex_quantize(v, flat), flat);
+  CHECK(back.pos.y == 2.0f && fabsf(back.pos.x - 0.5f) <= 1.0f / 65535.0f, "flat bounds gave %f %f %f", back.pos.x, back.pos.y, back.pos.z);
+  return test_exit("mesh_quantize_test");
+}
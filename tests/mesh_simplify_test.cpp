@@ -0,0 +1,179 @@
+#include "platform_linux.cpp"
+#include "mesh_simplify.cpp"
+#include "test.h"
+
+#include <math.h>
+
+// Simplifying a closed surface has to keep it a closed 2-manifold, down to very few triangles:
+// every edge in exactly two triangles, once each way round. Collapses that break the link
+// condition fold the surface onto itself and show up here as edges in four triangles.
+
+#define TEST_RINGS    12
+#define TEST_SEGMENTS 16
+
+
+internal int test_key_compare(const void *a, const void *b)
+{
+  u64 x = *(const u64*)a;
+  u64 y = *(const u64*)b;
+  return (x < y) ? -1 : (x > y);
+}
+
+
+// Edges not shared by exactly two triangles of opposite winding, plus degenerate triangles.
+internal u32 test_manifold_errors(u32 *indices, u32 count, arena *scratch)
+{
+  arena_savepoint save = arena_save(scratch);
+  u64 *edges = arena_push_array(scratch, count, u64);
+  u32 errors = 0;
+  for (u32 t = 0; t < count; t += 3)
+  {
+    for (u32 i = 0; i < 3; ++i)
+    {
+      u32 a = indices[t + i];
+      u32 b = indices[t + (i + 1) % 3];
+      errors += (a == b);
+      u64 lo = (a < b) ? a : b;
+      u64 hi = (a < b) ? b : a;
+      edges[t + i] = (lo << 33) | (hi << 1) | (u64)(a > b);
+    }
+  }
+  qsort(edges, count, sizeof(u64), test_key_compare);
+  for (u32 i = 0; i < count;)
+  {
+    u32 j = i;
+    while (j < count && (edges[j] >> 1) == (edges[i] >> 1)) j++;
+    errors += !((j - i == 2) && ((edges[i] & 1) == 0) && ((edges[i + 1] & 1) == 1));
+    i = j;
+  }
+  arena_pop(save);
+  return errors;
+}
+
+
+// UV sphere with shared vertices, poles included. Outward facing, counter-clockwise.
+internal mesh test_sphere(arena *a)
+{
+  mesh m = {};
+  m.vert_count = 2 + (TEST_RINGS - 1) * TEST_SEGMENTS;
+  m.vertices = arena_push_array(a, m.vert_count, vertex);
+  m.indices = arena_push_array(a, TEST_SEGMENTS * (TEST_RINGS - 1) * 6, u32);
+  m.vertices[0].pos = fvec3_init(0.0f, 1.0f, 0.0f);
+  m.vertices[1].pos = fvec3_init(0.0f, -1.0f, 0.0f);
+  for (u32 r = 1; r < TEST_RINGS; ++r)
+  {
+    f32 phi = PI * (f32)r / (f32)TEST_RINGS;
+    for (u32 s = 0; s < TEST_SEGMENTS; ++s)
+    {
+      f32 theta = 2.0f * PI * (f32)s / (f32)TEST_SEGMENTS;
+      m.vertices[2 + (r - 1) * TEST_SEGMENTS + s].pos = fvec3_init(sinf(phi) * cosf(theta), cosf(phi), -sinf(phi) * sinf(theta));
+    }
+  }
+  u32 *out = m.indices;
+  for (u32 s = 0; s < TEST_SEGMENTS; ++s)
+  {
+    u32 next = (s + 1) % TEST_SEGMENTS;
+    // Caps
+    *out++ = 0;
+    *out++ = 2 + s;
+    *out++ = 2 + next;
+    u32 last = 2 + (TEST_RINGS - 2) * TEST_SEGMENTS;
+    *out++ = 1;
+    *out++ = last + next;
+    *out++ = last + s;
+    // Bands
+    for (u32 r = 1; r + 1 < TEST_RINGS; ++r)
+    {
+      u32 a = 2 + (r - 1) * TEST_SEGMENTS;
+      u32 b = a + TEST_SEGMENTS;
+      *out++ = a + s;
+      *out++ = b + s;
+      *out++ = b + next;
+      *out++ = a + s;
+      *out++ = b + next;
+      *out++ = a + next;
+    }
+  }
+  m.index_count = (u32)(out - m.indices);
+  return m;
+}
+
+
+// Torus, TEST_SEGMENTS around the ring by TEST_RINGS around the tube. A closed torus needs at
+// least 14 triangles, so simplifying past that has to stop rather than pinch the tube shut.
+internal mesh test_torus(arena *a)
+{
+  mesh m = {};
+  m.vert_count = TEST_SEGMENTS * TEST_RINGS;
+  m.vertices = arena_push_array(a, m.vert_count, vertex);
+  m.indices = arena_push_array(a, m.vert_count * 6, u32);
+  for (u32 s = 0; s < TEST_SEGMENTS; ++s)
+  {
+    f32 theta = 2.0f * PI * (f32)s / (f32)TEST_SEGMENTS;
+    for (u32 r = 0; r < TEST_RINGS; ++r)
+    {
+      f32 phi = 2.0f * PI * (f32)r / (f32)TEST_RINGS;
+      f32 radius = 1.0f + 0.4f * cosf(phi);
+      m.vertices[s * TEST_RINGS + r].pos = fvec3_init(radius * cosf(theta), 0.4f * sinf(phi), radius * sinf(theta));
+    }
+  }
+  u32 *out = m.indices;
+  for (u32 s = 0; s < TEST_SEGMENTS; ++s)
+  {
+    for (u32 r = 0; r < TEST_RINGS; ++r)
+    {
+      u32 a = s * TEST_RINGS + r;
+      u32 b = ((s + 1) % TEST_SEGMENTS) * TEST_RINGS + r;
+      u32 c = ((s + 1) % TEST_SEGMENTS) * TEST_RINGS + (r + 1) % TEST_RINGS;
+      u32 d = s * TEST_RINGS + (r + 1) % TEST_RINGS;
+      *out++ = a; *out++ = c; *out++ = b;
+      *out++ = a; *out++ = d; *out++ = c;
+    }
+  }
+  m.index_count = (u32)(out - m.indices);
+  return m;
+}
+
+
+int main(int argc, char **argv)
+{
+  arena memory = test_memory(Megabytes(64));
+  mesh sphere = test_sphere(&memory);
+  CHECK(test_manifold_errors(sphere.indices, sphere.index_count, &memory) == 0, "the test sphere isn't closed");
+  // Down to a handful of triangles in one call, and as a chain of LODs.
+  const u32 targets[] = { 300, 120, 48, 24, 12 };
+  for (u32 i = 0; i < sizeof(targets) / sizeof(targets[0]); ++i)
+  {
+    u32 *indices = arena_push_array(&memory, sphere.index_count, u32);
+    memcpy(indices, sphere.indices, sphere.index_count * sizeof(u32));
+    f32 error = 0.0f;
+    u32 count = mesh_simplify(&sphere, indices, sphere.index_count, targets[i] * 3, &error, &memory);
+    u32 errors = test_manifold_errors(indices, count, &memory);
+    CHECK(errors == 0, "down to %u triangles: %u bad edges", count / 3, errors);
+    CHECK(count >= 4 * 3, "down to %u triangles, fewer than a closed surface can have", count / 3);
+    CHECK(error >= 0.0f && error < 2.0f, "error %f on a unit sphere", error);
+  }
+  // Past what the torus can lose without changing its topology.
+  mesh torus = test_torus(&memory);
+  CHECK(test_manifold_errors(torus.indices, torus.index_count, &memory) == 0, "the test torus isn't closed");
+  const u32 torus_targets[] = { 64, 24, 8, 1 };
+  for (u32 i = 0; i < sizeof(torus_targets) / sizeof(torus_targets[0]); ++i)
+  {
+    u32 *indices = arena_push_array(&memory, torus.index_count, u32);
+    memcpy(indices, torus.indices, torus.index_count * sizeof(u32));
+    u32 count = mesh_simplify(&torus, indices, torus.index_count, torus_targets[i] * 3, 0, &memory);
+    u32 errors = test_manifold_errors(indices, count, &memory);
+    CHECK(errors == 0, "torus down to %u triangles: %u bad edges", count / 3, errors);
+    CHECK(count >= 14 * 3, "torus down to %u triangles, fewer than a torus can have", count / 3);
+  }
+  mesh_lod lods[8];
+  u32 lod_count = mesh_lod_chain(&sphere, lods, 8, 0.5f, &memory, &memory);
+  CHECK(lod_count > 3, "only %u LODs", lod_count);
+  for (u32 i = 1; i < lod_count; ++i)
+  {
+    u32 errors = test_manifold_errors(lods[i].indices, lods[i].index_count, &memory);
+    CHECK(errors == 0, "LOD %u with %u triangles: %u bad edges", i, lods[i].index_count / 3, errors);
+    CHECK(lods[i].error >= lods[i - 1].error, "LOD %u error %f below the LOD before", i, lods[i].error);
+  }
+  return test_exit("mesh_simplify_test");
+}
@@ -0,0 +1,86 @@
+#include "platform_linux.cpp"
+#include "occlusion_cull.cpp"
+#include "test.h"
+
+// A known occluder quad is rasterized headlessly, then boxes behind it, in front of it, beside it
+// and across its edge are tested. Identity view projection: clip space is the input, x and y
+// in [-1, 1] fill the buffer and depth is z*0.5 + 0.5, so the quad at z = 0 sits at depth 0.5.
+
+
+internal void test_identity(fmat4 m)
+{
+  memset(m, 0, sizeof(fmat4));
+  for (u32 i = 0; i < 4; ++i) m[i][i] = 1.0f;
+}
+
+
+internal cull_bounds test_box(f32 x0, f32 y0, f32 z0, f32 x1, f32 y1, f32 z1)
+{
+  cull_bounds b = { fvec3_init(x0, y0, z0), fvec3_init(x1, y1, z1) };
+  return b;
+}
+
+
+int main(int argc, char **argv)
+{
+  arena memory = test_memory(Megabytes(64));
+  platform_init(&memory);
+  occlusion_buffer ob = occlusion_init(&memory, 256, 128, 64);
+  fmat4 identity;
+  test_identity(identity);
+  // Quad over the middle of the screen, x and y in [-0.5, 0.5], wound either way.
+  vertex1 vertices[4] = {};
+  vertices[0].pos = fvec3_init(-0.5f, -0.5f, 0.0f);
+  vertices[1].pos = fvec3_init( 0.5f, -0.5f, 0.0f);
+  vertices[2].pos = fvec3_init( 0.5f,  0.5f, 0.0f);
+  vertices[3].pos = fvec3_init(-0.5f,  0.5f, 0.0f);
+  u32 elements[6] = { 0, 1, 2, 0, 3, 2 };
+  entity quad = { 0, 0, 6 };
+  occlusion_clear(&ob);
+  occlusion_add_occluder(&ob, identity, quad, vertices, elements);
+  CHECK(ob.tri_count == 2, "%u occluder triangles", ob.tri_count);
+  occlusion_rasterize(&ob, &memory);
+  // The depth buffer itself: the quad covers the middle half of each axis.
+  f32 center = ob.depth[(ob.height / 2) * ob.width + ob.width / 2];
+  f32 corner = ob.depth[0];
+  CHECK(fabsf(center - 0.5f) < 1e-5f, "depth at the center %f", center);
+  CHECK(corner == 1.0f, "depth outside the quad %f", corner);
+  u32 covered = 0;
+  for (u32 i = 0; i < ob.width * ob.height; ++i) covered += (ob.depth[i] < 1.0f);
+  CHECK(covered == (ob.width / 2) * (ob.height / 2), "%u pixels covered, expected %u", covered, (ob.width / 2) * (ob.height / 2));
+  // Boxes against the quad.
+  CHECK(!occlusion_visible(&ob, identity, test_box(-0.25f, -0.25f, 0.2f, 0.25f, 0.25f, 0.8f)), "box behind the quad is visible");
+  CHECK(occlusion_visible(&ob, identity, test_box(-0.25f, -0.25f, -0.8f, 0.25f, 0.25f, -0.2f)), "box in front of the quad is hidden");
+  CHECK(occlusion_visible(&ob, identity, test_box(-0.25f, -0.25f, -0.2f, 0.25f, 0.25f, 0.5f)), "box through the quad is hidden");
+  CHECK(occlusion_visible(&ob, identity, test_box(0.6f, 0.6f, 0.2f, 0.9f, 0.9f, 0.8f)), "box beside the quad is hidden");
+  CHECK(occlusion_visible(&ob, identity, test_box(0.3f, -0.25f, 0.2f, 0.7f, 0.25f, 0.8f)), "box across the quad's edge is hidden");
+  // The same boxes through occlusion_cull, moved there by their transforms.
+  cull_bounds unit = test_box(-0.1f, -0.1f, -0.1f, 0.1f, 0.1f, 0.1f);
+  const f32 offsets[5][3] = { { 0.0f, 0.0f, 0.5f }, { 0.0f, 0.0f, -0.5f }, { 0.75f, 0.75f, 0.5f }, { -0.3f, 0.3f, 0.9f }, { 0.5f, 0.0f, 0.5f } };
+  const bool visible[5] = { false, true, true, false, true };
+  cull_bounds bounds[5];
+  fmat4 transforms[5];
+  u32 indices[5];
+  for (u32 i = 0; i < 5; ++i)
+  {
+    bounds[i] = unit;
+    test_identity(transforms[i]);
+    for (u32 k = 0; k < 3; ++k) transforms[i][3][k] = offsets[i][k];
+    indices[i] = i;
+  }
+  u32 count = occlusion_cull(&ob, identity, bounds, transforms, indices, 5, &memory);
+  u32 expected = 0;
+  for (u32 i = 0; i < 5; ++i)
+  {
+    if (!visible[i]) continue;
+    CHECK(expected < count && indices[expected] == i, "box %u should have survived in order", i);
+    expected++;
+  }
+  CHECK(count == expected, "%u boxes visible, expected %u", count, expected);
+  // A full occluder buffer drops the extra triangles instead of writing past the end.
+  occlusion_buffer small = occlusion_init(&memory, 64, 32, 1);
+  occlusion_clear(&small);
+  occlusion_add_occluder(&small, identity, quad, vertices, elements);
+  CHECK(small.tri_count == 1, "%u triangles in a buffer with room for one", small.tri_count);
+  return test_exit("occlusion_test");
+}
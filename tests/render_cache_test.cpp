@@ -0,0 +1,91 @@
+#include "platform_linux.cpp"
+#include "render_cache.cpp"
+#include "test.h"
+
+// Redundant state elision against a recording device: binds go through the cache like the
+// backends' STATE_CHANGED, the device counts the calls that reach it, the stats count both.
+
+#define TEST_SLOTS 4
+
+
+// Stands in for the graphics context, holds what each call last set.
+struct test_device
+{
+  u32 calls;
+  u64 bound[RSTATE_COUNT][TEST_SLOTS];
+};
+
+
+global render_cache test_cache;
+global test_device test_gpu;
+
+
+internal void test_bind(render_cache_state state, u32 slot, u64 value)
+{
+  if (render_cache_set(&test_cache, state, slot, value))
+  {
+    test_gpu.calls++;
+    test_gpu.bound[state][slot] = value;
+  }
+}
+
+
+// One frame of a typical pass: the same shaders and layout for every draw, a buffer per draw.
+internal void test_frame(u32 draws)
+{
+  for (u32 i = 0; i < draws; ++i)
+  {
+    test_bind(RSTATE_VS_SHADER, 0, 0x100);
+    test_bind(RSTATE_PS_SHADER, 0, 0x200);
+    test_bind(RSTATE_INPUT_LAYOUT, 0, 0x300);
+    test_bind(RSTATE_VS_CONSTANTS, 1, 0x1000 + i);
+  }
+  render_cache_frame_end(&test_cache);
+}
+
+
+int main(int argc, char **argv)
+{
+  // Repeats of the same value are dropped, changes and other slots go through.
+  test_bind(RSTATE_VS_SHADER, 0, 0x10);
+  test_bind(RSTATE_VS_SHADER, 0, 0x10);
+  CHECK(test_gpu.calls == 1, "%u calls for a repeated shader", test_gpu.calls);
+  test_bind(RSTATE_VS_SHADER, 0, 0x20);
+  test_bind(RSTATE_PS_SHADER, 0, 0x20);
+  test_bind(RSTATE_VS_CONSTANTS, 1, 0x20);
+  test_bind(RSTATE_VS_CONSTANTS, 2, 0x20);
+  CHECK(test_gpu.calls == 5, "%u calls after changing value, state and slot", test_gpu.calls);
+  CHECK(test_gpu.bound[RSTATE_VS_SHADER][0] == 0x20, "shader %llx bound", (unsigned long long)test_gpu.bound[RSTATE_VS_SHADER][0]);
+  // Zero is a value like any other, the first bind of it is not taken as already bound.
+  test_bind(RSTATE_PS_RESOURCE, 0, 0);
+  CHECK(test_gpu.calls == 6, "%u calls after binding null", test_gpu.calls);
+  // After invalidate nothing is trusted, even values that were bound.
+  render_cache_invalidate(&test_cache);
+  test_bind(RSTATE_VS_SHADER, 0, 0x20);
+  CHECK(test_gpu.calls == 7, "%u calls after invalidate", test_gpu.calls);
+  // Slots past the cache always go through.
+  u32 uncached = 0;
+  for (u32 i = 0; i < 2; ++i)
+  {
+    uncached += render_cache_set(&test_cache, RSTATE_PS_SAMPLER, RENDER_CACHE_SLOTS, 1);
+  }
+  CHECK(uncached == 2, "%u calls for an uncached slot", uncached);
+  render_cache_frame_end(&test_cache);
+  // A frame of draws: shaders and layout once each, constants every draw.
+  test_gpu.calls = 0;
+  render_cache_invalidate(&test_cache);
+  test_frame(8);
+  render_stats stats = test_cache.last;
+  CHECK(test_gpu.calls == 3 + 8, "%u calls for 8 draws", test_gpu.calls);
+  CHECK(stats.issued == test_gpu.calls, "%u issued, device saw %u", stats.issued, test_gpu.calls);
+  CHECK(stats.skipped == 3 * 7, "%u skipped", stats.skipped);
+  CHECK(stats.skipped_by_state[RSTATE_VS_SHADER] == 7 && stats.skipped_by_state[RSTATE_VS_CONSTANTS] == 0,
+        "%u shader, %u constant binds skipped", stats.skipped_by_state[RSTATE_VS_SHADER], stats.skipped_by_state[RSTATE_VS_CONSTANTS]);
+  CHECK(test_cache.frame.issued == 0 && test_cache.frame.skipped == 0, "frame counts not reset at frame end");
+  // The next frame starts with the state still bound, the shaders aren't set again.
+  test_gpu.calls = 0;
+  test_frame(8);
+  CHECK(test_gpu.calls == 8, "%u calls in a frame with the pipeline already bound", test_gpu.calls);
+  CHECK(test_cache.last.issued_by_state[RSTATE_VS_SHADER] == 0, "%u shader binds", test_cache.last.issued_by_state[RSTATE_VS_SHADER]);
+  return test_exit("render_cache_test");
+}
@@ -0,0 +1,165 @@
+#include "platform_linux.cpp"
+#include "render_commands.cpp"
+#include "test.h"
+
+// Instanced batching from an entity table: entities sharing a mesh and shader become one draw,
+// their transforms are grouped per draw, and a full instance buffer cuts the groups short
+// instead of writing past its end. Then a shuffled frame of mixed keys through the recording
+// backend: draws come out in key order, ties in queue order, and repeated shaders, vertex
+// buffers and constants aren't bound again.
+
+#define TEST_ENTITIES 10
+#define TEST_MESHES   3
+#define TEST_COMMANDS 24
+
+
+struct test_table
+{
+  u64   vert_start[TEST_ENTITIES];
+  u64   elem_start[TEST_ENTITIES];
+  u64   elem_count[TEST_ENTITIES];
+  u32   shader[TEST_ENTITIES];
+  fmat4 transforms[TEST_ENTITIES];
+};
+
+
+internal render_instances_source test_source(test_table *t)
+{
+  // Entity i uses mesh i % TEST_MESHES, its transform is tagged with i.
+  for (u32 i = 0; i < TEST_ENTITIES; ++i)
+  {
+    t->vert_start[i] = 100 * (i % TEST_MESHES);
+    t->elem_start[i] = 0;
+    t->elem_count[i] = 6;
+    t->shader[i] = 1;
+    memset(t->transforms[i], 0, sizeof(fmat4));
+    t->transforms[i][0][0] = (f32)i;
+  }
+  render_instances_source src = {};
+  src.count = TEST_ENTITIES;
+  src.vert_start = t->vert_start;
+  src.elem_start = t->elem_start;
+  src.elem_count = t->elem_count;
+  src.shader = t->shader;
+  src.transforms = t->transforms;
+  return src;
+}
+
+
+struct test_order
+{
+  u64 key;
+  u32 queued;  // Position in the queue, breaks ties.
+  u32 id;
+};
+
+
+internal int test_order_compare(const void *a, const void *b)
+{
+  const test_order *x = (const test_order*)a;
+  const test_order *y = (const test_order*)b;
+  if (x->key != y->key) return (x->key < y->key) ? -1 : 1;
+  return (x->queued < y->queued) ? -1 : (x->queued > y->queued);
+}
+
+
+int main(int argc, char **argv)
+{
+  arena memory = test_memory(Megabytes(16));
+  arena scratch = subarena_init(&memory, Megabytes(1));
+  render_commands rc = render_commands_init(&memory, 64);
+  test_table *table = arena_push_struct(&memory, test_table);
+  render_instances_source src = test_source(table);
+  // Room for everyone: one draw per mesh, instances grouped by mesh in first seen order.
+  arena instances = subarena_init(&memory, TEST_ENTITIES * sizeof(fmat4));
+  u32 draws = render_commands_instanced(&rc, src, 0, 0, 0, &instances, &scratch);
+  CHECK(draws == TEST_MESHES && render_commands_count(&rc) == TEST_MESHES, "%u draws queued", draws);
+  CHECK(instances.offset_new == TEST_ENTITIES * sizeof(fmat4), "%zu instance bytes written", instances.offset_new);
+  const f32 grouped[TEST_ENTITIES] = { 0, 3, 6, 9, 1, 4, 7, 2, 5, 8 };
+  fmat4 *written = (fmat4*)instances.buffer;
+  u32 misplaced = 0;
+  for (u32 i = 0; i < TEST_ENTITIES; ++i) misplaced += (written[i][0][0] != grouped[i]);
+  CHECK(misplaced == 0, "%u instances out of place", misplaced);
+  // Room for seven: the first mesh's four, the second's three, the third isn't drawn.
+  render_commands_reset(&rc);
+  u8 guard[sizeof(fmat4)];
+  arena small = subarena_init(&memory, 7 * sizeof(fmat4) + sizeof(guard));
+  small.length = 7 * sizeof(fmat4);
+  memset(guard, 0xcd, sizeof(guard));
+  memcpy((u8*)small.buffer + small.length, guard, sizeof(guard));
+  draws = render_commands_instanced(&rc, src, 0, 0, 0, &small, &scratch);
+  CHECK(draws == 2, "%u draws queued from a short instance buffer", draws);
+  CHECK(small.offset_new == small.length, "%zu of %zu instance bytes written", small.offset_new, small.length);
+  CHECK(memcmp((u8*)small.buffer + small.length, guard, sizeof(guard)) == 0, "instances written past the buffer");
+  written = (fmat4*)small.buffer;
+  misplaced = 0;
+  for (u32 i = 0; i < 7; ++i) misplaced += (written[i][0][0] != grouped[i]);
+  CHECK(misplaced == 0, "%u instances out of place in the short buffer", misplaced);
+  // Two layers of three shaders, two materials each with their own vertex buffer, a few depths.
+  // Every draw uploads its shader's constants, so a shader's run of draws uploads once.
+  render_commands_reset(&rc);
+  u8 fake_buffers[3];
+  rbuffer *vbuffers[2] = { (rbuffer*)&fake_buffers[0], (rbuffer*)&fake_buffers[1] };
+  rbuffer *object_constants = (rbuffer*)&fake_buffers[2];
+  fmat4 shader_constants[4] = {};
+  for (u32 s = 0; s < 4; ++s) shader_constants[s][0][0] = (f32)s;
+  u32 ids[TEST_COMMANDS];
+  for (u32 i = 0; i < TEST_COMMANDS; ++i) ids[i] = i;
+  u32 seed = 0x510e527fu;
+  for (u32 i = TEST_COMMANDS - 1; i > 0; --i)
+  {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    u32 j = seed % (i + 1);
+    u32 swap = ids[i];
+    ids[i] = ids[j];
+    ids[j] = swap;
+  }
+  test_order expected[TEST_COMMANDS];
+  for (u32 n = 0; n < TEST_COMMANDS; ++n)
+  {
+    u32 id = ids[n];
+    u32 layer = id % 2;
+    u32 shader = 1 + (id / 2) % 3;
+    u32 material = (id / 6) % 2;
+    u64 key = render_key(layer, shader, material, (f32)(id % 5) / 4.0f);
+    // The draw's element count is its id, so the recorded draws say which command they were.
+    render_command *cmd = render_commands_draw_elems(&rc, key, shader, vbuffers[material], 0, id, 0, 0);
+    render_command_constants(&rc, cmd, object_constants, 1, shader_constants[shader], sizeof(fmat4));
+    expected[n] = { key, n, id };
+  }
+  qsort(expected, TEST_COMMANDS, sizeof(test_order), test_order_compare);
+  arena log = subarena_init(&memory, 8 * TEST_COMMANDS * sizeof(render_record));
+  render_recorder recorder = {};
+  render_backend backend = render_backend_recording(&recorder, &log);
+  render_commands_submit(&rc, &backend, &scratch);
+  CHECK(scratch.offset_new == 0, "submit left %zu bytes in scratch", scratch.offset_new);
+  render_record *records = (render_record*)log.buffer;
+  u32 record_count = (u32)(log.offset_new / sizeof(render_record));
+  u32 drawn = 0, out_of_order = 0;
+  for (u32 r = 0; r < record_count; ++r)
+  {
+    if (records[r].type != RCALL_DRAW_ELEMS) continue;
+    out_of_order += (drawn >= TEST_COMMANDS || records[r].args[0] != expected[drawn].id);
+    drawn++;
+  }
+  CHECK(drawn == TEST_COMMANDS && out_of_order == 0, "%u draws, %u out of key order", drawn, out_of_order);
+  // Sorted, each layer sets each shader once: 6 shader binds, 18 skipped. The constant buffer
+  // is bound once and uploaded once per shader run, 23 and 18 skipped.
+  u32 shader_sets = (u32)recorder.calls[RCALL_SHADER_SET];
+  u32 constant_sets = (u32)recorder.calls[RCALL_CONSTANT_SET];
+  u32 uploads = (u32)recorder.calls[RCALL_BUFFER_UPDATE];
+  CHECK(shader_sets == 6 && TEST_COMMANDS - shader_sets == 18, "%u shader binds, %u skipped", shader_sets, TEST_COMMANDS - shader_sets);
+  CHECK(constant_sets == 1 && uploads == 6, "%u constant binds, %u uploads", constant_sets, uploads);
+  // The vertex buffer changes with the material inside each shader run, and only then.
+  u32 vertex_changes = 0;
+  for (u32 n = 0; n < TEST_COMMANDS; ++n)
+  {
+    vertex_changes += (n == 0) || ((expected[n].id / 6) % 2 != (expected[n - 1].id / 6) % 2);
+  }
+  CHECK(recorder.calls[RCALL_VERTEX_SET] == vertex_changes, "%llu vertex binds for %u material changes",
+        (unsigned long long)recorder.calls[RCALL_VERTEX_SET], vertex_changes);
+  CHECK(recorder.calls[RCALL_INDEX_SET] == 0, "index buffer bound without one");
+  return test_exit("render_commands_test");
+}
@@ -0,0 +1,136 @@
+#include "platform_linux.cpp"
+#include "render_ring.cpp"
+#include "test.h"
+
+#include <stdlib.h>
+
+// The CPU side of the ring buffered dynamic buffers: alignment, wrapping, running out of space
+// and frames giving their space back. A long random run checks that no allocation ever overlaps
+// one still owned by a frame in flight.
+
+#define TEST_FRAMES_IN_FLIGHT 3      // Like RENDER_FRAMES_IN_FLIGHT.
+#define TEST_RANDOM_FRAMES    20000
+#define TEST_MAX_LIVE         (RING_MAX_FRAMES * 24)
+
+
+struct test_range
+{
+  u32 offset;
+  u32 size;
+  u32 frame;
+};
+
+
+internal void test_basics()
+{
+  u32 offset = 0;
+  render_ring ring = ring_init(1024);
+  CHECK(ring_alloc(&ring, 10, 1, &offset) && offset == 0, "first allocation at %u", offset);
+  CHECK(ring_alloc(&ring, 16, 16, &offset) && offset == 16, "aligned allocation at %u", offset);
+  CHECK(ring_alloc(&ring, 12, 12, &offset) && offset == 36, "stride aligned allocation at %u", offset);
+  CHECK(ring.used == 48, "used %u", ring.used);
+  // Bigger than the ring never fits, however empty.
+  render_ring empty = ring_init(1024);
+  CHECK(!ring_alloc(&empty, 1025, 1, &offset), "oversize allocation succeeded");
+  CHECK(!ring_alloc(&empty, 0xffffffffu, 16, &offset), "huge allocation succeeded");
+  CHECK(ring_alloc(&empty, 1024, 1, &offset) && offset == 0, "whole ring allocation failed");
+  // Full with nothing in flight: the frame being built owns everything, retiring can't help.
+  CHECK(!ring_alloc(&empty, 1, 1, &offset), "allocation from a full ring succeeded");
+  CHECK(empty.frame_count == 0, "frames in flight %u", empty.frame_count);
+  ring_frame_end(&empty);
+  ring_frame_retire(&empty);
+  CHECK(empty.used == 0, "used %u after retiring everything", empty.used);
+  // Wrapping: the tail that's too short is skipped and counted until its frame retires.
+  render_ring wrap = ring_init(100);
+  CHECK(ring_alloc(&wrap, 70, 1, &offset) && offset == 0, "first allocation at %u", offset);
+  ring_frame_end(&wrap);
+  CHECK(!ring_alloc(&wrap, 40, 1, &offset), "allocation over a frame in flight succeeded");
+  ring_frame_retire(&wrap);
+  CHECK(ring_alloc(&wrap, 40, 1, &offset) && offset == 0, "wrapped allocation at %u", offset);
+  CHECK(wrap.used == 70, "used %u after wrapping, the skipped tail counts", wrap.used);
+  ring_frame_end(&wrap);
+  ring_frame_retire(&wrap);
+  CHECK(wrap.used == 0 && wrap.frame_count == 0, "used %u after the wrapped frame retired", wrap.used);
+  // Retiring with nothing in flight does nothing.
+  ring_frame_retire(&wrap);
+  CHECK(wrap.used == 0 && wrap.frame_count == 0, "retire without frames changed the ring");
+}
+
+
+// Retire the oldest frame in flight and forget its ranges.
+internal void test_retire(render_ring *ring, test_range *live, u32 *live_count, u32 *oldest_frame)
+{
+  ring_frame_retire(ring);
+  u32 kept = 0;
+  for (u32 r = 0; r < *live_count; ++r)
+  {
+    if (live[r].frame != *oldest_frame) live[kept++] = live[r];
+  }
+  *live_count = kept;
+  (*oldest_frame)++;
+}
+
+
+internal void test_random()
+{
+  u32 capacity = 1 << 16;
+  render_ring ring = ring_init(capacity);
+  test_range *live = (test_range*) calloc(TEST_MAX_LIVE, sizeof(test_range));
+  u32 live_count = 0;
+  u32 oldest_frame = 0;
+  u32 overlaps = 0;
+  u32 misaligned = 0;
+  u32 bad_failures = 0;
+  u32 allocations = 0;
+  u32 wraps = 0;
+  srand(99);
+  for (u32 frame = 0; frame < TEST_RANDOM_FRAMES; ++frame)
+  {
+    u32 count = 1 + rand() % 24;
+    u32 frame_bytes = 0;
+    for (u32 i = 0; i < count; ++i)
+    {
+      const u32 aligns[] = { 1, 4, 12, 16, 36, 64 };
+      u32 align = aligns[rand() % 6];
+      u32 size = 1 + rand() % 4096;
+      u32 offset = 0;
+      u32 head = ring.head;
+      bool allocated = false;
+      while (!(allocated = ring_alloc(&ring, size, align, &offset)) && ring.frame_count > 0)
+      {
+        // Wait on the GPU: the oldest frame retires.
+        test_retire(&ring, live, &live_count, &oldest_frame);
+      }
+      if (!allocated)
+      {
+        // Only this frame owns space, so it must really not fit beside this frame's data.
+        bad_failures += (frame_bytes + size <= capacity / 2);
+        continue;
+      }
+      allocations++;
+      wraps += (offset < head);
+      misaligned += (offset % align != 0) || (offset + size > capacity);
+      for (u32 r = 0; r < live_count; ++r)
+      {
+        overlaps += (offset < live[r].offset + live[r].size) && (live[r].offset < offset + size);
+      }
+      live[live_count++] = { offset, size, frame };
+      frame_bytes += size;
+    }
+    ring_frame_end(&ring);
+    if (ring.frame_count > TEST_FRAMES_IN_FLIGHT) test_retire(&ring, live, &live_count, &oldest_frame);
+  }
+  CHECK(overlaps == 0, "%u allocations overlapped space still in flight", overlaps);
+  CHECK(misaligned == 0, "%u allocations misaligned or past the end", misaligned);
+  CHECK(bad_failures == 0, "%u allocations failed with room to spare", bad_failures);
+  CHECK(wraps > 100, "only %u of %u allocations wrapped, the run doesn't cover wrapping", wraps, allocations);
+  free(live);
+}
+
+
+int main(int argc, char **argv)
+{
+  test_basics();
+  test_random();
+  return test_exit("render_ring_test");
+}
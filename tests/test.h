@@ -0,0 +1,37 @@
+#pragma once
+
+#include "core.h"
+#include "platform.h"
+
+// Minimal checks for the headless tests. A failed check prints where and carries on, test_exit
+// turns the count into the exit code so scripts can gate on it.
+
+global u32 test_failures;
+global u32 test_checks;
+
+#define CHECK(expression, ...)                                   \
+  do                                                             \
+  {                                                              \
+    test_checks++;                                               \
+    if (!(expression))                                           \
+    {                                                            \
+      test_failures++;                                           \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed: ", __FILE__, __LINE__, #expression); \
+      fprintf(stderr, __VA_ARGS__);                              \
+      fprintf(stderr, "\n");                                     \
+    }                                                            \
+  } while (0)
+
+
+internal arena test_memory(size_t size)
+{
+  void *raw_memory = platform_memory_alloc(0, size);
+  return arena_init(raw_memory, size);
+}
+
+
+internal int test_exit(const char *name)
+{
+  printf("%s: %u checks, %u failed\n", name, test_checks, test_failures);
+  return (test_failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,194 @@
+#include "platform_linux.cpp"
+#include "voxel_mesh.cpp"
+#include "test.h"
+
+#include <math.h>
+
+// The greedy mesh has to cover every face between a filled and an empty voxel exactly once,
+// facing out, and nothing else. That's the voxels' closed surface, so the mesh is watertight
+// (T-junctions aside). Each quad is rasterized back onto the unit faces it covers and compared
+// with the exposed faces, which also counts the quads the naive one-quad-per-face mesh would need.
+// Resolutions past VOXEL_CHUNK_SIZE check that quads stop at chunk seams without gaps.
+
+#define TEST_MAX_RES 40
+
+
+internal u32 test_face_index(u32 res, u32 axis, u32 side, i32 x, i32 y, i32 z)
+{
+  return (((axis * 2 + side) * res + (u32)z) * res + (u32)y) * res + (u32)x;
+}
+
+
+internal i32 test_grid_coord(f32 value, f32 min, f32 unit)
+{
+  return (i32)lroundf((value - min) / unit);
+}
+
+
+struct test_result
+{
+  u32 exposed;    // Faces a one quad per face mesh would have.
+  u32 quads;
+  u32 errors;     // Faces covered a wrong number of times, bad quads and wrongly wound triangles.
+};
+
+
+internal test_result test_mesh(voxel_grid grid, u32 res, arena *memory, arena *scratch)
+{
+  test_result result = {};
+  arena_savepoint save = arena_save(memory);
+  u32 face_count = 6 * res * res * res;
+  u32 *covered = arena_push_array(memory, face_count, u32);
+  arena vbuffer = subarena_init(memory, (size_t)face_count * 4 * sizeof(vertex1));
+  arena ebuffer = subarena_init(memory, (size_t)face_count * 6 * sizeof(u32));
+  entity e = voxel_grid_mesh(grid, res, fvec4_init(1.0f, 1.0f, 1.0f, 1.0f), &vbuffer, &ebuffer, scratch);
+  vertex1 *verts = (vertex1*)vbuffer.buffer + e.vert_start;
+  u32 *elems = (u32*)ebuffer.buffer + e.elem_start;
+  result.quads = (u32)(e.count / 6);
+  f32 unit = (grid.max.x - grid.min.x) / res;
+  for (u32 q = 0; q < result.quads; ++q)
+  {
+    // Quads are 4 vertices and 6 indices each, in the same order.
+    i32 lo[3] = { TEST_MAX_RES, TEST_MAX_RES, TEST_MAX_RES };
+    i32 hi[3] = { -1, -1, -1 };
+    for (u32 c = 0; c < 4; ++c)
+    {
+      fvec3 p = verts[q * 4 + c].pos;
+      i32 g[3] = { test_grid_coord(p.x, grid.min.x, unit), test_grid_coord(p.y, grid.min.y, unit), test_grid_coord(p.z, grid.min.z, unit) };
+      for (u32 k = 0; k < 3; ++k)
+      {
+        lo[k] = (g[k] < lo[k]) ? g[k] : lo[k];
+        hi[k] = (g[k] > hi[k]) ? g[k] : hi[k];
+      }
+    }
+    u32 axis = 3;
+    for (u32 k = 0; k < 3; ++k)
+    {
+      if (lo[k] == hi[k]) axis = k;
+    }
+    if (axis == 3)
+    {
+      result.errors++;
+      continue;
+    }
+    // Both triangles wind against the outward normal, like primitive_box3d.
+    f32 winding[2] = {};
+    for (u32 t = 0; t < 2; ++t)
+    {
+      u32 *tri = &elems[q * 6 + t * 3];
+      bool in_quad = (tri[0] - e.vert_start) / 4 == q && (tri[1] - e.vert_start) / 4 == q && (tri[2] - e.vert_start) / 4 == q;
+      if (!in_quad)
+      {
+        result.errors++;
+        continue;
+      }
+      fvec3 a = ((vertex1*)vbuffer.buffer)[tri[0]].pos;
+      fvec3 b = ((vertex1*)vbuffer.buffer)[tri[1]].pos;
+      fvec3 c = ((vertex1*)vbuffer.buffer)[tri[2]].pos;
+      winding[t] = cross3(fvec3_sub(b, a), fvec3_sub(c, a)).array[axis];
+    }
+    if ((winding[0] > 0.0f) != (winding[1] > 0.0f) || winding[0] == 0.0f)
+    {
+      result.errors++;
+      continue;
+    }
+    // Outward along +axis means the filled voxel is on the low side of the plane.
+    u32 side = (winding[0] < 0.0f) ? 0 : 1;
+    i32 plane = lo[axis];
+    i32 voxel = (side == 0) ? plane - 1 : plane;
+    u32 u = (axis + 1) % 3;
+    u32 v = (axis + 2) % 3;
+    for (i32 j = lo[v]; j < hi[v]; ++j)
+    {
+      for (i32 i = lo[u]; i < hi[u]; ++i)
+      {
+        i32 p[3] = {};
+        p[axis] = voxel;
+        p[u] = i;
+        p[v] = j;
+        if (p[0] < 0 || p[1] < 0 || p[2] < 0 || p[0] >= (i32)res || p[1] >= (i32)res || p[2] >= (i32)res)
+        {
+          result.errors++;
+          continue;
+        }
+        covered[test_face_index(res, axis, side, p[0], p[1], p[2])]++;
+      }
+    }
+  }
+  for (u32 axis = 0; axis < 3; ++axis)
+  {
+    for (u32 side = 0; side < 2; ++side)
+    {
+      i32 step = (side == 0) ? 1 : -1;
+      for (i32 z = 0; z < (i32)res; ++z)
+      {
+        for (i32 y = 0; y < (i32)res; ++y)
+        {
+          for (i32 x = 0; x < (i32)res; ++x)
+          {
+            i32 n[3] = { x, y, z };
+            n[axis] += step;
+            bool exposed = voxel_filled(&grid, res, x, y, z) && !voxel_filled(&grid, res, n[0], n[1], n[2]);
+            result.exposed += exposed;
+            result.errors += (covered[test_face_index(res, axis, side, x, y, z)] != (u32)exposed);
+          }
+        }
+      }
+    }
+  }
+  arena_pop(save);
+  return result;
+}
+
+
+internal voxel_grid test_grid(u32 res, arena *a)
+{
+  voxel_grid grid = {};
+  grid.contents = arena_push_array(a, res * res * res, u8);
+  grid.min = fvec3_init(-1.0f, -1.0f, -1.0f);
+  grid.max = fvec3_init(1.0f, 1.0f, 1.0f);
+  return grid;
+}
+
+
+int main(int argc, char **argv)
+{
+  arena memory = test_memory(Megabytes(256));
+  platform_init(&memory);
+  arena scratch = subarena_init(&memory, Megabytes(16));
+  // Empty, full, a ball across the chunk seams and random noise, which merges little.
+  const char *names[] = { "empty", "full", "ball", "noise" };
+  const u32 resolutions[] = { 8, TEST_MAX_RES, TEST_MAX_RES, 20 };
+  u32 seed = 0x9e3779b9u;
+  for (u32 c = 0; c < 4; ++c)
+  {
+    arena_savepoint save = arena_save(&memory);
+    u32 res = resolutions[c];
+    voxel_grid grid = test_grid(res, &memory);
+    f32 radius = 0.4f * res;
+    for (u32 z = 0; z < res; ++z)
+    {
+      for (u32 y = 0; y < res; ++y)
+      {
+        for (u32 x = 0; x < res; ++x)
+        {
+          u8 *cell = &grid.contents[x + y * res + z * res * res];
+          f32 dx = x + 0.5f - res * 0.5f, dy = y + 0.5f - res * 0.5f, dz = z + 0.5f - res * 0.5f;
+          seed ^= seed << 13;
+          seed ^= seed >> 17;
+          seed ^= seed << 5;
+          if (c == 1) *cell = 1;
+          if (c == 2) *cell = (dx*dx + dy*dy + dz*dz < radius * radius);
+          if (c == 3) *cell = (seed & 1);
+        }
+      }
+    }
+    test_result r = test_mesh(grid, res, &memory, &scratch);
+    CHECK(r.errors == 0, "%s %u^3: %u bad faces or quads", names[c], res, r.errors);
+    CHECK(r.quads <= r.exposed, "%s %u^3: %u greedy quads for %u faces", names[c], res, r.quads, r.exposed);
+    // Smooth shapes have to actually merge.
+    CHECK(c == 0 || c == 3 || r.quads * 2 < r.exposed, "%s %u^3: only %u quads saved of %u", names[c], res, r.exposed - r.quads, r.exposed);
+    arena_pop(save);
+  }
+  return test_exit("voxel_mesh_test");
+}